@@ -26,9 +26,12 @@
 
 #include <sys/time.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <pcap.h>
 #include <swarm.h>
+#include <utils/multi-file.h>
 #include <map>
 #include <vector>
 
@@ -84,6 +87,12 @@ class FlowHandler : public swarm::Handler {
 
  public:
   FlowHandler () : size_(0), pkt_(0) {}
+  ~FlowHandler () {
+    for (auto it = this->flow_map_.begin();
+         it != this->flow_map_.end(); it++) {
+      delete it->second;
+    }
+  }
   uint64_t size () const { return this->size_; }
   uint64_t pkt () const { return this->pkt_; }
   size_t flow_count () const { return this->flow_map_.size (); }
@@ -128,44 +137,58 @@ class FlowHandler : public swarm::Handler {
   }
 };
 
-void read_pcapfile(const std::string &fpath, optparse::Values &opt) {
-  // ----------------------------------------------
-  // setup NetDec
-  swarm::NetDec *nd = new swarm::NetDec();
-  FlowHandler * fh = new FlowHandler();
-  nd->set_handler("ipv4.packet", fh);
-
-  // ----------------------------------------------
-  // processing packets from pcap file
-  swarm::NetCap *nc = new swarm::CapPcapFile (fpath);
-  nc->bind_netdec (nd);
-
-  if (nc->ready ()) {
-    printf ("error: %s\n", nc->errmsg ().c_str ());
+// One task per file: files are decoded in parallel and printed in the
+// order given on the command line.
+class FlowTask : public swarm::FileTask {
+ public:
+  FlowHandler fh_;
+  std::string path_;
+  bool setup(swarm::NetDec *nd) {
+    return (nd->set_handler("ipv4.packet", &this->fh_) != swarm::HDLR_NULL);
   }
-
-  if (!nc->start ()) {
-    printf ("error: %s\n", nc->errmsg ().c_str ());
+  void finish(swarm::NetDec *nd, const std::string &path) {
+    this->path_ = path;
   }
+};
 
-  if (opt.get("summary")) {
-    printf ("%s, %zu, %llu, %llu\n", fpath.c_str (), fh->flow_count (),
-            fh->size (), fh->pkt ());
-  } else {
-    fh->dump();
-  }
+class FlowReducer : public swarm::FileReducer {
+ private:
+  bool summary_;
 
-  return;
-}
+ public:
+  explicit FlowReducer(bool summary) : summary_(summary) {}
+  swarm::FileTask *create() { return new FlowTask(); }
+  void reduce(swarm::FileTask *task) {
+    FlowTask *t = dynamic_cast<FlowTask*>(task);
+    if (this->summary_) {
+      printf ("%s, %zu, %llu, %llu\n", t->path_.c_str (), t->fh_.flow_count (),
+              t->fh_.size (), t->fh_.pkt ());
+    } else {
+      t->fh_.dump();
+    }
+  }
+};
 
 int main(int argc, char *argv[]) {
   optparse::OptionParser psr = optparse::OptionParser();
   psr.add_option("-s", "--summary").action("store_true").dest("summary");
+  psr.add_option("-w", "--worker").dest("worker")
+    .help("Number of worker threads (default: number of CPUs)");
 
   optparse::Values& opt = psr.parse_args(argc, argv);
   std::vector <std::string> args = psr.args();
 
+  long worker = opt.is_set("worker") ?
+    atol(opt["worker"].c_str()) : sysconf(_SC_NPROCESSORS_ONLN);
+  FlowReducer reducer(opt.get("summary"));
+  swarm::MultiFile mf(&reducer, worker > 0 ? worker : 1);
   for (auto it = args.begin(); it != args.end(); it++) {
-    read_pcapfile((*it), opt);
+    mf.add_file(*it);
+  }
+
+  if (!mf.run()) {
+    printf ("error: %s\n", mf.errmsg().c_str ());
+    return 1;
   }
+  return 0;
 }
@@ -27,72 +27,50 @@
 #include <sys/types.h>
 #include <pcap.h>
 #include <swarm.h>
-#include <map>
+#include <utils/passive-dns.h>
 
 #include "./optparse.h"
 
 
-class DnsFwdDB : public swarm::Handler {
- private:
-  std::map <u_int32_t, std::string> rev_map_;
-
+class DnsAnswer : public swarm::Handler {
  public:
-  const std::string * lookup (u_int32_t * v4addr) {
-    auto it = this->rev_map_.find (*v4addr);
-    if (it == this->rev_map_.end ()) {
-      return NULL;
-    } else {
-      return &(it->second);
-    }
-  }
-
   void recv (swarm::ev_id eid, const  swarm::Property &p) {
     for (size_t i = 0; i < p.value_size ("dns.an_name"); i++) {
       std::string name = p.value ("dns.an_name", i).repr();
       std::string type = p.value ("dns.an_type", i).repr();
-      std::string addr;
-
-      addr = p.value ("dns.an_data", i).repr();
+      std::string addr = p.value ("dns.an_data", i).repr();
       printf ("%s (%s) %s\n", name.c_str (), type.c_str (), addr.c_str ());
-
-      void * ptr = p.value ("dns.an_data", i).ptr();
-      if (ptr) {
-        u_int32_t * a = static_cast<u_int32_t*> (ptr);
-        this->rev_map_.insert (std::make_pair (*a, name));
-      }
     }
-    return;
   }
 };
 
 class IPFlow : public swarm::Handler {
  private:
-  DnsFwdDB * db_;
+  swarm::PassiveDns * db_;
+
+  static const char *resolve (const swarm::PassiveDns *db,
+                              const swarm::Property &p, bool is_src,
+                              std::string *tmp) {
+    size_t len;
+    void *addr = (is_src ? p.src_addr (&len) : p.dst_addr (&len));
+    const char *name = (addr ? db->lookup (addr, len, p.tv_sec ()) : NULL);
+    if (name == NULL) {
+      *tmp = (is_src ? p.src_addr () : p.dst_addr ());
+      name = tmp->c_str ();
+    }
+    return name;
+  }
 
  public:
-  void set_db (DnsFwdDB *db) {
+  void set_db (swarm::PassiveDns *db) {
     this->db_ = db;
   }
 
   void recv (swarm::ev_id eid, const  swarm::Property &p) {
     std::string s_tmp, d_tmp;
-    const std::string *src, *dst;
-    void *s_addr = p.value ("ipv4.src").ptr();
-    void *d_addr = p.value ("ipv4.dst").ptr();
-    if (!s_addr || !d_addr) {
-      return;
-    }
-
-    if (NULL == (src = this->db_->lookup (static_cast<u_int32_t*>(s_addr)))) {
-      s_tmp = p.value("ipv4.src").repr ();
-      src = &s_tmp;
-    }
-    if (NULL == (dst = this->db_->lookup (static_cast<u_int32_t*>(d_addr)))) {
-      d_tmp = p.value("ipv4.dst").repr ();
-      dst = &d_tmp;
-    }
-
-    printf ("%s -> %s\n", src->c_str (), dst->c_str ());
+    const char *src = IPFlow::resolve (this->db_, p, true, &s_tmp);
+    const char *dst = IPFlow::resolve (this->db_, p, false, &d_tmp);
+    printf ("%s -> %s\n", src, dst);
   }
 };
 
@@ -104,12 +82,14 @@ void capture (const std::string &dev, const std::string &filter = "") {
   // ----------------------------------------------
   // setup NetDec
   swarm::NetDec *nd = new swarm::NetDec ();
-  DnsFwdDB *dns_db = new DnsFwdDB ();
+  swarm::PassiveDns *dns_db = new swarm::PassiveDns (nd);
   IPFlow *ip4_flow = new IPFlow ();
   ip4_flow->set_db (dns_db);
 
+  nd->set_handler ("dns.an", new DnsAnswer ());
   nd->set_handler ("dns.an", dns_db);
   nd->set_handler ("ipv4.packet", ip4_flow);
+  nd->set_handler ("ipv6.packet", ip4_flow);
 
   swarm::NetCap *nc = new swarm::CapPcapDev (dev);
   nc->bind_netdec (nd);
@@ -129,12 +109,14 @@ void read_pcapfile (const std::string &fpath) {
   // ----------------------------------------------
   // setup NetDec
   swarm::NetDec *nd = new swarm::NetDec ();
-  DnsFwdDB * dns_db = new DnsFwdDB ();
+  swarm::PassiveDns *dns_db = new swarm::PassiveDns (nd);
   IPFlow * ip4_flow = new IPFlow ();
   ip4_flow->set_db (dns_db);
 
+  nd->set_handler ("dns.an", new DnsAnswer ());
   nd->set_handler ("dns.an", dns_db);
   nd->set_handler ("ipv4.packet", ip4_flow);
+  nd->set_handler ("ipv6.packet", ip4_flow);
 
   // ----------------------------------------------
   // processing packets from pcap file
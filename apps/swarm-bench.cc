@@ -25,7 +25,15 @@
  */
 
 #include <pcap.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <set>
 #include <swarm.h>
+#include <utils/mem-pool.h>
+#include <utils/stat-shm.h>
 #include "./optparse.h"
 
 class NetDecBench : public swarm::Task {
@@ -72,11 +80,193 @@ class NetDecBench : public swarm::Task {
   }
 };
 
+// 5 tuple of a TCP/UDP packet for flow hash benchmark
+struct Tuple {
+  uint8_t addr_[2][16];
+  uint16_t port_[2];
+  size_t addr_len_;
+  uint8_t proto_;
+};
+
+class TupleCollector : public swarm::Handler {
+ public:
+  std::vector<Tuple> tuple_;
+  void recv (swarm::ev_id eid, const swarm::Property &p) {
+    Tuple t;
+    size_t port_len;
+    const void *sa = p.src_addr (&(t.addr_len_));
+    const void *da = p.dst_addr (&(t.addr_len_));
+    const void *sp = p.src_port (&port_len);
+    const void *dp = p.dst_port (&port_len);
+    if (t.addr_len_ > 16 || port_len != 2) {
+      return;
+    }
+    memcpy (t.addr_[0], sa, t.addr_len_);
+    memcpy (t.addr_[1], da, t.addr_len_);
+    memcpy (&(t.port_[0]), sp, port_len);
+    memcpy (&(t.port_[1]), dp, port_len);
+    t.proto_ = p.ip_proto ();
+    this->tuple_.push_back (t);
+  }
+};
+
+// Speed (nsec per hash) and distribution over RSS_BUCKET queues like NIC
+// indirection table: chi-square per degree of freedom (about 1 for
+// uniform hash) and maximum queue load by average.
+void bench_flow_hash (const char *label, const std::vector<Tuple> &tuple) {
+  static const size_t RSS_BUCKET = 128;
+  static const size_t ROUND_MIN = 4000000;
+  const char *name[] = {"default", "toeplitz", "crc32c"};
+
+  if (tuple.empty ()) {
+    return;
+  }
+  printf ("%s: %zu tuples\n", label, tuple.size ());
+  for (size_t n = 0; n < sizeof (name) / sizeof (name[0]); n++) {
+    swarm::FlowHash *fh = swarm::FlowHash::New (name[n]);
+
+    size_t round = (ROUND_MIN + tuple.size () - 1) / tuple.size ();
+    uint64_t acc = 0;
+    double begin = NetDecBench::now ();
+    for (size_t r = 0; r < round; r++) {
+      for (size_t i = 0; i < tuple.size (); i++) {
+        const Tuple &t = tuple[i];
+        acc += fh->hash (t.addr_[0], t.addr_[1], t.addr_len_, &(t.port_[0]),
+                         &(t.port_[1]), 2, t.proto_);
+      }
+    }
+    double ns = (NetDecBench::now () - begin) * 1e9 /
+      static_cast<double>(round * tuple.size ());
+
+    // every flow is counted once
+    std::set<uint64_t> flow;
+    for (size_t i = 0; i < tuple.size (); i++) {
+      const Tuple &t = tuple[i];
+      flow.insert (fh->hash (t.addr_[0], t.addr_[1], t.addr_len_,
+                             &(t.port_[0]), &(t.port_[1]), 2, t.proto_));
+    }
+    std::vector<size_t> bucket (RSS_BUCKET, 0);
+    for (std::set<uint64_t>::iterator it = flow.begin (); it != flow.end ();
+         ++it) {
+      bucket[*it % RSS_BUCKET]++;
+    }
+    double avg = static_cast<double>(flow.size ()) / RSS_BUCKET;
+    double chi2 = 0, max = 0;
+    for (size_t i = 0; i < RSS_BUCKET; i++) {
+      double d = static_cast<double>(bucket[i]) - avg;
+      chi2 += d * d / avg;
+      max = std::max (max, static_cast<double>(bucket[i]));
+    }
+
+    printf ("  %-8s %7.2f nsec/hash  flows %8zu  chi2/df %7.3f  "
+            "max/avg %6.3f  (%llx)\n", name[n], ns, flow.size (),
+            chi2 / (RSS_BUCKET - 1), max / avg,
+            static_cast<unsigned long long>(acc & 0xfff));
+    delete fh;
+  }
+}
+
+bool do_hash_benchmark (const optparse::Values& opt) {
+  // tuples of the capture file
+  if (opt.is_set ("pcap_mmap")) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    TupleCollector tc;
+    nd->set_handler ("tcp.packet", &tc);
+    nd->set_handler ("udp.packet", &tc);
+    swarm::NetCap *nc = new swarm::CapPcapMmap (opt["pcap_mmap"]);
+    if (nc->status () != swarm::NetCap::READY) {
+      fprintf (stderr, "add file error: %s\n", nc->errmsg ().c_str ());
+      return false;
+    }
+    nc->bind_netdec (nd);
+    nc->start ();
+    bench_flow_hash (opt["pcap_mmap"].c_str (), tc.tuple_);
+    delete nc;
+    delete nd;
+  }
+
+  // synthetic IPv4 tuples
+  size_t n_syn = atoi (opt["synthetic"].c_str ());
+  std::vector<Tuple> syn (n_syn);
+  srand (1);
+  for (size_t i = 0; i < n_syn; i++) {
+    Tuple &t = syn[i];
+    t.addr_len_ = 4;
+    for (size_t j = 0; j < 4; j++) {
+      t.addr_[0][j] = static_cast<uint8_t>(rand ());
+      t.addr_[1][j] = static_cast<uint8_t>(rand ());
+    }
+    t.port_[0] = static_cast<uint16_t>(rand ());
+    t.port_[1] = htons (80);
+    t.proto_ = 6;
+  }
+  bench_flow_hash ("synthetic", syn);
+  return true;
+}
+
+bool setup_mem_pool (const optparse::Values& opt) {
+  const std::string &page = opt["page_size"];
+  swarm::MemPool::PageSize ps;
+  if (page == "4k") {
+    ps = swarm::MemPool::PAGE_4K;
+  } else if (page == "2m") {
+    ps = swarm::MemPool::PAGE_2M;
+  } else if (page == "1g") {
+    ps = swarm::MemPool::PAGE_1G;
+  } else {
+    fprintf (stderr, "error: invalid page size, %s\n", page.c_str ());
+    return false;
+  }
+
+  // node of the NIC for live capture, otherwise of this thread
+  int node = swarm::MemPool::NODE_ANY;
+  if (opt.is_set ("numa_node")) {
+    node = atoi (opt["numa_node"].c_str ());
+  } else if (opt.is_set ("interface")) {
+    node = swarm::MemPool::dev_node (opt["interface"]);
+  }
+  if (node == swarm::MemPool::NODE_ANY) {
+    node = swarm::MemPool::cpu_node ();
+  }
+  swarm::MemPool::set_default (ps, node);
+  return true;
+}
+
+void print_mem_stat () {
+  static const char *page_name[] = {"4k", "2m", "1g"};
+  std::vector<swarm::MemPool::Stat> st;
+  swarm::MemPool::stats (&st);
+  printf ("%-8s %4s %4s %12s %12s %12s %12s %8s %8s\n", "pool", "page",
+          "node", "used", "reserved", "huge", "thp", "tlb", "fallback");
+  for (size_t i = 0; i < st.size (); i++) {
+    const swarm::MemPool::Stat &s = st[i];
+    printf ("%-8s %4s %4d %12llu %12llu %12llu %12llu %8llu %8llu\n",
+            s.name_.c_str (), page_name[s.page_], s.node_,
+            static_cast<unsigned long long>(s.used_),
+            static_cast<unsigned long long>(s.reserved_),
+            static_cast<unsigned long long>(s.huge_),
+            static_cast<unsigned long long>(s.thp_),
+            static_cast<unsigned long long>(s.tlb_entry_),
+            static_cast<unsigned long long>(s.fallback_));
+  }
+}
+
 bool do_benchmark (const optparse::Values& opt) {
   // ----------------------------------------------
   // setup NetDec
+  if (!setup_mem_pool (opt)) {
+    return false;
+  }
   swarm::NetDec *nd = new swarm::NetDec ();
   NetDecBench *nd_bench = new NetDecBench (nd);
+  if (opt.is_set ("flow_hash")) {
+    swarm::FlowHash *fh = swarm::FlowHash::New (opt["flow_hash"]);
+    if (fh == NULL || !nd->set_flow_hash (fh)) {
+      fprintf (stderr, "error: invalid flow hash, %s\n",
+               opt["flow_hash"].c_str ());
+      return false;
+    }
+  }
 
   // ----------------------------------------------
   // processing packets from pcap file
@@ -99,6 +289,31 @@ bool do_benchmark (const optparse::Values& opt) {
     return false;
   }
 
+  // live stats for swarm-top, updated by wall clock for a device and
+  // by packet time for a file
+  swarm::StatPublisher *sp = NULL;
+  if (opt.is_set ("stat_name")) {
+    sp = new swarm::StatPublisher (opt["stat_name"], nd, nc);
+    if (!sp->ready ()) {
+      fprintf (stderr, "error: %s\n", sp->errmsg ().c_str ());
+      return false;
+    }
+    nd->set_profile (true);
+    if (opt.is_set ("interface")) {
+      nc->set_periodic_task (sp, 1.);
+    } else {
+      nd->set_repeat_timer (sp, 1000);
+    }
+  }
+
+  // sessions of the last run, restart keeps tracking mid-stream flows
+  if (opt.is_set ("checkpoint") &&
+      0 == access (opt["checkpoint"].c_str (), F_OK) &&
+      !nd->load_checkpoint (opt["checkpoint"])) {
+    fprintf (stderr, "warning: checkpoint is not restored, %s\n",
+             nd->errmsg ().c_str ());
+  }
+
   nc->bind_netdec (nd);
   nd_bench->start ();
   if (!nc->start ()) {
@@ -106,6 +321,14 @@ bool do_benchmark (const optparse::Values& opt) {
   }
 
   nd_bench->stat ();
+  print_mem_stat ();
+  if (sp) {
+    sp->update ();
+  }
+  if (opt.is_set ("checkpoint") && !nd->save_checkpoint (opt["checkpoint"])) {
+    fprintf (stderr, "error: %s\n", nd->errmsg ().c_str ());
+    return false;
+  }
   return true;
 }
 
@@ -118,11 +341,29 @@ int main (int argc, char *argv[]) {
     .help("Specify read pcap format file(s) by mmap based reader");
   psr.add_option("-i").dest("interface")
     .help("Specify interface to monitor on the fly");
+  psr.add_option("-H").dest("flow_hash")
+    .help("Flow hash of NetDec: default, toeplitz or crc32c");
+  psr.add_option("-F").dest("hash_bench").action("store_true")
+    .help("Benchmark flow hashes over tuples of -m file and synthetic ones");
+  psr.add_option("-n").dest("synthetic").set_default("1000000")
+    .help("Number of synthetic tuples for -F");
+  psr.add_option("-P").dest("page_size").set_default("2m")
+    .help("Page size of session tables and rings: 4k, 2m or 1g");
+  psr.add_option("-S").dest("stat_name")
+    .help("Publish live stats for swarm-top -n under the name");
+  psr.add_option("-K").dest("checkpoint")
+    .help("Restore sessions from the file if exists, and save them at exit");
+  psr.add_option("-N").dest("numa_node")
+    .help("NUMA node of memory, node of -i device or this thread by default");
 
   optparse::Values& opt = psr.parse_args(argc, argv);
   std::vector <std::string> args = psr.args();
 
-  do_benchmark (opt);
+  if (opt.get ("hash_bench")) {
+    do_hash_benchmark (opt);
+  } else {
+    do_benchmark (opt);
+  }
 
   return 0;
 }
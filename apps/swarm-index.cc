@@ -0,0 +1,182 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <pcap.h>
+#include <swarm.h>
+#include <utils/pcap-index.h>
+#include "./optparse.h"
+
+class Counter : public swarm::Handler {
+ private:
+  std::string key_;
+  uint64_t count_;
+
+ public:
+  Counter() : count_(0) {}
+  void set_key(const std::string &key) {
+    this->key_ = key;
+  }
+  uint64_t count() const { return this->count_; }
+  void recv (swarm::ev_id eid, const swarm::Property &p) {
+    this->count_++;
+    if (!this->key_.empty() && !p.value(this->key_).is_null()) {
+      for (size_t i = 0; i < p.value_size(this->key_); i++) {
+        std::cout << p.value(this->key_, i).repr() ;
+        if (i + 1 < p.value_size(this->key_)) {
+          std::cout << ", ";
+        }
+      }
+      std::cout << std::endl;
+    }
+  }
+};
+
+// "1389000000.5" (unix time in second) to nano second
+uint64_t parse_ts (const std::string &s) {
+  return static_cast<uint64_t>(strtod(s.c_str(), NULL) * 1e9);
+}
+
+bool do_build (const std::string &pcap_path, const std::string &idx_path,
+               const optparse::Values& opt) {
+  uint64_t interval = opt.is_set("interval") ?
+    parse_ts(opt["interval"]) : 1000000000ULL;
+  swarm::PcapIndex idx(interval);
+
+  if (opt.is_set("hash") && !idx.set_flow_hash(opt["hash"])) {
+    fprintf (stderr, "error: %s\n", idx.errmsg().c_str());
+    return false;
+  }
+  if (!idx.build(pcap_path) || !idx.save(idx_path)) {
+    fprintf (stderr, "error: %s\n", idx.errmsg().c_str());
+    return false;
+  }
+
+  printf ("%s: %zu blocks, %zu flows\n", idx_path.c_str(), idx.block_size(),
+          idx.flow_size());
+  return true;
+}
+
+bool do_query (const std::string &pcap_path, const std::string &idx_path,
+               const optparse::Values& opt) {
+  swarm::PcapIndex idx;
+  if (!idx.load(idx_path)) {
+    fprintf (stderr, "error: %s\n", idx.errmsg().c_str());
+    return false;
+  }
+
+  // flows are looked up by hash_value() of the hash the index is built with
+  swarm::NetDec *nd = new swarm::NetDec ();
+  if (idx.flow_hash() != "default") {
+    nd->set_flow_hash(swarm::FlowHash::New(idx.flow_hash()));
+  }
+  swarm::CapPcapIndexed *nc = new swarm::CapPcapIndexed (pcap_path, &idx);
+  if (!nc->ready()) {
+    fprintf (stderr, "error: %s\n", nc->errmsg ().c_str ());
+    return false;
+  }
+
+  if (opt.is_set("time")) {
+    // "begin,end" in unix time
+    const std::string &t = opt["time"];
+    size_t sep = t.find(',');
+    uint64_t begin = parse_ts(t.substr(0, sep));
+    uint64_t end = (sep == std::string::npos) ?
+      UINT64_MAX : parse_ts(t.substr(sep + 1));
+    nc->set_time_range(begin, end);
+  }
+  if (opt.is_set("flow")) {
+    nc->set_flow(strtoull(opt["flow"].c_str(), NULL, 0));
+  }
+
+  const char *dec = swarm::PcapReader::linktype2dec(idx.linktype());
+  if (!opt.is_set("event") && dec == NULL) {
+    fprintf (stderr, "error: unsupported linktype %u, specify event by -e\n",
+             idx.linktype());
+    return false;
+  }
+  const std::string ev_name =
+    opt.is_set("event") ? opt["event"] : std::string(dec) + ".packet";
+  Counter *cnt = new Counter();
+  if (swarm::HDLR_NULL == nd->set_handler(ev_name, cnt)) {
+    fprintf (stderr, "error: invalid event, %s\n", ev_name.c_str ());
+    return false;
+  }
+  if (opt.is_set("value")) {
+    cnt->set_key(opt["value"]);
+  }
+
+  nc->bind_netdec (nd);
+  if (!nc->start ()) {
+    fprintf (stderr, "error: %s\n", nc->errmsg ().c_str ());
+    return false;
+  }
+
+  fprintf (stderr, "%llu events, %llu records read\n",
+           static_cast<unsigned long long>(cnt->count()),
+           static_cast<unsigned long long>(nc->read_count()));
+  return true;
+}
+
+int main (int argc, char *argv[]) {
+  optparse::OptionParser psr = optparse::OptionParser();
+
+  psr.usage("%prog [options] <pcap_file>");
+  psr.add_option("-o").dest("index")
+    .help("Index file (default: <pcap_file>.swidx)");
+  psr.add_option("-b").dest("interval")
+    .help("Block interval in second to build index (default: 1)");
+  psr.add_option("-q", "--query").action("store_true").dest("query")
+    .help("Read packets by index instead of building it");
+  psr.add_option("-t").dest("time")
+    .help("Query time range, \"begin,end\" in unix time");
+  psr.add_option("-f").dest("flow")
+    .help("Query flow hash (Property::hash_value() of decoded packet)");
+  psr.add_option("-H").dest("hash")
+    .help("Flow hash to build index, default, toeplitz or crc32c "
+          "(default: default)");
+  psr.add_option("-e").dest("event")
+    .help("Event to count (default: <link layer>.packet of pcap_file)");
+  psr.add_option("-v").dest("value")
+    .help("Value name to print for each event");
+
+  optparse::Values& opt = psr.parse_args(argc, argv);
+  std::vector <std::string> args = psr.args();
+
+  if (args.size() != 1) {
+    psr.print_usage();
+    return EXIT_FAILURE;
+  }
+
+  const std::string idx_path = opt.is_set("index") ?
+    opt["index"] : swarm::PcapIndex::default_path(args[0]);
+  bool rc = opt.get("query") ?
+    do_query(args[0], idx_path, opt) : do_build(args[0], idx_path, opt);
+
+  return rc ? EXIT_SUCCESS : EXIT_FAILURE;
+}
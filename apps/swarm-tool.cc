@@ -24,9 +24,12 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
 #include <iostream>
 #include <pcap.h>
 #include <swarm.h>
+#include <utils/columnar.h>
+#include <utils/heavy-hitter.h>
 #include "./optparse.h"
 
 class GenHandler : public swarm::Handler {
@@ -76,18 +79,72 @@ bool do_benchmark (const optparse::Values& opt) {
     return false;
   }
 
-  GenHandler *gh = new GenHandler();
-  assert(swarm::HDLR_NULL != nd->set_handler("ether.packet", gh));
-  nc->bind_netdec (nd);
-
-  if (opt.is_set("value")) {
-    gh->set_key(opt["value"]);
+  const std::string ev_name =
+    opt.is_set("event") ? opt["event"] : "ether.packet";
+  swarm::ColumnarExporter *ce = NULL;
+  swarm::HeavyHitter *hh = NULL;
+
+  if (opt.is_set("top")) {
+    // top-K of -v value (or "5tuple") in fixed memory, no sorting offline
+    const size_t k = atoi(opt["top"].c_str());
+    const std::string key = opt.is_set("value") ? opt["value"] :
+      swarm::HeavyHitter::KEY_5TUPLE;
+    hh = new swarm::HeavyHitter (nd, key, (k > 100) ? k : 100);
+    if (!hh->ready()) {
+      fprintf (stderr, "error: %s\n", hh->errmsg ().c_str ());
+      return false;
+    }
+    if (swarm::HDLR_NULL == nd->set_handler(ev_name, hh)) {
+      fprintf (stderr, "error: invalid event, %s\n", ev_name.c_str ());
+      return false;
+    }
+  } else if (opt.is_set("write_file")) {
+    // columnar export: one row per event, "-c ipv4.src:ipv4,dns.qd_name"
+    ce = new swarm::ColumnarExporter (nd);
+    std::string cols = opt.is_set("columns") ? opt["columns"] : "";
+    for (size_t p = 0; p < cols.size(); ) {
+      size_t e = cols.find(',', p);
+      e = (e == std::string::npos) ? cols.size() : e;
+      if (e > p && !ce->add_column(cols.substr(p, e - p))) {
+        fprintf (stderr, "error: %s\n", ce->errmsg ().c_str ());
+        return false;
+      }
+      p = e + 1;
+    }
+    if (!ce->open(opt["write_file"])) {
+      fprintf (stderr, "error: %s\n", ce->errmsg ().c_str ());
+      return false;
+    }
+    if (swarm::HDLR_NULL == nd->set_handler(ev_name, ce)) {
+      fprintf (stderr, "error: invalid event, %s\n", ev_name.c_str ());
+      return false;
+    }
+  } else {
+    GenHandler *gh = new GenHandler();
+    assert(swarm::HDLR_NULL != nd->set_handler(ev_name, gh));
+    if (opt.is_set("value")) {
+      gh->set_key(opt["value"]);
+    }
   }
 
+  nc->bind_netdec (nd);
+
   if (!nc->start ()) {
     fprintf (stderr, "error: %s\n", nc->errmsg ().c_str ());
   }
 
+  if (ce && !ce->close()) {
+    fprintf (stderr, "error: %s\n", ce->errmsg ().c_str ());
+  }
+  if (hh) {
+    std::vector<swarm::SpaceSaving::Item> items;
+    hh->current().top(&items, atoi(opt["top"].c_str()));
+    for (size_t i = 0; i < items.size(); i++) {
+      std::cout << items[i].count_ << "\t" << items[i].error_ << "\t"
+                << hh->repr(items[i].key_) << std::endl;
+    }
+  }
+
   return true;
 }
 
@@ -102,6 +159,14 @@ int main (int argc, char *argv[]) {
     .help("Event of NetCap");
   psr.add_option("-v").dest("value")
     .help("Value name of property");
+  psr.add_option("-t").dest("top")
+    .help("Print top N of -v value (5 tuple if not set) with count and "
+          "error bound");
+  psr.add_option("-w").dest("write_file")
+    .help("Write values of -c to Arrow IPC file, one row per event");
+  psr.add_option("-c").dest("columns")
+    .help("Columns to write, name[:type] separated by comma. "
+          "type: u8, u16, u32, u64, ipv4, ipv6, mac, str (default)");
 
   optparse::Values& opt = psr.parse_args(argc, argv);
   std::vector <std::string> args = psr.args();
@@ -0,0 +1,176 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <swarm.h>
+#include <utils/stat-shm.h>
+#include "./optparse.h"
+
+// Live view of a swarm process publishing utils/stat-shm.h. It only
+// reads the shared memory segment, the capture process is not touched.
+
+struct DecRow {
+  const swarm::StatSegment::Dec *dec_;
+  double rate_;
+  bool operator<(const DecRow &r) const { return this->rate_ > r.rate_; }
+};
+
+static double per_sec (uint64_t curr, uint64_t prev, double sec) {
+  return (sec > 0 && curr >= prev) ? static_cast<double>(curr - prev) / sec : 0;
+}
+
+static void render (const swarm::StatSegment &cur,
+                    const swarm::StatSegment &prev, bool batch) {
+  const double sec =
+    static_cast<double>(cur.update_ns_ - prev.update_ns_) / 1e9;
+  const bool alive = (::kill (static_cast<pid_t>(cur.pid_), 0) == 0);
+
+  if (!batch) {
+    printf ("\033[H\033[2J");  // clear screen
+  }
+  printf ("swarm-top  pid %llu%s  up %.1fs  v%u\n",
+          static_cast<unsigned long long>(cur.pid_), alive ? "" : " (exited)",
+          static_cast<double>(cur.update_ns_ - cur.start_ns_) / 1e9,
+          cur.version_);
+  printf ("packets %12llu  %10.1f pps   bytes %14llu  %10.3f Mbps\n",
+          static_cast<unsigned long long>(cur.recv_pkt_),
+          per_sec (cur.recv_pkt_, prev.recv_pkt_, sec),
+          static_cast<unsigned long long>(cur.recv_len_),
+          per_sec (cur.recv_len_, prev.recv_len_, sec) * 8 / 1e6);
+  if (cur.cap_valid_) {
+    const uint64_t total = cur.cap_recv_ + cur.cap_drop_;
+    printf ("capture %12llu  drop %llu (%.3f%%)\n",
+            static_cast<unsigned long long>(cur.cap_recv_),
+            static_cast<unsigned long long>(cur.cap_drop_),
+            total > 0 ? 100.0 * cur.cap_drop_ / total : 0.0);
+  }
+  printf ("filtered %llu  sampled out %llu  shed %llu  bad checksum %llu  "
+          "swapped %llu\n\n",
+          static_cast<unsigned long long>(cur.filter_reject_),
+          static_cast<unsigned long long>(cur.sample_drop_),
+          static_cast<unsigned long long>(cur.shed_count_),
+          static_cast<unsigned long long>(cur.chksum_fail_),
+          static_cast<unsigned long long>(cur.swap_count_));
+
+  // decoders by rate, the previous entry is found by name as decoders
+  // may be loaded or unloaded between updates
+  std::vector<DecRow> rows;
+  for (uint32_t i = 0; i < cur.dec_size_; i++) {
+    const swarm::StatSegment::Dec &d = cur.dec_[i];
+    uint64_t prev_count = d.count_;
+    for (uint32_t j = 0; j < prev.dec_size_; j++) {
+      if (0 == strcmp (prev.dec_[j].name_, d.name_)) {
+        prev_count = prev.dec_[j].count_;
+        break;
+      }
+    }
+    if (d.count_ > 0) {
+      DecRow r = {&d, per_sec (d.count_, prev_count, sec)};
+      rows.push_back (r);
+    }
+  }
+  std::sort (rows.begin (), rows.end ());
+  printf ("%-16s %14s %12s %8s %10s\n", "DECODER", "CALLS", "CALLS/S",
+          "NSEC", "SESSIONS");
+  for (size_t i = 0; i < rows.size (); i++) {
+    const swarm::StatSegment::Dec &d = *rows[i].dec_;
+    printf ("%-16s %14llu %12.1f %8llu %10llu%s\n", d.name_,
+            static_cast<unsigned long long>(d.count_), rows[i].rate_,
+            static_cast<unsigned long long>(d.cost_ns_),
+            static_cast<unsigned long long>(d.session_),
+            d.shed_ ? "  shed" : "");
+  }
+
+  if (cur.hdlr_size_ > 0) {
+    printf ("\n%-24s %14s %12s %8s\n", "HANDLER", "CALLS", "CALLS/S", "NSEC");
+  }
+  for (uint32_t i = 0; i < cur.hdlr_size_; i++) {
+    const swarm::StatSegment::Hdlr &h = cur.hdlr_[i];
+    uint64_t prev_calls = h.calls_;
+    for (uint32_t j = 0; j < prev.hdlr_size_; j++) {
+      if (prev.hdlr_[j].id_ == h.id_) {
+        prev_calls = prev.hdlr_[j].calls_;
+        break;
+      }
+    }
+    printf ("%-24s %14llu %12.1f %8llu\n", h.ev_,
+            static_cast<unsigned long long>(h.calls_),
+            per_sec (h.calls_, prev_calls, sec),
+            static_cast<unsigned long long>(h.cost_ns_));
+  }
+  fflush (stdout);
+}
+
+int main (int argc, char *argv[]) {
+  optparse::OptionParser psr = optparse::OptionParser();
+
+  psr.usage("%prog [options]");
+  psr.add_option("-n").dest("name").set_default("default")
+    .help("Segment name given to StatPublisher (default: default)");
+  psr.add_option("-d").dest("delay").set_default("1")
+    .help("Seconds between updates (default: 1)");
+  psr.add_option("-c").dest("count").set_default("0")
+    .help("Number of updates, 0 is forever");
+  psr.add_option("-b").action("store_true").dest("batch")
+    .help("Batch mode, do not clear screen");
+
+  optparse::Values& opt = psr.parse_args(argc, argv);
+  const double delay = atof (opt["delay"].c_str ());
+  const int count = atoi (opt["count"].c_str ());
+
+  swarm::StatReader reader;
+  if (!reader.open (opt["name"])) {
+    fprintf (stderr, "error: %s\n", reader.errmsg ().c_str ());
+    return EXIT_FAILURE;
+  }
+
+  swarm::StatSegment *cur = new swarm::StatSegment ();
+  swarm::StatSegment *prev = new swarm::StatSegment ();
+  if (!reader.read (prev)) {
+    fprintf (stderr, "error: segment is busy\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; count == 0 || i < count; i++) {
+    ::usleep (static_cast<useconds_t>(delay * 1000000));
+    if (!reader.read (cur)) {
+      continue;
+    }
+    render (*cur, *prev, opt.get ("batch"));
+    std::swap (cur, prev);
+  }
+
+  delete cur;
+  delete prev;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "./bpf.h"
+
+namespace swarm {
+  namespace {
+    // Opcodes of classic BPF, same values as <pcap/bpf.h>
+    enum {
+      C_LD = 0x00, C_LDX = 0x01, C_ST = 0x02, C_STX = 0x03,
+      C_ALU = 0x04, C_JMP = 0x05, C_RET = 0x06, C_MISC = 0x07,
+    };
+    enum {
+      S_W = 0x00, S_H = 0x08, S_B = 0x10,
+      M_IMM = 0x00, M_ABS = 0x20, M_IND = 0x40, M_MEM = 0x60,
+      M_LEN = 0x80, M_MSH = 0xa0,
+    };
+    enum {
+      A_ADD = 0x00, A_SUB = 0x10, A_MUL = 0x20, A_DIV = 0x30, A_OR = 0x40,
+      A_AND = 0x50, A_LSH = 0x60, A_RSH = 0x70, A_NEG = 0x80, A_MOD = 0x90,
+      A_XOR = 0xa0,
+    };
+    enum {
+      J_JA = 0x00, J_JEQ = 0x10, J_JGT = 0x20, J_JGE = 0x30, J_JSET = 0x40,
+    };
+    enum { SRC_K = 0x00, SRC_X = 0x08, RVAL_A = 0x10 };
+    enum { MISC_TAX = 0x00, MISC_TXA = 0x80 };
+
+    inline uint32_t bpf_class (uint16_t code) { return code & 0x07; }
+
+    inline bool load_w (const byte_t *p, size_t caplen, uint32_t k,
+                        uint32_t *v) {
+      if (k > caplen || caplen - k < 4) {
+        return false;
+      }
+      *v = (static_cast<uint32_t>(p[k]) << 24) |
+        (static_cast<uint32_t>(p[k + 1]) << 16) |
+        (static_cast<uint32_t>(p[k + 2]) << 8) | p[k + 3];
+      return true;
+    }
+    inline bool load_h (const byte_t *p, size_t caplen, uint32_t k,
+                        uint32_t *v) {
+      if (k > caplen || caplen - k < 2) {
+        return false;
+      }
+      *v = (static_cast<uint32_t>(p[k]) << 8) | p[k + 1];
+      return true;
+    }
+    inline bool load_b (const byte_t *p, size_t caplen, uint32_t k,
+                        uint32_t *v) {
+      if (k >= caplen) {
+        return false;
+      }
+      *v = p[k];
+      return true;
+    }
+  }  // namespace
+
+  BpfFilter::BpfFilter () : accept_(0), reject_(0) {
+  }
+  BpfFilter::~BpfFilter () {
+  }
+
+  bool BpfFilter::compile (const std::string &expr, int linktype,
+                           int snaplen) {
+    pcap_t *pd = ::pcap_open_dead (linktype, snaplen);
+    if (pd == NULL) {
+      this->errmsg_ = "pcap_open_dead failed";
+      return false;
+    }
+
+    struct bpf_program fp;
+    if (::pcap_compile (pd, &fp, expr.c_str (), 1, PCAP_NETMASK_UNKNOWN) < 0) {
+      this->errmsg_ = "filter compile error: ";
+      this->errmsg_ += ::pcap_geterr (pd);
+      this->errmsg_ += " \"" + expr + "\"";
+      ::pcap_close (pd);
+      return false;
+    }
+
+    bool rc = this->load (fp.bf_insns, fp.bf_len);
+    ::pcap_freecode (&fp);
+    ::pcap_close (pd);
+    return rc;
+  }
+
+  bool BpfFilter::load (const struct bpf_insn *insns, size_t len) {
+    if (len == 0 || insns == NULL) {
+      this->errmsg_ = "empty BPF program";
+      return false;
+    }
+
+    // Validate jumps, scratch memory and constant division so that run()
+    // can trust the program.
+    for (size_t pc = 0; pc < len; pc++) {
+      const struct bpf_insn &i = insns[pc];
+      const size_t remain = len - pc - 1;
+      switch (bpf_class (i.code)) {
+      case C_LD:
+      case C_LDX:
+        if ((i.code & 0xe0) == M_MEM && i.k >= MEM_SIZE) {
+          this->errmsg_ = "invalid scratch memory index";
+          return false;
+        }
+        break;
+      case C_ST:
+      case C_STX:
+        if (i.k >= MEM_SIZE) {
+          this->errmsg_ = "invalid scratch memory index";
+          return false;
+        }
+        break;
+      case C_ALU:
+        if ((i.code & 0xf0) == A_DIV || (i.code & 0xf0) == A_MOD) {
+          if ((i.code & 0x08) == SRC_K && i.k == 0) {
+            this->errmsg_ = "division by zero";
+            return false;
+          }
+        }
+        break;
+      case C_JMP:
+        if ((i.code & 0xf0) == J_JA) {
+          if (i.k >= remain) {
+            this->errmsg_ = "jump out of program";
+            return false;
+          }
+        } else if (i.jt >= remain || i.jf >= remain) {
+          this->errmsg_ = "jump out of program";
+          return false;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    if (bpf_class (insns[len - 1].code) != C_RET) {
+      this->errmsg_ = "BPF program must end with ret";
+      return false;
+    }
+
+    this->prog_.assign (insns, insns + len);
+    this->accept_ = 0;
+    this->reject_ = 0;
+    return true;
+  }
+
+  uint32_t BpfFilter::run (const byte_t *p, size_t wirelen,
+                           size_t caplen) const {
+    const struct bpf_insn *pc = &(this->prog_[0]);
+    uint32_t A = 0, X = 0, v;
+    uint32_t mem[MEM_SIZE];
+
+    for (;; pc++) {
+      switch (pc->code) {
+      case C_RET | SRC_K:   return pc->k;
+      case C_RET | RVAL_A:  return A;
+
+      case C_LD | S_W | M_ABS:
+        if (!load_w (p, caplen, pc->k, &A)) { return 0; }
+        break;
+      case C_LD | S_H | M_ABS:
+        if (!load_h (p, caplen, pc->k, &A)) { return 0; }
+        break;
+      case C_LD | S_B | M_ABS:
+        if (!load_b (p, caplen, pc->k, &A)) { return 0; }
+        break;
+      case C_LD | S_W | M_IND:
+        if (!load_w (p, caplen, X + pc->k, &A)) { return 0; }
+        break;
+      case C_LD | S_H | M_IND:
+        if (!load_h (p, caplen, X + pc->k, &A)) { return 0; }
+        break;
+      case C_LD | S_B | M_IND:
+        if (!load_b (p, caplen, X + pc->k, &A)) { return 0; }
+        break;
+      case C_LD | S_W | M_LEN:   A = static_cast<uint32_t>(wirelen); break;
+      case C_LDX | S_W | M_LEN:  X = static_cast<uint32_t>(wirelen); break;
+      case C_LD | M_IMM:         A = pc->k; break;
+      case C_LDX | M_IMM:        X = pc->k; break;
+      case C_LD | M_MEM:         A = mem[pc->k]; break;
+      case C_LDX | M_MEM:        X = mem[pc->k]; break;
+      case C_LDX | S_B | M_MSH:
+        if (!load_b (p, caplen, pc->k, &v)) { return 0; }
+        X = (v & 0xf) << 2;
+        break;
+      case C_ST:                 mem[pc->k] = A; break;
+      case C_STX:                mem[pc->k] = X; break;
+
+      case C_JMP | J_JA:         pc += pc->k; break;
+      case C_JMP | J_JEQ | SRC_K:  pc += (A == pc->k) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JGT | SRC_K:  pc += (A > pc->k) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JGE | SRC_K:  pc += (A >= pc->k) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JSET | SRC_K: pc += (A & pc->k) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JEQ | SRC_X:  pc += (A == X) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JGT | SRC_X:  pc += (A > X) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JGE | SRC_X:  pc += (A >= X) ? pc->jt : pc->jf; break;
+      case C_JMP | J_JSET | SRC_X: pc += (A & X) ? pc->jt : pc->jf; break;
+
+      case C_ALU | A_ADD | SRC_K:  A += pc->k; break;
+      case C_ALU | A_SUB | SRC_K:  A -= pc->k; break;
+      case C_ALU | A_MUL | SRC_K:  A *= pc->k; break;
+      case C_ALU | A_DIV | SRC_K:  A /= pc->k; break;
+      case C_ALU | A_MOD | SRC_K:  A %= pc->k; break;
+      case C_ALU | A_AND | SRC_K:  A &= pc->k; break;
+      case C_ALU | A_OR  | SRC_K:  A |= pc->k; break;
+      case C_ALU | A_XOR | SRC_K:  A ^= pc->k; break;
+      case C_ALU | A_LSH | SRC_K:  A = (pc->k < 32) ? A << pc->k : 0; break;
+      case C_ALU | A_RSH | SRC_K:  A = (pc->k < 32) ? A >> pc->k : 0; break;
+      case C_ALU | A_ADD | SRC_X:  A += X; break;
+      case C_ALU | A_SUB | SRC_X:  A -= X; break;
+      case C_ALU | A_MUL | SRC_X:  A *= X; break;
+      case C_ALU | A_DIV | SRC_X:
+        if (X == 0) { return 0; }
+        A /= X;
+        break;
+      case C_ALU | A_MOD | SRC_X:
+        if (X == 0) { return 0; }
+        A %= X;
+        break;
+      case C_ALU | A_AND | SRC_X:  A &= X; break;
+      case C_ALU | A_OR  | SRC_X:  A |= X; break;
+      case C_ALU | A_XOR | SRC_X:  A ^= X; break;
+      case C_ALU | A_LSH | SRC_X:  A = (X < 32) ? A << X : 0; break;
+      case C_ALU | A_RSH | SRC_X:  A = (X < 32) ? A >> X : 0; break;
+      case C_ALU | A_NEG:          A = -A; break;
+
+      case C_MISC | MISC_TAX:      X = A; break;
+      case C_MISC | MISC_TXA:      A = X; break;
+
+      default:
+        // unknown instruction, reject as the kernel does
+        return 0;
+      }
+    }
+  }
+}  // namespace swarm
@@ -0,0 +1,76 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_BPF_H__
+#define SRC_BPF_H__
+
+#include <pcap.h>
+#include <string>
+#include <vector>
+#include "./common.h"
+
+namespace swarm {
+  // ----------------------------------------------------------
+  // BpfFilter
+  // Userspace classic BPF for capture backends without kernel/libpcap
+  // filtering (e.g. CapPcapMmap). Expressions are compiled by libpcap
+  // on a dead handle; the program is validated once at load time so
+  // that run() needs no per-instruction bound check on jumps.
+  //
+  class BpfFilter {
+  private:
+    std::vector<struct bpf_insn> prog_;
+    uint64_t accept_;
+    uint64_t reject_;
+    std::string errmsg_;
+
+    static const size_t MEM_SIZE = 16;  // BPF_MEMWORDS
+
+  public:
+    BpfFilter ();
+    ~BpfFilter ();
+    bool compile (const std::string &expr, int linktype, int snaplen = 0xffff);
+    bool load (const struct bpf_insn *insns, size_t len);
+    // returns accepted length, 0 means reject
+    uint32_t run (const byte_t *pkt, size_t wirelen, size_t caplen) const;
+    inline bool match (const byte_t *pkt, size_t wirelen, size_t caplen) {
+      if (this->run (pkt, wirelen, caplen) > 0) {
+        this->accept_++;
+        return true;
+      } else {
+        this->reject_++;
+        return false;
+      }
+    }
+
+    size_t size () const { return this->prog_.size (); }
+    uint64_t accept () const { return this->accept_; }
+    uint64_t reject () const { return this->reject_; }
+    const std::string &errmsg () const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_BPF_H__
@@ -0,0 +1,280 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include "./checkpoint.h"
+
+namespace swarm {
+  const char CheckpointWriter::MAGIC_[8] = {
+    'S', 'W', 'C', 'K', 'P', 'T', '\0', '\1'
+  };
+  const uint32_t CheckpointWriter::BYTE_ORDER_;
+  const size_t CheckpointWriter::SectionEnt::NAME_LEN;
+
+  static const size_t ALIGN = 8;
+
+  // ----------------------------------------------------------------
+  // CheckpointWriter
+  //
+  CheckpointWriter::CheckpointWriter() : fp_(NULL), offset_(0) {
+  }
+  CheckpointWriter::~CheckpointWriter() {
+    if (this->fp_) {
+      ::fclose(this->fp_);
+      ::unlink(this->tmp_path_.c_str());
+    }
+  }
+
+  bool CheckpointWriter::write(const void *ptr, size_t len) {
+    if (len > 0 && ::fwrite(ptr, len, 1, this->fp_) != 1) {
+      this->errmsg_ = std::string("write error: ") + strerror(errno);
+      return false;
+    }
+    this->offset_ += len;
+    return true;
+  }
+
+  bool CheckpointWriter::open(const std::string &path) {
+    if (this->fp_) {
+      this->errmsg_ = "already opened";
+      return false;
+    }
+    this->path_ = path;
+    this->tmp_path_ = path + ".tmp";
+    this->fp_ = ::fopen(this->tmp_path_.c_str(), "wb");
+    if (this->fp_ == NULL) {
+      this->errmsg_ = this->tmp_path_ + ": " + strerror(errno);
+      return false;
+    }
+    this->offset_ = 0;
+    this->sec_.clear();
+
+    // filled again by close()
+    Header hdr;
+    ::memset(&hdr, 0, sizeof(hdr));
+    return this->write(&hdr, sizeof(hdr));
+  }
+
+  bool CheckpointWriter::begin(const std::string &name, uint32_t version,
+                               size_t rec_size) {
+    if (this->fp_ == NULL) {
+      this->errmsg_ = "not opened";
+      return false;
+    }
+    if (name.length() >= SectionEnt::NAME_LEN || rec_size == 0 ||
+        rec_size % ALIGN != 0) {
+      this->errmsg_ = "invalid section: " + name;
+      return false;
+    }
+
+    SectionEnt ent;
+    ::memset(&ent, 0, sizeof(ent));
+    ::strncpy(ent.name_, name.c_str(), SectionEnt::NAME_LEN - 1);
+    ent.version_ = version;
+    ent.rec_size_ = static_cast<uint32_t>(rec_size);
+    ent.offset_ = this->offset_;
+    this->sec_.push_back(ent);
+    return true;
+  }
+
+  bool CheckpointWriter::append(const void *rec) {
+    if (this->fp_ == NULL || this->sec_.empty()) {
+      this->errmsg_ = "no section";
+      return false;
+    }
+
+    SectionEnt &ent = this->sec_.back();
+    if (!this->write(rec, ent.rec_size_)) {
+      return false;
+    }
+    ent.count_++;
+    return true;
+  }
+
+  bool CheckpointWriter::close() {
+    if (this->fp_ == NULL) {
+      this->errmsg_ = "not opened";
+      return false;
+    }
+
+    Header hdr;
+    ::memset(&hdr, 0, sizeof(hdr));
+    ::memcpy(hdr.magic_, MAGIC_, sizeof(hdr.magic_));
+    hdr.version_ = CHECKPOINT_VERSION;
+    hdr.byte_order_ = BYTE_ORDER_;
+    hdr.sec_count_ = static_cast<uint32_t>(this->sec_.size());
+    hdr.sec_offset_ = this->offset_;
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    hdr.saved_ns_ = static_cast<uint64_t>(tv.tv_sec) * 1000000000ULL +
+      static_cast<uint64_t>(tv.tv_usec) * 1000ULL;
+
+    bool rc = true;
+    for (size_t i = 0; rc && i < this->sec_.size(); i++) {
+      rc = this->write(&(this->sec_[i]), sizeof(SectionEnt));
+    }
+    if (rc && (::fseek(this->fp_, 0, SEEK_SET) != 0 ||
+               !this->write(&hdr, sizeof(hdr)) ||
+               ::fflush(this->fp_) != 0 || ::fsync(::fileno(this->fp_)) != 0)) {
+      if (this->errmsg_.empty()) {
+        this->errmsg_ = std::string("write error: ") + strerror(errno);
+      }
+      rc = false;
+    }
+
+    ::fclose(this->fp_);
+    this->fp_ = NULL;
+    if (rc && ::rename(this->tmp_path_.c_str(), this->path_.c_str()) != 0) {
+      this->errmsg_ = this->path_ + ": " + strerror(errno);
+      rc = false;
+    }
+    if (!rc) {
+      ::unlink(this->tmp_path_.c_str());
+    }
+    return rc;
+  }
+
+
+  // ----------------------------------------------------------------
+  // CheckpointReader
+  //
+  CheckpointReader::CheckpointReader() :
+    fd_(-1), addr_(NULL), length_(0), hdr_(NULL), sec_(NULL) {
+  }
+  CheckpointReader::~CheckpointReader() {
+    this->close();
+  }
+
+  bool CheckpointReader::open(const std::string &path) {
+    typedef CheckpointWriter::Header Header;
+    typedef CheckpointWriter::SectionEnt SectionEnt;
+    this->close();
+
+    this->fd_ = ::open(path.c_str(), O_RDONLY);
+    if (this->fd_ < 0) {
+      this->errmsg_ = path + ": " + strerror(errno);
+      return false;
+    }
+    struct stat st;
+    if (::fstat(this->fd_, &st) != 0) {
+      this->errmsg_ = "fstat error";
+      this->close();
+      return false;
+    }
+    this->length_ = st.st_size;
+    if (this->length_ < sizeof(Header)) {
+      this->errmsg_ = "too short checkpoint file";
+      this->close();
+      return false;
+    }
+
+    this->addr_ = ::mmap(NULL, this->length_, PROT_READ, MAP_PRIVATE,
+                         this->fd_, 0);
+    if (this->addr_ == MAP_FAILED) {
+      this->addr_ = NULL;
+      this->errmsg_ = "mmap error";
+      this->close();
+      return false;
+    }
+
+    const Header *hdr = static_cast<const Header *>(this->addr_);
+    if (0 != ::memcmp(hdr->magic_, CheckpointWriter::MAGIC_,
+                      sizeof(hdr->magic_))) {
+      this->errmsg_ = "not a checkpoint file";
+    } else if (hdr->byte_order_ != CheckpointWriter::BYTE_ORDER_) {
+      this->errmsg_ = "checkpoint of another byte order";
+    } else if (hdr->version_ != CHECKPOINT_VERSION) {
+      this->errmsg_ = "unsupported checkpoint version";
+    } else if (hdr->sec_offset_ > this->length_ ||
+               (this->length_ - hdr->sec_offset_) / sizeof(SectionEnt) <
+               hdr->sec_count_) {
+      this->errmsg_ = "broken section table";
+    }
+    if (!this->errmsg_.empty()) {
+      this->close();
+      return false;
+    }
+
+    this->hdr_ = hdr;
+    this->sec_ = reinterpret_cast<const SectionEnt *>
+      (static_cast<const byte_t *>(this->addr_) + hdr->sec_offset_);
+    return true;
+  }
+
+  void CheckpointReader::close() {
+    if (this->addr_) {
+      ::munmap(this->addr_, this->length_);
+      this->addr_ = NULL;
+    }
+    if (this->fd_ >= 0) {
+      ::close(this->fd_);
+      this->fd_ = -1;
+    }
+    this->length_ = 0;
+    this->hdr_ = NULL;
+    this->sec_ = NULL;
+  }
+
+  const void *CheckpointReader::section(const std::string &name,
+                                        uint32_t version, size_t rec_size,
+                                        size_t *count) const {
+    *count = 0;
+    if (this->hdr_ == NULL) {
+      return NULL;
+    }
+
+    for (uint32_t i = 0; i < this->hdr_->sec_count_; i++) {
+      const CheckpointWriter::SectionEnt &ent = this->sec_[i];
+      if (::strncmp(ent.name_, name.c_str(),
+                    CheckpointWriter::SectionEnt::NAME_LEN) != 0) {
+        continue;
+      }
+      if (ent.version_ != version || ent.rec_size_ != rec_size) {
+        return NULL;
+      }
+
+      if (ent.offset_ > this->hdr_->sec_offset_ ||
+          (this->hdr_->sec_offset_ - ent.offset_) / rec_size < ent.count_) {
+        return NULL;  // broken
+      }
+      *count = ent.count_;
+      return static_cast<const byte_t *>(this->addr_) + ent.offset_;
+    }
+    return NULL;
+  }
+
+  uint64_t CheckpointReader::saved_ns() const {
+    return (this->hdr_) ? this->hdr_->saved_ns_ : 0;
+  }
+}  // namespace swarm
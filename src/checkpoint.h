@@ -0,0 +1,117 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CHECKPOINT_H__
+#define SRC_CHECKPOINT_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "./common.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // Checkpoint file
+  // State of session tables and flow meters saved at shutdown and
+  // restored at the next start, so that flows in the middle of stream are
+  // tracked again without waiting for a new SYN. A file is a header, then
+  // sections of fixed size records (size of multiple of 8), then the
+  // section table. Records are plain structs in host byte order, so a reader
+  // mmaps the file and uses them in place. A section has its own layout
+  // version and record size; a reader asking another version or size gets
+  // nothing, and the owner starts empty as before.
+  //
+  //   [Header][section data]...[SectionEnt x sec_count_]
+  //
+  const uint32_t CHECKPOINT_VERSION = 1;
+
+  class CheckpointWriter {
+  public:
+    struct Header {
+      char magic_[8];        // "SWCKPT\0\1"
+      uint32_t version_;     // CHECKPOINT_VERSION
+      uint32_t byte_order_;  // 0x01020304 in host order
+      uint32_t sec_count_;
+      uint32_t reserved_;
+      uint64_t sec_offset_;  // offset of section table
+      uint64_t saved_ns_;    // wall clock
+    };
+    struct SectionEnt {
+      static const size_t NAME_LEN = 32;
+      char name_[NAME_LEN];
+      uint32_t version_;
+      uint32_t rec_size_;
+      uint64_t count_;
+      uint64_t offset_;
+    };
+    static const char MAGIC_[8];
+    static const uint32_t BYTE_ORDER_ = 0x01020304;
+
+  private:
+    FILE *fp_;
+    std::string path_;
+    std::string tmp_path_;
+    uint64_t offset_;
+    std::vector<SectionEnt> sec_;
+    std::string errmsg_;
+
+    bool write(const void *ptr, size_t len);
+
+  public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+    // The file is written as path + ".tmp" and renamed by close(), then
+    // a crash while saving does not break the last checkpoint.
+    bool open(const std::string &path);
+    bool begin(const std::string &name, uint32_t version, size_t rec_size);
+    bool append(const void *rec);
+    bool close();
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+
+  class CheckpointReader {
+  private:
+    int fd_;
+    void *addr_;
+    size_t length_;
+    const CheckpointWriter::Header *hdr_;
+    const CheckpointWriter::SectionEnt *sec_;
+    std::string errmsg_;
+
+  public:
+    CheckpointReader();
+    ~CheckpointReader();
+    bool open(const std::string &path);
+    void close();
+    // Records of the section, NULL if not found or the layout differs.
+    const void *section(const std::string &name, uint32_t version,
+                        size_t rec_size, size_t *count) const;
+    uint64_t saved_ns() const;
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_CHECKPOINT_H__
@@ -0,0 +1,152 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWARM_CHKSUM_X86
+#endif
+
+#include "./checksum.h"
+
+namespace swarm {
+  // sum of the last 0-7 bytes; an odd byte is padded by zero in memory
+  // order as RFC 1071 says
+  static inline uint64_t sum_tail (const byte_t *p, size_t len,
+                                   uint64_t sum) {
+    byte_t buf[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    ::memcpy (buf, p, len);
+    uint32_t w[2];
+    ::memcpy (w, buf, sizeof (w));
+    return sum + w[0] + w[1];
+  }
+
+  static uint64_t sum_scalar (const byte_t *p, size_t len, uint64_t sum) {
+    // 4 words per round, no carry handling is needed until 2^32 rounds
+    while (len >= 16) {
+      uint32_t w[4];
+      ::memcpy (w, p, sizeof (w));
+      sum += static_cast<uint64_t> (w[0]) + w[1] + w[2] + w[3];
+      p += 16;
+      len -= 16;
+    }
+    while (len >= 8) {
+      uint32_t w[2];
+      ::memcpy (w, p, sizeof (w));
+      sum += static_cast<uint64_t> (w[0]) + w[1];
+      p += 8;
+      len -= 8;
+    }
+    return (len > 0) ? sum_tail (p, len, sum) : sum;
+  }
+
+#ifdef SWARM_CHKSUM_X86
+  // 32 bit words are zero extended to 64 bit lanes, then the lanes are
+  // added without carry handling.
+  __attribute__((target("sse2")))
+  static uint64_t sum_sse2 (const byte_t *p, size_t len, uint64_t sum) {
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i acc0 = _mm_setzero_si128 ();
+    __m128i acc1 = _mm_setzero_si128 ();
+    while (len >= 16) {
+      __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (p));
+      acc0 = _mm_add_epi64 (acc0, _mm_unpacklo_epi32 (v, zero));
+      acc1 = _mm_add_epi64 (acc1, _mm_unpackhi_epi32 (v, zero));
+      p += 16;
+      len -= 16;
+    }
+    uint64_t lane[2];
+    _mm_storeu_si128 (reinterpret_cast<__m128i *> (lane),
+                      _mm_add_epi64 (acc0, acc1));
+    return sum_scalar (p, len, sum + lane[0] + lane[1]);
+  }
+
+  __attribute__((target("avx2")))
+  static uint64_t sum_avx2 (const byte_t *p, size_t len, uint64_t sum) {
+    const __m256i zero = _mm256_setzero_si256 ();
+    __m256i acc0 = _mm256_setzero_si256 ();
+    __m256i acc1 = _mm256_setzero_si256 ();
+    while (len >= 32) {
+      __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i *> (p));
+      acc0 = _mm256_add_epi64 (acc0, _mm256_unpacklo_epi32 (v, zero));
+      acc1 = _mm256_add_epi64 (acc1, _mm256_unpackhi_epi32 (v, zero));
+      p += 32;
+      len -= 32;
+    }
+    uint64_t lane[4];
+    _mm256_storeu_si256 (reinterpret_cast<__m256i *> (lane),
+                         _mm256_add_epi64 (acc0, acc1));
+    return sum_scalar (p, len, sum + lane[0] + lane[1] + lane[2] + lane[3]);
+  }
+
+  static Checksum::SumFunc select_sum () {
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+      return sum_avx2;
+    } else if (__builtin_cpu_supports ("sse2")) {
+      return sum_sse2;
+    } else {
+      return sum_scalar;
+    }
+  }
+#else
+  static Checksum::SumFunc select_sum () {
+    return sum_scalar;
+  }
+#endif
+
+  Checksum::SumFunc Checksum::sum_func_ = select_sum ();
+
+  uint64_t Checksum::pseudo (const void *src, const void *dst,
+                             size_t addr_len, uint8_t proto, size_t l4_len) {
+    uint64_t sum = sum_scalar (static_cast<const byte_t *> (src), addr_len, 0);
+    sum = sum_scalar (static_cast<const byte_t *> (dst), addr_len, sum);
+    // zero, protocol and length as 16 bit words in network order
+    sum += htons (static_cast<uint16_t> (proto));
+    if (addr_len == 4) {
+      sum += htons (static_cast<uint16_t> (l4_len));
+    } else {
+      sum += htonl (static_cast<uint32_t> (l4_len));
+    }
+    return sum;
+  }
+
+  uint64_t Checksum::add_scalar (const void *data, size_t len, uint64_t sum) {
+    return sum_scalar (static_cast<const byte_t *> (data), len, sum);
+  }
+
+  const char *Checksum::impl () {
+#ifdef SWARM_CHKSUM_X86
+    if (sum_func_ == sum_avx2) {
+      return "avx2";
+    } else if (sum_func_ == sum_sse2) {
+      return "sse2";
+    }
+#endif
+    return "scalar";
+  }
+}  // namespace swarm
@@ -0,0 +1,76 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_CHECKSUM_H__
+#define SRC_CHECKSUM_H__
+
+#include "./common.h"
+
+namespace swarm {
+  // ----------------------------------------------------------
+  // Checksum
+  // Internet checksum (RFC 1071) for IPv4, TCP, UDP and ICMP. add()
+  // returns an unfolded partial sum of 32 bit words in memory order, so
+  // partial sums (e.g. pseudo header and segment) can be chained as
+  // long as every part but the last has even length. The summing loop
+  // uses AVX2 or SSE2 if the CPU has it.
+  //
+  class Checksum {
+  public:
+    typedef uint64_t (*SumFunc)(const byte_t *p, size_t len, uint64_t sum);
+
+  private:
+    static SumFunc sum_func_;
+
+  public:
+    static inline uint64_t add (const void *data, size_t len,
+                                uint64_t sum = 0) {
+      return sum_func_(static_cast<const byte_t *> (data), len, sum);
+    }
+    static inline uint16_t fold (uint64_t sum) {
+      sum = (sum & 0xffffffff) + (sum >> 32);
+      sum = (sum & 0xffffffff) + (sum >> 32);
+      sum = (sum & 0xffff) + (sum >> 16);
+      sum = (sum & 0xffff) + (sum >> 16);
+      return static_cast<uint16_t> (sum);
+    }
+    // partial sum of TCP/UDP pseudo header, addr_len is 4 or 16
+    static uint64_t pseudo (const void *src, const void *dst, size_t addr_len,
+                            uint8_t proto, size_t l4_len);
+    // true if data including its checksum field sums to 0xffff
+    static inline bool verify (const void *data, size_t len,
+                               uint64_t sum = 0) {
+      return (fold (add (data, len, sum)) == 0xffff);
+    }
+    // portable version, for test and benchmark
+    static uint64_t add_scalar (const void *data, size_t len,
+                                uint64_t sum = 0);
+    // "avx2", "sse2" or "scalar"
+    static const char *impl ();
+  };
+}  // namespace swarm
+
+#endif  // SRC_CHECKSUM_H__
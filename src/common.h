@@ -56,6 +56,13 @@ namespace swarm {
   class Value;
   class Decoder;
   class Task;
+  class TimerWheel;
+  class BpfFilter;
+  class Sampler;
+  class FlowHash;
+  class CheckpointWriter;
+  class CheckpointReader;
+  struct PluginInfo;
 
   enum FlowDir {
     DIR_NIL = 0, // Not defined
@@ -63,6 +70,12 @@ namespace swarm {
     DIR_R2L, // Right to Left
   };
 
+  enum SampleMode {
+    SAMPLE_NONE = 0,
+    SAMPLE_PACKET,  // 1-in-N packets
+    SAMPLE_FLOW,    // 1-in-N flows by 5 tuple hash, both directions
+  };
+
 }  // namespace swarm
 
 #endif  // SRC_COMMON_H__
@@ -62,6 +62,11 @@ namespace swarm {
     return i;
   }
 
+  Decoder * (*DecoderMap::lookup (const std::string &name)) (NetDec * nd) {
+    auto it = DecoderMap::protocol_decoder_map_.find (name);
+    return (it != DecoderMap::protocol_decoder_map_.end ()) ? it->second : NULL;
+  }
+
   // -------------------------------------------------------
   // Decoder
   void Decoder::emit (dec_id dec, Property *p) {
@@ -69,9 +74,23 @@ namespace swarm {
       this->nd_->decode (dec, p);
     }
   }
+  bool Decoder::decode_shed (Property *p) {
+    return false;
+  }
   bool Decoder::accept (const Property &p) {
     return false;
   }
+  void Decoder::migrate (Decoder *old) {
+  }
+  size_t Decoder::session_count () const {
+    return 0;
+  }
+  bool Decoder::checkpoint (CheckpointWriter *w) const {
+    return true;
+  }
+  bool Decoder::restore (const CheckpointReader &r) {
+    return true;
+  }
 
   Decoder::Decoder (NetDec *nd) : nd_(nd) {
   }
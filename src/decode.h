@@ -42,15 +42,49 @@ namespace swarm {
 
   protected:
     void emit (dec_id dec, Property *p);
+    inline NetDec *netdec () const { return this->nd_; }
 
   public:
     explicit Decoder (NetDec * nd);
     virtual ~Decoder ();
     virtual void setup (NetDec *nd) = 0;
     virtual bool decode (Property *p) = 0;
+    // Called instead of decode() while the decoder is shed by overload
+    // control. Override it to keep a cheap part of decoding; the default
+    // decodes nothing and stops there.
+    virtual bool decode_shed (Property *p);
     virtual bool accept (const Property &p);
+    // Called on a new decoder by NetDec::swap_decoder() just before it
+    // replaces old one of the same name. Take over state such as sessions
+    // from old here, old is deleted after that. Default takes nothing.
+    virtual void migrate (Decoder *old);
+    // entries of session (or transaction) table for live stats
+    virtual size_t session_count () const;
+    // Save sessions to a section of own name, and restore them at the
+    // next start (see checkpoint.h). Called by NetDec::save_checkpoint()
+    // and load_checkpoint(); default has nothing to save.
+    virtual bool checkpoint (CheckpointWriter *w) const;
+    virtual bool restore (const CheckpointReader &r);
   };
 
+  // Plugin ABI of NetDec::load_plugin(). A shared object built against
+  // the same swarm headers exports one decoder with
+  //
+  //   SWARM_PLUGIN (my_proto, MyProtoDecoder::New);
+  //
+  // PLUGIN_ABI_VERSION is raised when Decoder, Property or NetDec
+  // changes its layout, and a plugin of another version is rejected.
+  const int PLUGIN_ABI_VERSION = 1;
+  struct PluginInfo {
+    int abi_version_;
+    const char *name_;
+    Decoder * (*New) (NetDec * nd);
+  };
+
+#define SWARM_PLUGIN(NAME,FUNC)                                     \
+  extern "C" const swarm::PluginInfo swarm_plugin_info =            \
+  { swarm::PLUGIN_ABI_VERSION, #NAME, FUNC }
+
 
   class DecoderMap {
   private:
@@ -65,6 +99,8 @@ namespace swarm {
     static size_t build_decoder_vector (NetDec * nd,
                                         std::vector <Decoder *> *dec_vec,
                                         std::vector <std::string> *dec_name);
+    // factory of a built-in decoder, NULL if not found
+    static Decoder * (*lookup (const std::string &name)) (NetDec * nd);
   };
 
 #define INIT_DECODER(NAME,FUNC)                     \
@@ -0,0 +1,265 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWARM_CRC32C_X86
+#endif
+
+#include "./flowhash.h"
+#include "./property.h"
+
+namespace swarm {
+  FlowHash *FlowHash::New (const std::string &name) {
+    if (name == "default") {
+      return new FlowHashDefault ();
+    } else if (name == "toeplitz") {
+      return new FlowHashToeplitz ();
+    } else if (name == "crc32c") {
+      return new FlowHashCrc32c ();
+    } else {
+      return NULL;
+    }
+  }
+
+  // ----------------------------------------------------------
+  // FlowHashDefault
+  uint64_t FlowHashDefault::hash (const void *src_addr, const void *dst_addr,
+                                  size_t addr_len, const void *src_port,
+                                  const void *dst_port, size_t port_len,
+                                  uint8_t proto) const {
+    return Property::flow_hash (src_addr, dst_addr, addr_len, src_port,
+                                dst_port, port_len, proto);
+  }
+
+  // ----------------------------------------------------------
+  // FlowHashToeplitz
+  const uint8_t FlowHashToeplitz::SYM_KEY_[KEY_LEN] = {
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+  };
+  const uint8_t FlowHashToeplitz::MS_KEY_[KEY_LEN] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+  };
+
+  FlowHashToeplitz::FlowHashToeplitz (const uint8_t *key) {
+    this->set_key (key);
+  }
+
+  void FlowHashToeplitz::set_key (const uint8_t *key) {
+    ::memcpy (this->key_, key, KEY_LEN);
+
+    // Input bit k (from MSB of the first byte) XORs 32 bits of the key
+    // starting at bit k into the hash. XOR of them for every byte value
+    // at every position is precomputed, so a hash is a lookup per byte.
+    for (size_t i = 0; i < INPUT_MAX; i++) {
+      uint64_t w = 0;  // key bytes i .. i+4
+      for (size_t j = 0; j < 5; j++) {
+        w = (w << 8) | key[i + j];
+      }
+      uint32_t bit[8];
+      for (size_t b = 0; b < 8; b++) {
+        bit[b] = static_cast<uint32_t> (w >> (8 - b));
+      }
+      for (size_t v = 0; v < 256; v++) {
+        uint32_t h = 0;
+        for (size_t b = 0; b < 8; b++) {
+          if (v & (0x80 >> b)) {
+            h ^= bit[b];
+          }
+        }
+        this->table_[i][v] = h;
+      }
+    }
+  }
+
+  bool FlowHashToeplitz::symmetric () const {
+    for (size_t i = 2; i < KEY_LEN; i++) {
+      if (this->key_[i] != this->key_[i % 2]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint64_t FlowHashToeplitz::hash (const void *src_addr, const void *dst_addr,
+                                   size_t addr_len, const void *src_port,
+                                   const void *dst_port, size_t port_len,
+                                   uint8_t proto) const {
+    if (addr_len != 4 && addr_len != 16) {
+      return 0;
+    }
+
+    uint32_t h = 0;
+    size_t pos = 0;
+    const uint8_t *p = static_cast<const uint8_t *> (src_addr);
+    for (size_t i = 0; i < addr_len; i++) {
+      h ^= this->table_[pos++][p[i]];
+    }
+    p = static_cast<const uint8_t *> (dst_addr);
+    for (size_t i = 0; i < addr_len; i++) {
+      h ^= this->table_[pos++][p[i]];
+    }
+
+    // NIC uses ports for TCP and UDP only
+    if (port_len == 2 && (proto == 6 || proto == 17)) {
+      p = static_cast<const uint8_t *> (src_port);
+      h ^= this->table_[pos++][p[0]];
+      h ^= this->table_[pos++][p[1]];
+      p = static_cast<const uint8_t *> (dst_port);
+      h ^= this->table_[pos++][p[0]];
+      h ^= this->table_[pos++][p[1]];
+    }
+    return h;
+  }
+
+  // ----------------------------------------------------------
+  // FlowHashCrc32c
+  typedef uint32_t (*CrcFunc)(uint32_t crc, const uint8_t *p, size_t len);
+
+  static uint32_t crc_table_[256];
+
+  static uint32_t crc_sw (uint32_t crc, const uint8_t *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      crc = crc_table_[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+  }
+
+#ifdef SWARM_CRC32C_X86
+  __attribute__((target("sse4.2")))
+  static uint32_t crc_hw (uint32_t crc, const uint8_t *p, size_t len) {
+#ifdef __x86_64__
+    uint64_t c = crc;
+    while (len >= 8) {
+      uint64_t w;
+      ::memcpy (&w, p, sizeof (w));
+      c = _mm_crc32_u64 (c, w);
+      p += 8;
+      len -= 8;
+    }
+    crc = static_cast<uint32_t> (c);
+#endif
+    while (len >= 4) {
+      uint32_t w;
+      ::memcpy (&w, p, sizeof (w));
+      crc = _mm_crc32_u32 (crc, w);
+      p += 4;
+      len -= 4;
+    }
+    while (len > 0) {
+      crc = _mm_crc32_u8 (crc, *p);
+      p++;
+      len--;
+    }
+    return crc;
+  }
+#endif
+
+  static CrcFunc select_crc () {
+    // reflected Castagnoli polynomial
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : (c >> 1);
+      }
+      crc_table_[i] = c;
+    }
+
+#ifdef SWARM_CRC32C_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("sse4.2")) {
+      return crc_hw;
+    }
+#endif
+    return crc_sw;
+  }
+
+  static const CrcFunc crc_func_ = select_crc ();
+
+  uint32_t FlowHashCrc32c::crc32c (const void *data, size_t len) {
+    return ~crc_func_ (0xffffffff, static_cast<const uint8_t *> (data), len);
+  }
+
+  bool FlowHashCrc32c::hw () {
+    return (crc_func_ != crc_sw);
+  }
+
+  // lay out end points in order, lower one first as Property::flow_hash()
+  // does. N is fixed so that memcmp and memcpy are inlined.
+  template <size_t N>
+  static inline size_t pack_tuple (uint8_t *buf, const void *src_addr,
+                                   const void *dst_addr, const void *src_port,
+                                   const void *dst_port, size_t port_len,
+                                   uint8_t proto) {
+    int rc = ::memcmp (src_addr, dst_addr, N);
+    if (rc == 0 && port_len == 2) {
+      rc = ::memcmp (src_port, dst_port, 2);
+    }
+    if (rc > 0) {
+      std::swap (src_addr, dst_addr);
+      std::swap (src_port, dst_port);
+    }
+
+    ::memcpy (buf, src_addr, N);
+    ::memcpy (buf + N, dst_addr, N);
+    size_t len = N * 2;
+    if (port_len == 2) {
+      ::memcpy (buf + len, src_port, 2);
+      ::memcpy (buf + len + 2, dst_port, 2);
+      len += 4;
+    }
+    buf[len++] = proto;
+    return len;
+  }
+
+  uint64_t FlowHashCrc32c::hash (const void *src_addr, const void *dst_addr,
+                                 size_t addr_len, const void *src_port,
+                                 const void *dst_port, size_t port_len,
+                                 uint8_t proto) const {
+    uint8_t buf[40];
+    size_t len;
+    if (addr_len == 4) {
+      len = pack_tuple<4> (buf, src_addr, dst_addr, src_port, dst_port,
+                           port_len, proto);
+    } else if (addr_len == 16) {
+      len = pack_tuple<16> (buf, src_addr, dst_addr, src_port, dst_port,
+                            port_len, proto);
+    } else {
+      return 0;
+    }
+    return crc_func_ (0xffffffff, buf, len);
+  }
+}  // namespace swarm
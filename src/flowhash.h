@@ -0,0 +1,118 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_FLOWHASH_H__
+#define SRC_FLOWHASH_H__
+
+#include <string>
+#include "./common.h"
+
+namespace swarm {
+  // ----------------------------------------------------------
+  // FlowHash
+  // Hash function of 5 tuple for Property::hash_value(), selected by
+  // NetDec::set_flow_hash(). Addresses and ports are in network byte
+  // order. A hash used by NetDec must be symmetric, i.e. give the same
+  // value for both directions of a flow.
+  //
+  class FlowHash {
+  public:
+    virtual ~FlowHash () {}
+    virtual uint64_t hash (const void *src_addr, const void *dst_addr,
+                           size_t addr_len, const void *src_port,
+                           const void *dst_port, size_t port_len,
+                           uint8_t proto) const = 0;
+    virtual bool symmetric () const { return true; }
+    virtual const char *name () const = 0;
+    // "default", "toeplitz" or "crc32c", NULL if unknown
+    static FlowHash *New (const std::string &name);
+  };
+
+  // ----------------------------------------------------------
+  // FlowHashDefault
+  // Same as Property::flow_hash(), for comparison with others.
+  //
+  class FlowHashDefault : public FlowHash {
+  public:
+    uint64_t hash (const void *src_addr, const void *dst_addr,
+                   size_t addr_len, const void *src_port,
+                   const void *dst_port, size_t port_len,
+                   uint8_t proto) const;
+    const char *name () const { return "default"; }
+  };
+
+  // ----------------------------------------------------------
+  // FlowHashToeplitz
+  // Toeplitz hash of RSS. Input is laid out as NIC does: source and
+  // destination address, then source and destination port if TCP or
+  // UDP, so the value is the same as the NIC gives with the same key.
+  // The default key (0x6d5a repeated) is symmetric; a key like
+  // MS_KEY_ is not, and can not be used by NetDec. A symmetric key
+  // gives only 16 bits of entropy: good for queue selection, but hash
+  // tables keyed by hash_value() see more collisions than with crc32c.
+  //
+  class FlowHashToeplitz : public FlowHash {
+  public:
+    static const size_t KEY_LEN = 40;
+    static const uint8_t SYM_KEY_[KEY_LEN];
+    static const uint8_t MS_KEY_[KEY_LEN];  // Microsoft RSS sample key
+
+  private:
+    static const size_t INPUT_MAX = 36;  // IPv6 address x2 + port x2
+    uint8_t key_[KEY_LEN];
+    uint32_t table_[INPUT_MAX][256];  // hash of a byte at a position
+
+  public:
+    explicit FlowHashToeplitz (const uint8_t *key = SYM_KEY_);
+    void set_key (const uint8_t *key);  // KEY_LEN bytes
+    const uint8_t *key () const { return this->key_; }
+    uint64_t hash (const void *src_addr, const void *dst_addr,
+                   size_t addr_len, const void *src_port,
+                   const void *dst_port, size_t port_len,
+                   uint8_t proto) const;
+    bool symmetric () const;
+    const char *name () const { return "toeplitz"; }
+  };
+
+  // ----------------------------------------------------------
+  // FlowHashCrc32c
+  // CRC32C of the 5 tuple with ordered end points. Uses SSE4.2 crc32
+  // instruction if the CPU has it.
+  //
+  class FlowHashCrc32c : public FlowHash {
+  public:
+    uint64_t hash (const void *src_addr, const void *dst_addr,
+                   size_t addr_len, const void *src_port,
+                   const void *dst_port, size_t port_len,
+                   uint8_t proto) const;
+    const char *name () const { return "crc32c"; }
+    // plain CRC32C (initial value and final xor 0xffffffff)
+    static uint32_t crc32c (const void *data, size_t len);
+    static bool hw ();  // true if SSE4.2 is used
+  };
+}  // namespace swarm
+
+#endif  // SRC_FLOWHASH_H__
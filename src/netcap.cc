@@ -29,6 +29,7 @@
 #include <pcap.h>
 #include <pthread.h>
 #include <assert.h>
+#include <stdio.h>
 #include <sys/types.h> 
 #include <sys/stat.h> 
 #include <unistd.h>
@@ -36,6 +37,7 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <string>
+#include <algorithm>
 #include <ev.h>
 #include "./netcap.h"
 #include "./netdec.h"
@@ -87,7 +89,9 @@ namespace swarm {
     ev_io_start(this->ev_loop_, &(this->watcher_));
   }
   void NetCap::ev_loop_exit() {
-    // ev_io_stop (EV_A_ w);
+    // stop the watcher so a later capture on the shared default loop
+    // does not dispatch to this (possibly destroyed) NetCap
+    ev_io_stop(this->ev_loop_, &(this->watcher_));
     ev_unloop (this->ev_loop_, EVUNLOOP_ALL);
   }
 
@@ -113,6 +117,10 @@ namespace swarm {
     }
   }
 
+  bool NetCap::stats (uint64_t *recv, uint64_t *drop) {
+    return false;
+  }
+
   void NetCap::set_status(Status st) {
     this->status_ = st;
   }
@@ -125,87 +133,365 @@ namespace swarm {
 
 
   // -------------------------------------------------------------------
-  // class CapPcapMmap
+  // class PcapReader
   //
-  CapPcapMmap::CapPcapMmap(const std::string &filepath) : fd_(0), addr_(NULL) {
-    assert(0); // don't use in libev arch
-    this->set_status(FAIL);
-
+  PcapReader::PcapReader(const std::string &filepath) :
+    fd_(-1), addr_(NULL), base_(NULL), ptr_(NULL), eof_(NULL), length_(0),
+    ready_(false), format_(FMT_PCAP), swap_(false), frac_mul_(1000),
+    linktype_(0), last_ts_(0) {
     this->fd_ = ::open(filepath.c_str(), O_RDONLY);
     if (this->fd_ < 0) {
-      this->set_errmsg("can't open file");
+      this->errmsg_ = "can't open file";
       return;
     }
 
     struct stat buf;
     if (fstat(this->fd_, &buf) != 0) {
-      this->set_errmsg("fstat error");
+      this->errmsg_ = "fstat error";
       return;
     }
     
     this->length_ = buf.st_size;
     if (this->length_ < sizeof(struct pcap_file_hdr)) {
-      this->set_errmsg("The file is too short");
+      this->errmsg_ = "The file is too short";
       return;
     }
       
-    this->addr_ = 
+    void *addr =
       ::mmap(NULL, this->length_, PROT_READ, MAP_PRIVATE, this->fd_, 0);
-    if (!this->addr_) {
-      this->set_errmsg("mmap error");
+    if (addr == MAP_FAILED) {
+      this->errmsg_ = "mmap error";
       return;
     }
+    this->addr_ = addr;
     if (0 != madvise(this->addr_, this->length_, MADV_SEQUENTIAL)) {
-      this->set_errmsg("madvise error");
+      this->errmsg_ = "madvise error";
       return;
     }
 
-    struct pcap_file_hdr *hdr =
-      static_cast<struct pcap_file_hdr *>(this->addr_);
+    this->base_ = static_cast<uint8_t*>(this->addr_);
+    this->eof_  = this->base_ + this->length_;
+
+    uint32_t magic;
+    ::memcpy(&magic, this->base_, sizeof(magic));
 
-    if (hdr->magic != 0xA1B2C3D4) {
-      this->set_errmsg("Invalid pcap magic number");
+    switch (magic) {
+    case 0xA1B2C3D4: this->frac_mul_ = 1000; break;
+    case 0xD4C3B2A1: this->swap_ = true; this->frac_mul_ = 1000; break;
+    case 0xA1B23C4D: this->frac_mul_ = 1;    break;
+    case 0x4D3CB2A1: this->swap_ = true; this->frac_mul_ = 1;    break;
+    case PCAPNG_SHB: break;
+    default:
+      this->errmsg_ = "Invalid pcap magic number";
       return;
     }
 
-    this->base_ = static_cast<uint8_t*>(this->addr_);
-    this->eof_  = this->base_ + this->length_;
-    this->ptr_  = this->base_ + sizeof(struct pcap_file_hdr);
-    ::memcpy(&this->hdr_, hdr, sizeof(this->hdr_));
-
-#if 0      
-    debug(1, "magic = %08X", hdr->magic);
-    debug(1, "ver_major = %u", hdr->version_major);
-    debug(1, "ver_minor = %u", hdr->version_minor);
-    debug(1, "snaplen = %u", hdr->snaplen);
-#endif
-
-    this->set_status(READY);
+    this->ready_ = (magic == PCAPNG_SHB) ?
+      this->open_pcapng() : this->open_pcap();
   }
-  CapPcapMmap::~CapPcapMmap() {
+  PcapReader::~PcapReader() {
     if (this->addr_) {
       ::munmap(this->addr_, this->length_);
     }
-    if (this->fd_ != 0) {
+    if (this->fd_ >= 0) {
       ::close(this->fd_);
     }
   }
 
+  uint16_t PcapReader::rd16(const uint8_t *p) const {
+    uint16_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return this->swap_ ? __builtin_bswap16(v) : v;
+  }
+  uint32_t PcapReader::rd32(const uint8_t *p) const {
+    uint32_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return this->swap_ ? __builtin_bswap32(v) : v;
+  }
+
+  uint64_t PcapReader::tsresol2ns(uint64_t ts, uint8_t tsresol) {
+    static const uint64_t pow10[] = {
+      1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+      10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+      100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+      100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+      100000000000000000ULL, 1000000000000000000ULL,
+      10000000000000000000ULL,
+    };
+
+    if (tsresol & 0x80) {
+      // 2^-e second unit
+      uint8_t e = tsresol & 0x7f;
+      if (e >= 64) {
+        return 0;
+      }
+      uint64_t sec = ts >> e;
+      uint64_t frac = ts & ((1ULL << e) - 1);
+      if (e > 32) {
+        frac >>= (e - 32);
+        e = 32;
+      }
+      return sec * 1000000000 + ((frac * 1000000000) >> e);
+    } else {
+      // 10^-e second unit
+      if (tsresol <= 9) {
+        return ts * pow10[9 - tsresol];
+      } else if (tsresol <= 19) {
+        return ts / pow10[tsresol - 9];
+      } else {
+        return 0;
+      }
+    }
+  }
+
+  const char *PcapReader::linktype2dec(uint32_t linktype) {
+    switch (linktype) {
+    case LINKTYPE_ETHERNET:  return "ether";
+    case LINKTYPE_RAW:       return "ipv4";
+    case LINKTYPE_LINUX_SLL: return "lcc";
+    default:                 return NULL;
+    }
+  }
+
+  bool PcapReader::open_pcap() {
+    this->format_ = FMT_PCAP;
+    this->linktype_ = this->rd32(this->base_ + 20);
+    this->ptr_ = this->base_ + sizeof(struct pcap_file_hdr);
+    return true;
+  }
+
+  bool PcapReader::open_pcapng() {
+    this->format_ = FMT_PCAPNG;
+    this->ptr_ = this->base_;
+
+    // link type is decided by the first interface description block
+    const uint8_t *p = this->base_;
+    while (this->eof_ - p >= 12) {
+      uint32_t type = this->rd32(p);
+      if (type == PCAPNG_SHB) {
+        uint32_t bom;
+        ::memcpy(&bom, p + 8, sizeof(bom));
+        if (bom == 0x1A2B3C4D) {
+          this->swap_ = false;
+        } else if (bom == 0x4D3C2B1A) {
+          this->swap_ = true;
+        } else {
+          this->errmsg_ = "Invalid pcapng byte-order magic";
+          return false;
+        }
+      }
+
+      uint32_t blen = this->rd32(p + 4);
+      if (blen < 12 || blen > static_cast<size_t>(this->eof_ - p)) {
+        this->errmsg_ = "Invalid pcapng block length";
+        return false;
+      }
+      if (type == PCAPNG_IDB && blen >= 20) {
+        this->linktype_ = this->rd16(p + 8);
+        return true;
+      }
+      p += blen;
+    }
+
+    this->errmsg_ = "No interface description block in pcapng";
+    return false;
+  }
+
+  int PcapReader::next(Record *rec) {
+    if (!this->ready_) {
+      return -1;
+    }
+    return (this->format_ == FMT_PCAPNG) ?
+      this->next_pcapng(rec) : this->next_pcap(rec);
+  }
+
+  bool PcapReader::seek(size_t offset) {
+    if (!this->ready_) {
+      return false;
+    }
+    if (this->format_ != FMT_PCAP) {
+      this->errmsg_ = "seek is not supported for pcapng";
+      return false;
+    }
+    if (offset < sizeof(struct pcap_file_hdr) || offset > this->length_) {
+      this->errmsg_ = "Invalid file offset";
+      return false;
+    }
+    this->ptr_ = this->base_ + offset;
+    return true;
+  }
+
+  int PcapReader::next_pcap(Record *rec) {
+    if (this->ptr_ >= this->eof_) {
+      return 0;
+    }
+
+    if (static_cast<size_t>(this->eof_ - this->ptr_) <
+        sizeof(struct pcap_pkt_hdr)) {
+      this->errmsg_ = "Invalid packet header";
+      return -1;
+    }
+
+    const uint8_t *hdr = this->ptr_;
+    uint32_t caplen = this->rd32(hdr + 8);
+    if (static_cast<size_t>(this->eof_ - this->ptr_) - 
+        sizeof(struct pcap_pkt_hdr) < caplen) {
+      this->errmsg_ = "Invalid packet data";
+      return -1;
+    }
+
+    rec->ts_ns_ = static_cast<uint64_t>(this->rd32(hdr)) * 1000000000 +
+      static_cast<uint64_t>(this->rd32(hdr + 4)) * this->frac_mul_;
+    rec->len_ = this->rd32(hdr + 12);
+    rec->caplen_ = (caplen < rec->len_) ? caplen : rec->len_;
+    rec->data_ = this->ptr_ + sizeof(struct pcap_pkt_hdr);
+    this->ptr_ += sizeof(struct pcap_pkt_hdr) + caplen;
+    return 1;
+  }
+
+  int PcapReader::next_pcapng(Record *rec) {
+    while (this->ptr_ < this->eof_) {
+      if (this->eof_ - this->ptr_ < 12) {
+        this->errmsg_ = "Invalid pcapng block header";
+        return -1;
+      }
+
+      const uint8_t *blk = this->ptr_;
+      uint32_t type = this->rd32(blk);
+      if (type == PCAPNG_SHB) {
+        // new section, byte order and interfaces are reset
+        uint32_t bom;
+        ::memcpy(&bom, blk + 8, sizeof(bom));
+        if (bom != 0x1A2B3C4D && bom != 0x4D3C2B1A) {
+          this->errmsg_ = "Invalid pcapng byte-order magic";
+          return -1;
+        }
+        this->swap_ = (bom == 0x4D3C2B1A);
+        this->if_list_.clear();
+      }
+
+      uint32_t blen = this->rd32(blk + 4);
+      if (blen < 12 || blen > static_cast<size_t>(this->eof_ - blk)) {
+        this->errmsg_ = "Invalid pcapng block length";
+        return -1;
+      }
+      this->ptr_ += blen;
+
+      const uint8_t *body = blk + 8;
+      size_t body_len = blen - 12;
+
+      switch (type) {
+      case PCAPNG_IDB: {
+        if (body_len < 8) {
+          this->errmsg_ = "Invalid pcapng interface description block";
+          return -1;
+        }
+        pcapng_if ifc;
+        ifc.linktype = this->rd16(body);
+        ifc.tsresol = 6;
+
+        const uint8_t *opt = body + 8;
+        const uint8_t *opt_end = body + body_len;
+        while (opt_end - opt >= 4) {
+          uint16_t code = this->rd16(opt);
+          uint16_t olen = this->rd16(opt + 2);
+          if (code == 0 || opt_end - opt - 4 < olen) {
+            break;  // opt_endofopt
+          }
+          if (code == 9 && olen >= 1) {  // if_tsresol
+            ifc.tsresol = opt[4];
+          }
+          opt += 4 + ((olen + 3) & ~3);
+        }
+        this->if_list_.push_back(ifc);
+        break;
+      }
+
+      case PCAPNG_EPB: {
+        if (body_len < 20) {
+          this->errmsg_ = "Invalid pcapng enhanced packet block";
+          return -1;
+        }
+        uint32_t if_id = this->rd32(body);
+        if (if_id >= this->if_list_.size()) {
+          this->errmsg_ = "Unknown interface ID in pcapng";
+          return -1;
+        }
+        const pcapng_if &ifc = this->if_list_[if_id];
+        uint64_t ts = (static_cast<uint64_t>(this->rd32(body + 4)) << 32) |
+          this->rd32(body + 8);
+        uint32_t caplen = this->rd32(body + 12);
+        uint32_t len    = this->rd32(body + 16);
+        if (caplen > body_len - 20) {
+          this->errmsg_ = "Invalid packet data";
+          return -1;
+        }
+
+        this->last_ts_ = (ifc.tsresol == 6) ?
+          ts * 1000 : tsresol2ns(ts, ifc.tsresol);
+        // only one default decoder can be set, packets from an interface
+        // with another link type are not decodable
+        if (ifc.linktype == this->linktype_) {
+          rec->data_ = body + 20;
+          rec->len_ = len;
+          rec->caplen_ = (caplen < len) ? caplen : len;
+          rec->ts_ns_ = this->last_ts_;
+          return 1;
+        }
+        break;
+      }
+
+      case PCAPNG_SPB: {
+        // Simple packet block has no time stamp, use the last one
+        if (body_len < 4 || this->if_list_.empty()) {
+          this->errmsg_ = "Invalid pcapng simple packet block";
+          return -1;
+        }
+        uint32_t len = this->rd32(body);
+        if (this->if_list_[0].linktype == this->linktype_) {
+          rec->data_ = body + 4;
+          rec->len_ = len;
+          rec->caplen_ = (len < body_len - 4) ? len : body_len - 4;
+          rec->ts_ns_ = this->last_ts_;
+          return 1;
+        }
+        break;
+      }
+
+      default:
+        break;  // skip unsupported blocks
+      }
+    }
+
+    return 0;
+  }
+
+
+  // -------------------------------------------------------------------
+  // class CapPcapMmap
+  //
+  CapPcapMmap::CapPcapMmap(const std::string &filepath) :
+    reader_(filepath) {
+    if (this->reader_.ready()) {
+      this->set_status(READY);
+    } else {
+      this->set_errmsg(this->reader_.errmsg());
+      this->set_status(FAIL);
+    }
+  }
+  CapPcapMmap::~CapPcapMmap() {
+  }
+
   bool CapPcapMmap::setup() {
     // delegate pcap descriptor
-    std::string dec = "";
-    switch (this->hdr_.linktype) {
-    case LINKTYPE_ETHERNET:  dec = "ether"; break;
-    case LINKTYPE_RAW:       dec = "ipv4";  break;
-    case LINKTYPE_LINUX_SLL: dec = "lcc";   break;
-    default:
+    const char *dec = PcapReader::linktype2dec(this->reader_.linktype());
+    if (dec == NULL) {
       this->set_errmsg ("Only DLT_EN10MB and DLT_RAW are "
                         "supported in this version");
       this->set_status (NetCap::FAIL);
       return false;
     }
 
-    std::string err;
     if (this->netdec() && !this->netdec()->set_default_decoder(dec)) {
       this->set_errmsg(this->netdec()->errmsg());
       this->set_status(FAIL);
@@ -214,65 +500,122 @@ namespace swarm {
 
     // ----------------------------------------------
     // processing packets from pcap file
-    bool rc = true;
-    struct timeval tv;
+    PcapReader::Record rec;
+    int rc;
+    while ((rc = this->reader_.next(&rec)) > 0) {
+      if (this->netdec()) {
+        this->netdec()->input (rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+      }
+    }
+    if (rc < 0) {
+      this->set_errmsg(this->reader_.errmsg());
+    }
 
-    while (this->ptr_ < this->eof_) {
-#if 0
-      debug(1, "PTR: %u", this->ptr_ - this->base_);
-      debug(1, "HDR: remain: %u, need: %u", this->eof_ - this->ptr_,
-            sizeof(struct pcap_pkt_hdr));
-#endif
+    this->set_status(STOP);    
+    return (rc == 0);
+  }
 
-      if (this->eof_ - this->ptr_ < sizeof(struct pcap_pkt_hdr)) {
-        this->set_errmsg("Invalid packet header");
-        rc = false;
-        break;
+  bool CapPcapMmap::teardown() {
+    return true;
+  }
+
+  void CapPcapMmap::handler(int revents) {
+  }
+
+  // -------------------------------------------------------------------
+  // class CapMergedFiles
+  //
+  CapMergedFiles::CapMergedFiles(const std::vector<std::string> &filepath) {
+    this->set_status(FAIL);
+    if (filepath.empty()) {
+      this->set_errmsg("No input file");
+      return;
+    }
+
+    for (size_t i = 0; i < filepath.size(); i++) {
+      PcapReader *r = new PcapReader(filepath[i]);
+      this->reader_.push_back(r);
+      if (!r->ready()) {
+        this->set_errmsg(filepath[i] + ": " + r->errmsg());
+        return;
       }
+      if (r->linktype() != this->reader_[0]->linktype()) {
+        this->set_errmsg(filepath[i] + ": link type differs");
+        return;
+      }
+    }
 
-      struct pcap_pkt_hdr *pkthdr = 
-        reinterpret_cast<struct pcap_pkt_hdr*>(this->ptr_);
-      this->ptr_ += sizeof(struct pcap_pkt_hdr);
-      size_t len = (pkthdr->caplen < pkthdr->len) ? pkthdr->caplen : pkthdr->len;
+    this->heap_.reserve(this->reader_.size());
+    this->set_status(READY);
+  }
+  CapMergedFiles::~CapMergedFiles() {
+    for (size_t i = 0; i < this->reader_.size(); i++) {
+      delete this->reader_[i];
+    }
+  }
 
-      tv.tv_sec  = pkthdr->tv_sec;
-      tv.tv_usec = pkthdr->tv_usec;
+  bool CapMergedFiles::push(size_t idx) {
+    Head h;
+    h.idx_ = idx;
+    int rc = this->reader_[idx]->next(&h.rec_);
+    if (rc > 0) {
+      this->heap_.push_back(h);
+      std::push_heap(this->heap_.begin(), this->heap_.end(), HeadCmp());
+    } else if (rc < 0) {
+      this->set_errmsg(this->reader_[idx]->errmsg());
+      return false;
+    }
+    return true;
+  }
 
-#if 0
-      debug(1, "DATA: remain: %u, need: %u", this->eof_ - this->ptr_, len);
-      debug(1, "TS: %u.%06u", pkthdr->tv_sec, pkthdr->tv_usec);
-      debug(1, "CAPLEN: %u, LEN: %u", pkthdr->caplen, pkthdr->len);
-#endif
+  bool CapMergedFiles::setup() {
+    const char *dec = PcapReader::linktype2dec(this->reader_[0]->linktype());
+    if (dec == NULL) {
+      this->set_errmsg ("Only DLT_EN10MB and DLT_RAW are "
+                        "supported in this version");
+      this->set_status (NetCap::FAIL);
+      return false;
+    }
 
-      if (this->eof_ - this->ptr_ < len) {
-        this->set_errmsg("Invalid packet data");
-        rc = false;
-        break;
-      }
+    if (this->netdec() && !this->netdec()->set_default_decoder(dec)) {
+      this->set_errmsg(this->netdec()->errmsg());
+      this->set_status(FAIL);
+      return false;
+    }
 
-      uint8_t *pkt_data = this->ptr_;
-      this->ptr_ += len;
+    bool rc = true;
+    for (size_t i = 0; rc && i < this->reader_.size(); i++) {
+      rc = this->push(i);
+    }
 
+    while (rc && !this->heap_.empty()) {
+      std::pop_heap(this->heap_.begin(), this->heap_.end(), HeadCmp());
+      const Head &h = this->heap_.back();
       if (this->netdec()) {
-        this->netdec()->input (pkt_data, pkthdr->len, tv, pkthdr->caplen);
+        this->netdec()->input (h.rec_.data_, h.rec_.len_, h.rec_.ts_ns_,
+                               h.rec_.caplen_);
       }
+      size_t idx = h.idx_;
+      this->heap_.pop_back();
+      rc = this->push(idx);
     }
 
-    this->set_status(STOP);    
+    this->heap_.clear();
+    this->set_status(STOP);
     return rc;
   }
 
-  bool CapPcapMmap::teardown() {
+  bool CapMergedFiles::teardown() {
     return true;
   }
 
-  void CapPcapMmap::handler(int revents) {
+  void CapMergedFiles::handler(int revents) {
   }
 
   // -------------------------------------------------------------------
   // class PcapBase
   //
-  PcapBase::PcapBase () : pcap_(NULL) {
+  PcapBase::PcapBase () : pcap_(NULL), frac_mul_(1000) {
   }
   PcapBase::~PcapBase () {
   }
@@ -309,6 +652,16 @@ namespace swarm {
     return true;
   }
 
+  bool PcapBase::stats (uint64_t *recv, uint64_t *drop) {
+    struct pcap_stat ps;
+    if (this->pcap_ == NULL || ::pcap_stats (this->pcap_, &ps) != 0) {
+      return false;
+    }
+    *recv = ps.ps_recv;
+    *drop = static_cast<uint64_t>(ps.ps_drop) + ps.ps_ifdrop;
+    return true;
+  }
+
   bool PcapBase::setup () {
     // delegate pcap descriptor
     int dlt = pcap_datalink (this->pcap_);
@@ -352,8 +705,11 @@ namespace swarm {
       rc = ::pcap_next_ex (this->pcap_, &pkthdr, &pkt_data);
 
       if (rc == 1 && this->netdec()) {
-        this->netdec()->input (pkt_data, pkthdr->len, pkthdr->ts,
-                               pkthdr->caplen);
+        // tv_usec holds nano second if the handle has nano precision
+        uint64_t ts_ns =
+          static_cast<uint64_t>(pkthdr->ts.tv_sec) * 1000000000 +
+          static_cast<uint64_t>(pkthdr->ts.tv_usec) * this->frac_mul_;
+        this->netdec()->input (pkt_data, pkthdr->len, ts_ns, pkthdr->caplen);
       } else if (rc < 0) {
         this->ev_loop_exit();
         return;
@@ -371,8 +727,29 @@ namespace swarm {
     dev_name_(dev_name) {
     char errbuf[PCAP_ERRBUF_SIZE];
 
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+    this->pcap_ = pcap_create (this->dev_name_.c_str (), errbuf);
+    if (this->pcap_) {
+      pcap_set_snaplen (this->pcap_, PCAP_BUFSIZE_);
+      pcap_set_promisc (this->pcap_, 1);
+      pcap_set_timeout (this->pcap_, PCAP_TIMEOUT_);
+      // not every device supports nano second time stamp, micro second
+      // precision is kept in that case
+      pcap_set_tstamp_precision (this->pcap_, PCAP_TSTAMP_PRECISION_NANO);
+
+      if (pcap_activate (this->pcap_) < 0) {
+        snprintf (errbuf, sizeof(errbuf), "%s", pcap_geterr (this->pcap_));
+        pcap_close (this->pcap_);
+        this->pcap_ = NULL;
+      } else if (pcap_get_tstamp_precision (this->pcap_) ==
+                 PCAP_TSTAMP_PRECISION_NANO) {
+        this->frac_mul_ = 1;
+      }
+    }
+#else
     this->pcap_ = pcap_open_live (this->dev_name_.c_str (), PCAP_BUFSIZE_,
                                   1, PCAP_TIMEOUT_, errbuf);
+#endif
     // open interface
     if (NULL == this->pcap_) {
       this->set_errmsg (errbuf);
@@ -393,7 +770,15 @@ namespace swarm {
     file_path_(file_path) {
     char errbuf[PCAP_ERRBUF_SIZE];
 
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+    this->pcap_ = ::pcap_open_offline_with_tstamp_precision
+      (this->file_path_.c_str (), PCAP_TSTAMP_PRECISION_NANO, errbuf);
+    if (this->pcap_) {
+      this->frac_mul_ = 1;
+    }
+#else
     this->pcap_ = ::pcap_open_offline(this->file_path_.c_str (), errbuf);
+#endif
     if (this->pcap_ == NULL) {
       this->set_errmsg (errbuf);
       this->set_status (NetCap::FAIL);
@@ -28,7 +28,9 @@
 #define SRC_NETCAP_H__
 
 #include <ev.h>
+#include <pcap.h>
 #include <string>
+#include <vector>
 #include "./common.h"
 #include "./timer.h"
 
@@ -82,6 +84,9 @@ namespace swarm {
     inline Status status () const { return this->status_; }
     inline bool ready () const { return (this->status_ == READY); }
     bool start ();
+    // capture side counters for overload detection. false if the backend
+    // can not drop packets (e.g. file)
+    virtual bool stats (uint64_t *recv, uint64_t *drop);
 
     task_id set_periodic_task(Task *task, float interval);
     bool unset_task(task_id id);
@@ -90,11 +95,21 @@ namespace swarm {
   };
 
   // ----------------------------------------------------------------
-  // class CapPcapMmap:
-  // Mmap based fast pcap file reader
+  // class PcapReader:
+  // Sequential record reader over a mmap'ed pcap or pcapng file. It does
+  // not use the event loop, so it can be used from any thread. Reads
+  // classic pcap (micro and nano second magic, either byte order) and
+  // pcapng; timestamps are converted to nano second integers.
   //
-  class CapPcapMmap : public NetCap {
-  private:
+  class PcapReader {
+  public:
+    struct Record {
+      const byte_t *data_;
+      uint32_t caplen_;
+      uint32_t len_;
+      uint64_t ts_ns_;
+    };
+
     // From libpcap header
     enum LINKTYPE {
       LINKTYPE_ETHERNET = 1,
@@ -102,6 +117,20 @@ namespace swarm {
       LINKTYPE_LINUX_SLL = 113,
     };
 
+  private:
+    enum Format {
+      FMT_PCAP,
+      FMT_PCAPNG,
+    };
+
+    // pcapng block types
+    enum PCAPNG_BLOCK {
+      PCAPNG_IDB = 0x00000001,
+      PCAPNG_SPB = 0x00000003,
+      PCAPNG_EPB = 0x00000006,
+      PCAPNG_SHB = 0x0A0D0D0A,
+    };
+
     struct pcap_file_hdr {
       uint32_t magic;
       uint16_t version_major;
@@ -110,21 +139,69 @@ namespace swarm {
       uint32_t sigfigs;
       uint32_t snaplen;
       uint32_t linktype;
-    } hdr_;
+    };
 
     struct pcap_pkt_hdr {
       uint32_t tv_sec;
-      uint32_t tv_usec;
+      uint32_t tv_frac;  // micro or nano second, depends on magic
       uint32_t caplen;
       uint32_t len;
     };
 
+    // pcapng Interface Description Block, only what is needed for decoding
+    struct pcapng_if {
+      uint32_t linktype;
+      uint8_t tsresol;  // if_tsresol option, 6 (micro second) by default
+    };
+
     int fd_;
     void *addr_;
     uint8_t *base_;
     uint8_t *ptr_;
     uint8_t *eof_;
     size_t length_;
+    bool ready_;
+    std::string errmsg_;
+
+    Format format_;
+    bool swap_;          // file byte order differs from host
+    uint64_t frac_mul_;  // pcap: multiplier from tv_frac to nano second
+    uint32_t linktype_;
+    uint64_t last_ts_;   // pcapng: for simple packet block
+    std::vector<pcapng_if> if_list_;
+
+    inline uint16_t rd16(const uint8_t *p) const;
+    inline uint32_t rd32(const uint8_t *p) const;
+    static uint64_t tsresol2ns(uint64_t ts, uint8_t tsresol);
+    bool open_pcap();
+    bool open_pcapng();
+    int next_pcap(Record *rec);
+    int next_pcapng(Record *rec);
+
+  public:
+    explicit PcapReader(const std::string &filepath);
+    ~PcapReader();
+    inline bool ready() const { return this->ready_; }
+    inline uint32_t linktype() const { return this->linktype_; }
+    // 1: a record is set to rec, 0: end of file, -1: broken file (errmsg)
+    int next(Record *rec);
+    // file offset of the next record and jump to an offset got by it.
+    // seek is available for classic pcap only
+    inline size_t offset() const { return this->ptr_ - this->base_; }
+    bool seek(size_t offset);
+    inline size_t length() const { return this->length_; }
+    // name of default decoder for the link type, NULL if not supported
+    static const char *linktype2dec(uint32_t linktype);
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+
+  // ----------------------------------------------------------------
+  // class CapPcapMmap:
+  // Mmap based fast pcap file reader, NetCap front end of PcapReader.
+  //
+  class CapPcapMmap : public NetCap {
+  private:
+    PcapReader reader_;
 
     bool setup();
     bool teardown();
@@ -135,6 +212,40 @@ namespace swarm {
     ~CapPcapMmap ();
   };
 
+  // ----------------------------------------------------------------
+  // class CapMergedFiles:
+  // Reads several pcap/pcapng files captured on taps of the same link
+  // and feeds packets to NetDec in global timestamp order. Each file
+  // keeps one mmap cursor and only the head record of every file is in
+  // the merge heap, so memory does not depend on the file size. Ties
+  // are broken by file order.
+  //
+  class CapMergedFiles : public NetCap {
+  private:
+    struct Head {
+      PcapReader::Record rec_;
+      size_t idx_;
+    };
+    struct HeadCmp {
+      bool operator()(const Head &a, const Head &b) const {
+        return (a.rec_.ts_ns_ != b.rec_.ts_ns_) ?
+          (a.rec_.ts_ns_ > b.rec_.ts_ns_) : (a.idx_ > b.idx_);
+      }
+    };
+
+    std::vector<PcapReader*> reader_;
+    std::vector<Head> heap_;
+
+    bool push(size_t idx);
+    bool setup();
+    bool teardown();
+    void handler(int revents);
+
+  public:
+    explicit CapMergedFiles(const std::vector<std::string> &filepath);
+    ~CapMergedFiles();
+  };
+
   // ----------------------------------------------------------------
   // class PcapBase:
   // Implemented common pcap functions for CapPcapDev and CapPcapFile
@@ -143,6 +254,7 @@ namespace swarm {
   protected:
     pcap_t *pcap_;
     std::string filter_;
+    uint64_t frac_mul_;  // 1 if libpcap gives nano second, otherwise 1000
     static const size_t PCAP_BUFSIZE_ = 0xffff;
     static const size_t PCAP_TIMEOUT_ = 1;
 
@@ -156,6 +268,7 @@ namespace swarm {
     PcapBase ();
     virtual ~PcapBase ();
     bool set_filter (const std::string &filter);
+    bool stats (uint64_t *recv, uint64_t *drop);
   };
 
   // ----------------------------------------------------------------
@@ -25,14 +25,33 @@
  */
 
 #include <string.h>
+#include <fnmatch.h>
+#include <dlfcn.h>
 #include <sys/time.h>
+#include <time.h>
+#include <algorithm>
 #include "./netdec.h"
 #include "./property.h"
 #include "./decode.h"
 #include "./timer.h"
+#include "./bpf.h"
+#include "./sampler.h"
+#include "./flowhash.h"
+#include "./checkpoint.h"
 #include "./debug.h"
 
 namespace swarm {
+  // -------------------------------------------------------
+  // PortMap
+  PortMap::PortMap () {
+    std::fill (this->port_, this->port_ + 0x10000, DEC_NULL);
+  }
+  void PortMap::remove (dec_id d_id) {
+    std::replace (this->port_, this->port_ + 0x10000, d_id, DEC_NULL);
+    this->sig_.erase (std::remove (this->sig_.begin (), this->sig_.end (),
+                                   d_id), this->sig_.end ());
+  }
+
   // -------------------------------------------------------
   // Handler
   Handler::Handler () {
@@ -41,7 +60,12 @@ namespace swarm {
   }
 
   HandlerEntry::HandlerEntry (hdlr_id hid, ev_id ev, Handler * hdlr) :
-    id_(hid), ev_(ev), hdlr_(hdlr) {
+    id_(hid), ev_(ev), hdlr_(hdlr), calls_(0), prof_calls_(0), cost_ns_(0) {
+  }
+  HandlerEntry::HandlerEntry (hdlr_id hid, const std::string &pattern,
+                              Handler * hdlr) :
+    id_(hid), ev_(EV_NULL), hdlr_(hdlr), pattern_(pattern),
+    calls_(0), prof_calls_(0), cost_ns_(0) {
   }
   HandlerEntry::~HandlerEntry () {
   }
@@ -54,6 +78,19 @@ namespace swarm {
   ev_id HandlerEntry::ev () const {
     return this->ev_;
   }
+  const std::string &HandlerEntry::pattern () const {
+    return this->pattern_;
+  }
+  bool HandlerEntry::match (const std::string &ev_name) const {
+    return (0 == ::fnmatch (this->pattern_.c_str (), ev_name.c_str (), 0));
+  }
+  void HandlerEntry::add_event (ev_id eid) {
+    const size_t i = static_cast<size_t> (eid) / 64;
+    if (this->ev_set_.size () <= i) {
+      this->ev_set_.resize (i + 1, 0);
+    }
+    this->ev_set_[i] |= (1ULL << (eid % 64));
+  }
 
 
   // -------------------------------------------------------
@@ -64,13 +101,29 @@ namespace swarm {
     base_vid_(VALUE_BASE),
     base_hid_(HDLR_BASE),
     none_(""),
+    profile_(false),
+    prof_now_(false),
+    prof_child_ns_(0),
+    shed_count_(0),
+    swap_req_count_(0),
+    in_packet_(false),
+    reassign_(false),
+    swap_count_(0),
+    prop_(NULL),
+    timer_(new TimerWheel ()),
+    filter_(NULL),
+    sampler_(NULL),
+    recorder_(NULL),
+    flow_hash_(NULL),
+    chksum_(false),
+    chksum_pass_(0),
+    chksum_fail_(0),
+    linktype_(DLT_EN10MB),
     recv_len_(0),
     cap_len_(0),
-    recv_pkt_(0) {
-    this->init_ts_.tv_sec = 0;;
-    this->init_ts_.tv_nsec = 0;;
-    this->last_ts_.tv_sec = 0;;
-    this->last_ts_.tv_nsec = 0;;
+    recv_pkt_(0),
+    init_ts_(0),
+    last_ts_(0) {
 
     std::vector <Decoder *> mod_array;
     std::vector <std::string> name_array;
@@ -85,6 +138,7 @@ namespace swarm {
     for (size_t n = 0; n < mod_count; n++) {
       this->dec_mod_[n]->setup (this);
     }
+    ::pthread_mutex_init (&(this->swap_mutex_), NULL);
 
     this->dec_default_ = this->lookup_dec_id ("ether");
     assert (this->dec_default_ != DEC_NULL);
@@ -99,6 +153,23 @@ namespace swarm {
 
     this->fwd_dec_.clear ();
     this->rev_dec_.clear ();
+    for (size_t i = 0; i < this->port_map_.size (); i++) {
+      delete this->port_map_[i];
+    }
+    for (size_t i = 0; i < this->swap_ready_.size (); i++) {
+      delete this->swap_ready_[i].dec_;
+    }
+    // decoders of plugins must be deleted before dlclose()
+    for (size_t i = 0; i < this->dec_mod_.size (); i++) {
+      delete this->dec_mod_[i];
+    }
+    for (size_t i = 0; i < this->plugin_handle_.size (); i++) {
+      ::dlclose (this->plugin_handle_[i]);
+    }
+    ::pthread_mutex_destroy (&(this->swap_mutex_));
+    delete this->timer_;
+    delete this->filter_;
+    delete this->sampler_;
   }
 
   dec_id NetDec::install_dec_mod (const std::string &name, Decoder *dec) {
@@ -108,6 +179,11 @@ namespace swarm {
       this->dec_mod_.resize (d_id + 1);
       this->dec_mod_[d_id] = NULL;
       this->dec_bind_.resize (d_id + 1);
+      this->dec_shed_.resize (d_id + 1, false);
+      this->port_map_.resize (d_id + 1, NULL);
+      this->dec_cost_ns_.resize (d_id + 1, 0);
+      this->dec_calls_.resize (d_id + 1, 0);
+      this->dec_count_.resize (d_id + 1, 0);
     }
 
     if (this->fwd_dec_.find (name) != this->fwd_dec_.end ()) {
@@ -138,6 +214,11 @@ namespace swarm {
     Decoder * dec = this->dec_mod_[d_id];
     assert (NULL != dec);
     this->dec_mod_[d_id] = NULL;
+    for (size_t i = 0; i < this->port_map_.size (); i++) {
+      if (this->port_map_[i]) {
+        this->port_map_[i]->remove (d_id);
+      }
+    }
     return dec;
   }
 
@@ -146,6 +227,23 @@ namespace swarm {
     dec_id d_id = this->lookup_dec_id (dec_name);
     if (d_id != DEC_NULL) {
       this->dec_default_ = d_id;
+      if (dec_name == "ether") {
+        this->linktype_ = DLT_EN10MB;
+      } else if (dec_name == "ipv4") {
+        this->linktype_ = DLT_RAW;
+      } else if (dec_name == "lcc") {
+        this->linktype_ = DLT_LINUX_SLL;
+      } else {
+        this->linktype_ = -1;
+      }
+      if (this->sampler_) {
+        this->sampler_->set_linktype (this->linktype_);
+      }
+
+      // filter expression depends on link type
+      if (!this->filter_expr_.empty ()) {
+        return this->set_filter (this->filter_expr_);
+      }
       return true;
     } else {
       return false;
@@ -153,36 +251,79 @@ namespace swarm {
   }
   bool NetDec::input (const byte_t *data, const size_t len,
                       const struct timeval &tv, const size_t cap_len) {
-    // If cap_len == 0, actual captured length is same with real packet length
-    size_t c_len = (cap_len == 0) ? len : cap_len;
-
+    uint64_t ts_ns = static_cast<uint64_t>(tv.tv_sec) * 1000000000 +
+      static_cast<uint64_t>(tv.tv_usec) * 1000;
+    return this->input(data, len, ts_ns, cap_len);
+  }
+  Property *NetDec::begin_packet (const size_t len, const uint64_t ts_ns,
+                                  const size_t cap_len) {
     // update stat information
-    if (this->init_ts_.tv_sec == 0) {
-      this->init_ts_.tv_sec = tv.tv_sec;
-      this->init_ts_.tv_nsec = tv.tv_usec * 1000;
+    if (this->prop_ == NULL) {
+      this->init_ts_ = ts_ns;
       this->prop_ = new Property (this);
     }
 
-    // main process of NetDec
-    Property * prop = this->prop_;
+    // fire timers due by this packet time before the packet is counted,
+    // so a periodic task sees exactly the packets of its own interval
+    this->timer_->ticktock (ts_ns);
 
+    this->prof_now_ =
+      (this->profile_ && (this->recv_pkt_ % PROF_INTERVAL) == 0);
     this->recv_pkt_ += 1;
     this->recv_len_ += len;
-    this->cap_len_ += c_len;
-    this->last_ts_.tv_sec = tv.tv_sec;
-    this->last_ts_.tv_nsec = tv.tv_usec * 1000;
+    this->cap_len_ += cap_len;
+    this->last_ts_ = ts_ns;
+    return this->prop_;
+  }
+
+  bool NetDec::input (const byte_t *data, const size_t len,
+                      const uint64_t ts_ns, const size_t cap_len) {
+    // If cap_len == 0, actual captured length is same with real packet length
+    size_t c_len = (cap_len == 0) ? len : cap_len;
+
+    // quiescent point for swap requested by other threads
+    if (__atomic_load_n (&(this->swap_req_count_), __ATOMIC_ACQUIRE) > 0) {
+      this->handle_swap_req ();
+    }
+
+    // main process of NetDec
+    Property * prop = this->begin_packet (len, ts_ns, c_len);
+
+    if (this->filter_ && !this->filter_->match (data, len, c_len)) {
+      return true;
+    }
+    if (this->sampler_ && !this->sampler_->match (data, c_len)) {
+      return true;
+    }
 
     // Initialize property with packet data
     // NOTE: memory of data must be secured in this function because of
     //       zero-copy impolementation.
-    prop->init (data, c_len, len, tv);
+    prop->init (data, c_len, len, ts_ns);
+    if (this->sampler_) {
+      prop->set_sample_rate (this->sampler_->rate ());
+    }
 
     // emit to decoder
+    this->in_packet_ = true;
     this->decode (this->dec_default_, prop);
 
     // calculate hash value of 5 tuple
     prop->calc_hash ();
 
+    if (this->recorder_) {
+      this->recorder_->record (*prop);
+    }
+
+    this->dispatch (prop);
+    this->in_packet_ = false;
+    if (!this->swap_ready_.empty ()) {
+      this->commit_swap ();
+    }
+    return true;
+  }
+
+  void NetDec::dispatch (Property *prop) {
     // execute callback function of handler
     ev_id eid;
     while (EV_NULL != (eid = prop->pop_event ())) {
@@ -192,16 +333,54 @@ namespace swarm {
       auto hdlr_list = this->event_handler_[eid];
       if (hdlr_list) {
         for (auto it = hdlr_list->begin (); it != hdlr_list->end (); it++) {
-          Handler * hdlr = (*it)->hdlr ();
-          assert (hdlr != NULL);
-          hdlr->recv (eid, *prop);
+          assert ((*it)->hdlr () != NULL);
+          this->call_handler (*it, eid, *prop);
+        }
+      }
+
+      // glob subscriptions, one bit test per entry
+      for (size_t i = 0; i < this->pattern_handler_.size (); i++) {
+        HandlerEntry * ent = this->pattern_handler_[i];
+        if (ent->has_event (eid)) {
+          this->call_handler (ent, eid, *prop);
         }
       }
     }
+  }
 
-    // handle timer
-    // this->timer_->ticktock (tv);
+  void NetDec::call_handler (HandlerEntry *ent, ev_id eid,
+                             const Property &prop) {
+    if (!this->prof_now_) {
+      ent->count (0, false);
+      ent->hdlr ()->recv (eid, prop);
+      return;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    ent->hdlr ()->recv (eid, prop);
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    ent->count (static_cast<uint64_t>(t1.tv_sec - t0.tv_sec) * 1000000000 +
+                t1.tv_nsec - t0.tv_nsec, true);
+  }
 
+  void NetDec::set_recorder (DecodeRecorder *rec) {
+    this->recorder_ = rec;
+  }
+
+  bool NetDec::replay (DecodeRestorer *rst, const byte_t *data,
+                       const size_t len, const uint64_t ts_ns,
+                       const size_t cap_len) {
+    Property * prop = this->begin_packet (len, ts_ns, cap_len);
+    prop->init (data, (data) ? cap_len : 0, len, ts_ns);
+    rst->restore (prop);
+    prop->calc_hash ();
+    this->in_packet_ = true;
+    this->dispatch (prop);
+    this->in_packet_ = false;
+    if (!this->swap_ready_.empty ()) {
+      this->commit_swap ();
+    }
     return true;
   }
 
@@ -260,6 +439,9 @@ namespace swarm {
     dec_id d_id = this->install_dec_mod (dec_name, dec);
     if (d_id != DEC_NULL) {
       dec->setup (this);
+      if (this->prop_) {
+        this->prop_->extend_values ();
+      }
     }
     return d_id;
   }
@@ -303,6 +485,283 @@ namespace swarm {
     return true;
   }
 
+  PortMap *NetDec::port_map (const std::string &tgt_dec_name) {
+    auto it = this->fwd_dec_.find (tgt_dec_name);
+    if (it == this->fwd_dec_.end ()) {
+      this->errmsg_ = "no such decoder name: " + tgt_dec_name;
+      return NULL;
+    }
+
+    dec_id tgt_id = it->second;
+    assert (tgt_id < static_cast<dec_id> (this->port_map_.size ()));
+    if (this->port_map_[tgt_id] == NULL) {
+      this->port_map_[tgt_id] = new PortMap ();
+    }
+    return this->port_map_[tgt_id];
+  }
+  bool NetDec::bind_port (dec_id d_id, const std::string &tgt_dec_name,
+                          uint16_t port) {
+    if (d_id < 0 || static_cast<size_t>(d_id) >= this->dec_mod_.size () ||
+        this->dec_mod_[d_id] == NULL) {
+      this->errmsg_ = "no such decoder";
+      return false;
+    }
+    PortMap *pm = this->port_map (tgt_dec_name);
+    if (pm == NULL) {
+      return false;
+    }
+    if (pm->port (port) != DEC_NULL) {
+      this->errmsg_ = "already bound port";
+      return false;
+    }
+
+    pm->set_port (port, d_id);
+    return true;
+  }
+  bool NetDec::unbind_port (dec_id d_id, const std::string &tgt_dec_name,
+                            uint16_t port) {
+    PortMap *pm = this->port_map (tgt_dec_name);
+    if (pm == NULL) {
+      return false;
+    }
+    if (pm->port (port) != d_id) {
+      this->errmsg_ = "no available bind";
+      return false;
+    }
+
+    pm->set_port (port, DEC_NULL);
+    return true;
+  }
+  bool NetDec::bind_signature (dec_id d_id, const std::string &tgt_dec_name) {
+    if (d_id < 0 || static_cast<size_t>(d_id) >= this->dec_mod_.size () ||
+        this->dec_mod_[d_id] == NULL) {
+      this->errmsg_ = "no such decoder";
+      return false;
+    }
+    PortMap *pm = this->port_map (tgt_dec_name);
+    if (pm == NULL) {
+      return false;
+    }
+    std::vector <dec_id> *sig = pm->sig ();
+    if (std::find (sig->begin (), sig->end (), d_id) != sig->end ()) {
+      this->errmsg_ = "already bound decoder";
+      return false;
+    }
+
+    sig->push_back (d_id);
+    return true;
+  }
+  bool NetDec::unbind_signature (dec_id d_id,
+                                 const std::string &tgt_dec_name) {
+    PortMap *pm = this->port_map (tgt_dec_name);
+    if (pm == NULL) {
+      return false;
+    }
+    std::vector <dec_id> *sig = pm->sig ();
+    auto it = std::find (sig->begin (), sig->end (), d_id);
+    if (it == sig->end ()) {
+      this->errmsg_ = "no available bind";
+      return false;
+    }
+
+    sig->erase (it);
+    return true;
+  }
+  dec_id NetDec::lookup_port (const std::string &tgt_dec_name,
+                              uint16_t port) {
+    auto it = this->fwd_dec_.find (tgt_dec_name);
+    if (it == this->fwd_dec_.end () || this->port_map_[it->second] == NULL) {
+      return DEC_NULL;
+    }
+    return this->port_map_[it->second]->port (port);
+  }
+  dec_id NetDec::match_signature (const PortMap *pm, const Property &p) {
+    const std::vector <dec_id> &sig = pm->sig ();
+    for (size_t i = 0; i < sig.size (); i++) {
+      Decoder *dec = this->dec_mod_[sig[i]];
+      if (dec && dec->accept (p)) {
+        return sig[i];
+      }
+    }
+    return DEC_NULL;
+  }
+
+  const PluginInfo *NetDec::open_plugin (const std::string &path) {
+    void *handle = ::dlopen (path.c_str (), RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+      this->errmsg_ = ::dlerror ();
+      return NULL;
+    }
+
+    auto info = static_cast<const PluginInfo *>
+      (::dlsym (handle, "swarm_plugin_info"));
+    if (info == NULL) {
+      this->errmsg_ = "not a swarm plugin: " + path;
+    } else if (info->abi_version_ != PLUGIN_ABI_VERSION) {
+      this->errmsg_ = "plugin ABI version mismatch: " + path;
+    } else if (info->name_ == NULL || info->New == NULL) {
+      this->errmsg_ = "broken plugin info: " + path;
+    } else {
+      this->plugin_handle_.push_back (handle);
+      return info;
+    }
+
+    ::dlclose (handle);
+    return NULL;
+  }
+  dec_id NetDec::load_plugin (const std::string &path) {
+    const PluginInfo *info = this->open_plugin (path);
+    if (info == NULL) {
+      return DEC_NULL;
+    }
+
+    Decoder *dec = info->New (this);
+    dec_id d_id = this->load_decoder (info->name_, dec);
+    if (d_id == DEC_NULL) {
+      delete dec;
+    }
+    return d_id;
+  }
+  bool NetDec::swap_plugin (const std::string &path) {
+    const PluginInfo *info = this->open_plugin (path);
+    if (info == NULL) {
+      return false;
+    }
+    return this->swap_decoder (info->name_, info->New);
+  }
+  bool NetDec::swap_decoder (const std::string &dec_name,
+                             Decoder * (*New) (NetDec * nd)) {
+    dec_id d_id = this->lookup_dec_id (dec_name);
+    if (d_id == DEC_NULL || this->dec_mod_[d_id] == NULL) {
+      this->errmsg_ = "no such decoder name: " + dec_name;
+      return false;
+    }
+
+    SwapEntry ent;
+    ent.d_id_ = d_id;
+    this->reassign_ = true;
+    ent.dec_ = New (this);
+    this->reassign_ = false;
+    this->swap_ready_.push_back (ent);
+
+    if (!this->in_packet_) {
+      this->commit_swap ();
+    }
+    return true;
+  }
+  void NetDec::commit_swap () {
+    for (size_t i = 0; i < this->swap_ready_.size (); i++) {
+      const SwapEntry &ent = this->swap_ready_[i];
+      Decoder *old = this->dec_mod_[ent.d_id_];
+      if (old == NULL) {
+        delete ent.dec_;  // unloaded before commit
+        continue;
+      }
+
+      ent.dec_->setup (this);
+      ent.dec_->migrate (old);
+      this->dec_mod_[ent.d_id_] = ent.dec_;
+      delete old;
+      this->swap_count_++;
+    }
+    this->swap_ready_.clear ();
+    if (this->prop_) {
+      this->prop_->extend_values ();
+    }
+  }
+  void NetDec::request_swap (const std::string &path) {
+    ::pthread_mutex_lock (&(this->swap_mutex_));
+    this->swap_req_.push_back (path);
+    __atomic_store_n (&(this->swap_req_count_),
+                      static_cast<int> (this->swap_req_.size ()),
+                      __ATOMIC_RELEASE);
+    ::pthread_mutex_unlock (&(this->swap_mutex_));
+  }
+  void NetDec::handle_swap_req () {
+    std::vector <std::string> req;
+    ::pthread_mutex_lock (&(this->swap_mutex_));
+    req.swap (this->swap_req_);
+    __atomic_store_n (&(this->swap_req_count_), 0, __ATOMIC_RELEASE);
+    ::pthread_mutex_unlock (&(this->swap_mutex_));
+
+    for (size_t i = 0; i < req.size (); i++) {
+      if (!this->swap_plugin (req[i])) {
+        debug (1, "swap failed: %s", this->errmsg_.c_str ());
+      }
+    }
+  }
+
+  bool NetDec::set_shed (dec_id d_id, bool shed) {
+    if (d_id < 0 || static_cast<size_t>(d_id) >= this->dec_mod_.size () ||
+        this->dec_mod_[d_id] == NULL) {
+      this->errmsg_ = "no such decoder";
+      return false;
+    }
+
+    if (this->dec_shed_[d_id] != shed) {
+      this->dec_shed_[d_id] = shed;
+      if (shed) {
+        this->shed_count_++;
+      } else {
+        this->shed_count_--;
+      }
+    }
+    return true;
+  }
+  bool NetDec::is_shed (dec_id d_id) const {
+    return (d_id >= 0 && static_cast<size_t>(d_id) < this->dec_shed_.size () &&
+            this->dec_shed_[d_id]);
+  }
+  size_t NetDec::shed_count () const {
+    return this->shed_count_;
+  }
+  void NetDec::set_profile (bool enable) {
+    this->profile_ = enable;
+  }
+  double NetDec::decoder_cost (dec_id d_id) const {
+    if (d_id < 0 || static_cast<size_t>(d_id) >= this->dec_calls_.size () ||
+        this->dec_calls_[d_id] == 0) {
+      return 0;
+    }
+    return static_cast<double>(this->dec_cost_ns_[d_id]) /
+      static_cast<double>(this->dec_calls_[d_id]);
+  }
+  uint64_t NetDec::decoder_count (dec_id d_id) const {
+    if (d_id < 0 || static_cast<size_t>(d_id) >= this->dec_count_.size ()) {
+      return 0;
+    }
+    return this->dec_count_[d_id];
+  }
+  size_t NetDec::session_count (dec_id d_id) const {
+    if (d_id < 0 || static_cast<size_t>(d_id) >= this->dec_mod_.size () ||
+        this->dec_mod_[d_id] == NULL) {
+      return 0;
+    }
+    return this->dec_mod_[d_id]->session_count ();
+  }
+  std::string NetDec::lookup_dec_name (dec_id d_id) const {
+    auto it = this->rev_dec_.find (d_id);
+    return (it != this->rev_dec_.end ()) ? it->second : this->none_;
+  }
+  void NetDec::handler_stat (std::vector <HandlerStat> *st) const {
+    st->clear ();
+    for (auto it = this->rev_hdlr_.begin ();
+         it != this->rev_hdlr_.end (); it++) {
+      const HandlerEntry *ent = it->second;
+      HandlerStat hs;
+      hs.id_ = ent->id ();
+      if (ent->ev () == EV_NULL) {
+        hs.ev_ = ent->pattern ();
+      } else {
+        auto e_it = this->rev_event_.find (ent->ev ());
+        hs.ev_ = (e_it != this->rev_event_.end ()) ? e_it->second : "";
+      }
+      hs.calls_ = ent->calls ();
+      hs.cost_ns_ = ent->cost ();
+      st->push_back (hs);
+    }
+  }
+
 
   // -------------------------------------------------------------------------------
   // NetDec Handler
@@ -323,6 +782,22 @@ namespace swarm {
   }
 
   hdlr_id NetDec::set_handler (const std::string ev_name, Handler * hdlr) {
+    if (ev_name.find_first_of ("*?[") != std::string::npos) {
+      // glob pattern: accepted even if no event matches yet, events of
+      // decoders loaded later are added in assign_event ()
+      hdlr_id hid = this->base_hid_++;
+      HandlerEntry * ent = new HandlerEntry (hid, ev_name, hdlr);
+      for (auto it = this->fwd_event_.begin ();
+           it != this->fwd_event_.end (); it++) {
+        if (ent->match (it->first)) {
+          ent->add_event (it->second);
+        }
+      }
+      this->pattern_handler_.push_back (ent);
+      this->rev_hdlr_.insert (std::make_pair (hid, ent));
+      return hid;
+    }
+
     auto it = this->fwd_event_.find (ev_name);
     if (it == this->fwd_event_.end ()) {
       return HDLR_NULL;
@@ -338,12 +813,17 @@ namespace swarm {
     } else {
       HandlerEntry * ent = it->second;
       this->rev_hdlr_.erase (it);
-      size_t idx = NetDec::eid2idx (ent->ev ());
-      auto dq = this->event_handler_[idx];
-      for (auto dit = dq->begin (); dit != dq->end (); dit++) {
-        if ((*dit)->id () == ent->id ()) {
-          dq->erase (dit);
-          break;
+      if (ent->ev () == EV_NULL) {
+        auto &pv = this->pattern_handler_;
+        pv.erase (std::find (pv.begin (), pv.end (), ent));
+      } else {
+        size_t idx = NetDec::eid2idx (ent->ev ());
+        auto dq = this->event_handler_[idx];
+        for (auto dit = dq->begin (); dit != dq->end (); dit++) {
+          if ((*dit)->id () == ent->id ()) {
+            dq->erase (dit);
+            break;
+          }
         }
       }
       Handler * hdlr = ent->hdlr ();
@@ -352,6 +832,201 @@ namespace swarm {
     }
   }
 
+  // -------------------------------------------------------------------------------
+  // NetDec Filter
+  //
+  bool NetDec::set_filter (const std::string &expr) {
+    if (expr.empty ()) {
+      delete this->filter_;
+      this->filter_ = NULL;
+      this->filter_expr_.clear ();
+      return true;
+    }
+
+    if (this->linktype_ < 0) {
+      this->errmsg_ = "no link type for default decoder";
+      return false;
+    }
+
+    BpfFilter *filter = new BpfFilter ();
+    if (!filter->compile (expr, this->linktype_)) {
+      this->errmsg_ = filter->errmsg ();
+      delete filter;
+      return false;
+    }
+
+    delete this->filter_;
+    this->filter_ = filter;
+    this->filter_expr_ = expr;
+    return true;
+  }
+  bool NetDec::set_filter (const struct bpf_insn *insns, size_t len) {
+    BpfFilter *filter = new BpfFilter ();
+    if (!filter->load (insns, len)) {
+      this->errmsg_ = filter->errmsg ();
+      delete filter;
+      return false;
+    }
+
+    delete this->filter_;
+    this->filter_ = filter;
+    this->filter_expr_.clear ();
+    return true;
+  }
+  uint64_t NetDec::filter_accept () const {
+    return (this->filter_) ? this->filter_->accept () : 0;
+  }
+  uint64_t NetDec::filter_reject () const {
+    return (this->filter_) ? this->filter_->reject () : 0;
+  }
+
+  // -------------------------------------------------------------------------------
+  // NetDec Sampling
+  //
+  bool NetDec::set_sampling (SampleMode mode, uint32_t rate) {
+    if (mode != SAMPLE_NONE && mode != SAMPLE_PACKET && mode != SAMPLE_FLOW) {
+      this->errmsg_ = "invalid sampling mode";
+      return false;
+    }
+    if (mode != SAMPLE_NONE && rate == 0) {
+      this->errmsg_ = "sampling rate must be 1 or more";
+      return false;
+    }
+
+    if (mode == SAMPLE_NONE || rate == 1) {
+      delete this->sampler_;
+      this->sampler_ = NULL;
+    } else if (this->sampler_) {
+      this->sampler_->set (mode, rate);
+    } else {
+      this->sampler_ = new Sampler (mode, rate, this->linktype_);
+    }
+    return true;
+  }
+  uint32_t NetDec::sample_rate () const {
+    return (this->sampler_) ? this->sampler_->rate () : 1;
+  }
+  uint64_t NetDec::sample_drop () const {
+    return (this->sampler_) ? this->sampler_->drop () : 0;
+  }
+
+  // -------------------------------------------------------------------------------
+  // NetDec Flow hash
+  //
+  bool NetDec::set_flow_hash (FlowHash *fh) {
+    if (fh && !fh->symmetric ()) {
+      this->errmsg_ = std::string (fh->name ()) + " is not symmetric";
+      return false;
+    }
+    this->flow_hash_ = fh;
+    return true;
+  }
+
+  // -------------------------------------------------------------------------------
+  // NetDec Checkpoint
+  //
+  struct NetDecCheckpoint {
+    static const uint32_t VERSION = 1;
+    char flow_hash_[32];
+  };
+
+  bool NetDec::save_checkpoint (const std::string &path) {
+    CheckpointWriter w;
+    if (!w.open (path) || !this->save_checkpoint (&w) || !w.close ()) {
+      if (this->errmsg_.empty ()) {
+        this->errmsg_ = w.errmsg ();
+      }
+      return false;
+    }
+    return true;
+  }
+  bool NetDec::save_checkpoint (CheckpointWriter *w) {
+    this->errmsg_.clear ();
+    NetDecCheckpoint rec;
+    ::memset (&rec, 0, sizeof (rec));
+    ::strncpy (rec.flow_hash_,
+               (this->flow_hash_) ? this->flow_hash_->name () : "default",
+               sizeof (rec.flow_hash_) - 1);
+    if (!w->begin ("netdec", NetDecCheckpoint::VERSION, sizeof (rec)) ||
+        !w->append (&rec)) {
+      this->errmsg_ = w->errmsg ();
+      return false;
+    }
+
+    for (size_t i = 0; i < this->dec_mod_.size (); i++) {
+      const Decoder *dec = this->dec_mod_[i];
+      if (dec && !dec->checkpoint (w)) {
+        this->errmsg_ = "checkpoint failed: " +
+          this->lookup_dec_name (static_cast<dec_id> (i)) + ": " +
+          w->errmsg ();
+        return false;
+      }
+    }
+    return true;
+  }
+  bool NetDec::load_checkpoint (const std::string &path) {
+    CheckpointReader r;
+    if (!r.open (path)) {
+      this->errmsg_ = r.errmsg ();
+      return false;
+    }
+    return this->load_checkpoint (r);
+  }
+  bool NetDec::load_checkpoint (const CheckpointReader &r) {
+    size_t count;
+    const NetDecCheckpoint *rec = static_cast<const NetDecCheckpoint *>
+      (r.section ("netdec", NetDecCheckpoint::VERSION, sizeof (*rec), &count));
+    if (rec == NULL || count != 1) {
+      this->errmsg_ = "no netdec section in checkpoint";
+      return false;
+    }
+    const char *fh = (this->flow_hash_) ? this->flow_hash_->name () : "default";
+    if (::strncmp (rec->flow_hash_, fh, sizeof (rec->flow_hash_)) != 0) {
+      this->errmsg_ = "checkpoint of another flow hash: " +
+        std::string (rec->flow_hash_, ::strnlen (rec->flow_hash_,
+                                                 sizeof (rec->flow_hash_)));
+      return false;
+    }
+
+    for (size_t i = 0; i < this->dec_mod_.size (); i++) {
+      Decoder *dec = this->dec_mod_[i];
+      if (dec && !dec->restore (r)) {
+        this->errmsg_ = "restore failed: " +
+          this->lookup_dec_name (static_cast<dec_id> (i));
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // -------------------------------------------------------------------------------
+  // NetDec Timer
+  //
+  task_id NetDec::set_onetime_timer (Task *task, int delay_msec) {
+    if (task == NULL || delay_msec < 0) {
+      this->errmsg_ = "invalid task or delay";
+      return TASK_NULL;
+    }
+    return this->timer_->add (task, delay_msec, 0);
+  }
+  task_id NetDec::set_repeat_timer (Task *task, int interval_msec) {
+    if (task == NULL || interval_msec <= 0) {
+      this->errmsg_ = "invalid task or interval";
+      return TASK_NULL;
+    }
+    return this->timer_->add (task, interval_msec, interval_msec);
+  }
+  bool NetDec::unset_timer (task_id id) {
+    if (!this->timer_->remove (id)) {
+      this->errmsg_ = "no such timer";
+      return false;
+    }
+    return true;
+  }
+
+  // -------------------------------------------------------------------------------
+  // NetDec Stat
+  //
   uint64_t NetDec::recv_len () const {
     return this->recv_len_;
   }
@@ -362,18 +1037,26 @@ namespace swarm {
     return this->recv_pkt_;
   }
   void NetDec::init_ts (struct timespec *ts) const {
-    memcpy (ts, &(this->init_ts_), sizeof (struct timespec));
+    ts->tv_sec  = this->init_ts_ / 1000000000;
+    ts->tv_nsec = this->init_ts_ % 1000000000;
   }
   void NetDec::last_ts (struct timespec *ts) const {
-    memcpy (ts, &(this->init_ts_), sizeof (struct timespec));
+    ts->tv_sec  = this->last_ts_ / 1000000000;
+    ts->tv_nsec = this->last_ts_ % 1000000000;
   }
   double NetDec::init_ts () const {
-    return static_cast<double> (this->init_ts_.tv_sec) +
-      static_cast<double> (this->init_ts_.tv_nsec) / (1000 * 1000 * 1000);
+    return static_cast<double> (this->init_ts_ / 1000000000) +
+      static_cast<double> (this->init_ts_ % 1000000000) / (1000 * 1000 * 1000);
   }
   double NetDec::last_ts () const {
-    return static_cast<double> (this->last_ts_.tv_sec) +
-      static_cast<double> (this->last_ts_.tv_nsec) / (1000 * 1000 * 1000);
+    return static_cast<double> (this->last_ts_ / 1000000000) +
+      static_cast<double> (this->last_ts_ % 1000000000) / (1000 * 1000 * 1000);
+  }
+  uint64_t NetDec::init_ts_ns () const {
+    return this->init_ts_;
+  }
+  uint64_t NetDec::last_ts_ns () const {
+    return this->last_ts_;
   }
 
 
@@ -385,8 +1068,9 @@ namespace swarm {
 
   ev_id NetDec::assign_event (const std::string &name,
                               const std::string &desc) {
-    if (this->fwd_event_.end () != this->fwd_event_.find (name)) {
-      return EV_NULL;
+    auto it = this->fwd_event_.find (name);
+    if (this->fwd_event_.end () != it) {
+      return (this->reassign_) ? it->second : EV_NULL;
     } else {
       const ev_id eid = this->base_eid_;
       this->fwd_event_.insert (std::make_pair (name, eid));
@@ -398,13 +1082,24 @@ namespace swarm {
       }
       this->event_handler_[idx] = new std::deque <HandlerEntry *> ();
 
+      for (size_t i = 0; i < this->pattern_handler_.size (); i++) {
+        if (this->pattern_handler_[i]->match (name)) {
+          this->pattern_handler_[i]->add_event (eid);
+        }
+      }
+
       this->base_eid_++;
       return eid;
     }
   }
   val_id NetDec::assign_value (const std::string &name,
                                  const std::string &desc, ValueFactory * fac) {
-    if (this->fwd_value_.end () != this->fwd_value_.find (name)) {
+    auto it = this->fwd_value_.find (name);
+    if (this->fwd_value_.end () != it) {
+      if (this->reassign_) {
+        delete fac;  // Property keeps value sets of the first factory
+        return it->second->vid ();
+      }
       return VALUE_NULL;
     } else {
       const val_id vid = this->base_vid_;
@@ -417,17 +1112,61 @@ namespace swarm {
     }
   }
 
+  Value *NetDec::new_value (val_id vid) const {
+    auto it = this->rev_value_.find (vid);
+    if (it == this->rev_value_.end ()) {
+      return NULL;
+    }
+    ValueFactory *fac = it->second->fac ();
+    return (fac) ? fac->New () : new Value ();
+  }
+
+  bool NetDec::run_decoder (dec_id dec, Property *p) {
+    Decoder * mod = this->dec_mod_[dec];
+    this->dec_count_[dec]++;
+    if (!this->prof_now_) {
+      if (this->dec_shed_[dec]) {
+        p->add_shed (dec);
+        return mod->decode_shed (p);
+      }
+      return mod->decode (p);
+    }
+
+    struct timespec t0, t1;
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    uint64_t saved = this->prof_child_ns_;
+    this->prof_child_ns_ = 0;
+
+    bool rc;
+    if (this->dec_shed_[dec]) {
+      p->add_shed (dec);
+      rc = mod->decode_shed (p);
+    } else {
+      rc = mod->decode (p);
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    uint64_t el = static_cast<uint64_t>(t1.tv_sec - t0.tv_sec) * 1000000000 +
+      t1.tv_nsec - t0.tv_nsec;
+    if (el > this->prof_child_ns_) {
+      this->dec_cost_ns_[dec] += el - this->prof_child_ns_;
+    }
+    this->dec_calls_[dec]++;
+    this->prof_child_ns_ = saved + el;
+    return rc;
+  }
+
   void NetDec::decode (dec_id dec, Property *p) {
     assert (0 <= dec && dec < static_cast<dec_id>(this->dec_mod_.size ()));
     if (this->dec_mod_[dec]) {
-      bool rc = this->dec_mod_[dec]->decode (p);
+      bool rc = this->run_decoder (dec, p);
 
       if (rc && this->dec_bind_[dec].size () > 0) {
         for (auto it = this->dec_bind_[dec].begin ();
              it != this->dec_bind_[dec].end (); it++) {
           Decoder * dec = this->dec_mod_[it->first];
           if (dec && dec->accept (*p)) {
-            dec->decode (p);
+            this->run_decoder (it->first, p);
           }
         }
       }
@@ -443,7 +1182,9 @@ namespace swarm {
       debug (0, "name: %s, %s", ent->name().c_str (), ent->desc().c_str ());
       size_t idx = Property::vid2idx (ent->vid ());
       assert (idx < val_vec_->size ());
-      (*val_vec_)[idx] = new ValueSet (ent->fac ());
+      if ((*val_vec_)[idx] == NULL) {
+        (*val_vec_)[idx] = new ValueSet (ent->fac ());
+      }
     }
   }
 }  // namespace swarm
@@ -27,12 +27,15 @@
 #ifndef SRC_NETDEC_H__
 #define SRC_NETDEC_H__
 
+#include <pthread.h>
 #include <map>
 #include <vector>
 #include <deque>
 #include <string>
 #include "./common.h"
 
+struct bpf_insn;  // pcap.h
+
 namespace swarm {
   class Handler {
   public:
@@ -41,18 +44,97 @@ namespace swarm {
     virtual void recv (ev_id eid, const Property &p) = 0;
   };
 
+  // ----------------------------------------------------------------
+  // DecodeRecorder receives every decoded packet before handlers, and
+  // DecodeRestorer fills values and events of a packet instead of
+  // decoders, see NetDec::replay() and utils/decode-log.h
+  //
+  class DecodeRecorder {
+  public:
+    virtual ~DecodeRecorder () {}
+    virtual void record (const Property &prop) = 0;
+  };
+  class DecodeRestorer {
+  public:
+    virtual ~DecodeRestorer () {}
+    virtual void restore (Property *prop) = 0;
+  };
+
   class HandlerEntry {
   private:
     hdlr_id id_;
     ev_id ev_;
     Handler * hdlr_;
 
+    // for glob subscription ("dns.*", "*.packet"), ev_ is EV_NULL and
+    // matched event IDs are kept as bitset
+    std::string pattern_;
+    std::vector <uint64_t> ev_set_;
+
+    // counted by NetDec::dispatch (), cost only on profiled packets
+    uint64_t calls_;
+    uint64_t prof_calls_;
+    uint64_t cost_ns_;
+
   public:
     HandlerEntry (hdlr_id hid, ev_id eid, Handler * hdlr_);
+    HandlerEntry (hdlr_id hid, const std::string &pattern, Handler * hdlr_);
     ~HandlerEntry ();
     Handler * hdlr () const;
     hdlr_id id () const;
     ev_id ev () const;
+    const std::string &pattern () const;
+    bool match (const std::string &ev_name) const;
+    void add_event (ev_id eid);
+    inline void count (uint64_t prof_ns, bool prof) {
+      this->calls_++;
+      if (prof) {
+        this->prof_calls_++;
+        this->cost_ns_ += prof_ns;
+      }
+    }
+    uint64_t calls () const { return this->calls_; }
+    double cost () const {  // nsec per call
+      return (this->prof_calls_ > 0) ?
+        static_cast<double> (this->cost_ns_) / this->prof_calls_ : 0;
+    }
+    inline bool has_event (ev_id eid) const {
+      const size_t i = static_cast<size_t> (eid) / 64;
+      return (i < this->ev_set_.size () &&
+              (this->ev_set_[i] & (1ULL << (eid % 64))) != 0);
+    }
+  };
+
+  // ----------------------------------------------------------------
+  // PortMap is a port to decoder table of one transport decoder ("udp",
+  // "tcp"), filled by NetDec::bind_port(). Lookup is one array index per
+  // port, and the lower bound port of the pair wins as a well known port
+  // usually is lower than an ephemeral one. Decoders bound by
+  // NetDec::bind_signature() are asked by Decoder::accept() in bound
+  // order when neither port is bound.
+  //
+  class PortMap {
+  private:
+    dec_id port_[0x10000];
+    std::vector <dec_id> sig_;
+
+  public:
+    PortMap ();
+    inline dec_id lookup (uint16_t src_port, uint16_t dst_port) const {
+      return (src_port < dst_port) ?
+        (this->port_[src_port] != DEC_NULL ?
+         this->port_[src_port] : this->port_[dst_port]) :
+        (this->port_[dst_port] != DEC_NULL ?
+         this->port_[dst_port] : this->port_[src_port]);
+    }
+    inline dec_id port (uint16_t port) const { return this->port_[port]; }
+    inline void set_port (uint16_t port, dec_id d_id) {
+      this->port_[port] = d_id;
+    }
+    std::vector <dec_id> *sig () { return &(this->sig_); }
+    const std::vector <dec_id> &sig () const { return this->sig_; }
+    bool has_sig () const { return !this->sig_.empty (); }
+    void remove (dec_id d_id);
   };
 
   class NetDec {
@@ -74,19 +156,66 @@ namespace swarm {
     const std::string none_;
     std::vector <Decoder *> dec_mod_;
     std::vector <std::map<dec_id, dec_id> > dec_bind_;
+    std::vector <bool> dec_shed_;
+    std::vector <PortMap *> port_map_;  // index is dec_id of transport
+
+    // Decoder cost profiling, every PROF_INTERVAL packets
+    static const uint64_t PROF_INTERVAL = 64;
+    bool profile_;
+    bool prof_now_;
+    uint64_t prof_child_ns_;
+    std::vector <uint64_t> dec_cost_ns_;
+    std::vector <uint64_t> dec_calls_;
+    std::vector <uint64_t> dec_count_;  // all calls, not only profiled
+    size_t shed_count_;
     dec_id install_dec_mod (const std::string &name, Decoder *dec);
     Decoder* uninstall_dec_mod (dec_id d_id);
 
+    // Plugin and hot swap. A swap is committed only between packets;
+    // in_packet_ defers one requested while decoding or in a handler.
+    struct SwapEntry {
+      dec_id d_id_;
+      Decoder *dec_;
+    };
+    std::vector <void *> plugin_handle_;
+    std::vector <SwapEntry> swap_ready_;   // built, waiting for commit
+    std::vector <std::string> swap_req_;   // by request_swap (), locked
+    pthread_mutex_t swap_mutex_;
+    int swap_req_count_;                   // atomic, size of swap_req_
+    bool in_packet_;
+    bool reassign_;  // assign_* returns existing ID while building a swap
+    uint64_t swap_count_;
+    const PluginInfo *open_plugin (const std::string &path);
+    void commit_swap ();
+    void handle_swap_req ();
+
     std::vector <std::deque <HandlerEntry *> * > event_handler_;
+    std::vector <HandlerEntry *> pattern_handler_;
     dec_id dec_default_;
     Property * prop_;
+    TimerWheel * timer_;
+    BpfFilter * filter_;
+    std::string filter_expr_;
+    Sampler * sampler_;
+    DecodeRecorder * recorder_;
+    FlowHash * flow_hash_;
+    bool chksum_;
+    uint64_t chksum_pass_;
+    uint64_t chksum_fail_;
+    int linktype_;  // pcap DLT of dec_default_, -1 if unknown
 
     // now can count by 16 Exa byte/packet
     uint64_t recv_len_;
     uint64_t cap_len_;
     uint64_t recv_pkt_;
-    struct timespec init_ts_;
-    struct timespec last_ts_;
+    uint64_t init_ts_;  // nano second since epoch
+    uint64_t last_ts_;
+
+    inline Property *begin_packet (const size_t len, const uint64_t ts_ns,
+                                   const size_t cap_len);
+    void dispatch (Property *prop);
+    inline void call_handler (HandlerEntry *ent, ev_id eid,
+                              const Property &prop);
 
     inline static size_t eid2idx (const ev_id eid) {
       return static_cast <size_t> (eid - EV_BASE);
@@ -99,8 +228,20 @@ namespace swarm {
     ~NetDec ();
 
     bool set_default_decoder (const std::string &dec);
+    // pcap DLT of the default decoder, -1 if unknown
+    int linktype () const { return this->linktype_; }
     bool input (const byte_t *data, const size_t len,
                 const struct timeval &tv, const size_t cap_len = 0);
+    // ts_ns is nano second since epoch; no conversion on the way to Property
+    bool input (const byte_t *data, const size_t len,
+                const uint64_t ts_ns, const size_t cap_len = 0);
+
+    // Record and replay of decode result. A replayed packet skips filter,
+    // sampling and decoders; restorer sets values and events, and
+    // handlers and timers run as for input(). data may be NULL.
+    void set_recorder (DecodeRecorder *rec);
+    bool replay (DecodeRestorer *rst, const byte_t *data, const size_t len,
+                 const uint64_t ts_ns, const size_t cap_len);
 
     // Event
     ev_id lookup_event_id (const std::string &name);
@@ -111,6 +252,9 @@ namespace swarm {
     val_id lookup_value_id (const std::string &name);
     std::string lookup_value_name (val_id pid);
     size_t value_size () const;
+    // Value made by the factory of vid, to print raw bytes kept out of
+    // Property by repr(). Caller deletes it; NULL if no such value.
+    Value *new_value (val_id vid) const;
 
     // Decoder
     dec_id lookup_dec_id (const std::string &name);
@@ -120,13 +264,118 @@ namespace swarm {
     bool unload_decoder (dec_id d_id);
     bool bind_decoder (dec_id d_id, const std::string &tgt_dec_name);
     bool unbind_decoder (dec_id d_id, const std::string &tgt_dec_name);
+    // Port dispatch: tgt_dec_name is a transport decoder ("udp", "tcp")
+    // and port is in host byte order. A TCP segment always goes to
+    // tcp_ssn, and then to the decoder bound for it. When both ports
+    // are bound, the lower one wins. A port has at most one decoder, so
+    // unbind the old one first to take over a port. bind_signature() is
+    // for a protocol on non-standard ports; its Decoder::accept() sees
+    // the transport payload by Property::peek() when no port matched.
+    // Bindings of a decoder are removed by unload_decoder().
+    bool bind_port (dec_id d_id, const std::string &tgt_dec_name,
+                    uint16_t port);
+    bool unbind_port (dec_id d_id, const std::string &tgt_dec_name,
+                      uint16_t port);
+    bool bind_signature (dec_id d_id, const std::string &tgt_dec_name);
+    bool unbind_signature (dec_id d_id, const std::string &tgt_dec_name);
+    dec_id lookup_port (const std::string &tgt_dec_name, uint16_t port);
+
+    // Plugin: a shared object exporting SWARM_PLUGIN() (see decode.h)
+    // is loaded by load_plugin() as a new decoder. swap_decoder() and
+    // swap_plugin() replace a decoder of the same name with keeping its
+    // dec_id, so bindings, ports and shedding stay, and events and values
+    // assigned again by the new decoder get the same IDs (and the value
+    // factory of the first one). Decoder::migrate() hands over state. A
+    // swap is done at once between packets, or at the end of the packet
+    // if called while decoding. request_swap() can be called from any
+    // thread; the capture thread swaps at the head of the next packet
+    // and a failure is left in errmsg(). Loaded objects are closed with
+    // NetDec because values they created may still be referred.
+    dec_id load_plugin (const std::string &path);
+    bool swap_plugin (const std::string &path);
+    bool swap_decoder (const std::string &dec_name,
+                       Decoder * (*New) (NetDec * nd));
+    void request_swap (const std::string &path);
+    uint64_t swap_count () const { return this->swap_count_; }
+
+    // Load shedding: a shed decoder runs Decoder::decode_shed() instead of
+    // decode(), and the packet is marked by Property::shed().
+    bool set_shed (dec_id d_id, bool shed);
+    bool is_shed (dec_id d_id) const;
+    size_t shed_count () const;
+    // Profiling of decoder cost, exclusive of child decoders
+    void set_profile (bool enable);
+    double decoder_cost (dec_id d_id) const;  // nsec per call
+    // Live counters, e.g. for utils/stat-shm.h. Handler cost is sampled
+    // with set_profile () as decoder cost is.
+    uint64_t decoder_count (dec_id d_id) const;
+    size_t session_count (dec_id d_id) const;  // Decoder::session_count ()
+    std::string lookup_dec_name (dec_id d_id) const;
+    size_t dec_size () const { return this->dec_mod_.size (); }
+    struct HandlerStat {
+      hdlr_id id_;
+      std::string ev_;  // event name or glob pattern
+      uint64_t calls_;
+      double cost_ns_;  // nsec per call
+    };
+    void handler_stat (std::vector <HandlerStat> *st) const;
 
     // Handler
+    // ev_name may be a glob pattern ("dns.*", "*.packet"). It is expanded
+    // to event IDs here and again when an event is assigned later.
     hdlr_id set_handler (ev_id eid, Handler * hdlr);
     hdlr_id set_handler (const std::string ev_name, Handler * hdlr);
     Handler * unset_handler (hdlr_id hid);
 
+    // Filter
+    // Packets rejected by the filter are counted in recv_pkt() but never
+    // reach any decoder. An expression is compiled for the link type of
+    // the default decoder; empty expression removes the filter.
+    bool set_filter (const std::string &expr);
+    bool set_filter (const struct bpf_insn *insns, size_t len);
+    uint64_t filter_accept () const;
+    uint64_t filter_reject () const;
+
+    // Sampling
+    // rate is N of 1-in-N; SAMPLE_NONE or rate 1 turns sampling off. It
+    // can be changed during capture, and Property::sample_rate() tells
+    // the rate each packet was sampled at.
+    bool set_sampling (SampleMode mode, uint32_t rate);
+    uint32_t sample_rate () const;
+    uint64_t sample_drop () const;
+
+    // Checksum verification (off by default). IPv4, TCP and UDP decoders
+    // set "*.chksum_ok" (1 or 0) when the whole data to sum is captured;
+    // a packet failing it is not decoded further. Other L4 decoders can
+    // use Property::pseudo_sum() and Checksum::verify() in the same way.
+    // Note that packets sent by the capturing host usually fail it
+    // because of checksum offload.
+    void set_checksum (bool enable) { this->chksum_ = enable; }
+    bool checksum () const { return this->chksum_; }
+    uint64_t checksum_pass () const { return this->chksum_pass_; }
+    uint64_t checksum_fail () const { return this->chksum_fail_; }
+
+    // Flow hash
+    // Hash function of Property::hash_value(), NULL is Property::flow_hash().
+    // It must be symmetric. NetDec does not own it. Sampler and PcapIndex
+    // keep using Property::flow_hash() so that saved hashes stay valid.
+    bool set_flow_hash (FlowHash *fh);
+    FlowHash *flow_hash () const { return this->flow_hash_; }
+
+    // Checkpoint: sessions of all decoders (Decoder::checkpoint()) are
+    // saved with the name of the flow hash, and restored only into a
+    // NetDec using the same one because tables are keyed by hash_value().
+    // Call them between packets, usually before exit and before the first
+    // packet. Writer and reader versions let an application save its own
+    // handler state (e.g. IpfixExporter) in the same file.
+    bool save_checkpoint (const std::string &path);
+    bool save_checkpoint (CheckpointWriter *w);
+    bool load_checkpoint (const std::string &path);
+    bool load_checkpoint (const CheckpointReader &r);
+
     // Timer
+    // Driven by packet time stamp, not wall clock. Task::exec() receives
+    // the scheduled packet time.
     task_id set_onetime_timer (Task *task, int delay_msec);
     task_id set_repeat_timer (Task *task, int interval_msec);
     bool unset_timer (task_id id);
@@ -139,6 +388,8 @@ namespace swarm {
     void last_ts (struct timespec *ts) const;
     double init_ts () const;
     double last_ts () const;
+    uint64_t init_ts_ns () const;
+    uint64_t last_ts_ns () const;
 
 
     // Error
@@ -150,6 +401,26 @@ namespace swarm {
     val_id assign_value (const std::string &name, const std::string &desc,
                            ValueFactory *fac = NULL);
     void decode (dec_id dec, Property *p);
+    // port table of a transport decoder, created at first call and owned
+    // by NetDec. Transport decoders get it in Decoder::setup()
+    PortMap *port_map (const std::string &tgt_dec_name);
+    inline dec_id match_port (const PortMap *pm, uint16_t src_port,
+                              uint16_t dst_port, const Property &p) {
+      dec_id d_id = pm->lookup (src_port, dst_port);
+      if (d_id == DEC_NULL && pm->has_sig ()) {
+        d_id = this->match_signature (pm, p);
+      }
+      return d_id;
+    }
+    dec_id match_signature (const PortMap *pm, const Property &p);
+    inline void count_checksum (bool ok) {
+      if (ok) {
+        this->chksum_pass_++;
+      } else {
+        this->chksum_fail_++;
+      }
+    }
+    inline bool run_decoder (dec_id dec, Property *p);
     void build_value_vector (std::vector <ValueSet *> * prm_vec_);
   };
 
@@ -32,6 +32,7 @@
 #include "./property.h"
 #include "./value.h"
 #include "./netdec.h"
+#include "./flowhash.h"
 #include "./debug.h"
 
 namespace swarm {
@@ -46,6 +47,9 @@ namespace swarm {
   // Property
   Property::Property (NetDec * nd) : 
     nd_(nd), 
+    ts_ns_(0),
+    tv_sec_(0),
+    tv_usec_(0),
     buf_(NULL),
     val_hist_(VAL_HIST_MAX), 
     val_hist_ptr_(0) {
@@ -58,8 +62,17 @@ namespace swarm {
     }
     */
   }
+  void Property::extend_values () {
+    this->nd_->build_value_vector (&(this->value_));
+  }
   void Property::init  (const byte_t *data, const size_t cap_len,
                         const size_t data_len, const struct timeval &tv) {
+    uint64_t ts_ns = static_cast<uint64_t>(tv.tv_sec) * 1000000000 +
+      static_cast<uint64_t>(tv.tv_usec) * 1000;
+    this->init(data, cap_len, data_len, ts_ns);
+  }
+  void Property::init  (const byte_t *data, const size_t cap_len,
+                        const size_t data_len, const uint64_t ts_ns) {
     // In this version, init is now zero-copy implementation
     /*
     if (this->buf_len_ < cap_len) {
@@ -69,8 +82,11 @@ namespace swarm {
     }
     */
 
-    this->tv_sec_   = tv.tv_sec;
-    this->tv_usec_  = tv.tv_usec;
+    // keep second/micro second split as well because most decoders only
+    // need tv_sec(); it is computed once here instead of on every call
+    this->ts_ns_    = ts_ns;
+    this->tv_sec_   = static_cast<time_t>(ts_ns / 1000000000);
+    this->tv_usec_  = static_cast<time_t>((ts_ns % 1000000000) / 1000);
     this->data_len_ = data_len;
     this->cap_len_  = cap_len;
     this->ptr_      = 0;
@@ -93,7 +109,12 @@ namespace swarm {
     this->proto_ = 0;
     this->hash_value_ = 0;
     this->hashed_ = false;
+    this->ssn_label_len_ = 0;
     this->dir_ = DIR_NIL;
+    this->sample_rate_ = 1;
+    this->l4_len_ = 0;
+    this->tunnel_depth_ = 0;
+    this->shed_len_ = 0;
   }
   const Value& Property::value(const std::string &key, size_t idx) const {
     const val_id vid = this->nd_->lookup_value_id (key);
@@ -127,6 +148,19 @@ namespace swarm {
   }
 
 
+  void Property::add_shed (dec_id d_id) {
+    if (this->shed_len_ < SHED_MAX) {
+      this->shed_[this->shed_len_++] = d_id;
+    }
+  }
+  bool Property::shed (dec_id d_id) const {
+    for (size_t i = 0; i < this->shed_len_; i++) {
+      if (this->shed_[i] == d_id) {
+        return true;
+      }
+    }
+    return false;
+  }
   size_t Property::len () const {
     return this->data_len_;
   }
@@ -250,6 +284,10 @@ namespace swarm {
     return s;
   }
 
+  u_int8_t Property::ip_proto () const {
+    return this->proto_;
+  }
+
   uint64_t Property::hash_value () const {
     return this->hash_value_ ;
   }
@@ -262,7 +300,7 @@ namespace swarm {
   }
   const void *Property::ssn_label(size_t *len) const {
     assert(len != NULL);
-    *len = this->addr_len_ * sizeof(uint32_t);
+    *len = this->ssn_label_len_ * sizeof(uint32_t);
     return static_cast<const void *>(this->ssn_label_);
   }
 
@@ -348,8 +386,9 @@ namespace swarm {
       }*/
   }
 
-  FlowDir Property::get_dir(void *src_addr, void *dst_addr, size_t addr_len,
-                            void *src_port, void *dst_port, size_t port_len) {
+  FlowDir Property::get_dir(const void *src_addr, const void *dst_addr,
+                            size_t addr_len, const void *src_port,
+                            const void *dst_port, size_t port_len) {
     // Determine flow direction by IP addresses and port numbers
     // Low address or low port number means LEFT, high one means RIGHT
     FlowDir dir = DIR_NIL;
@@ -374,63 +413,118 @@ namespace swarm {
     return dir;
   }
 
-  void Property::calc_hash () {
-    if (this->hashed_) {
-      // don't allow override
-      return;
-    }
-
-    uint32_t *la, *ra;
-    uint16_t *lp, *rp;
-    uint32_t *p = this->ssn_label_;
-    this->dir_ =
-      Property::get_dir(this->src_addr_, this->dst_addr_, this->addr_len_,
-                        this->src_port_, this->dst_port_, this->port_len_);
+  size_t Property::ssn_label (const void *src_addr, const void *dst_addr,
+                              size_t addr_len, const void *src_port,
+                              const void *dst_port, size_t port_len,
+                              uint8_t proto, uint32_t *label, FlowDir *dir) {
+    const void *la, *ra;
+    const void *lp, *rp;
+    uint32_t *p = label;
+    FlowDir d = Property::get_dir(src_addr, dst_addr, addr_len,
+                                  src_port, dst_port, port_len);
 
     // Set IP addresses and TCP/UDP port.
-    if (this->dir_ == DIR_L2R) {
-      la = static_cast <uint32_t *>(this->src_addr_);
-      ra = static_cast <uint32_t *>(this->dst_addr_);
-      lp = static_cast <uint16_t *>(this->src_port_);
-      rp = static_cast <uint16_t *>(this->dst_port_);
+    if (d == DIR_L2R) {
+      la = src_addr;
+      ra = dst_addr;
+      lp = src_port;
+      rp = dst_port;
     } else {
-      assert(this->dir_ == DIR_R2L || this->dir_ == DIR_NIL);
-      ra = static_cast <uint32_t *>(this->src_addr_);
-      la = static_cast <uint32_t *>(this->dst_addr_);
-      rp = static_cast <uint16_t *>(this->src_port_);
-      lp = static_cast <uint16_t *>(this->dst_port_);
+      assert(d == DIR_R2L || d == DIR_NIL);
+      ra = src_addr;
+      la = dst_addr;
+      rp = src_port;
+      lp = dst_port;
     }
     
     // Copy IP address, port number into buffer.
-    memcpy(p, la, this->addr_len_);
-    p += this->addr_len_ / 4;
-    memcpy(p, ra, this->addr_len_);
-    p += this->addr_len_ / 4;
-
-    if (this->port_len_ == 2) {
-      uint32_t t = static_cast<uint32_t>(*lp);
-      *p =  (t << 16) + static_cast<uint32_t>(*rp);
+    memcpy(p, la, addr_len);
+    p += addr_len / 4;
+    memcpy(p, ra, addr_len);
+    p += addr_len / 4;
+
+    if (port_len == 2) {
+      uint32_t t = static_cast<uint32_t>(*static_cast<const uint16_t *>(lp));
+      *p =  (t << 16) +
+        static_cast<uint32_t>(*static_cast<const uint16_t *>(rp));
     } else {
       *p = 0;
     }
     p++;
 
     // Set IP_PROTOCOL as unsigned 32bit integer
-    *p = static_cast<uint32_t>(this->proto_);
+    *p = static_cast<uint32_t>(proto);
     p++;
 
     // Set `session label length`
-    this->ssn_label_len_ = p - this->ssn_label_;
-    assert(this->ssn_label_len_ < SSN_LABEL_MAX);
+    size_t len = p - label;
+    assert(len < SSN_LABEL_MAX);
+
+    if (dir) {
+      *dir = d;
+    }
+    return len;
+  }
+
+  uint64_t Property::flow_hash (const void *src_addr, const void *dst_addr,
+                                size_t addr_len, const void *src_port,
+                                const void *dst_port, size_t port_len,
+                                uint8_t proto, uint32_t *label,
+                                size_t *label_len, FlowDir *dir) {
+    uint32_t buf[SSN_LABEL_MAX];
+    uint32_t *head = (label) ? label : buf;
+    size_t len = Property::ssn_label(src_addr, dst_addr, addr_len, src_port,
+                                     dst_port, port_len, proto, head, dir);
 
     // Calculate hash value.
     u_int64_t h = 1125899906842597;
-    for (size_t i = 0; i < this->ssn_label_len_; i++) {
-      h = (this->ssn_label_[i] + (h << 6) + (h << 16) - h);
+    for (size_t i = 0; i < len; i++) {
+      h = (head[i] + (h << 6) + (h << 16) - h);
+    }
+
+    if (label_len) {
+      *label_len = len;
+    }
+    return h;
+  }
+
+  void Property::calc_hash () {
+    if (this->hashed_) {
+      // don't allow override
+      return;
     }
 
+    const FlowHash *fh = this->nd_->flow_hash ();
+    if (fh) {
+      // session label is still needed by session tables, but the serial
+      // hash over it is not
+      this->ssn_label_len_ =
+        Property::ssn_label(this->src_addr_, this->dst_addr_, this->addr_len_,
+                            this->src_port_, this->dst_port_, this->port_len_,
+                            this->proto_, this->ssn_label_, &(this->dir_));
+      this->hash_value_ =
+        fh->hash (this->src_addr_, this->dst_addr_, this->addr_len_,
+                  this->src_port_, this->dst_port_, this->port_len_,
+                  this->proto_);
+    } else {
+      this->hash_value_ =
+        Property::flow_hash(this->src_addr_, this->dst_addr_, this->addr_len_,
+                            this->src_port_, this->dst_port_, this->port_len_,
+                            this->proto_, this->ssn_label_,
+                            &(this->ssn_label_len_), &(this->dir_));
+    }
     this->hashed_ = true;
-    this->hash_value_ = h;
+  }
+  void Property::decap () {
+    this->addr_len_ = 0;
+    this->port_len_ = 0;
+    this->proto_ = 0;
+    this->hash_value_ = 0;
+    this->hashed_ = false;
+    this->ssn_label_len_ = 0;
+    this->dir_ = DIR_NIL;
+    this->l4_len_ = 0;
+    this->tunnel_depth_++;
   }
   void Property::set_addr (void *src_addr, void *dst_addr, u_int8_t proto,
                            size_t addr_len) {
@@ -455,6 +549,13 @@ namespace swarm {
     }
   }
   void Property::push_event (const ev_id eid) {
+    if (this->tunnel_depth_ > 0) {
+      for (size_t i = 0; i < this->ev_push_ptr_; i++) {
+        if (this->ev_queue_[i] == eid) {
+          return;  // pushed by outer layer
+        }
+      }
+    }
     if (this->ev_push_ptr_ >= this->ev_queue_.size ()) {
       // prevent frequet call of memory allocation
       this->ev_queue_.resize (this->ev_queue_.size () +
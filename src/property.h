@@ -49,6 +49,7 @@ namespace swarm {
 
   private:
     NetDec * nd_;
+    uint64_t ts_ns_;  // nano second since epoch
     time_t tv_sec_;
     time_t tv_usec_;
 
@@ -81,6 +82,14 @@ namespace swarm {
     bool hashed_;
     uint64_t hash_value_;
     FlowDir dir_;
+    uint32_t sample_rate_;
+    uint64_t pseudo_sum_;
+    size_t l4_len_;
+    size_t tunnel_depth_;
+
+    static const size_t SHED_MAX = 8;
+    dec_id shed_[SHED_MAX];
+    size_t shed_len_;
 
     static const size_t SSN_LABEL_MAX = 128;
     uint32_t ssn_label_[SSN_LABEL_MAX];
@@ -88,15 +97,25 @@ namespace swarm {
 
     static const ValueNull val_null_;
 
-    static inline FlowDir get_dir(void *src_addr, void *dst_addr, size_t addr_len,
-                                  void *src_port, void *dst_port, size_t port_len);
+    static inline FlowDir get_dir(const void *src_addr, const void *dst_addr,
+                                  size_t addr_len, const void *src_port,
+                                  const void *dst_port, size_t port_len);
+    // Write the session label into label and return its length in words
+    static size_t ssn_label (const void *src_addr, const void *dst_addr,
+                             size_t addr_len, const void *src_port,
+                             const void *dst_port, size_t port_len,
+                             uint8_t proto, uint32_t *label, FlowDir *dir);
     void set_val_history(size_t v_idx);
 
   public:
     explicit Property (NetDec * nd);
     ~Property ();
+    // add value sets for values assigned after construction
+    void extend_values ();
     void init (const byte_t *data, const size_t cap_len,
                const size_t data_len, const struct timeval &tv);
+    void init (const byte_t *data, const size_t cap_len,
+               const size_t data_len, const uint64_t ts_ns);
     Value * retain (const std::string &value_name);
     Value * retain (const val_id vid);
     bool set (const std::string &value_name, void * ptr, size_t len);
@@ -108,6 +127,35 @@ namespace swarm {
                    size_t addr_len);
     void set_port (void *src_port, void *dst_port, size_t port_len);
     void calc_hash ();
+    // Called by a tunnel decoder before emitting the inner packet. The
+    // 5 tuple and flow hash are cleared so that decoders of the inner
+    // packet set them again. Values and events of outer headers are
+    // kept, and the inner ones are added after them, e.g.
+    // value("ipv4.src", 0) is the outer address. An event already pushed
+    // by an outer layer (e.g. "ipv4.packet" of IP in IP) is not pushed
+    // again, so a handler runs once per packet and sees the inner tuple.
+    void decap ();
+    size_t tunnel_depth () const { return this->tunnel_depth_; }
+    // 5 tuple hash shared with Sampler; label receives the session label
+    // (SSN_LABEL_MAX words at least) if not NULL
+    static uint64_t flow_hash (const void *src_addr, const void *dst_addr,
+                               size_t addr_len, const void *src_port,
+                               const void *dst_port, size_t port_len,
+                               uint8_t proto, uint32_t *label = NULL,
+                               size_t *label_len = NULL, FlowDir *dir = NULL);
+    void set_sample_rate (uint32_t rate) { this->sample_rate_ = rate; }
+    // Set by IP decoders for checksum verification of L4 decoders:
+    // partial sum of pseudo header and L4 length. Not set for fragments.
+    void set_pseudo_sum (uint64_t sum, size_t l4_len) {
+      this->pseudo_sum_ = sum;
+      this->l4_len_ = l4_len;
+    }
+    bool pseudo_sum (uint64_t *sum, size_t *l4_len) const {
+      *sum = this->pseudo_sum_;
+      *l4_len = this->l4_len_;
+      return (this->l4_len_ > 0);
+    }
+    void add_shed (dec_id d_id);
 
     ev_id pop_event ();
     void push_event (const ev_id eid);
@@ -119,16 +167,29 @@ namespace swarm {
     
     size_t len () const;      // original data length
     size_t cap_len () const;  // captured data length
+    const byte_t *raw_data () const { return this->buf_; }  // head of packet
     void tv (struct timeval *tv) const;
     time_t tv_sec() const;
     time_t tv_usec() const;
     double ts () const;
+    uint64_t ts_ns () const { return this->ts_ns_; }
+    // N of 1-in-N sampling this packet passed, 1 if not sampled
+    uint32_t sample_rate () const { return this->sample_rate_; }
+    // true if a decoder was shed for this packet, i.e. values of the
+    // decoder are missing on purpose
+    bool shed () const { return (this->shed_len_ > 0); }
+    bool shed (dec_id d_id) const;
 
     // ToDo(masa): byte_t * refer() should be const byte_t * refer()
     byte_t * refer (size_t alloc_size);
     // ToDo(masa): byte_t * payload() should be const byte_t * payload()
     byte_t * payload (size_t alloc_size);
     size_t remain () const;
+    // rest of data without consuming it, e.g. for Decoder::accept()
+    const byte_t *peek (size_t *len) const {
+      *len = this->remain ();
+      return (*len > 0) ? &(this->buf_[this->ptr_]) : NULL;
+    }
 
     std::string src_addr () const;
     std::string dst_addr () const;
@@ -137,8 +198,25 @@ namespace swarm {
     int src_port () const;
     int dst_port () const;
     std::string proto () const;
+    u_int8_t ip_proto () const;
     uint64_t hash_value () const;
     const void *ssn_label(size_t *len) const;
+    const void *src_port (size_t *len) const {
+      *len = this->port_len_;
+      return this->src_port_;
+    }
+    const void *dst_port (size_t *len) const {
+      *len = this->port_len_;
+      return this->dst_port_;
+    }
+    // values retained (may be duplicated) and events pushed for this
+    // packet, to save decode result by DecodeRecorder
+    size_t retained_size () const { return this->val_hist_ptr_; }
+    val_id retained (size_t i) const {
+      return VALUE_BASE + static_cast<val_id> (this->val_hist_[i]);
+    }
+    size_t event_size () const { return this->ev_push_ptr_; }
+    ev_id event (size_t i) const { return this->ev_queue_[i]; }
     FlowDir dir() const;
     inline static size_t vid2idx (val_id vid) {
       return static_cast <size_t> (vid - VALUE_BASE);
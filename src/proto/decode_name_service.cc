@@ -30,6 +30,9 @@
 
 namespace swarm {
   std::string NameServiceDecoder::VarNameServiceData::repr() const {
+    if (this->restored_) {
+      return this->text_ok_ ? this->text_ : Value::null_;
+    }
     std::string s;
 
     bool rc = false;
@@ -64,6 +67,33 @@ namespace swarm {
     return s;
   }
 
+  bool NameServiceDecoder::VarNameServiceData::text(std::string *s) const {
+    if (this->restored_) {
+      if (this->text_ok_) {
+        *s = this->text_;
+      }
+      return this->text_ok_;
+    }
+    size_t len;
+    byte_t * ptr = this->ptr(&len);
+    if (ptr == NULL) {
+      return false;
+    }
+
+    switch (this->type_) {
+    case  2:  // NS
+    case  5:  // CNAME
+    case  6:  // SOA
+    case 12:  // PTR
+    case 15:  // MX
+      return (NULL != NameServiceDecoder::parse_label
+              (ptr, len, this->base_ptr_, this->total_len_, s));
+    default:
+      *s = this->repr();
+      return true;
+    }
+  }
+
   void NameServiceDecoder::VarNameServiceData::set_data (byte_t * ptr,
                                                          size_t len,
                                                          u_int16_t type,
@@ -73,9 +103,22 @@ namespace swarm {
     this->type_ = type;
     this->base_ptr_ = base_ptr;
     this->total_len_ = total_len;
+    this->restored_ = false;
+  }
+  void NameServiceDecoder::VarNameServiceData::restore
+  (byte_t * ptr, size_t len, const std::string *text) {
+    this->Value::restore (ptr, len, text);
+    this->restored_ = true;
+    this->text_ok_ = (text != NULL);
+    if (text) {
+      this->text_ = *text;
+    }
   }
 
   std::string NameServiceDecoder::VarNameServiceName::repr() const {
+    if (this->restored_) {
+      return this->text_ok_ ? this->text_ : Value::null_;
+    }
     size_t len;
     byte_t * ptr = this->ptr(&len);
     byte_t * rp;
@@ -85,16 +128,41 @@ namespace swarm {
     return (rp != NULL) ? s : Value::null_;
   }
 
+  bool NameServiceDecoder::VarNameServiceName::text(std::string *s) const {
+    if (this->restored_) {
+      if (this->text_ok_) {
+        *s = this->text_;
+      }
+      return this->text_ok_;
+    }
+    size_t len;
+    byte_t * ptr = this->ptr(&len);
+    return (ptr != NULL &&
+            NULL != NameServiceDecoder::parse_label (ptr, len, this->base_ptr_,
+                                                     this->total_len_, s));
+  }
+
   void NameServiceDecoder::VarNameServiceName::set_data
   (byte_t * ptr, size_t len, byte_t * base_ptr, size_t total_len) {
     this->set (ptr, len);
     this->base_ptr_ = base_ptr;
     this->total_len_ = total_len;
+    this->restored_ = false;
+  }
+  void NameServiceDecoder::VarNameServiceName::restore
+  (byte_t * ptr, size_t len, const std::string *text) {
+    this->Value::restore (ptr, len, text);
+    this->restored_ = true;
+    this->text_ok_ = (text != NULL);
+    if (text) {
+      this->text_ = *text;
+    }
   }
 
   NameServiceDecoder::NameServiceDecoder (NetDec * nd,
-                                          const std::string &base_name) :
-    Decoder (nd), base_name_ (base_name) {
+                                          const std::string &base_name,
+                                          u_int16_t port) :
+    Decoder (nd), base_name_ (base_name), port_ (port) {
     const std::string &bn = this->base_name_;
 
     // Assign event name
@@ -103,6 +171,8 @@ namespace swarm {
     // Assign parameter name
     this->P_ID_  = nd->assign_value(bn + ".tx_id", bn + " Transaction ID",
                                     new FacNum ());
+    this->P_FLAGS_ = nd->assign_value(bn + ".flags", bn + " Flags",
+                                      new FacNum ());
 
     for (size_t i = 0; i < RR_CNT; i++) {
       std::string base, desc;
@@ -126,14 +196,23 @@ namespace swarm {
                                           new FacType ());
       this->NS_DATA[i] = nd->assign_value(data_key, desc + " Data",
                                           new FacNameServiceData ());
+
+      // question section has no TTL
+      this->NS_TTL[i] = VALUE_NULL;
+      if (i != RR_QD) {
+        std::string ttl_key = bn + "." + base + "_ttl";
+        this->NS_TTL[i] = nd->assign_value(ttl_key, desc + " TTL",
+                                           new FacNum ());
+      }
     }
   }
 
   void NameServiceDecoder::setup (NetDec * nd) {
     // No upper decoder is needed
+    nd->bind_port (nd->lookup_dec_id (this->base_name_), "udp", this->port_);
   };
 
-  bool NameServiceDecoder::ns_decode (Property *p) {
+  bool NameServiceDecoder::ns_decode (Property *p, bool parse_rr) {
     const size_t hdr_len = sizeof (struct ns_header);
     byte_t *base_ptr = p->payload (hdr_len);
 
@@ -146,6 +225,13 @@ namespace swarm {
 
     p->push_event (this->EV_NS_PKT_);
 
+    if (!parse_rr) {
+      // header only, records are left to be parsed by nobody
+      p->set (this->P_ID_, &(hdr->trans_id_), sizeof (hdr->trans_id_));
+      p->set (this->P_FLAGS_, &(hdr->flags_), sizeof (hdr->flags_));
+      return true;
+    }
+
     int rr_count[4], rr_delim[4];
     rr_count[RR_QD] = ntohs (hdr->qd_count_);
     rr_count[RR_AN] = ntohs (hdr->an_count_);
@@ -174,6 +260,7 @@ namespace swarm {
     const byte_t * ep = base_ptr + hdr_len + total_len;
 
     p->set (this->P_ID_, &(hdr->trans_id_), sizeof (hdr->trans_id_));
+    p->set (this->P_FLAGS_, &(hdr->flags_), sizeof (hdr->flags_));
 
     // parsing resource record
     int target = 0, rr_c = 0;
@@ -241,6 +328,7 @@ namespace swarm {
           (p->retain (this->NS_DATA[target]));
         assert (v != NULL);
         v->set_data (ptr, rd_len, htons (rr_hdr->type_), base_ptr, total_len);
+        p->set (this->NS_TTL[target], &(ans_hdr->ttl_), sizeof (ans_hdr->ttl_));
 
         // seek pointer
         ptr += rd_len;
@@ -257,7 +345,11 @@ namespace swarm {
   // Main decoding function.
   bool NameServiceDecoder::decode (Property *p) {
     return this->ns_decode (p);
-  };
+  }
+  // Under overload, only the header; no record and no dns_tx matching
+  bool NameServiceDecoder::decode_shed (Property *p) {
+    return this->ns_decode (p, false);
+  }
 
 
   byte_t * NameServiceDecoder::parse_label (byte_t * p, size_t remain,
@@ -62,7 +62,7 @@ namespace swarm {
 
     // flags must be done ntohs ()
     inline static bool has_qr_flag (u_int16_t flags) {
-      return ((flags & 0x0001) > 0);
+      return ((flags & 0x8000) > 0);
     }
 
     inline static byte_t * parse_label (byte_t * p, size_t remain,
@@ -71,11 +71,13 @@ namespace swarm {
                                         std::string * s);
 
     const std::string base_name_;
+    const u_int16_t port_;  // UDP port to claim in setup()
     ev_id EV_NS_PKT_, EV_TYPE_[4];
-    val_id P_ID_;
+    val_id P_ID_, P_FLAGS_;
     val_id NS_NAME[4];
     val_id NS_TYPE[4];
     val_id NS_DATA[4];
+    val_id NS_TTL[4];
 
   public:
     // VarNameServiceData for data part of record
@@ -84,9 +86,17 @@ namespace swarm {
       u_int16_t type_;
       byte_t * base_ptr_;
       size_t total_len_;
+      bool restored_;  // text is given by restore(), not by packet
+      bool text_ok_;
+      std::string text_;
 
     public:
+      VarNameServiceData () : type_(0), base_ptr_(NULL), total_len_(0),
+                              restored_(false), text_ok_(false) {}
       std::string repr() const;
+      bool text(std::string *s) const;
+      bool contextual() const { return true; }
+      void restore(byte_t *ptr, size_t len, const std::string *text);
       void set_data (byte_t * ptr, size_t len, u_int16_t type,
                      byte_t * base_ptr, size_t total_len);
     };
@@ -101,9 +111,17 @@ namespace swarm {
     private:
       byte_t * base_ptr_;
       size_t total_len_;
+      bool restored_;
+      bool text_ok_;
+      std::string text_;
 
     public:
+      VarNameServiceName () : base_ptr_(NULL), total_len_(0),
+                              restored_(false), text_ok_(false) {}
       std::string repr () const;
+      bool text (std::string *s) const;
+      bool contextual () const { return true; }
+      void restore (byte_t *ptr, size_t len, const std::string *text);
       void set_data (byte_t * ptr, size_t len, byte_t * base_ptr,
                      size_t total_len);
     };
@@ -115,10 +133,12 @@ namespace swarm {
 
     DEF_REPR_CLASS (VarType, FacType);
 
-    explicit NameServiceDecoder (NetDec * nd, const std::string &base_name);
+    NameServiceDecoder (NetDec * nd, const std::string &base_name,
+                        u_int16_t port);
     void setup (NetDec * nd);
-    bool ns_decode (Property *p);
+    bool ns_decode (Property *p, bool parse_rr = true);
     bool decode (Property *p);
+    bool decode_shed (Property *p);
   };
 }  // namespace swarm
 
@@ -31,8 +31,16 @@
 namespace swarm {
 
   class DnsDecoder : public NameServiceDecoder {
+  private:
+    dec_id D_DNS_TX_;
+
   public:
-    explicit DnsDecoder (NetDec * nd) : NameServiceDecoder (nd, "dns") {
+    explicit DnsDecoder (NetDec * nd) :
+      NameServiceDecoder (nd, "dns", 53) {
+    }
+    void setup (NetDec * nd) {
+      NameServiceDecoder::setup (nd);
+      this->D_DNS_TX_ = nd->lookup_dec_id ("dns_tx");
     }
 
     // Factory function for DnsDecoder
@@ -40,7 +48,13 @@ namespace swarm {
 
     // Main decoding function.
     bool decode (Property *p) {
-      return this->ns_decode (p);
+      if (!this->ns_decode (p)) {
+        return false;
+      }
+
+      // query/response matching
+      this->emit (this->D_DNS_TX_, p);
+      return true;
     }
   };
 
@@ -0,0 +1,229 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <string>
+#include "../decode.h"
+#include "../utils/lru-hash.h"
+#include "../debug.h"
+
+namespace swarm {
+  // Outstanding DNS query. A matched query is removed from the table and
+  // deleted at once, so only unanswered ones are left to expire.
+  class DnsTx : public LRUHash::Node {
+  public:
+    static const size_t KEY_MAX = 16 * 2 + 2 + 2;
+
+  private:
+    byte_t key_[KEY_MAX];
+    size_t key_len_;
+    size_t addr_len_;
+    uint64_t hash_;
+    uint64_t ts_ns_;
+    std::string name_;
+
+  public:
+    DnsTx(const byte_t *key, size_t key_len, size_t addr_len, uint64_t hv,
+          const Property &p) :
+      key_len_(key_len), addr_len_(addr_len), hash_(hv),
+      ts_ns_(p.ts_ns()) {
+      ::memcpy(this->key_, key, key_len);
+    }
+    ~DnsTx() {}
+    uint64_t hash() { return this->hash_; }
+    bool match(const void *key, size_t len) {
+      return (this->key_len_ == len && 0 == ::memcmp(this->key_, key, len));
+    }
+
+    std::string *name() { return &(this->name_); }
+    const byte_t *client() const { return this->key_; }
+    const byte_t *server() const { return this->key_ + this->addr_len_; }
+    size_t addr_len() const { return this->addr_len_; }
+    // elapsed time since the query in micro second
+    uint32_t latency(const Property &p) const {
+      int64_t usec = (static_cast<int64_t>(p.ts_ns()) -
+                      static_cast<int64_t>(this->ts_ns_)) / 1000;
+      return (usec > 0) ? static_cast<uint32_t>(usec) : 0;
+    }
+  };
+
+  class DnsTxDecoder : public Decoder {
+  private:
+    ev_id EV_TX_, EV_TIMEOUT_;
+    val_id P_NAME_, P_RCODE_, P_AN_COUNT_, P_LATENCY_, P_CLIENT_, P_SERVER_;
+    val_id P_TO_NAME_, P_TO_CLIENT_, P_TO_SERVER_;
+    val_id P_DNS_ID_, P_DNS_FLAGS_, P_DNS_QD_NAME_, P_DNS_AN_NAME_;
+
+    LRUHash *tx_table_;
+    time_t last_ts_;
+    size_t tx_count_;  // outstanding queries in tx_table_
+    std::string name_;
+
+    static const time_t TIMEOUT = 5;
+    static const size_t TX_MAX = 0x10000;
+    static const size_t TIMESLOT = 60;
+
+  public:
+    explicit DnsTxDecoder (NetDec * nd) :
+      Decoder (nd), last_ts_(0), tx_count_(0) {
+      this->EV_TX_ = nd->assign_event ("dns.transaction",
+                                       "DNS query and response matched");
+      this->EV_TIMEOUT_ = nd->assign_event ("dns.timeout",
+                                            "DNS query not answered");
+
+      this->P_NAME_ = nd->assign_value ("dns_tx.name", "DNS Query Name");
+      this->P_RCODE_ = nd->assign_value ("dns_tx.rcode", "DNS Response Code",
+                                         new FacNum ());
+      this->P_AN_COUNT_ = nd->assign_value ("dns_tx.an_count",
+                                            "DNS Answer Count", new FacNum ());
+      this->P_LATENCY_ = nd->assign_value ("dns_tx.latency",
+                                           "DNS Response Latency (usec)",
+                                           new FacNum ());
+      this->P_CLIENT_ = nd->assign_value ("dns_tx.client", "DNS Client",
+                                          new FacIPAddr ());
+      this->P_SERVER_ = nd->assign_value ("dns_tx.server", "DNS Server",
+                                          new FacIPAddr ());
+      this->P_TO_NAME_ = nd->assign_value ("dns_tx.timeout_name",
+                                           "Unanswered DNS Query Name");
+      this->P_TO_CLIENT_ = nd->assign_value ("dns_tx.timeout_client",
+                                             "Unanswered DNS Client",
+                                             new FacIPAddr ());
+      this->P_TO_SERVER_ = nd->assign_value ("dns_tx.timeout_server",
+                                             "Unanswered DNS Server",
+                                             new FacIPAddr ());
+
+      this->tx_table_ = new LRUHash(TIMESLOT, 0xffff);
+    }
+    ~DnsTxDecoder() {
+      this->tx_table_->prog(TIMESLOT);
+      DnsTx *tx;
+      while (NULL != (tx = dynamic_cast<DnsTx*>(this->tx_table_->pop()))) {
+        delete tx;
+      }
+      delete this->tx_table_;
+    }
+
+    void setup (NetDec * nd) {
+      this->P_DNS_ID_ = nd->lookup_value_id ("dns.tx_id");
+      this->P_DNS_FLAGS_ = nd->lookup_value_id ("dns.flags");
+      this->P_DNS_QD_NAME_ = nd->lookup_value_id ("dns.qd_name");
+      this->P_DNS_AN_NAME_ = nd->lookup_value_id ("dns.an_name");
+    };
+
+    static Decoder * New (NetDec * nd) { return new DnsTxDecoder (nd); }
+    size_t session_count () const { return this->tx_count_; }
+
+    void timeout_tx(Property *p) {
+      const time_t tv_sec = p->tv_sec();
+      if (this->last_ts_ > 0 && this->last_ts_ < tv_sec) {
+        time_t d = tv_sec - this->last_ts_;
+        this->tx_table_->prog(d < static_cast<time_t>(TIMESLOT) ?
+                              d : TIMESLOT);
+      }
+      this->last_ts_ = tv_sec;
+
+      bool expired = false;
+      DnsTx *tx;
+      while (NULL != (tx = dynamic_cast<DnsTx*>(this->tx_table_->pop()))) {
+        p->copy(this->P_TO_NAME_, const_cast<char*>(tx->name()->data()),
+                tx->name()->size());
+        p->copy(this->P_TO_CLIENT_, const_cast<byte_t*>(tx->client()),
+                tx->addr_len());
+        p->copy(this->P_TO_SERVER_, const_cast<byte_t*>(tx->server()),
+                tx->addr_len());
+        expired = true;
+        delete tx;
+        this->tx_count_--;
+      }
+
+      if (expired) {
+        p->push_event(this->EV_TIMEOUT_);
+      }
+    }
+
+    bool decode (Property *p) {
+      this->timeout_tx(p);
+
+      size_t id_len, s_len, d_len;
+      const byte_t *tx_id = p->value(this->P_DNS_ID_).ptr(&id_len);
+      const byte_t *src = static_cast<const byte_t*>(p->src_addr(&s_len));
+      const byte_t *dst = static_cast<const byte_t*>(p->dst_addr(&d_len));
+      if (tx_id == NULL || id_len != 2 || src == NULL || dst == NULL ||
+          s_len != d_len || s_len > 16) {
+        return false;
+      }
+
+      const uint16_t flags = p->value(this->P_DNS_FLAGS_).ntoh<uint16_t>();
+      const bool is_resp = ((flags & 0x8000) != 0);  // QR bit
+
+      // key: client address, server address, client port, transaction ID
+      byte_t key[DnsTx::KEY_MAX];
+      const byte_t *client = is_resp ? dst : src;
+      const byte_t *server = is_resp ? src : dst;
+      const uint16_t c_port = htons(is_resp ? p->dst_port() : p->src_port());
+      ::memcpy(key, client, s_len);
+      ::memcpy(key + s_len, server, s_len);
+      ::memcpy(key + s_len * 2, &c_port, sizeof(c_port));
+      ::memcpy(key + s_len * 2 + sizeof(c_port), tx_id, id_len);
+      const size_t key_len = s_len * 2 + sizeof(c_port) + id_len;
+      const uint64_t hv = p->hash_value() + ((tx_id[0] << 8) | tx_id[1]);
+
+      DnsTx *tx = dynamic_cast<DnsTx*>
+        (this->tx_table_->get(hv, key, key_len));
+
+      if (!is_resp) {
+        // retransmitted query keeps the time of the first one
+        if (tx == NULL && this->tx_count_ < TX_MAX) {
+          tx = new DnsTx(key, key_len, s_len, hv, *p);
+          p->value(this->P_DNS_QD_NAME_).text(tx->name());
+          this->tx_table_->put(TIMEOUT, tx);
+          this->tx_count_++;
+        }
+      } else if (tx != NULL) {
+        uint32_t latency = htonl(tx->latency(*p));
+        uint8_t rcode = static_cast<uint8_t>(flags & 0x000F);
+        uint16_t an_count =
+          htons(static_cast<uint16_t>(p->value_size(this->P_DNS_AN_NAME_)));
+
+        p->copy(this->P_NAME_, const_cast<char*>(tx->name()->data()),
+                tx->name()->size());
+        p->copy(this->P_RCODE_, &rcode, sizeof(rcode));
+        p->copy(this->P_AN_COUNT_, &an_count, sizeof(an_count));
+        p->copy(this->P_LATENCY_, &latency, sizeof(latency));
+        p->copy(this->P_CLIENT_, const_cast<byte_t*>(client), s_len);
+        p->copy(this->P_SERVER_, const_cast<byte_t*>(server), s_len);
+        p->push_event(this->EV_TX_);
+        this->tx_table_->remove(tx);
+        delete tx;
+        this->tx_count_--;
+      }
+
+      return true;
+    }
+  };
+
+  INIT_DECODER (dns_tx, DnsTxDecoder::New);
+}  // namespace swarm
@@ -51,6 +51,12 @@
 #ifndef ETHERTYPE_PPPOE_SSN
 #define ETHERTYPE_PPPOE_SSN 0x8864
 #endif
+#ifndef ETHERTYPE_MPLS
+#define ETHERTYPE_MPLS 0x8847
+#endif
+#ifndef ETHERTYPE_MPLS_MCAST
+#define ETHERTYPE_MPLS_MCAST 0x8848
+#endif
 #ifndef ETHERTYPE_NETWARE /* Netware IPX/SPX */
 #define ETHERTYPE_NETWARE 0x8137
 #endif
@@ -68,7 +74,7 @@ namespace swarm {
 
     ev_id EV_ETH_PKT_;
     val_id P_SRC_, P_DST_, P_TYPE_, P_HDR_;
-    dec_id D_ARP_, D_VLAN_, D_IPV4_, D_IPV6_, D_PPPOE_;
+    dec_id D_ARP_, D_VLAN_, D_IPV4_, D_IPV6_, D_PPPOE_, D_MPLS_;
 
   public:
     explicit EtherDecoder (NetDec * nd) : Decoder (nd) {
@@ -88,6 +94,7 @@ namespace swarm {
       this->D_IPV4_ = nd->lookup_dec_id ("ipv4");
       this->D_IPV6_ = nd->lookup_dec_id ("ipv6");
       this->D_PPPOE_ = nd->lookup_dec_id ("pppoe");
+      this->D_MPLS_ = nd->lookup_dec_id ("mpls");
     };
 
     static Decoder * New (NetDec * nd) { return new EtherDecoder (nd); }
@@ -112,6 +119,8 @@ namespace swarm {
       case ETHERTYPE_IP:   this->emit (this->D_IPV4_, p); break;
       case ETHERTYPE_IPV6: this->emit (this->D_IPV6_, p); break;
       case ETHERTYPE_PPPOE_SSN: this->emit (this->D_PPPOE_, p); break;
+      case ETHERTYPE_MPLS:
+      case ETHERTYPE_MPLS_MCAST: this->emit (this->D_MPLS_, p); break;
         // case ETHERTYPE_LOOPBACK: this->emit (this->D_IPV4_, p); break;
       }
 
@@ -0,0 +1,113 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../decode.h"
+
+
+namespace swarm {
+
+  class GreDecoder : public Decoder {
+  private:
+    struct gre_header {
+      u_int16_t flags_;  // C, K, S flags and version
+      u_int16_t proto_;  // protocol type of payload (ether type)
+    } __attribute__((packed));
+
+    static const u_int16_t FLAG_C = 0x8000;  // checksum present
+    static const u_int16_t FLAG_K = 0x2000;  // key present
+    static const u_int16_t FLAG_S = 0x1000;  // sequence number present
+    static const u_int16_t VER_MASK = 0x0007;
+
+    static const u_int16_t PROTO_IPV4 = 0x0800;
+    static const u_int16_t PROTO_IPV6 = 0x86dd;
+    static const u_int16_t PROTO_TEB  = 0x6558;  // transparent bridging
+    static const u_int16_t PROTO_MPLS = 0x8847;
+
+    ev_id EV_GRE_PKT_;
+    val_id P_PROTO_, P_KEY_;
+    dec_id D_ETHER_, D_IPV4_, D_IPV6_, D_MPLS_;
+
+  public:
+    explicit GreDecoder (NetDec * nd) : Decoder (nd) {
+      this->EV_GRE_PKT_ = nd->assign_event ("gre.packet", "GRE Packet");
+      this->P_PROTO_ = nd->assign_value ("gre.proto", "GRE Protocol Type",
+                                         new FacNum ());
+      this->P_KEY_   = nd->assign_value ("gre.key", "GRE Key",
+                                         new FacNum ());
+    }
+    void setup (NetDec * nd) {
+      this->D_ETHER_ = nd->lookup_dec_id ("ether");
+      this->D_IPV4_  = nd->lookup_dec_id ("ipv4");
+      this->D_IPV6_  = nd->lookup_dec_id ("ipv6");
+      this->D_MPLS_  = nd->lookup_dec_id ("mpls");
+    };
+
+    static Decoder * New (NetDec * nd) { return new GreDecoder (nd); }
+
+    bool decode (Property *p) {
+      auto hdr = reinterpret_cast <struct gre_header *>
+        (p->payload (sizeof (struct gre_header)));
+
+      if (hdr == NULL) {
+        return false;
+      }
+
+      // version 1 is enhanced GRE of PPTP, not decapsulated
+      const u_int16_t flags = ntohs (hdr->flags_);
+      if ((flags & VER_MASK) != 0) {
+        return false;
+      }
+
+      p->set (this->P_PROTO_, &(hdr->proto_), sizeof (hdr->proto_));
+      if ((flags & FLAG_C) && p->payload (4) == NULL) {  // checksum, reserved
+        return false;
+      }
+      if (flags & FLAG_K) {
+        byte_t *key = p->payload (4);
+        if (key == NULL) {
+          return false;
+        }
+        p->set (this->P_KEY_, key, 4);
+      }
+      if ((flags & FLAG_S) && p->payload (4) == NULL) {
+        return false;
+      }
+
+      p->push_event (this->EV_GRE_PKT_);
+
+      switch (ntohs (hdr->proto_)) {
+      case PROTO_IPV4: p->decap (); this->emit (this->D_IPV4_, p); break;
+      case PROTO_IPV6: p->decap (); this->emit (this->D_IPV6_, p); break;
+      case PROTO_TEB:  p->decap (); this->emit (this->D_ETHER_, p); break;
+      case PROTO_MPLS: p->decap (); this->emit (this->D_MPLS_, p); break;
+      }
+
+      return true;
+    }
+  };
+
+  INIT_DECODER (gre, GreDecoder::New);
+}  // namespace swarm
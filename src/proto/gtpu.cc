@@ -0,0 +1,126 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../decode.h"
+
+
+namespace swarm {
+
+  class GtpuDecoder : public Decoder {
+  private:
+    struct gtp_header {
+      u_int8_t flags_;    // version, PT, E, S, PN
+      u_int8_t type_;     // message type
+      u_int16_t length_;  // length after mandatory header
+      u_int32_t teid_;    // tunnel endpoint identifier
+    } __attribute__((packed));
+
+    struct gtp_opt_header {
+      u_int16_t seq_;
+      u_int8_t npdu_;
+      u_int8_t next_ext_;  // type of next extension header
+    } __attribute__((packed));
+
+    static const u_int8_t VERSION_1 = 0x20;
+    static const u_int8_t VERSION_MASK = 0xe0;
+    static const u_int8_t FLAG_E  = 0x04;  // extension header
+    static const u_int8_t FLAG_S  = 0x02;  // sequence number
+    static const u_int8_t FLAG_PN = 0x01;  // N-PDU number
+    static const u_int8_t TYPE_GPDU = 0xff;
+    static const u_int16_t PORT_GTPU = 2152;
+
+    ev_id EV_GTPU_PKT_;
+    val_id P_TYPE_, P_TEID_;
+    dec_id D_IPV4_, D_IPV6_;
+
+  public:
+    explicit GtpuDecoder (NetDec * nd) : Decoder (nd) {
+      this->EV_GTPU_PKT_ = nd->assign_event ("gtpu.packet", "GTP-U Packet");
+      this->P_TYPE_ = nd->assign_value ("gtpu.type", "GTP-U Message Type",
+                                        new FacNum ());
+      this->P_TEID_ = nd->assign_value ("gtpu.teid",
+                                        "GTP-U Tunnel Endpoint ID",
+                                        new FacNum ());
+    }
+    void setup (NetDec * nd) {
+      this->D_IPV4_ = nd->lookup_dec_id ("ipv4");
+      this->D_IPV6_ = nd->lookup_dec_id ("ipv6");
+      nd->bind_port (nd->lookup_dec_id ("gtpu"), "udp", PORT_GTPU);
+    };
+
+    static Decoder * New (NetDec * nd) { return new GtpuDecoder (nd); }
+
+    bool decode (Property *p) {
+      auto hdr = reinterpret_cast <struct gtp_header *>
+        (p->payload (sizeof (struct gtp_header)));
+
+      if (hdr == NULL || (hdr->flags_ & VERSION_MASK) != VERSION_1) {
+        return false;
+      }
+
+      p->set (this->P_TYPE_, &(hdr->type_), sizeof (hdr->type_));
+      p->set (this->P_TEID_, &(hdr->teid_), sizeof (hdr->teid_));
+
+      if (hdr->flags_ & (FLAG_E | FLAG_S | FLAG_PN)) {
+        auto opt = reinterpret_cast <struct gtp_opt_header *>
+          (p->payload (sizeof (struct gtp_opt_header)));
+        if (opt == NULL) {
+          return false;
+        }
+
+        // extension header: length in 4 octets, the last octet is type
+        // of the next one
+        u_int8_t next_ext = (hdr->flags_ & FLAG_E) ? opt->next_ext_ : 0;
+        while (next_ext != 0) {
+          byte_t *ext_len = p->refer (1);
+          if (ext_len == NULL || *ext_len == 0) {
+            return false;
+          }
+          byte_t *ext = p->payload (*ext_len * 4);
+          if (ext == NULL) {
+            return false;
+          }
+          next_ext = ext[*ext_len * 4 - 1];
+        }
+      }
+
+      p->push_event (this->EV_GTPU_PKT_);
+
+      // G-PDU carries a user IP packet
+      byte_t *ip = p->refer (1);
+      if (hdr->type_ == TYPE_GPDU && ip) {
+        switch (*ip >> 4) {
+        case 4: p->decap (); this->emit (this->D_IPV4_, p); break;
+        case 6: p->decap (); this->emit (this->D_IPV6_, p); break;
+        }
+      }
+
+      return true;
+    }
+  };
+
+  INIT_DECODER (gtpu, GtpuDecoder::New);
+}  // namespace swarm
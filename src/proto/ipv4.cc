@@ -38,9 +38,11 @@ namespace swarm {
   class IPv4Decoder : public Decoder {
   private:
     static const u_int8_t PROTO_ICMP  = 1;
+    static const u_int8_t PROTO_IPIP  = 4;
     static const u_int8_t PROTO_TCP   = 6;
     static const u_int8_t PROTO_UDP   = 17;
     static const u_int8_t PROTO_IPV6  = 41;
+    static const u_int8_t PROTO_GRE   = 47;
     static const u_int8_t PROTO_ICMP6 = 58;
 
     struct ipv4_header {
@@ -59,11 +61,13 @@ namespace swarm {
     } __attribute__((packed));
 
     ev_id EV_IPV4_PKT_;
-    val_id P_PROTO_, P_SRC_, P_DST_, P_TLEN_, P_PL_;
+    val_id P_PROTO_, P_SRC_, P_DST_, P_TLEN_, P_PL_, P_CHKSUM_OK_;
+    u_int8_t chksum_ok_[2];  // values of P_CHKSUM_OK_
     dec_id D_ICMP_;
     dec_id D_UDP_;
     dec_id D_TCP_;
     dec_id D_ICMP6_;
+    dec_id D_IPV4_, D_IPV6_, D_GRE_;
 
   public:
     DEF_REPR_CLASS (Proto, FacProto);
@@ -79,12 +83,20 @@ namespace swarm {
       this->P_TLEN_  = nd->assign_value ("ipv4.total", "IPv4 Total Length",
                                          new FacNum());
       this->P_PL_    = nd->assign_value ("ipv4.payload", "IPv4 Data Payload");
+      this->P_CHKSUM_OK_ = nd->assign_value ("ipv4.chksum_ok",
+                                             "IPv4 Header Checksum OK",
+                                             new FacNum ());
+      this->chksum_ok_[0] = 0;
+      this->chksum_ok_[1] = 1;
     }
     void setup (NetDec * nd) {
       this->D_ICMP_  = nd->lookup_dec_id ("icmp");
       this->D_ICMP6_ = nd->lookup_dec_id ("icmp6");
       this->D_UDP_   = nd->lookup_dec_id ("udp");
       this->D_TCP_   = nd->lookup_dec_id ("tcp");
+      this->D_IPV4_  = nd->lookup_dec_id ("ipv4");
+      this->D_IPV6_  = nd->lookup_dec_id ("ipv6");
+      this->D_GRE_   = nd->lookup_dec_id ("gre");
     };
 
     static Decoder * New (NetDec * nd) { return new IPv4Decoder (nd); }
@@ -113,7 +125,25 @@ namespace swarm {
         return false;
       }
 
-      size_t data_len = htons (hdr->total_len_) - (hdr_len);
+      const size_t total_len = ntohs (hdr->total_len_);
+      size_t data_len = (total_len > hdr_len) ? total_len - hdr_len : 0;
+      bool chksum_ok = true;
+      if (this->netdec ()->checksum ()) {
+        chksum_ok = Checksum::verify (hdr, hdr_len);
+        p->set (this->P_CHKSUM_OK_, &(this->chksum_ok_[chksum_ok]), 1);
+        this->netdec ()->count_checksum (chksum_ok);
+
+        // L4 checksum can not be verified for a fragment
+        if (chksum_ok && (ntohs (hdr->offset_) & (IP_MF | IP_OFFMASK)) == 0) {
+          p->set_pseudo_sum (Checksum::pseudo (&(hdr->src_), &(hdr->dst_),
+                                               sizeof (hdr->src_),
+                                               hdr->proto_, data_len),
+                             data_len);
+        } else {
+          p->set_pseudo_sum (0, 0);
+        }
+      }
+
       auto ip_data = p->refer (data_len);
       if (ip_data) {
         p->set (this->P_PL_, ip_data, data_len);
@@ -126,12 +156,21 @@ namespace swarm {
       assert (sizeof (hdr->src_) == sizeof (hdr->dst_));
       p->set_addr (&(hdr->src_), &(hdr->dst_), hdr->proto_, sizeof (hdr->src_));
 
+      if (!chksum_ok) {
+        return true;  // do not let a broken header reach upper layers
+      }
+
       // call next decoder
       switch (hdr->proto_) {
       case PROTO_ICMP:  this->emit (this->D_ICMP_,  p); break;
       case PROTO_TCP:   this->emit (this->D_TCP_,   p); break;
       case PROTO_UDP:   this->emit (this->D_UDP_,   p); break;
       case PROTO_ICMP6: this->emit (this->D_ICMP6_, p); break;
+      case PROTO_GRE:   this->emit (this->D_GRE_,   p); break;
+
+        // IP in IP (RFC 2003) and 6in4 (RFC 4213)
+      case PROTO_IPIP:  p->decap (); this->emit (this->D_IPV4_, p); break;
+      case PROTO_IPV6:  p->decap (); this->emit (this->D_IPV6_, p); break;
       }
 
       return true;
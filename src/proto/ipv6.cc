@@ -35,9 +35,11 @@ namespace swarm {
     static const size_t OCTET_UNIT = 8;
 
     static const u_int8_t PROTO_ICMP  = 1;
+    static const u_int8_t PROTO_IPIP  = 4;
     static const u_int8_t PROTO_TCP   = 6;
     static const u_int8_t PROTO_UDP   = 17;
     static const u_int8_t PROTO_IPV6  = 41;
+    static const u_int8_t PROTO_GRE   = 47;
     static const u_int8_t PROTO_ICMP6 = 58;
 
     static const u_int8_t EXT_HBH   =  0;  // Hop-by-Hop Options
@@ -68,6 +70,7 @@ namespace swarm {
     dec_id D_UDP_;
     dec_id D_TCP_;
     dec_id D_ICMP6_;
+    dec_id D_IPV4_, D_IPV6_, D_GRE_;
 
   public:
     DEF_REPR_CLASS (Proto, FacProto);
@@ -89,18 +92,55 @@ namespace swarm {
       this->D_ICMP6_ = nd->lookup_dec_id ("icmp6");
       this->D_UDP_   = nd->lookup_dec_id ("udp");
       this->D_TCP_   = nd->lookup_dec_id ("tcp");
+      this->D_IPV4_  = nd->lookup_dec_id ("ipv4");
+      this->D_IPV6_  = nd->lookup_dec_id ("ipv6");
+      this->D_GRE_   = nd->lookup_dec_id ("gre");
     };
 
     static Decoder * New (NetDec * nd) { return new Ipv6Decoder (nd); }
 
-    bool next (u_int8_t next_hdr, Property *p) {
+    // For checksum verification of upper layer. ip_data is head of IPv6
+    // payload, or NULL if checksum is not verified.
+    void set_pseudo_sum (u_int8_t next_hdr, Property *p,
+                         const byte_t *ip_data, size_t data_len) {
+      const byte_t *l4 = p->refer (0);
+      if (ip_data == NULL || l4 == NULL ||
+          static_cast<size_t> (l4 - ip_data) >= data_len) {
+        p->set_pseudo_sum (0, 0);
+        return;
+      }
+
+      size_t addr_len;
+      const void *src = p->src_addr (&addr_len);
+      const void *dst = p->dst_addr (&addr_len);
+      const size_t l4_len = data_len - (l4 - ip_data);
+      p->set_pseudo_sum (Checksum::pseudo (src, dst, addr_len, next_hdr,
+                                           l4_len), l4_len);
+    }
+
+    bool next (u_int8_t next_hdr, Property *p, const byte_t *ip_data,
+               size_t data_len) {
       // call next decoder
       switch (next_hdr) {
         // next protocol decoder
       case PROTO_ICMP:  this->emit (this->D_ICMP_,  p); break;
-      case PROTO_TCP:   this->emit (this->D_TCP_,   p); break;
-      case PROTO_UDP:   this->emit (this->D_UDP_,   p); break;
-      case PROTO_ICMP6: this->emit (this->D_ICMP6_, p); break;
+      case PROTO_TCP:
+        this->set_pseudo_sum (next_hdr, p, ip_data, data_len);
+        this->emit (this->D_TCP_,   p);
+        break;
+      case PROTO_UDP:
+        this->set_pseudo_sum (next_hdr, p, ip_data, data_len);
+        this->emit (this->D_UDP_,   p);
+        break;
+      case PROTO_ICMP6:
+        this->set_pseudo_sum (next_hdr, p, ip_data, data_len);
+        this->emit (this->D_ICMP6_, p);
+        break;
+      case PROTO_GRE:   this->emit (this->D_GRE_,   p); break;
+
+        // IPv4 and IPv6 in IPv6 (RFC 2473)
+      case PROTO_IPIP:  p->decap (); this->emit (this->D_IPV4_, p); break;
+      case PROTO_IPV6:  p->decap (); this->emit (this->D_IPV6_, p); break;
 
         // IPv6 extention header
       case EXT_HBH:
@@ -124,7 +164,11 @@ namespace swarm {
             }
           }
 
-          return this->next (opthdr->next_hdr_, p);
+          // L4 checksum can not be verified for a fragment
+          if (next_hdr == EXT_FRAG) {
+            ip_data = NULL;
+          }
+          return this->next (opthdr->next_hdr_, p, ip_data, data_len);
         }
         break;
 
@@ -164,7 +208,9 @@ namespace swarm {
       p->set_addr (&(hdr->src_), &(hdr->dst_), hdr->next_hdr_,
                    sizeof (hdr->src_));
 
-      return this->next (hdr->next_hdr_, p);
+      return this->next (hdr->next_hdr_, p,
+                         this->netdec ()->checksum () ? p->refer (0) : NULL,
+                         data_len);
     }
   };
 
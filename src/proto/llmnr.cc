@@ -32,7 +32,8 @@ namespace swarm {
   // Link-local Multicast Name Resolution Protocol
   class LlmnrDecoder : public NameServiceDecoder {
   public:
-    explicit LlmnrDecoder (NetDec * nd) : NameServiceDecoder (nd, "llmnr") {
+    explicit LlmnrDecoder (NetDec * nd) :
+      NameServiceDecoder (nd, "llmnr", 5355) {
     }
 
     // Factory function for LlmnrDecoder
@@ -32,7 +32,8 @@ namespace swarm {
   // Link-local Multicast Name Resolution Protocol
   class MdnsDecoder : public NameServiceDecoder {
   public:
-    explicit MdnsDecoder (NetDec * nd) : NameServiceDecoder (nd, "mdns") {
+    explicit MdnsDecoder (NetDec * nd) :
+      NameServiceDecoder (nd, "mdns", 5353) {
     }
 
     // Factory function for MdnsDecoder
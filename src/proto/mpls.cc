@@ -0,0 +1,88 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../decode.h"
+
+
+namespace swarm {
+
+  class MplsDecoder : public Decoder {
+  private:
+    static const u_int32_t LABEL_SHIFT = 12;
+    static const u_int32_t BOS = 0x00000100;  // bottom of stack
+    static const size_t STACK_MAX = 16;
+
+    ev_id EV_MPLS_PKT_;
+    val_id P_LABEL_;
+    dec_id D_IPV4_, D_IPV6_;
+
+  public:
+    explicit MplsDecoder (NetDec * nd) : Decoder (nd) {
+      this->EV_MPLS_PKT_ = nd->assign_event ("mpls.packet", "MPLS Packet");
+      this->P_LABEL_ = nd->assign_value ("mpls.label",
+                                         "MPLS Label (outer first)",
+                                         new FacNum ());
+    }
+    void setup (NetDec * nd) {
+      this->D_IPV4_ = nd->lookup_dec_id ("ipv4");
+      this->D_IPV6_ = nd->lookup_dec_id ("ipv6");
+    };
+
+    static Decoder * New (NetDec * nd) { return new MplsDecoder (nd); }
+
+    bool decode (Property *p) {
+      // label stack entry: label (20 bits), TC (3), S (1), TTL (8)
+      for (size_t i = 0; ; i++) {
+        byte_t *ent = p->payload (4);
+        if (ent == NULL || i >= STACK_MAX) {
+          return false;
+        }
+
+        u_int32_t e = (ent[0] << 24) | (ent[1] << 16) | (ent[2] << 8) | ent[3];
+        u_int32_t label = htonl (e >> LABEL_SHIFT);
+        p->copy (this->P_LABEL_, &label, sizeof (label));
+        if (e & BOS) {
+          break;
+        }
+      }
+
+      p->push_event (this->EV_MPLS_PKT_);
+
+      // no payload type in MPLS, guess it by IP version
+      byte_t *ip = p->refer (1);
+      if (ip) {
+        switch (*ip >> 4) {
+        case 4: this->emit (this->D_IPV4_, p); break;
+        case 6: this->emit (this->D_IPV6_, p); break;
+        }
+      }
+
+      return true;
+    }
+  };
+
+  INIT_DECODER (mpls, MplsDecoder::New);
+}  // namespace swarm
@@ -33,7 +33,7 @@ namespace swarm {
   class NetBiosNSDecoder : public NameServiceDecoder {
   public:
     explicit NetBiosNSDecoder (NetDec * nd) :
-      NameServiceDecoder (nd, "netbios_ns") {
+      NameServiceDecoder (nd, "netbios_ns", 137) {
     }
 
     // Factory function for NetBiosNSDecoder
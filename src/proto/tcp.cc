@@ -57,8 +57,10 @@ namespace swarm {
     static const u_int8_t CWR  = 0x80;
 
     ev_id EV_PKT_, EV_SYN_;
-    val_id P_SRC_PORT_, P_DST_PORT_, P_FLAGS_, P_SEQ_, P_ACK_;
+    val_id P_SRC_PORT_, P_DST_PORT_, P_FLAGS_, P_SEQ_, P_ACK_, P_CHKSUM_OK_;
+    u_int8_t chksum_ok_[2];  // values of P_CHKSUM_OK_
     dec_id TCP_SSN_;
+    const PortMap *port_map_;
 
   public:
     DEF_REPR_CLASS (VarFlags, FacFlags);
@@ -77,10 +79,16 @@ namespace swarm {
         nd->assign_value ("tcp.flags", "TCP Flags", new FacFlags ());
       this->P_SEQ_ = nd->assign_value ("tcp.seq", "TCP Sequence Number");
       this->P_ACK_ = nd->assign_value ("tcp.ack", "TCP Acknowledge");
+      this->P_CHKSUM_OK_ = nd->assign_value ("tcp.chksum_ok",
+                                             "TCP Checksum OK", new FacNum ());
+      this->chksum_ok_[0] = 0;
+      this->chksum_ok_[1] = 1;
 
     }
     void setup (NetDec * nd) {
       this->TCP_SSN_ = nd->lookup_dec_id("tcp_ssn");
+      // decoders claim their ports by NetDec::bind_port()
+      this->port_map_ = nd->port_map ("tcp");
     };
 
     static Decoder * New (NetDec * nd) { return new TcpDecoder (nd); }
@@ -100,6 +108,17 @@ namespace swarm {
       p->set (this->P_SEQ_,      &(hdr->seq_),      sizeof (hdr->seq_));
       p->set (this->P_ACK_,      &(hdr->ack_),      sizeof (hdr->ack_));
 
+      // verify whole segment if it is captured
+      bool chksum_ok = true;
+      uint64_t sum;
+      size_t seg_len;
+      if (this->netdec ()->checksum () && p->pseudo_sum (&sum, &seg_len) &&
+          seg_len <= p->remain () + sizeof (struct tcp_header)) {
+        chksum_ok = Checksum::verify (hdr, seg_len, sum);
+        p->set (this->P_CHKSUM_OK_, &(this->chksum_ok_[chksum_ok]), 1);
+        this->netdec ()->count_checksum (chksum_ok);
+      }
+
       // push event
       p->push_event (this->EV_PKT_);
 
@@ -141,7 +160,15 @@ namespace swarm {
         }
       }
 
-      this->emit(this->TCP_SSN_, p);
+      if (chksum_ok) {
+        // a broken segment must not change session state. tcp_ssn tracks
+        // every segment, and then a decoder bound to the port gets it too.
+        this->emit (this->TCP_SSN_, p);
+        this->emit (this->netdec ()->match_port (this->port_map_,
+                                                 ntohs (hdr->src_port_),
+                                                 ntohs (hdr->dst_port_), *p),
+                    p);
+      }
 
       return true;
     }
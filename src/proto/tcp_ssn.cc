@@ -24,9 +24,13 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <new>
 #include <sstream>
 #include "../decode.h"
+#include "../checkpoint.h"
 #include "../utils/lru-hash.h"
+#include "../utils/mem-pool.h"
 #include "../debug.h"
 
 namespace swarm {
@@ -44,6 +48,29 @@ namespace swarm {
     LAST_ACK,
   };
 
+  // Checkpoint record of TcpSession, see TcpSsnDecoder::checkpoint().
+  // VERSION must be raised when the layout changes.
+  struct TcpSsnRecord {
+    static const uint32_t VERSION = 1;
+    static const size_t KEY_MAX = 40;  // session label of IPv6
+    struct Node {
+      uint32_t base_seq_;
+      uint32_t sent_len_;
+      uint32_t next_ack_;
+      uint8_t avail_seq_;
+      uint8_t avail_ack_;
+      uint8_t stat_;
+      uint8_t flags_;  // cf_wait_ and updated_
+    };
+    uint64_t hash_;
+    int64_t ts_;
+    Node server_, client_;
+    uint8_t dir_;
+    uint8_t key_len_;
+    uint8_t reserved_[6];
+    byte_t key_[KEY_MAX];
+  };
+
   class TcpSession : public LRUHash::Node {
     static const u_int8_t FIN  = 0x01;
     static const u_int8_t SYN  = 0x02;
@@ -84,6 +111,30 @@ namespace swarm {
       }
       ~Node() {};
       inline TcpStat stat() const { return this->stat_; }
+
+      void save(TcpSsnRecord::Node *rec) const {
+        rec->base_seq_ = this->base_seq_;
+        rec->sent_len_ = this->sent_len_;
+        rec->next_ack_ = this->next_ack_;
+        rec->avail_seq_ = this->avail_seq_;
+        rec->avail_ack_ = this->avail_ack_;
+        rec->stat_ = static_cast<uint8_t>(this->stat_);
+        rec->flags_ = (this->cf_wait_ ? 0x01 : 0) | (this->updated_ ? 0x02 : 0);
+      }
+      bool load(const TcpSsnRecord::Node &rec) {
+        if (rec.stat_ > LAST_ACK) {
+          return false;
+        }
+        this->base_seq_ = rec.base_seq_;
+        this->sent_len_ = rec.sent_len_;
+        this->next_ack_ = rec.next_ack_;
+        this->avail_seq_ = (rec.avail_seq_ != 0);
+        this->avail_ack_ = (rec.avail_ack_ != 0);
+        this->stat_ = static_cast<TcpStat>(rec.stat_);
+        this->cf_wait_ = ((rec.flags_ & 0x01) != 0);
+        this->updated_ = ((rec.flags_ & 0x02) != 0);
+        return true;
+      }
       bool updated() const { return this->updated_; }
 
       void update_stat(TcpStat stat) {
@@ -290,6 +341,30 @@ namespace swarm {
     uint64_t hash() {
       return this->hash_;
     }
+    // false if the key is too long for a record
+    bool save(TcpSsnRecord *rec) const {
+      if (this->len_ > TcpSsnRecord::KEY_MAX) {
+        return false;
+      }
+      ::memset(rec, 0, sizeof(*rec));
+      rec->hash_ = this->hash_;
+      rec->ts_ = static_cast<int64_t>(this->ts_);
+      this->server_.save(&rec->server_);
+      this->client_.save(&rec->client_);
+      rec->dir_ = static_cast<uint8_t>(this->dir_);
+      rec->key_len_ = static_cast<uint8_t>(this->len_);
+      ::memcpy(rec->key_, this->key_, this->len_);
+      return true;
+    }
+    bool load(const TcpSsnRecord &rec) {
+      if (rec.dir_ > DIR_R2L) {
+        return false;
+      }
+      this->ts_ = static_cast<time_t>(rec.ts_);
+      this->dir_ = static_cast<FlowDir>(rec.dir_);
+      return (this->server_.load(rec.server_) && this->client_.load(rec.client_));
+    }
+
     inline bool to_server(FlowDir dir) const {
       return (this->dir_ == dir && this->dir_ != DIR_NIL);
     }
@@ -379,6 +454,7 @@ namespace swarm {
     val_id P_SEG_, P_TO_SERVER_;
     val_id P_TCP_HDR_, P_TCP_SEQ_, P_TCP_ACK_, P_TCP_FLAGS_;
     LRUHash *ssn_table_;
+    MemSlab *ssn_slab_;  // TcpSession objects
     time_t last_ts_;
     static const time_t TIMEOUT = 300;
 
@@ -390,16 +466,25 @@ namespace swarm {
       this->P_TO_SERVER_ = 
         nd->assign_value ("tcp_ssn.to_server", "Packet to server");
 
-      this->ssn_table_ = new LRUHash(3600, 0xffff);
+      // sessions and buckets on huge pages of "tcp_ssn" pool
+      MemPool *pool = MemPool::get("tcp_ssn");
+      this->ssn_table_ = new LRUHash(3600, 0xffff, pool);
+      this->ssn_slab_ = new MemSlab(pool, sizeof(TcpSession));
     }
     ~TcpSsnDecoder() {
       this->ssn_table_->prog(3600);
       TcpSession *ssn;
       while (NULL != (ssn = dynamic_cast<TcpSession*>(this->ssn_table_->pop()))) {
-        delete ssn;
+        this->free_session(ssn);
       }
 
       delete this->ssn_table_;
+      delete this->ssn_slab_;
+    }
+
+    void free_session(TcpSession *ssn) {
+      ssn->~TcpSession();
+      this->ssn_slab_->put(ssn);
     }
 
     void setup (NetDec * nd) {
@@ -412,6 +497,64 @@ namespace swarm {
 
     static Decoder * New (NetDec * nd) { return new TcpSsnDecoder (nd); }
 
+    size_t session_count () const { return this->ssn_slab_->count(); }
+
+    // keep sessions over hot swap, old one deletes the empty table
+    void migrate (Decoder *old) {
+      TcpSsnDecoder *prev = dynamic_cast<TcpSsnDecoder *> (old);
+      if (prev) {
+        std::swap (this->ssn_table_, prev->ssn_table_);
+        std::swap (this->ssn_slab_, prev->ssn_slab_);
+        this->last_ts_ = prev->last_ts_;
+      }
+    }
+
+    // Established and half open sessions are saved, so a restarted sensor
+    // goes on with them instead of dropping non SYN packets for TIMEOUT.
+    bool checkpoint (CheckpointWriter *w) const {
+      if (!w->begin("tcp_ssn", TcpSsnRecord::VERSION, sizeof(TcpSsnRecord))) {
+        return false;
+      }
+      std::vector<LRUHash::Node*> nodes;
+      this->ssn_table_->nodes(&nodes);
+      TcpSsnRecord rec;
+      for (size_t i = 0; i < nodes.size(); i++) {
+        const TcpSession *ssn = dynamic_cast<const TcpSession*>(nodes[i]);
+        if (ssn && ssn->save(&rec) && !w->append(&rec)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool restore (const CheckpointReader &r) {
+      size_t count;
+      const TcpSsnRecord *rec = static_cast<const TcpSsnRecord *>
+        (r.section("tcp_ssn", TcpSsnRecord::VERSION, sizeof(TcpSsnRecord),
+                   &count));
+      // no section or another layout: start with empty table
+      for (size_t i = 0; rec != NULL && i < count; i++) {
+        const TcpSsnRecord &ent = rec[i];
+        if (ent.key_len_ > TcpSsnRecord::KEY_MAX ||
+            this->ssn_table_->get(ent.hash_, ent.key_, ent.key_len_)) {
+          continue;  // broken or already seen
+        }
+
+        void *mem = this->ssn_slab_->get();
+        if (mem == NULL) {
+          return false;  // out of memory
+        }
+        TcpSession *ssn = new (mem) TcpSession(ent.key_, ent.key_len_,
+                                               ent.hash_);
+        if (!ssn->load(ent)) {
+          this->free_session(ssn);
+          continue;
+        }
+        this->ssn_table_->put(TIMEOUT, ssn);
+      }
+      return true;
+    }
+
     void timeout_session(time_t tv_sec) {
       // session timeout 
       if (this->last_ts_ > 0 && this->last_ts_ < tv_sec) {
@@ -422,7 +565,7 @@ namespace swarm {
       while (NULL != (outdated_ssn = 
                       dynamic_cast<TcpSession*>(this->ssn_table_->pop()))) {
         if (outdated_ssn->ts() + TIMEOUT < tv_sec) {
-          delete outdated_ssn;
+          this->free_session(outdated_ssn);
         } else {
           this->ssn_table_->put(TIMEOUT, outdated_ssn);
         }
@@ -440,7 +583,11 @@ namespace swarm {
         (this->ssn_table_->get(p->hash_value(), ssn_key, key_len));
 
       if (!ssn) {
-        ssn = new TcpSession(ssn_key, key_len, p->hash_value());
+        void *mem = this->ssn_slab_->get();
+        if (mem == NULL) {
+          return NULL;  // out of memory
+        }
+        ssn = new (mem) TcpSession(ssn_key, key_len, p->hash_value());
         this->ssn_table_->put(TIMEOUT, ssn);
       }
 
@@ -452,6 +599,9 @@ namespace swarm {
       this->timeout_session(p->tv_sec());
 
       TcpSession *ssn = this->fetch_session(p);
+      if (!ssn) {
+        return false;
+      }
       size_t data_len = p->remain();
 
       uint8_t flags = p->value(this->P_TCP_FLAGS_).ntoh <uint8_t> ();
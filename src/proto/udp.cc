@@ -40,8 +40,9 @@ namespace swarm {
     } __attribute__((packed));
 
     ev_id EV_UDP_PKT_;
-    val_id P_SRC_PORT_, P_DST_PORT_, P_LEN_;
-    dec_id D_DNS_, D_LLMNR_, D_NETBIOS_NS_, D_MDNS_;
+    val_id P_SRC_PORT_, P_DST_PORT_, P_LEN_, P_CHKSUM_OK_;
+    u_int8_t chksum_ok_[2];  // values of P_CHKSUM_OK_
+    const PortMap *port_map_;
 
   public:
     explicit UdpDecoder (NetDec * nd) : Decoder (nd) {
@@ -55,12 +56,14 @@ namespace swarm {
                           new FacNum ());
       this->P_LEN_ =
         nd->assign_value ("udp.len", "UDP Data Length", new FacNum ());
+      this->P_CHKSUM_OK_ =
+        nd->assign_value ("udp.chksum_ok", "UDP Checksum OK", new FacNum ());
+      this->chksum_ok_[0] = 0;
+      this->chksum_ok_[1] = 1;
     }
     void setup (NetDec * nd) {
-      this->D_DNS_ = nd->lookup_dec_id ("dns");
-      this->D_LLMNR_ = nd->lookup_dec_id ("llmnr");
-      this->D_NETBIOS_NS_ = nd->lookup_dec_id ("netbios_ns");
-      this->D_MDNS_ = nd->lookup_dec_id ("mdns");
+      // upper decoders claim their ports by NetDec::bind_port()
+      this->port_map_ = nd->port_map ("udp");
     };
 
     static Decoder * New (NetDec * nd) { return new UdpDecoder (nd); }
@@ -78,6 +81,21 @@ namespace swarm {
       p->set (this->P_DST_PORT_, &(hdr->dst_port_), sizeof (hdr->dst_port_));
       p->set (this->P_LEN_, &(hdr->length_), sizeof (hdr->length_));
 
+      // verify whole datagram if it is captured. Zero checksum means
+      // not computed by sender over IPv4
+      bool chksum_ok = true;
+      uint64_t sum;
+      size_t dgm_len, addr_len;
+      if (this->netdec ()->checksum () && p->pseudo_sum (&sum, &dgm_len) &&
+          dgm_len <= p->remain () + sizeof (struct udp_header)) {
+        p->src_addr (&addr_len);
+        if (hdr->chksum_ != 0 || addr_len != 4) {
+          chksum_ok = Checksum::verify (hdr, dgm_len, sum);
+        }
+        p->set (this->P_CHKSUM_OK_, &(this->chksum_ok_[chksum_ok]), 1);
+        this->netdec ()->count_checksum (chksum_ok);
+      }
+
       // push event
       p->push_event (this->EV_UDP_PKT_);
 
@@ -88,19 +106,13 @@ namespace swarm {
       p->calc_hash();
 
       // call next decoder
-      if (ntohs (hdr->src_port_) == 53 ||
-          ntohs (hdr->dst_port_) == 53) {
-        this->emit (this->D_DNS_, p);
-      } else if (ntohs (hdr->src_port_) == 5355 ||
-                 ntohs (hdr->dst_port_) == 5355) {
-        this->emit (this->D_LLMNR_, p);
-      } else if (ntohs (hdr->src_port_) == 137 ||
-                 ntohs (hdr->dst_port_) == 137) {
-        this->emit (this->D_NETBIOS_NS_, p);
-      } else if (ntohs (hdr->src_port_) == 5353 ||
-                 ntohs (hdr->dst_port_) == 5353) {
-        this->emit (this->D_MDNS_, p);
+      if (!chksum_ok) {
+        return true;  // a broken datagram must not change DNS state
       }
+      this->emit (this->netdec ()->match_port (this->port_map_,
+                                               ntohs (hdr->src_port_),
+                                               ntohs (hdr->dst_port_), *p),
+                  p);
 
       return true;
     }
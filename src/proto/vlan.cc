@@ -39,12 +39,14 @@ namespace swarm {
 
     ev_id EV_VLAN_PKT_;
     val_id P_PROTO_, P_ID_;
-    dec_id D_ARP_, D_VLAN_, D_IPV4_, D_IPV6_;
+    dec_id D_ARP_, D_VLAN_, D_IPV4_, D_IPV6_, D_MPLS_;
 
     static const u_int16_t ETHERTYPE_ARP = 0x0806;
     static const u_int16_t ETHERTYPE_VLAN = 0x8100;
     static const u_int16_t ETHERTYPE_IP = 0x0800;
     static const u_int16_t ETHERTYPE_IPV6 = 0x86dd;
+    static const u_int16_t ETHERTYPE_MPLS = 0x8847;
+    static const u_int16_t ETHERTYPE_MPLS_MCAST = 0x8848;
     static const u_int16_t ETHERTYPE_LOOPBACK = 0x9000;
     static const u_int16_t ETHERTYPE_WLCCP = 0x872d;
     static const u_int16_t ETHERTYPE_NETWARE = 0x8137;
@@ -73,6 +75,8 @@ namespace swarm {
     }
     void setup (NetDec * nd) {
       this->D_ARP_  = nd->lookup_dec_id ("arp");
+      this->D_VLAN_ = nd->lookup_dec_id ("vlan");
+      this->D_MPLS_ = nd->lookup_dec_id ("mpls");
       this->D_IPV4_ = nd->lookup_dec_id ("ipv4");
       this->D_IPV6_ = nd->lookup_dec_id ("ipv6");
     };
@@ -104,6 +108,8 @@ namespace swarm {
       case ETHERTYPE_VLAN: this->emit (this->D_VLAN_, p); break;
       case ETHERTYPE_IP:   this->emit (this->D_IPV4_, p); break;
       case ETHERTYPE_IPV6: this->emit (this->D_IPV6_, p); break;
+      case ETHERTYPE_MPLS:
+      case ETHERTYPE_MPLS_MCAST: this->emit (this->D_MPLS_, p); break;
       case ETHERTYPE_LOOPBACK: break;  // ignore
       case ETHERTYPE_WLCCP:    break;  // ignore
       case ETHERTYPE_NETWARE:  break;  // ignore
@@ -0,0 +1,81 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../decode.h"
+
+
+namespace swarm {
+
+  class VxlanDecoder : public Decoder {
+  private:
+    struct vxlan_header {
+      u_int8_t flags_;
+      u_int8_t reserved1_[3];
+      u_int8_t vni_[3];       // VXLAN network identifier
+      u_int8_t reserved2_;
+    } __attribute__((packed));
+
+    static const u_int8_t FLAG_I = 0x08;  // VNI is valid
+    static const u_int16_t PORT_VXLAN = 4789;
+
+    ev_id EV_VXLAN_PKT_;
+    val_id P_VNI_;
+    dec_id D_ETHER_;
+
+  public:
+    explicit VxlanDecoder (NetDec * nd) : Decoder (nd) {
+      this->EV_VXLAN_PKT_ = nd->assign_event ("vxlan.packet", "VXLAN Packet");
+      this->P_VNI_ = nd->assign_value ("vxlan.vni", "VXLAN Network Identifier",
+                                       new FacNum ());
+    }
+    void setup (NetDec * nd) {
+      this->D_ETHER_ = nd->lookup_dec_id ("ether");
+      nd->bind_port (nd->lookup_dec_id ("vxlan"), "udp", PORT_VXLAN);
+    };
+
+    static Decoder * New (NetDec * nd) { return new VxlanDecoder (nd); }
+
+    bool decode (Property *p) {
+      auto hdr = reinterpret_cast <struct vxlan_header *>
+        (p->payload (sizeof (struct vxlan_header)));
+
+      if (hdr == NULL || (hdr->flags_ & FLAG_I) == 0) {
+        return false;
+      }
+
+      u_int32_t vni = htonl ((hdr->vni_[0] << 16) | (hdr->vni_[1] << 8) |
+                             hdr->vni_[2]);
+      p->copy (this->P_VNI_, &vni, sizeof (vni));
+      p->push_event (this->EV_VXLAN_PKT_);
+
+      p->decap ();
+      this->emit (this->D_ETHER_, p);
+      return true;
+    }
+  };
+
+  INIT_DECODER (vxlan, VxlanDecoder::New);
+}  // namespace swarm
@@ -0,0 +1,156 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pcap.h>
+#include "./sampler.h"
+#include "./property.h"
+
+namespace swarm {
+  namespace {
+    inline uint16_t rd16 (const byte_t *p) {
+      return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    // finalizer of MurmurHash3, flow_hash() has weak high bits
+    inline uint64_t mix64 (uint64_t h) {
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    const uint8_t IPPROTO_TCP_ = 6;
+    const uint8_t IPPROTO_UDP_ = 17;
+  }  // namespace
+
+  Sampler::Sampler (SampleMode mode, uint32_t rate, int linktype) :
+    mode_(SAMPLE_PACKET), rate_(1), threshold_(UINT64_MAX), count_(0),
+    accept_(0), drop_(0), linktype_(linktype) {
+    this->set (mode, rate);
+  }
+  Sampler::~Sampler () {
+  }
+
+  void Sampler::set (SampleMode mode, uint32_t rate) {
+    this->mode_ = mode;
+    this->rate_ = (rate > 0) ? rate : 1;
+    this->threshold_ = UINT64_MAX / this->rate_;
+    if (this->count_ >= this->rate_) {
+      this->count_ = 0;
+    }
+  }
+
+  bool Sampler::match_flow (const byte_t *data, size_t cap_len) {
+    uint64_t h = Sampler::raw_flow_hash (data, cap_len, this->linktype_);
+    return (mix64 (h) <= this->threshold_);
+  }
+
+  uint64_t Sampler::raw_flow_hash (const byte_t *data, size_t cap_len,
+                                   int linktype) {
+    // Follows what ether/vlan/lcc/ipv4/ipv6/tcp/udp decoders pass to
+    // Property::set_addr() and set_port() for the outermost 5 tuple, and
+    // hashes it with Property::flow_hash(). It differs from
+    // Property::hash_value() if NetDec::set_flow_hash() installs another
+    // hash or if the packet is tunnelled (hash_value() is of the inner one).
+    // A non-first IPv4 fragment has no L4 header, so it is hashed without
+    // ports.
+    static const byte_t none[4] = {0, 0, 0, 0};
+    const byte_t *src = none, *dst = none, *sport = none, *dport = none;
+    size_t addr_len = 0, port_len = 0;
+    uint8_t proto = 0;
+
+    size_t off = 0;
+    uint16_t etype = 0;
+    switch (linktype) {
+    case DLT_EN10MB:
+      if (cap_len >= 14) {
+        etype = rd16 (data + 12);
+        off = 14;
+        while (etype == 0x8100 && cap_len >= off + 4) {
+          etype = rd16 (data + off + 2);
+          off += 4;
+        }
+      }
+      break;
+    case DLT_RAW:
+      etype = 0x0800;
+      break;
+    case DLT_LINUX_SLL:
+      if (cap_len >= 16) {
+        etype = rd16 (data + 14);
+        off = 16;
+      }
+      break;
+    }
+
+    size_t l4 = 0;
+    if (etype == 0x0800 && cap_len >= off + 20) {
+      const byte_t *ip = data + off;
+      proto = ip[9];
+      src = ip + 12;
+      dst = ip + 16;
+      addr_len = 4;
+      if ((rd16 (ip + 6) & 0x1fff) == 0) {  // fragment offset
+        l4 = off + ((ip[0] & 0x0f) << 2);
+      }
+    } else if (etype == 0x86dd && cap_len >= off + 40) {
+      const byte_t *ip = data + off;
+      proto = ip[6];
+      src = ip + 8;
+      dst = ip + 24;
+      addr_len = 16;
+
+      // hop-by-hop, routing and destination options
+      uint8_t nh = proto;
+      l4 = off + 40;
+      while ((nh == 0 || nh == 43 || nh == 60) && cap_len >= l4 + 8) {
+        nh = data[l4];
+        l4 += (data[l4 + 1] + 1) * 8;
+      }
+      // Property keeps the first next header as protocol, while ports
+      // come from the header after extension headers
+      if ((nh == IPPROTO_TCP_ && cap_len >= l4 + 20) ||
+          (nh == IPPROTO_UDP_ && cap_len >= l4 + 8)) {
+        sport = data + l4;
+        dport = data + l4 + 2;
+        port_len = 2;
+      }
+      l4 = 0;
+    }
+
+    if (l4 > 0 && ((proto == IPPROTO_TCP_ && cap_len >= l4 + 20) ||
+                   (proto == IPPROTO_UDP_ && cap_len >= l4 + 8))) {
+      sport = data + l4;
+      dport = data + l4 + 2;
+      port_len = 2;
+    }
+
+    return Property::flow_hash (src, dst, addr_len, sport, dport, port_len,
+                                proto);
+  }
+}  // namespace swarm
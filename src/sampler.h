@@ -0,0 +1,89 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_SAMPLER_H__
+#define SRC_SAMPLER_H__
+
+#include "./common.h"
+
+namespace swarm {
+  // ----------------------------------------------------------
+  // Sampler
+  // Drops packets before decoding. SAMPLE_PACKET keeps every N-th
+  // packet. SAMPLE_FLOW keeps or drops a whole flow (both directions)
+  // by Property::flow_hash() of the 5 tuple read directly from raw
+  // packet, so the decision is made without running any decoder. A flow
+  // kept at 1-in-N is also kept at any smaller N.
+  //
+  class Sampler {
+  private:
+    SampleMode mode_;
+    uint32_t rate_;
+    uint64_t threshold_;
+    uint64_t count_;
+    uint64_t accept_;
+    uint64_t drop_;
+    int linktype_;
+
+    bool match_flow (const byte_t *data, size_t cap_len);
+
+  public:
+    Sampler (SampleMode mode, uint32_t rate, int linktype);
+    ~Sampler ();
+    void set (SampleMode mode, uint32_t rate);
+    void set_linktype (int linktype) { this->linktype_ = linktype; }
+    inline bool match (const byte_t *data, size_t cap_len) {
+      bool rc;
+      if (this->mode_ == SAMPLE_PACKET) {
+        if (++(this->count_) >= this->rate_) {
+          this->count_ = 0;
+          rc = true;
+        } else {
+          rc = false;
+        }
+      } else {
+        rc = this->match_flow (data, cap_len);
+      }
+
+      if (rc) {
+        this->accept_++;
+      } else {
+        this->drop_++;
+      }
+      return rc;
+    }
+
+    SampleMode mode () const { return this->mode_; }
+    uint32_t rate () const { return this->rate_; }
+    uint64_t accept () const { return this->accept_; }
+    uint64_t drop () const { return this->drop_; }
+
+    static uint64_t raw_flow_hash (const byte_t *data, size_t cap_len,
+                                   int linktype);
+  };
+}  // namespace swarm
+
+#endif  // SRC_SAMPLER_H__
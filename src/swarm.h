@@ -36,6 +36,9 @@
 #include <deque>
 
 #include "./common.h"
+#include "./checksum.h"
+#include "./checkpoint.h"
+#include "./flowhash.h"
 #include "./property.h"
 #include "./timer.h"
 #include "./netcap.h"
@@ -58,5 +58,186 @@ namespace swarm {
     ent->task_->exec(ts);
   };
 
+
+  // ----------------------------------------------------------
+  // TimerWheel
+  //
+  TimerWheel::TimerWheel () :
+    now_(0), started_(false), last_id_(TASK_NULL), firing_(NULL),
+    cancel_firing_(false) {
+    for (size_t lv = 0; lv < LV_NUM; lv++) {
+      for (size_t i = 0; i < LV_SIZE; i++) {
+        list_init(&(this->wheel_[lv][i]));
+      }
+      this->lv_count_[lv] = 0;
+    }
+    list_init(&(this->pending_));
+  }
+  TimerWheel::~TimerWheel () {
+    for (auto it = this->entry_map_.begin ();
+         it != this->entry_map_.end (); it++) {
+      delete it->second;
+    }
+  }
+
+  void TimerWheel::list_init(Entry *head) {
+    head->prev_ = head;
+    head->next_ = head;
+  }
+  void TimerWheel::list_push(Entry *head, Entry *ent) {
+    ent->prev_ = head->prev_;
+    ent->next_ = head;
+    head->prev_->next_ = ent;
+    head->prev_ = ent;
+  }
+  void TimerWheel::unlink(Entry *ent) {
+    ent->prev_->next_ = ent->next_;
+    ent->next_->prev_ = ent->prev_;
+    ent->prev_ = ent->next_ = ent;
+    if (ent->lv_ >= 0) {
+      this->lv_count_[ent->lv_]--;
+      ent->lv_ = -1;
+    }
+  }
+
+  void TimerWheel::schedule(Entry *ent, tick_t min_tick) {
+    tick_t exp = (ent->expire_ < min_tick) ? min_tick : ent->expire_;
+    tick_t delta = exp - this->now_;
+
+    size_t lv = 0;
+    while (lv + 1 < LV_NUM && delta >= (1ULL << (LV_BITS * (lv + 1)))) {
+      lv++;
+    }
+    if (delta >= (1ULL << (LV_BITS * LV_NUM))) {
+      // too far, park it at the end of the top level and cascade again
+      exp = this->now_ + (1ULL << (LV_BITS * LV_NUM)) - 1;
+    }
+
+    size_t idx = (exp >> (LV_BITS * lv)) & LV_MASK;
+    list_push(&(this->wheel_[lv][idx]), ent);
+    ent->lv_ = static_cast<int>(lv);
+    this->lv_count_[lv]++;
+  }
+
+  void TimerWheel::cascade(size_t lv) {
+    size_t idx = (this->now_ >> (LV_BITS * lv)) & LV_MASK;
+    if (idx == 0 && lv + 1 < LV_NUM) {
+      this->cascade(lv + 1);
+    }
+
+    // slot of now_ on level 0 is fired right after cascading, so entries
+    // expiring just now can be put there
+    Entry *head = &(this->wheel_[lv][idx]);
+    while (head->next_ != head) {
+      Entry *ent = head->next_;
+      this->unlink(ent);
+      this->schedule(ent, this->now_);
+    }
+  }
+
+  void TimerWheel::fire(Entry *ent) {
+    struct timespec ts;
+    ts.tv_sec  = static_cast<time_t>(ent->expire_ / 1000);
+    ts.tv_nsec = static_cast<long>((ent->expire_ % 1000) * NS_PER_TICK);
+
+    this->firing_ = ent;
+    this->cancel_firing_ = false;
+    ent->task_->exec(ts);
+    this->firing_ = NULL;
+
+    if (this->cancel_firing_ || ent->interval_ == 0) {
+      this->entry_map_.erase(ent->id_);
+      delete ent;
+    } else {
+      // a repeat task catches up one interval per tick if packets had
+      // a gap longer than the interval
+      ent->expire_ += ent->interval_;
+      this->schedule(ent, this->now_ + 1);
+    }
+  }
+
+  task_id TimerWheel::add (Task *task, tick_t delay, tick_t interval) {
+    Entry *ent = new Entry;
+    ent->prev_ = ent->next_ = ent;
+    ent->id_ = ++(this->last_id_);
+    ent->task_ = task;
+    ent->interval_ = interval;
+    ent->lv_ = -1;
+    this->entry_map_.insert(std::make_pair(ent->id_, ent));
+
+    if (this->started_) {
+      ent->expire_ = this->now_ + delay;
+      this->schedule(ent, this->now_ + 1);
+    } else {
+      ent->expire_ = delay;
+      list_push(&(this->pending_), ent);
+    }
+    return ent->id_;
+  }
+
+  bool TimerWheel::remove (task_id id) {
+    auto it = this->entry_map_.find(id);
+    if (it == this->entry_map_.end()) {
+      return false;
+    }
+
+    Entry *ent = it->second;
+    if (ent == this->firing_) {
+      // deleted after exec() returns
+      this->cancel_firing_ = true;
+    } else {
+      this->unlink(ent);
+      this->entry_map_.erase(it);
+      delete ent;
+    }
+    return true;
+  }
+
+  void TimerWheel::ticktock (uint64_t ts_ns) {
+    tick_t tick = ts_ns / NS_PER_TICK;
+
+    if (!this->started_) {
+      this->now_ = tick;
+      this->started_ = true;
+      while (this->pending_.next_ != &(this->pending_)) {
+        Entry *ent = this->pending_.next_;
+        this->unlink(ent);
+        ent->expire_ += this->now_;
+        this->schedule(ent, this->now_ + 1);
+      }
+      return;
+    }
+
+    while (this->now_ < tick) {
+      if (this->lv_count_[0] == 0) {
+        // nothing can fire until the next cascade of the lowest non-empty
+        // level, jump to there
+        size_t lv = 1;
+        while (lv + 1 < LV_NUM && this->lv_count_[lv] == 0) {
+          lv++;
+        }
+        tick_t next = (this->now_ | ((1ULL << (LV_BITS * lv)) - 1)) + 1;
+        if (this->entry_map_.empty() || next > tick) {
+          this->now_ = tick;
+          break;
+        }
+        this->now_ = next;
+      } else {
+        this->now_++;
+      }
+
+      if ((this->now_ & LV_MASK) == 0) {
+        this->cascade(1);
+      }
+
+      Entry *head = &(this->wheel_[0][this->now_ & LV_MASK]);
+      while (head->next_ != head) {
+        Entry *ent = head->next_;
+        this->unlink(ent);
+        this->fire(ent);
+      }
+    }
+  }
+
 }  // namespace swarm
 
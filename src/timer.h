@@ -69,6 +69,59 @@ namespace swarm {
     static void work (EV_P_ struct ev_timer *w, int revents);
   };
 
+  // ----------------------------------------------------------
+  // TimerWheel
+  // Hierarchical timing wheel driven by packet time instead of wall
+  // clock. NetDec advances it with time stamp of each packet, so tasks
+  // fire at the same capture time whatever the replay speed is.
+  // Resolution is 1 msec, 4 levels x 256 slots cover about 49 days;
+  // longer delays are parked in the top level and cascaded again.
+  //
+  class TimerWheel {
+  private:
+    struct Entry {
+      Entry *prev_, *next_;
+      task_id id_;
+      Task *task_;
+      tick_t expire_;
+      tick_t interval_;  // 0 means one-time task
+      int lv_;           // wheel level, -1 if not in the wheel
+    };
+
+    static const size_t LV_BITS = 8;
+    static const size_t LV_SIZE = 1 << LV_BITS;
+    static const size_t LV_MASK = LV_SIZE - 1;
+    static const size_t LV_NUM  = 4;
+    static const tick_t NS_PER_TICK = 1000000;  // 1 msec
+
+    Entry wheel_[LV_NUM][LV_SIZE];  // list heads
+    Entry pending_;  // added before the first tick, expire_ is relative
+    size_t lv_count_[LV_NUM];
+    std::map<task_id, Entry *> entry_map_;
+    tick_t now_;
+    bool started_;
+    task_id last_id_;
+    Entry *firing_;
+    bool cancel_firing_;
+
+    static void list_init(Entry *head);
+    static void list_push(Entry *head, Entry *ent);
+    void unlink(Entry *ent);
+    void schedule(Entry *ent, tick_t min_tick);
+    void cascade(size_t lv);
+    void fire(Entry *ent);
+
+  public:
+    TimerWheel ();
+    ~TimerWheel ();
+    // interval 0 registers one-time task. delay and interval are msec
+    task_id add (Task *task, tick_t delay, tick_t interval);
+    bool remove (task_id id);
+    void ticktock (uint64_t ts_ns);
+    size_t size () const { return this->entry_map_.size(); }
+    tick_t now () const { return this->now_; }
+  };
+
 
 }  // namespace swarm
 
@@ -0,0 +1,760 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <algorithm>
+
+#include "./columnar.h"
+#include "../property.h"
+#include "../value.h"
+#include "../debug.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // Minimal FlatBuffers writer for Arrow IPC metadata. Objects are laid
+  // out front to back: a table is written with placeholder offsets, then
+  // its children follow and the placeholders are patched. All offsets
+  // therefore point forward as FlatBuffers requires. Metadata is small
+  // (a few hundred bytes per message), so simplicity wins over speed.
+  //
+  namespace {
+    typedef std::vector<byte_t> Buffer;
+
+    void fb_pad(Buffer *buf, size_t align, size_t mod = 0) {
+      while (buf->size() % align != mod) {
+        buf->push_back(0);
+      }
+    }
+    void fb_put(Buffer *buf, uint64_t v, size_t size) {
+      for (size_t i = 0; i < size; i++) {
+        buf->push_back(static_cast<byte_t>(v >> (i * 8)));
+      }
+    }
+    void fb_set(Buffer *buf, size_t pos, uint64_t v, size_t size) {
+      for (size_t i = 0; i < size; i++) {
+        (*buf)[pos + i] = static_cast<byte_t>(v >> (i * 8));
+      }
+    }
+
+    class FbObject {
+    public:
+      virtual ~FbObject() {}
+      // write the object and return its position in buf
+      virtual size_t write(Buffer *buf) const = 0;
+    };
+
+    class FbString : public FbObject {
+    private:
+      std::string s_;
+    public:
+      explicit FbString(const std::string &s) : s_(s) {}
+      size_t write(Buffer *buf) const {
+        fb_pad(buf, 4);
+        size_t pos = buf->size();
+        fb_put(buf, this->s_.size(), 4);
+        buf->insert(buf->end(), this->s_.begin(), this->s_.end());
+        buf->push_back(0);
+        return pos;
+      }
+    };
+
+    // vector of structs, elements are 8 byte aligned
+    class FbStructVector : public FbObject {
+    private:
+      size_t count_;
+      Buffer data_;
+    public:
+      FbStructVector() : count_(0) {}
+      FbStructVector *push(uint64_t v, size_t size) {
+        fb_put(&this->data_, v, size);
+        return this;
+      }
+      void next() { this->count_++; }
+      size_t write(Buffer *buf) const {
+        fb_pad(buf, 8, 4);
+        size_t pos = buf->size();
+        fb_put(buf, this->count_, 4);
+        buf->insert(buf->end(), this->data_.begin(), this->data_.end());
+        return pos;
+      }
+    };
+
+    class FbTable : public FbObject {
+    private:
+      struct Field {
+        int id_;
+        size_t size_;
+        uint64_t val_;
+        FbObject *child_;
+      };
+      std::vector<Field> fields_;
+
+      static bool by_size(const Field &a, const Field &b) {
+        return a.size_ > b.size_;
+      }
+
+    public:
+      ~FbTable() {
+        for (size_t i = 0; i < this->fields_.size(); i++) {
+          delete this->fields_[i].child_;
+        }
+      }
+      FbTable *scalar(int id, size_t size, uint64_t val) {
+        Field f = {id, size, val, NULL};
+        this->fields_.push_back(f);
+        return this;
+      }
+      FbTable *child(int id, FbObject *obj) {
+        Field f = {id, 4, 0, obj};
+        this->fields_.push_back(f);
+        return this;
+      }
+
+      size_t write(Buffer *buf) const {
+        // Fields are placed by descending size right after the 4 byte
+        // vtable offset and the table starts at 8n+4, so every field is
+        // naturally aligned.
+        std::vector<Field> fields(this->fields_);
+        std::stable_sort(fields.begin(), fields.end(), FbTable::by_size);
+
+        int nfield = 0;
+        std::vector<size_t> field_off(fields.size());
+        size_t tbl_len = 4;
+        for (size_t i = 0; i < fields.size(); i++) {
+          nfield = std::max(nfield, fields[i].id_ + 1);
+          field_off[i] = tbl_len;
+          tbl_len += fields[i].size_;
+        }
+
+        fb_pad(buf, 2);
+        size_t vt_pos = buf->size();
+        fb_put(buf, 4 + nfield * 2, 2);
+        fb_put(buf, tbl_len, 2);
+        for (int id = 0; id < nfield; id++) {
+          size_t off = 0;
+          for (size_t i = 0; i < fields.size(); i++) {
+            if (fields[i].id_ == id) {
+              off = field_off[i];
+            }
+          }
+          fb_put(buf, off, 2);
+        }
+
+        fb_pad(buf, 8, 4);
+        size_t pos = buf->size();
+        fb_put(buf, pos - vt_pos, 4);
+        for (size_t i = 0; i < fields.size(); i++) {
+          fb_put(buf, fields[i].val_, fields[i].size_);
+        }
+
+        for (size_t i = 0; i < fields.size(); i++) {
+          if (fields[i].child_) {
+            size_t slot = pos + field_off[i];
+            size_t c_pos = fields[i].child_->write(buf);
+            fb_set(buf, slot, c_pos - slot, 4);
+          }
+        }
+        return pos;
+      }
+    };
+
+    class FbTableVector : public FbObject {
+    private:
+      std::vector<FbTable*> elems_;
+    public:
+      ~FbTableVector() {
+        for (size_t i = 0; i < this->elems_.size(); i++) {
+          delete this->elems_[i];
+        }
+      }
+      FbTableVector *push(FbTable *t) {
+        this->elems_.push_back(t);
+        return this;
+      }
+      size_t write(Buffer *buf) const {
+        fb_pad(buf, 4);
+        size_t pos = buf->size();
+        fb_put(buf, this->elems_.size(), 4);
+        for (size_t i = 0; i < this->elems_.size(); i++) {
+          fb_put(buf, 0, 4);
+        }
+        for (size_t i = 0; i < this->elems_.size(); i++) {
+          size_t slot = pos + 4 + i * 4;
+          size_t c_pos = this->elems_[i]->write(buf);
+          fb_set(buf, slot, c_pos - slot, 4);
+        }
+        return pos;
+      }
+    };
+
+    // Serialize root table, the result is padded to 8 bytes.
+    void fb_finish(FbTable *root, Buffer *buf) {
+      buf->clear();
+      fb_put(buf, 0, 4);
+      size_t pos = root->write(buf);
+      fb_set(buf, 0, pos, 4);
+      fb_pad(buf, 8);
+      delete root;
+    }
+
+    // Arrow schema constants (format/Schema.fbs, Message.fbs)
+    const uint64_t ARROW_V5 = 4;
+    const uint64_t HDR_SCHEMA = 1;
+    const uint64_t HDR_DICT_BATCH = 2;
+    const uint64_t HDR_RECORD_BATCH = 3;
+    const uint64_t TYPE_INT = 2;
+    const uint64_t TYPE_UTF8 = 5;
+    const uint64_t TYPE_TIMESTAMP = 10;
+    const uint64_t TYPE_FIXED_BINARY = 15;
+    const uint64_t UNIT_MICROSECOND = 2;
+
+    const byte_t ARROW_MAGIC[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+
+    FbTable *arrow_int(int bits, bool is_signed) {
+      return (new FbTable())->scalar(0, 4, bits)->scalar(1, 1, is_signed);
+    }
+
+    FbTable *arrow_message(uint64_t hdr_type, FbTable *hdr,
+                           uint64_t body_len) {
+      return (new FbTable())->scalar(0, 2, ARROW_V5)
+        ->scalar(1, 1, hdr_type)->child(2, hdr)->scalar(3, 8, body_len);
+    }
+
+    FbTable *arrow_field(const std::string &name,
+                         ColumnarExporter::ColType type, size_t width,
+                         size_t dict_id) {
+      FbTable *f = new FbTable();
+      f->child(0, new FbString(name))->scalar(1, 1, 1);
+      switch (type) {
+      case ColumnarExporter::UINT8:
+      case ColumnarExporter::UINT16:
+      case ColumnarExporter::UINT32:
+      case ColumnarExporter::UINT64:
+        f->scalar(2, 1, TYPE_INT)
+          ->child(3, arrow_int(static_cast<int>(width * 8), false));
+        break;
+      case ColumnarExporter::IPV4:
+      case ColumnarExporter::IPV6:
+      case ColumnarExporter::MAC:
+        f->scalar(2, 1, TYPE_FIXED_BINARY)
+          ->child(3, (new FbTable())->scalar(0, 4, width));
+        break;
+      case ColumnarExporter::TIMESTAMP:
+        f->scalar(2, 1, TYPE_TIMESTAMP)
+          ->child(3, (new FbTable())->scalar(0, 2, UNIT_MICROSECOND));
+        break;
+      case ColumnarExporter::STRING:
+        f->scalar(2, 1, TYPE_UTF8)->child(3, new FbTable())
+          ->child(4, (new FbTable())->scalar(0, 8, dict_id)
+                  ->child(1, arrow_int(32, true)));
+        break;
+      default: assert(0);
+      }
+      // readers expect the children vector even for primitive types
+      f->child(5, new FbTableVector());
+      return f;
+    }
+
+    // Append one buffer to a message body and describe it in buffers.
+    void add_buffer(Buffer *body, FbStructVector *buffers,
+                    const void *ptr, size_t len) {
+      buffers->push(body->size(), 8)->push(len, 8)->next();
+      const byte_t *p = static_cast<const byte_t*>(ptr);
+      body->insert(body->end(), p, p + len);
+      fb_pad(body, 8);
+    }
+  }  // namespace
+
+
+  // ----------------------------------------------------------------
+  // ColumnarExporter::Dictionary
+  //
+  ColumnarExporter::Dictionary::Dictionary() : flushed_(0) {
+    this->offsets_.push_back(0);
+    this->slots_.resize(256, -1);
+  }
+  ColumnarExporter::Dictionary::~Dictionary() {
+  }
+
+  uint32_t ColumnarExporter::Dictionary::hash(const byte_t *ptr,
+                                              size_t len) {
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; i++) {
+      h = (h ^ ptr[i]) * 16777619U;
+    }
+    return h;
+  }
+
+  void ColumnarExporter::Dictionary::grow() {
+    std::vector<int32_t> slots(this->slots_.size() * 2, -1);
+    const size_t mask = slots.size() - 1;
+    for (size_t i = 0; i < this->size(); i++) {
+      const byte_t *p = &(this->values_[this->offsets_[i]]);
+      size_t len = this->offsets_[i + 1] - this->offsets_[i];
+      size_t s = ColumnarExporter::Dictionary::hash(p, len) & mask;
+      while (slots[s] >= 0) {
+        s = (s + 1) & mask;
+      }
+      slots[s] = static_cast<int32_t>(i);
+    }
+    this->slots_.swap(slots);
+  }
+
+  int32_t ColumnarExporter::Dictionary::lookup(const byte_t *ptr,
+                                               size_t len) {
+    const size_t mask = this->slots_.size() - 1;
+    size_t s = ColumnarExporter::Dictionary::hash(ptr, len) & mask;
+
+    for (; this->slots_[s] >= 0; s = (s + 1) & mask) {
+      int32_t idx = this->slots_[s];
+      size_t e_len = this->offsets_[idx + 1] - this->offsets_[idx];
+      if (e_len == len &&
+          0 == ::memcmp(&(this->values_[this->offsets_[idx]]), ptr, len)) {
+        return idx;
+      }
+    }
+
+    int32_t idx = static_cast<int32_t>(this->size());
+    this->values_.insert(this->values_.end(), ptr, ptr + len);
+    this->offsets_.push_back(static_cast<int32_t>(this->values_.size()));
+    this->slots_[s] = idx;
+
+    // keep load factor under 1/2
+    if (this->size() * 2 > this->slots_.size()) {
+      this->grow();
+    }
+    return idx;
+  }
+
+
+  // ----------------------------------------------------------------
+  // ColumnarExporter::Column
+  //
+  ColumnarExporter::Column::Column(const std::string &name, val_id vid,
+                                   ColType type) :
+    name_(name), vid_(vid), type_(type), width_(0), null_count_(0),
+    dict_(NULL) {
+    switch (type) {
+    case UINT8:     this->width_ = 1; break;
+    case UINT16:    this->width_ = 2; break;
+    case UINT32:    this->width_ = 4; break;
+    case UINT64:    this->width_ = 8; break;
+    case IPV4:      this->width_ = 4; break;
+    case IPV6:      this->width_ = 16; break;
+    case MAC:       this->width_ = 6; break;
+    case TIMESTAMP: this->width_ = 8; break;
+    case STRING:
+      this->width_ = 4;  // int32 dictionary index
+      this->dict_ = new Dictionary();
+      break;
+    default: assert(0);
+    }
+  }
+  ColumnarExporter::Column::~Column() {
+    delete this->dict_;
+  }
+  void ColumnarExporter::Column::reset() {
+    this->valid_.clear();
+    this->data_.clear();
+    this->null_count_ = 0;
+  }
+
+
+  // ----------------------------------------------------------------
+  // ColumnarExporter
+  //
+  ColumnarExporter::ColumnarExporter(NetDec *nd, size_t batch_rows) :
+    nd_(nd), fp_(NULL), batch_rows_(batch_rows > 0 ? batch_rows : 1),
+    rows_(0), total_rows_(0), batches_(0), schema_written_(false),
+    file_pos_(0) {
+    this->columns_.push_back(new Column("timestamp", VALUE_NULL, TIMESTAMP));
+  }
+  ColumnarExporter::~ColumnarExporter() {
+    this->close();
+    for (size_t i = 0; i < this->columns_.size(); i++) {
+      delete this->columns_[i];
+    }
+  }
+
+  bool ColumnarExporter::str2type(const std::string &name, ColType *type) {
+    static const char *names[] = {
+      "u8", "u16", "u32", "u64", "ipv4", "ipv6", "mac", "str",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+      if (name == names[i]) {
+        *type = static_cast<ColType>(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ColumnarExporter::add_column(const std::string &name, ColType type) {
+    if (this->schema_written_) {
+      this->errmsg_ = "can not add column after export started";
+      return false;
+    }
+    if (type == TIMESTAMP || type >= COL_TYPE_CNT) {
+      this->errmsg_ = "invalid column type";
+      return false;
+    }
+
+    val_id vid = this->nd_->lookup_value_id(name);
+    if (vid == VALUE_NULL) {
+      this->errmsg_ = "no such value: " + name;
+      return false;
+    }
+
+    this->columns_.push_back(new Column(name, vid, type));
+    return true;
+  }
+
+  bool ColumnarExporter::add_column(const std::string &spec) {
+    size_t pos = spec.rfind(':');
+    ColType type = STRING;
+    if (pos != std::string::npos &&
+        !ColumnarExporter::str2type(spec.substr(pos + 1), &type)) {
+      this->errmsg_ = "invalid column type: " + spec.substr(pos + 1);
+      return false;
+    }
+    return this->add_column(spec.substr(0, pos), type);
+  }
+
+  bool ColumnarExporter::open(const std::string &path) {
+    this->close();
+
+    this->fp_ = ::fopen(path.c_str(), "wb");
+    if (this->fp_ == NULL) {
+      this->errmsg_ = "fopen: ";
+      this->errmsg_ += strerror(errno);
+      return false;
+    }
+
+    this->file_pos_ = 0;
+    this->dict_blocks_.clear();
+    this->batch_blocks_.clear();
+    this->schema_written_ = false;
+    return this->write_raw(ARROW_MAGIC, sizeof(ARROW_MAGIC));
+  }
+
+  bool ColumnarExporter::close() {
+    if (this->fp_ == NULL) {
+      return true;
+    }
+
+    bool rc = this->flush();
+    if (rc && !this->schema_written_) {
+      // empty file still needs schema and dictionaries
+      rc = this->write_schema() && this->write_dictionaries();
+    }
+
+    if (rc) {
+      // end-of-stream marker
+      Buffer eos;
+      fb_put(&eos, 0xFFFFFFFF, 4);
+      fb_put(&eos, 0, 4);
+      rc = this->write_raw(&eos[0], eos.size());
+    }
+
+    if (rc) {
+      // Footer repeats the schema and locates every message
+      FbStructVector *dicts = new FbStructVector();
+      FbStructVector *batches = new FbStructVector();
+      for (size_t i = 0; i < this->dict_blocks_.size(); i++) {
+        const Block &b = this->dict_blocks_[i];
+        dicts->push(b.offset_, 8)->push(b.meta_len_, 4)->push(0, 4)
+          ->push(b.body_len_, 8)->next();
+      }
+      for (size_t i = 0; i < this->batch_blocks_.size(); i++) {
+        const Block &b = this->batch_blocks_[i];
+        batches->push(b.offset_, 8)->push(b.meta_len_, 4)->push(0, 4)
+          ->push(b.body_len_, 8)->next();
+      }
+
+      Buffer footer;
+      FbTableVector *fields = new FbTableVector();
+      for (size_t i = 0; i < this->columns_.size(); i++) {
+        const Column *col = this->columns_[i];
+        fields->push(arrow_field(col->name_, col->type_, col->width_, i));
+      }
+      FbTable *sc = (new FbTable())->scalar(0, 2, 0)->child(1, fields);
+      FbTable *ft = (new FbTable())->scalar(0, 2, ARROW_V5)->child(1, sc)
+        ->child(2, dicts)->child(3, batches);
+      fb_finish(ft, &footer);
+
+      fb_put(&footer, footer.size(), 4);
+      rc = this->write_raw(&footer[0], footer.size()) &&
+        this->write_raw(ARROW_MAGIC, 6);
+    }
+
+    if (0 != ::fclose(this->fp_) && rc) {
+      this->errmsg_ = "fclose: ";
+      this->errmsg_ += strerror(errno);
+      rc = false;
+    }
+    this->fp_ = NULL;
+    return rc;
+  }
+
+  bool ColumnarExporter::write_raw(const void *ptr, size_t len) {
+    if (len > 0 && 1 != ::fwrite(ptr, len, 1, this->fp_)) {
+      this->errmsg_ = "fwrite: ";
+      this->errmsg_ += strerror(errno);
+      return false;
+    }
+    this->file_pos_ += len;
+    return true;
+  }
+
+  bool ColumnarExporter::write_message(const Buffer &meta, const Buffer &body,
+                                       Block *blk) {
+    // encapsulated message: continuation, metadata size, metadata, body
+    assert(meta.size() % 8 == 0);
+    Buffer prefix;
+    fb_put(&prefix, 0xFFFFFFFF, 4);
+    fb_put(&prefix, meta.size(), 4);
+    if (blk) {
+      blk->offset_ = this->file_pos_;
+      blk->meta_len_ = static_cast<int32_t>(prefix.size() + meta.size());
+      blk->body_len_ = static_cast<int64_t>(body.size());
+    }
+    return (this->write_raw(&prefix[0], prefix.size()) &&
+            this->write_raw(&meta[0], meta.size()) &&
+            this->write_raw(body.data(), body.size()));
+  }
+
+  bool ColumnarExporter::write_schema() {
+    // dictionary id of a string column is its column index
+    FbTableVector *fields = new FbTableVector();
+    for (size_t i = 0; i < this->columns_.size(); i++) {
+      const Column *col = this->columns_[i];
+      fields->push(arrow_field(col->name_, col->type_, col->width_, i));
+    }
+
+    Buffer meta, body;
+    FbTable *sc = (new FbTable())->scalar(0, 2, 0)->child(1, fields);
+    fb_finish(arrow_message(HDR_SCHEMA, sc, 0), &meta);
+    this->schema_written_ = true;
+    return this->write_message(meta, body, NULL);
+  }
+
+  bool ColumnarExporter::write_dictionaries() {
+    // Entries added since the last flush of every string column are
+    // written before the record batch that refers to them. The first
+    // dictionary batch of a column is a full one, later ones are deltas.
+    for (size_t i = 0; i < this->columns_.size(); i++) {
+      Dictionary *dict = this->columns_[i]->dict_;
+      if (dict == NULL) {
+        continue;
+      }
+
+      const size_t start = dict->flushed(), end = dict->size();
+      if (start > 0 && start == end) {
+        continue;
+      }
+
+      const int32_t *offsets = dict->offsets();
+      std::vector<int32_t> rebased(end - start + 1);
+      for (size_t n = start; n <= end; n++) {
+        rebased[n - start] = offsets[n] - offsets[start];
+      }
+
+      Buffer body;
+      Buffer offs;
+      for (size_t n = 0; n < rebased.size(); n++) {
+        fb_put(&offs, static_cast<uint32_t>(rebased[n]), 4);
+      }
+      FbStructVector *nodes = new FbStructVector();
+      FbStructVector *buffers = new FbStructVector();
+      nodes->push(end - start, 8)->push(0, 8)->next();
+      add_buffer(&body, buffers, NULL, 0);
+      add_buffer(&body, buffers, &offs[0], offs.size());
+      add_buffer(&body, buffers, dict->values() + offsets[start],
+                 offsets[end] - offsets[start]);
+
+      FbTable *rb = (new FbTable())->scalar(0, 8, end - start)
+        ->child(1, nodes)->child(2, buffers);
+      FbTable *db = (new FbTable())->scalar(0, 8, i)->child(1, rb)
+        ->scalar(2, 1, start > 0);
+
+      Buffer meta;
+      fb_finish(arrow_message(HDR_DICT_BATCH, db, body.size()), &meta);
+      Block blk;
+      if (!this->write_message(meta, body, &blk)) {
+        return false;
+      }
+      this->dict_blocks_.push_back(blk);
+      dict->mark_flushed();
+    }
+    return true;
+  }
+
+  bool ColumnarExporter::write_batch() {
+    Buffer body;
+    FbStructVector *nodes = new FbStructVector();
+    FbStructVector *buffers = new FbStructVector();
+
+    for (size_t i = 0; i < this->columns_.size(); i++) {
+      const Column *col = this->columns_[i];
+      nodes->push(this->rows_, 8)->push(col->null_count_, 8)->next();
+      if (col->null_count_ > 0) {
+        add_buffer(&body, buffers, col->valid_.data(), col->valid_.size());
+      } else {
+        add_buffer(&body, buffers, NULL, 0);
+      }
+      add_buffer(&body, buffers, col->data_.data(), col->data_.size());
+    }
+
+    FbTable *rb = (new FbTable())->scalar(0, 8, this->rows_)
+      ->child(1, nodes)->child(2, buffers);
+    Buffer meta;
+    fb_finish(arrow_message(HDR_RECORD_BATCH, rb, body.size()), &meta);
+
+    Block blk;
+    if (!this->write_message(meta, body, &blk)) {
+      return false;
+    }
+    this->batch_blocks_.push_back(blk);
+    return true;
+  }
+
+  bool ColumnarExporter::flush() {
+    if (this->fp_ == NULL) {
+      this->errmsg_ = "not opened";
+      return false;
+    }
+    if (this->rows_ == 0) {
+      return true;
+    }
+
+    if (!this->schema_written_ && !this->write_schema()) {
+      return false;
+    }
+    if (!this->write_dictionaries() || !this->write_batch()) {
+      return false;
+    }
+
+    for (size_t i = 0; i < this->columns_.size(); i++) {
+      this->columns_[i]->reset();
+    }
+    this->total_rows_ += this->rows_;
+    this->rows_ = 0;
+    this->batches_++;
+    return true;
+  }
+
+  void ColumnarExporter::append(const Property &p) {
+    const size_t bit = this->rows_ % 8;
+
+    for (size_t i = 0; i < this->columns_.size(); i++) {
+      Column *col = this->columns_[i];
+      if (bit == 0) {
+        col->valid_.push_back(0);
+      }
+
+      const size_t w = col->width_;
+      const size_t d_pos = col->data_.size();
+      col->data_.resize(d_pos + w, 0);
+      byte_t *dst = &(col->data_[d_pos]);
+      bool valid = true;
+
+      if (col->type_ == TIMESTAMP) {
+        uint64_t usec = p.ts_ns() / 1000;
+        for (size_t n = 0; n < w; n++) {
+          dst[n] = static_cast<byte_t>(usec >> (n * 8));
+        }
+      } else {
+        size_t len;
+        const Value &v = p.value(col->vid_);
+        const byte_t *src = v.ptr(&len);
+
+        switch (col->type_) {
+        case UINT8: case UINT16: case UINT32: case UINT64:
+          if (src == NULL || len == 0) {
+            valid = false;
+          } else {
+            // network byte order to little endian, values shorter than
+            // the column are zero extended and longer ones keep their
+            // last (low order) bytes
+            uint64_t num = 0;
+            for (size_t n = (len > w) ? len - w : 0; n < len; n++) {
+              num = (num << 8) | src[n];
+            }
+            for (size_t n = 0; n < w; n++) {
+              dst[n] = static_cast<byte_t>(num >> (n * 8));
+            }
+          }
+          break;
+
+        case IPV4: case IPV6: case MAC:
+          if (src == NULL || len < w) {
+            valid = false;
+          } else {
+            ::memcpy(dst, src, w);
+          }
+          break;
+
+        case STRING:
+          if (!v.text(&col->text_)) {
+            valid = false;
+          } else {
+            const byte_t *t = reinterpret_cast<const byte_t*>
+              (col->text_.data());
+            int32_t idx = col->dict_->lookup(t, col->text_.size());
+            for (size_t n = 0; n < w; n++) {
+              dst[n] = static_cast<byte_t>(idx >> (n * 8));
+            }
+          }
+          break;
+
+        default: assert(0);
+        }
+      }
+
+      if (valid) {
+        col->valid_.back() |= (1 << bit);
+      } else {
+        col->null_count_++;
+      }
+    }
+
+    this->rows_++;
+  }
+
+  void ColumnarExporter::recv(ev_id eid, const Property &p) {
+    if (this->fp_ == NULL) {
+      return;
+    }
+
+    this->append(p);
+    if (this->rows_ >= this->batch_rows_ && !this->flush()) {
+      debug(true, "columnar export error: %s", this->errmsg_.c_str());
+    }
+  }
+}  // namespace swarm
@@ -0,0 +1,155 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_COLUMNAR_H__
+#define SRC_UTILS_COLUMNAR_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class ColumnarExporter:
+  // Handler that appends one row per received event to typed column
+  // buffers and writes them as record batches of an Arrow IPC file
+  // (format version V5). Columns are declared up front by value name and
+  // filled from the first value of the Property, missing values become
+  // nulls. A "timestamp" column with the capture time is always added.
+  // Numbers and addresses are stored as fixed width columns, strings are
+  // dictionary encoded (UTF-8 dictionary, int32 indices) and new
+  // dictionary entries are written as delta dictionary batches.
+  //
+  class ColumnarExporter : public Handler {
+  public:
+    enum ColType {
+      UINT8,
+      UINT16,
+      UINT32,
+      UINT64,
+      IPV4,     // FixedSizeBinary(4), network byte order
+      IPV6,     // FixedSizeBinary(16)
+      MAC,      // FixedSizeBinary(6)
+      STRING,   // Dictionary<int32, Utf8>, from Value::text()
+      TIMESTAMP,  // Timestamp(usec), capture time, always the 1st column
+      COL_TYPE_CNT,
+    };
+
+  private:
+    // String dictionary with open addressing, keys point into values_.
+    class Dictionary {
+    private:
+      std::vector<byte_t> values_;
+      std::vector<int32_t> offsets_;
+      std::vector<int32_t> slots_;
+      size_t flushed_;  // entries already written to the file
+
+      static uint32_t hash(const byte_t *ptr, size_t len);
+      void grow();
+
+    public:
+      Dictionary();
+      ~Dictionary();
+      int32_t lookup(const byte_t *ptr, size_t len);
+      size_t size() const { return this->offsets_.size() - 1; }
+      size_t flushed() const { return this->flushed_; }
+      void mark_flushed() { this->flushed_ = this->size(); }
+      const int32_t *offsets() const { return &(this->offsets_[0]); }
+      const byte_t *values() const { return this->values_.data(); }
+    };
+
+    class Column {
+    public:
+      std::string name_;
+      val_id vid_;
+      ColType type_;
+      size_t width_;                // bytes per row in data_
+      std::vector<byte_t> valid_;   // validity bitmap
+      std::vector<byte_t> data_;
+      size_t null_count_;
+      Dictionary *dict_;
+      std::string text_;            // scratch buffer for Value::text()
+
+      Column(const std::string &name, val_id vid, ColType type);
+      ~Column();
+      void reset();
+    };
+
+    NetDec *nd_;
+    FILE *fp_;
+    std::string errmsg_;
+    std::vector<Column*> columns_;
+    size_t batch_rows_;
+    size_t rows_;                   // rows in the current batch
+    uint64_t total_rows_;
+    uint64_t batches_;
+    bool schema_written_;
+
+    // blocks for the file footer
+    struct Block {
+      int64_t offset_;
+      int32_t meta_len_;
+      int64_t body_len_;
+    };
+    std::vector<Block> dict_blocks_;
+    std::vector<Block> batch_blocks_;
+    int64_t file_pos_;
+
+    bool write_raw(const void *ptr, size_t len);
+    bool write_message(const std::vector<byte_t> &meta,
+                       const std::vector<byte_t> &body, Block *blk);
+    bool write_schema();
+    bool write_dictionaries();
+    bool write_batch();
+    void append(const Property &p);
+
+  public:
+    static const size_t DEFAULT_BATCH_ROWS = 0x10000;
+
+    explicit ColumnarExporter(NetDec *nd,
+                              size_t batch_rows = DEFAULT_BATCH_ROWS);
+    ~ColumnarExporter();
+
+    bool add_column(const std::string &name, ColType type);
+    bool add_column(const std::string &spec);  // "name" or "name:type"
+    bool open(const std::string &path);
+    bool flush();  // write buffered rows as one record batch
+    bool close();  // flush and write the file footer
+
+    void recv(ev_id eid, const Property &p);
+
+    size_t column_size() const { return this->columns_.size(); }
+    uint64_t rows() const { return this->total_rows_ + this->rows_; }
+    uint64_t batches() const { return this->batches_; }
+    const std::string &errmsg() const { return this->errmsg_; }
+
+    static bool str2type(const std::string &name, ColType *type);
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_COLUMNAR_H__
@@ -0,0 +1,477 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "./decode-log.h"
+#include "../property.h"
+#include "../value.h"
+
+namespace swarm {
+  // Log layout: MAGIC_, 1 byte flags, then records led by 1 byte tag.
+  //   TAG_EVENT / TAG_VALUE: id, name length, name
+  //   TAG_PACKET: ts_ns, len, cap_len, [data length, data],
+  //     proto (1 byte), addr_len, src/dst addr, port_len, src/dst port,
+  //     sample_rate, N of values, {vid, N of entries, {flag (1 byte),
+  //     [length, bytes], [text length, text]}}, N of events, {eid}
+  static const char MAGIC_[8] = {'S', 'W', 'D', 'L', 'O', 'G', 0, 1};
+  static const uint8_t FLAG_DATA = 0x01;
+  // upper bound of event/value id, far more than a NetDec assigns. an id
+  // read from a log must not size the maps freely
+  static const uint64_t ID_MAX = 0x10000;
+  enum {
+    TAG_EVENT = 1,
+    TAG_VALUE = 2,
+    TAG_PACKET = 3,
+  };
+  enum {
+    ENT_SET = 0x01,     // not null
+    ENT_TEXT = 0x02,    // text is saved (contextual value)
+  };
+
+  static inline void put_vu(std::string *buf, uint64_t v) {
+    while (v >= 0x80) {
+      buf->push_back(static_cast<char>((v & 0x7f) | 0x80));
+      v >>= 7;
+    }
+    buf->push_back(static_cast<char>(v));
+  }
+  static inline void put_bytes(std::string *buf, const void *p, size_t len) {
+    if (len > 0) {
+      buf->append(static_cast<const char*>(p), len);
+    }
+  }
+
+  // ----------------------------------------------------------------
+  DecodeLogWriter::DecodeLogWriter(NetDec *nd) :
+    nd_(nd), fp_(NULL), with_data_(false), pkt_count_(0) {
+  }
+  DecodeLogWriter::~DecodeLogWriter() {
+    this->close();
+  }
+
+  bool DecodeLogWriter::open(const std::string &path, bool with_data) {
+    if (this->fp_) {
+      this->errmsg_ = "already opened";
+      return false;
+    }
+
+    this->fp_ = ::fopen(path.c_str(), "wb");
+    if (this->fp_ == NULL) {
+      this->errmsg_ = path + ": " + strerror(errno);
+      return false;
+    }
+
+    this->with_data_ = with_data;
+    this->ev_def_.clear();
+    this->val_def_.clear();
+    this->val_seen_.clear();
+    this->pkt_count_ = 0;
+
+    const char flags = with_data ? FLAG_DATA : 0;
+    if (::fwrite(MAGIC_, sizeof(MAGIC_), 1, this->fp_) != 1 ||
+        ::fwrite(&flags, 1, 1, this->fp_) != 1) {
+      this->errmsg_ = path + ": " + strerror(errno);
+      ::fclose(this->fp_);
+      this->fp_ = NULL;
+      return false;
+    }
+
+    this->nd_->set_recorder(this);
+    return true;
+  }
+
+  bool DecodeLogWriter::close() {
+    if (this->fp_ == NULL) {
+      return true;
+    }
+
+    this->nd_->set_recorder(NULL);
+    bool rc = true;
+    if (::fclose(this->fp_) != 0) {
+      this->errmsg_ = strerror(errno);
+      rc = false;
+    }
+    this->fp_ = NULL;
+    return rc;
+  }
+
+  void DecodeLogWriter::put_def(uint8_t tag, uint64_t id,
+                                const std::string &name) {
+    this->buf_.push_back(static_cast<char>(tag));
+    put_vu(&this->buf_, id);
+    put_vu(&this->buf_, name.size());
+    put_bytes(&this->buf_, name.data(), name.size());
+  }
+
+  void DecodeLogWriter::record(const Property &prop) {
+    if (this->fp_ == NULL) {
+      return;
+    }
+
+    std::string &buf = this->buf_;
+    buf.clear();
+    this->pkt_count_++;
+
+    // name definitions first, so a record can be read in one pass
+    const size_t n_ret = prop.retained_size();
+    for (size_t i = 0; i < n_ret; i++) {
+      const size_t idx = Property::vid2idx(prop.retained(i));
+      if (idx >= this->val_def_.size()) {
+        this->val_def_.resize(idx + 1, false);
+        this->val_seen_.resize(idx + 1, 0);
+      }
+      if (!this->val_def_[idx]) {
+        this->put_def(TAG_VALUE, idx,
+                      this->nd_->lookup_value_name(prop.retained(i)));
+        this->val_def_[idx] = true;
+      }
+    }
+    const size_t n_ev = prop.event_size();
+    for (size_t i = 0; i < n_ev; i++) {
+      const size_t idx = static_cast<size_t>(prop.event(i) - EV_BASE);
+      if (idx >= this->ev_def_.size()) {
+        this->ev_def_.resize(idx + 1, false);
+      }
+      if (!this->ev_def_[idx]) {
+        this->put_def(TAG_EVENT, idx,
+                      this->nd_->lookup_event_name(prop.event(i)));
+        this->ev_def_[idx] = true;
+      }
+    }
+
+    buf.push_back(static_cast<char>(TAG_PACKET));
+    put_vu(&buf, prop.ts_ns());
+    put_vu(&buf, prop.len());
+    put_vu(&buf, prop.cap_len());
+    if (this->with_data_) {
+      put_vu(&buf, prop.cap_len());
+      put_bytes(&buf, prop.raw_data(), prop.cap_len());
+    }
+
+    size_t addr_len, port_len;
+    const void *src_addr = prop.src_addr(&addr_len);
+    const void *dst_addr = prop.dst_addr(&addr_len);
+    if (src_addr == NULL || dst_addr == NULL) {
+      addr_len = 0;
+    }
+    buf.push_back(static_cast<char>(prop.ip_proto()));
+    put_vu(&buf, addr_len);
+    put_bytes(&buf, src_addr, addr_len);
+    put_bytes(&buf, dst_addr, addr_len);
+    const void *src_port = prop.src_port(&port_len);
+    const void *dst_port = prop.dst_port(&port_len);
+    if (src_port == NULL || dst_port == NULL) {
+      port_len = 0;
+    }
+    put_vu(&buf, port_len);
+    put_bytes(&buf, src_port, port_len);
+    put_bytes(&buf, dst_port, port_len);
+    put_vu(&buf, prop.sample_rate());
+
+    // a value may be retained several times, save it once per packet
+    const uint64_t seq = this->pkt_count_;
+    size_t n_val = 0;
+    for (size_t i = 0; i < n_ret; i++) {
+      const size_t idx = Property::vid2idx(prop.retained(i));
+      if (this->val_seen_[idx] != seq) {
+        this->val_seen_[idx] = seq;
+        n_val++;
+      }
+    }
+    put_vu(&buf, n_val);
+    for (size_t i = 0; i < n_ret; i++) {
+      const val_id vid = prop.retained(i);
+      const size_t idx = Property::vid2idx(vid);
+      if (this->val_seen_[idx] != seq) {
+        continue;  // already saved
+      }
+      this->val_seen_[idx] = 0;
+
+      const size_t n_ent = prop.value_size(vid);
+      put_vu(&buf, idx);
+      put_vu(&buf, n_ent);
+      for (size_t j = 0; j < n_ent; j++) {
+        const Value &v = prop.value(vid, j);
+        size_t len;
+        const byte_t *ptr = v.ptr(&len);
+        uint8_t flag = 0;
+        std::string text;
+        if (ptr) {
+          flag |= ENT_SET;
+          if (v.contextual() && v.text(&text)) {
+            flag |= ENT_TEXT;
+          }
+        }
+        buf.push_back(static_cast<char>(flag));
+        if (flag & ENT_SET) {
+          put_vu(&buf, len);
+          put_bytes(&buf, ptr, len);
+        }
+        if (flag & ENT_TEXT) {
+          put_vu(&buf, text.size());
+          put_bytes(&buf, text.data(), text.size());
+        }
+      }
+    }
+
+    put_vu(&buf, n_ev);
+    for (size_t i = 0; i < n_ev; i++) {
+      put_vu(&buf, static_cast<uint64_t>(prop.event(i) - EV_BASE));
+    }
+
+    if (::fwrite(buf.data(), buf.size(), 1, this->fp_) != 1) {
+      this->errmsg_ = strerror(errno);
+      this->close();
+    }
+  }
+
+  // ----------------------------------------------------------------
+  DecodeLogReplayer::DecodeLogReplayer(NetDec *nd) :
+    nd_(nd), fd_(-1), addr_(NULL), length_(0), ptr_(NULL), eof_(NULL),
+    with_data_(false), broken_(false), pkt_count_(0) {
+  }
+  DecodeLogReplayer::~DecodeLogReplayer() {
+    if (this->addr_) {
+      ::munmap(this->addr_, this->length_);
+    }
+    if (this->fd_ >= 0) {
+      ::close(this->fd_);
+    }
+  }
+
+  bool DecodeLogReplayer::open(const std::string &path) {
+    if (this->fd_ >= 0) {
+      this->errmsg_ = "already opened";
+      return false;
+    }
+
+    this->fd_ = ::open(path.c_str(), O_RDONLY);
+    if (this->fd_ < 0) {
+      this->errmsg_ = path + ": " + strerror(errno);
+      return false;
+    }
+
+    struct stat st;
+    if (::fstat(this->fd_, &st) != 0) {
+      this->errmsg_ = path + ": " + strerror(errno);
+      return false;
+    }
+    this->length_ = st.st_size;
+    if (this->length_ < sizeof(MAGIC_) + 1 ||
+        NULL == (this->addr_ = ::mmap(NULL, this->length_, PROT_READ,
+                                      MAP_PRIVATE, this->fd_, 0)) ||
+        this->addr_ == MAP_FAILED) {
+      this->addr_ = NULL;
+      this->errmsg_ = path + ": not a decode log";
+      return false;
+    }
+
+    const uint8_t *base = static_cast<const uint8_t*>(this->addr_);
+    if (0 != ::memcmp(base, MAGIC_, sizeof(MAGIC_))) {
+      this->errmsg_ = path + ": not a decode log";
+      return false;
+    }
+    this->with_data_ = (base[sizeof(MAGIC_)] & FLAG_DATA) != 0;
+    this->ptr_ = base + sizeof(MAGIC_) + 1;
+    this->eof_ = base + this->length_;
+    return true;
+  }
+
+  inline bool DecodeLogReplayer::get_vu(uint64_t *v) {
+    uint64_t r = 0;
+    for (int s = 0; s < 64; s += 7) {
+      if (this->ptr_ >= this->eof_) {
+        return false;
+      }
+      const uint8_t b = *(this->ptr_++);
+      r |= static_cast<uint64_t>(b & 0x7f) << s;
+      if ((b & 0x80) == 0) {
+        *v = r;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline bool DecodeLogReplayer::get_bytes(size_t len, const uint8_t **p) {
+    if (static_cast<size_t>(this->eof_ - this->ptr_) < len) {
+      return false;
+    }
+    *p = this->ptr_;
+    this->ptr_ += len;
+    return true;
+  }
+
+  bool DecodeLogReplayer::read_def(uint8_t tag) {
+    uint64_t id, len;
+    const uint8_t *name;
+    if (!this->get_vu(&id) || !this->get_vu(&len) ||
+        !this->get_bytes(len, &name) || id >= ID_MAX) {
+      return false;
+    }
+
+    const std::string s(reinterpret_cast<const char*>(name), len);
+    if (tag == TAG_EVENT) {
+      if (id >= this->ev_map_.size()) {
+        this->ev_map_.resize(id + 1, EV_NULL);
+      }
+      this->ev_map_[id] = this->nd_->lookup_event_id(s);
+    } else {
+      if (id >= this->val_map_.size()) {
+        this->val_map_.resize(id + 1, VALUE_NULL);
+      }
+      this->val_map_[id] = this->nd_->lookup_value_id(s);
+    }
+    return true;
+  }
+
+  bool DecodeLogReplayer::read_packet() {
+    uint64_t ts_ns, len, cap_len, data_len = 0;
+    const uint8_t *data = NULL;
+    if (!this->get_vu(&ts_ns) || !this->get_vu(&len) ||
+        !this->get_vu(&cap_len)) {
+      return false;
+    }
+    if (this->with_data_) {
+      if (!this->get_vu(&data_len) || !this->get_bytes(data_len, &data)) {
+        return false;
+      }
+    }
+
+    this->broken_ = false;
+    this->nd_->replay(this, data, len, ts_ns, data ? data_len : cap_len);
+    this->pkt_count_++;
+    return !this->broken_;
+  }
+
+  void DecodeLogReplayer::restore(Property *prop) {
+    // rest of the packet record
+    uint64_t addr_len, port_len, rate, n_val, n_ev;
+    const uint8_t *proto, *src_addr, *dst_addr, *src_port, *dst_port;
+    if (!this->get_bytes(1, &proto) || !this->get_vu(&addr_len) ||
+        !this->get_bytes(addr_len, &src_addr) ||
+        !this->get_bytes(addr_len, &dst_addr) ||
+        !this->get_vu(&port_len) ||
+        !this->get_bytes(port_len, &src_port) ||
+        !this->get_bytes(port_len, &dst_port) ||
+        !this->get_vu(&rate)) {
+      this->broken_ = true;
+      return;
+    }
+
+    if (addr_len > 0) {
+      prop->set_addr(const_cast<uint8_t*>(src_addr),
+                     const_cast<uint8_t*>(dst_addr), *proto, addr_len);
+    }
+    if (port_len > 0) {
+      prop->set_port(const_cast<uint8_t*>(src_port),
+                     const_cast<uint8_t*>(dst_port), port_len);
+    }
+    prop->set_sample_rate(static_cast<uint32_t>(rate));
+
+    if (!this->get_vu(&n_val)) {
+      this->broken_ = true;
+      return;
+    }
+    for (uint64_t i = 0; i < n_val; i++) {
+      uint64_t idx, n_ent;
+      if (!this->get_vu(&idx) || !this->get_vu(&n_ent)) {
+        this->broken_ = true;
+        return;
+      }
+      const val_id vid = (idx < this->val_map_.size()) ?
+        this->val_map_[idx] : VALUE_NULL;
+
+      for (uint64_t j = 0; j < n_ent; j++) {
+        const uint8_t *flag, *ptr = NULL, *text = NULL;
+        uint64_t vlen = 0, tlen = 0;
+        if (!this->get_bytes(1, &flag) ||
+            ((*flag & ENT_SET) && (!this->get_vu(&vlen) ||
+                                   !this->get_bytes(vlen, &ptr))) ||
+            ((*flag & ENT_TEXT) && (!this->get_vu(&tlen) ||
+                                    !this->get_bytes(tlen, &text)))) {
+          this->broken_ = true;
+          return;
+        }
+
+        Value *v = (vid != VALUE_NULL) ? prop->retain(vid) : NULL;
+        if (v == NULL) {
+          continue;  // unknown to this NetDec
+        }
+        if (text) {
+          this->text_.assign(reinterpret_cast<const char*>(text), tlen);
+        }
+        v->restore(const_cast<uint8_t*>(ptr), vlen,
+                   text ? &this->text_ : NULL);
+      }
+    }
+
+    if (!this->get_vu(&n_ev)) {
+      this->broken_ = true;
+      return;
+    }
+    for (uint64_t i = 0; i < n_ev; i++) {
+      uint64_t idx;
+      if (!this->get_vu(&idx)) {
+        this->broken_ = true;
+        return;
+      }
+      if (idx < this->ev_map_.size() && this->ev_map_[idx] != EV_NULL) {
+        prop->push_event(this->ev_map_[idx]);
+      }
+    }
+  }
+
+  bool DecodeLogReplayer::run() {
+    if (this->ptr_ == NULL) {
+      this->errmsg_ = "not opened";
+      return false;
+    }
+
+    while (this->ptr_ < this->eof_) {
+      const uint8_t tag = *(this->ptr_++);
+      bool rc;
+      switch (tag) {
+      case TAG_EVENT:
+      case TAG_VALUE: rc = this->read_def(tag); break;
+      case TAG_PACKET: rc = this->read_packet(); break;
+      default: rc = false; break;
+      }
+
+      if (!rc) {
+        this->errmsg_ = "broken decode log";
+        return false;
+      }
+    }
+    return true;
+  }
+}  // namespace swarm
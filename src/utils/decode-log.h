@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_DECODE_LOG_H__
+#define SRC_UTILS_DECODE_LOG_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class DecodeLogWriter:
+  // Records decode result of every packet into a compact binary log:
+  // time stamp, lengths, 5 tuple, retained values and pushed events.
+  // Packet data is saved only if with_data. Event and value names are
+  // written once when they first appear, so a log can be replayed by a
+  // NetDec of another build. Integers are LEB128 varints.
+  //
+  class DecodeLogWriter : public DecodeRecorder {
+  private:
+    NetDec *nd_;
+    FILE *fp_;
+    bool with_data_;
+    std::vector<bool> ev_def_;
+    std::vector<bool> val_def_;
+    std::vector<uint64_t> val_seen_;  // packet number the value was saved
+    std::string buf_;
+    uint64_t pkt_count_;
+    std::string errmsg_;
+
+    void put_def(uint8_t tag, uint64_t id, const std::string &name);
+
+  public:
+    explicit DecodeLogWriter(NetDec *nd);
+    ~DecodeLogWriter();
+    // also sets this writer as recorder of the NetDec
+    bool open(const std::string &path, bool with_data = false);
+    bool close();
+    void record(const Property &prop);
+    uint64_t pkt_count() const { return this->pkt_count_; }
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+
+  // ----------------------------------------------------------------
+  // class DecodeLogReplayer:
+  // Feeds handlers of a NetDec from a log of DecodeLogWriter without
+  // decoding. Values are restored zero-copy from the mmap'ed log.
+  // Events or values unknown to the NetDec are skipped.
+  //
+  class DecodeLogReplayer : public DecodeRestorer {
+  private:
+    NetDec *nd_;
+    int fd_;
+    void *addr_;
+    size_t length_;
+    const uint8_t *ptr_;
+    const uint8_t *eof_;
+    bool with_data_;
+    bool broken_;
+    std::vector<ev_id> ev_map_;
+    std::vector<val_id> val_map_;
+    std::string text_;
+    uint64_t pkt_count_;
+    std::string errmsg_;
+
+    inline bool get_vu(uint64_t *v);
+    inline bool get_bytes(size_t len, const uint8_t **p);
+    bool read_def(uint8_t tag);
+    bool read_packet();
+
+  public:
+    explicit DecodeLogReplayer(NetDec *nd);
+    ~DecodeLogReplayer();
+    bool open(const std::string &path);
+    // replay all packets of the log
+    bool run();
+    void restore(Property *prop);
+    uint64_t pkt_count() const { return this->pkt_count_; }
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_DECODE_LOG_H__
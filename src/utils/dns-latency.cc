@@ -0,0 +1,160 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "./dns-latency.h"
+#include "../property.h"
+#include "../value.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // LatencyHistogram
+  //
+  LatencyHistogram::LatencyHistogram() {
+    this->reset();
+  }
+  LatencyHistogram::~LatencyHistogram() {
+  }
+
+  void LatencyHistogram::reset() {
+    ::memset(this->bucket_, 0, sizeof(this->bucket_));
+    this->count_ = this->sum_ = 0;
+    this->min_ = this->max_ = 0;
+  }
+
+  size_t LatencyHistogram::to_idx(uint32_t usec) {
+    if (usec < LINEAR_MAX) {
+      return usec;
+    }
+    size_t msb = 31 - __builtin_clz(usec);  // >= 4
+    size_t sub = (usec >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return LINEAR_MAX + (msb - 4) * (1 << SUB_BITS) + sub;
+  }
+
+  uint32_t LatencyHistogram::to_value(size_t idx) {
+    if (idx < LINEAR_MAX) {
+      return static_cast<uint32_t>(idx);
+    }
+    size_t msb = (idx - LINEAR_MAX) / (1 << SUB_BITS) + 4;
+    uint64_t sub = (idx - LINEAR_MAX) % (1 << SUB_BITS);
+    uint64_t upper = ((uint64_t(1) << SUB_BITS) + sub + 1) <<
+      (msb - SUB_BITS);
+    return static_cast<uint32_t>(upper - 1);
+  }
+
+  void LatencyHistogram::add(uint32_t usec) {
+    this->bucket_[LatencyHistogram::to_idx(usec)]++;
+    if (this->count_ == 0 || usec < this->min_) {
+      this->min_ = usec;
+    }
+    if (usec > this->max_) {
+      this->max_ = usec;
+    }
+    this->count_++;
+    this->sum_ += usec;
+  }
+
+  double LatencyHistogram::mean() const {
+    return (this->count_ > 0) ?
+      static_cast<double>(this->sum_) / this->count_ : 0;
+  }
+
+  uint32_t LatencyHistogram::quantile(double q) const {
+    if (this->count_ == 0) {
+      return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q * this->count_);
+    if (rank >= this->count_) {
+      rank = this->count_ - 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_CNT; i++) {
+      seen += this->bucket_[i];
+      if (seen > rank) {
+        uint32_t v = LatencyHistogram::to_value(i);
+        // bucket bound never goes out of observed range
+        return (v < this->min_) ? this->min_ :
+          (v > this->max_ ? this->max_ : v);
+      }
+    }
+    return this->max_;
+  }
+
+
+  // ----------------------------------------------------------------
+  // DnsLatency
+  //
+  DnsLatency::Server::Server() : timeout_(0) {
+    ::memset(this->rcode_, 0, sizeof(this->rcode_));
+  }
+
+  DnsLatency::DnsLatency(NetDec *nd) {
+    this->EV_TX_ = nd->lookup_event_id("dns.transaction");
+    this->EV_TIMEOUT_ = nd->lookup_event_id("dns.timeout");
+    this->P_SERVER_ = nd->lookup_value_id("dns_tx.server");
+    this->P_LATENCY_ = nd->lookup_value_id("dns_tx.latency");
+    this->P_RCODE_ = nd->lookup_value_id("dns_tx.rcode");
+    this->P_TO_SERVER_ = nd->lookup_value_id("dns_tx.timeout_server");
+  }
+  DnsLatency::~DnsLatency() {
+  }
+
+  DnsLatency::Server *DnsLatency::fetch(const byte_t *addr, size_t len) {
+    // key_ is reused to avoid allocation on lookup of known servers
+    this->key_.assign(reinterpret_cast<const char*>(addr), len);
+    return &(this->server_[this->key_]);
+  }
+
+  const DnsLatency::Server *DnsLatency::server(const void *addr,
+                                               size_t len) const {
+    std::string key(static_cast<const char*>(addr), len);
+    auto it = this->server_.find(key);
+    return (it != this->server_.end()) ? &(it->second) : NULL;
+  }
+
+  void DnsLatency::recv(ev_id eid, const Property &p) {
+    size_t len;
+    if (eid == this->EV_TX_) {
+      const byte_t *addr = p.value(this->P_SERVER_).ptr(&len);
+      if (addr) {
+        Server *srv = this->fetch(addr, len);
+        srv->hist_.add(p.value(this->P_LATENCY_).uint32());
+        srv->rcode_[p.value(this->P_RCODE_).ntoh<uint8_t>() & 0x0F]++;
+      }
+    } else if (eid == this->EV_TIMEOUT_) {
+      for (size_t i = 0; i < p.value_size(this->P_TO_SERVER_); i++) {
+        const byte_t *addr = p.value(this->P_TO_SERVER_, i).ptr(&len);
+        if (addr) {
+          this->fetch(addr, len)->timeout_++;
+        }
+      }
+    }
+  }
+}  // namespace swarm
@@ -0,0 +1,105 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_DNS_LATENCY_H__
+#define SRC_UTILS_DNS_LATENCY_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class LatencyHistogram:
+  // Log-linear histogram of micro second values. Values under 16 usec have
+  // their own bucket, larger ones are split into 8 buckets per power of
+  // two, so quantiles are within 12.5% of the real value. Fixed size, no
+  // samples are kept.
+  //
+  class LatencyHistogram {
+  private:
+    static const size_t SUB_BITS = 3;
+    static const size_t LINEAR_MAX = 16;
+    static const size_t BUCKET_CNT = LINEAR_MAX + (32 - 4) * (1 << SUB_BITS);
+
+    uint64_t bucket_[BUCKET_CNT];
+    uint64_t count_;
+    uint64_t sum_;
+    uint32_t min_, max_;
+
+    static size_t to_idx(uint32_t usec);
+    static uint32_t to_value(size_t idx);  // upper bound of bucket
+
+  public:
+    LatencyHistogram();
+    ~LatencyHistogram();
+    void add(uint32_t usec);
+    void reset();
+
+    uint64_t count() const { return this->count_; }
+    uint32_t min() const { return this->min_; }
+    uint32_t max() const { return this->max_; }
+    double mean() const;
+    uint32_t quantile(double q) const;  // q in [0, 1]
+  };
+
+  // ----------------------------------------------------------------
+  // class DnsLatency:
+  // Handler for "dns.transaction" and "dns.timeout" events that keeps a
+  // latency histogram and timeout count per DNS server address.
+  //
+  class DnsLatency : public Handler {
+  public:
+    class Server {
+    public:
+      LatencyHistogram hist_;
+      uint64_t timeout_;
+      uint64_t rcode_[16];
+      Server();
+    };
+    typedef std::map<std::string, Server> ServerMap;  // key: raw address
+
+  private:
+    ev_id EV_TX_, EV_TIMEOUT_;
+    val_id P_SERVER_, P_LATENCY_, P_RCODE_, P_TO_SERVER_;
+    ServerMap server_;
+    std::string key_;
+
+    Server *fetch(const byte_t *addr, size_t len);
+
+  public:
+    explicit DnsLatency(NetDec *nd);
+    ~DnsLatency();
+    void recv(ev_id eid, const Property &p);
+
+    const ServerMap &servers() const { return this->server_; }
+    const Server *server(const void *addr, size_t len) const;
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_DNS_LATENCY_H__
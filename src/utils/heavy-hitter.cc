@@ -0,0 +1,486 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <sstream>
+#include "./heavy-hitter.h"
+#include "../property.h"
+#include "../value.h"
+
+namespace swarm {
+  const size_t SpaceSaving::KEY_MAX;
+  const uint32_t SpaceSaving::EMPTY;
+  const char *HeavyHitter::KEY_5TUPLE = "5tuple";
+
+  // -------------------------------------------------------
+  // CountMin
+  CountMin::CountMin(size_t width, size_t depth) :
+    width_((width > 0) ? width : 1), depth_((depth > 0) ? depth : 1),
+    count_(this->width_ * this->depth_, 0), total_(0) {
+  }
+  CountMin::~CountMin() {
+  }
+
+  void CountMin::add(uint64_t hv, uint64_t weight) {
+    // row i uses h1 + i * h2 (Kirsch and Mitzenmacher)
+    const uint32_t h1 = static_cast<uint32_t>(hv);
+    const uint32_t h2 = static_cast<uint32_t>(hv >> 32) | 1;
+    uint64_t *row = &(this->count_[0]);
+    for (size_t i = 0; i < this->depth_; i++, row += this->width_) {
+      row[(h1 + i * h2) % this->width_] += weight;
+    }
+    this->total_ += weight;
+  }
+
+  uint64_t CountMin::estimate(uint64_t hv) const {
+    const uint32_t h1 = static_cast<uint32_t>(hv);
+    const uint32_t h2 = static_cast<uint32_t>(hv >> 32) | 1;
+    const uint64_t *row = &(this->count_[0]);
+    uint64_t est = row[h1 % this->width_];
+    for (size_t i = 1; i < this->depth_; i++) {
+      row += this->width_;
+      est = std::min(est, row[(h1 + i * h2) % this->width_]);
+    }
+    return est;
+  }
+
+  bool CountMin::merge(const CountMin &cm) {
+    if (this->width_ != cm.width_ || this->depth_ != cm.depth_) {
+      return false;
+    }
+    for (size_t i = 0; i < this->count_.size(); i++) {
+      this->count_[i] += cm.count_[i];
+    }
+    this->total_ += cm.total_;
+    return true;
+  }
+
+  void CountMin::clear() {
+    std::fill(this->count_.begin(), this->count_.end(), 0);
+    this->total_ = 0;
+  }
+
+
+  // -------------------------------------------------------
+  // SpaceSaving
+  SpaceSaving::SpaceSaving(size_t capacity) :
+    capacity_((capacity > 0) ? capacity : 1), size_(0),
+    counter_(this->capacity_), heap_(this->capacity_) {
+    size_t len = 1;
+    while (len < this->capacity_ * 2) {
+      len <<= 1;
+    }
+    this->index_.resize(len, EMPTY);
+    this->mask_ = len - 1;
+  }
+  SpaceSaving::~SpaceSaving() {
+  }
+
+  size_t SpaceSaving::find(uint64_t hv, const byte_t *key, size_t len) const {
+    for (size_t pos = hv & this->mask_; ; pos = (pos + 1) & this->mask_) {
+      const uint32_t c_idx = this->index_[pos];
+      if (c_idx == EMPTY) {
+        return EMPTY;
+      }
+      const Counter &c = this->counter_[c_idx];
+      if (c.hash_ == hv && c.len_ == len && 0 == ::memcmp(c.key_, key, len)) {
+        return c_idx;
+      }
+    }
+  }
+
+  void SpaceSaving::insert_index(uint32_t c_idx) {
+    size_t pos = this->counter_[c_idx].hash_ & this->mask_;
+    while (this->index_[pos] != EMPTY) {
+      pos = (pos + 1) & this->mask_;
+    }
+    this->index_[pos] = c_idx;
+  }
+
+  void SpaceSaving::remove_index(uint32_t c_idx) {
+    size_t i = this->counter_[c_idx].hash_ & this->mask_;
+    while (this->index_[i] != c_idx) {
+      assert(this->index_[i] != EMPTY);
+      i = (i + 1) & this->mask_;
+    }
+
+    // backward shift deletion of linear probing, no tombstone
+    for (size_t j = i; ; ) {
+      j = (j + 1) & this->mask_;
+      if (this->index_[j] == EMPTY) {
+        break;
+      }
+      size_t k = this->counter_[this->index_[j]].hash_ & this->mask_;
+      if ((i <= j) ? (k <= i || j < k) : (k <= i && j < k)) {
+        this->index_[i] = this->index_[j];
+        i = j;
+      }
+    }
+    this->index_[i] = EMPTY;
+  }
+
+  void SpaceSaving::sift_up(size_t pos) {
+    while (pos > 0) {
+      size_t parent = (pos - 1) / 2;
+      if (this->counter_[this->heap_[parent]].count_ <=
+          this->counter_[this->heap_[pos]].count_) {
+        break;
+      }
+      std::swap(this->heap_[parent], this->heap_[pos]);
+      this->counter_[this->heap_[pos]].heap_ = pos;
+      pos = parent;
+    }
+    this->counter_[this->heap_[pos]].heap_ = pos;
+  }
+
+  void SpaceSaving::sift_down(size_t pos) {
+    for (;;) {
+      size_t min = pos;
+      const size_t l = pos * 2 + 1, r = pos * 2 + 2;
+      if (l < this->size_ && this->counter_[this->heap_[l]].count_ <
+          this->counter_[this->heap_[min]].count_) {
+        min = l;
+      }
+      if (r < this->size_ && this->counter_[this->heap_[r]].count_ <
+          this->counter_[this->heap_[min]].count_) {
+        min = r;
+      }
+      if (min == pos) {
+        break;
+      }
+      std::swap(this->heap_[min], this->heap_[pos]);
+      this->counter_[this->heap_[pos]].heap_ = pos;
+      pos = min;
+    }
+    this->counter_[this->heap_[pos]].heap_ = pos;
+  }
+
+  void SpaceSaving::add(uint64_t hv, const void *key, size_t len,
+                        uint64_t weight) {
+    len = std::min(len, KEY_MAX);
+    const byte_t *k = static_cast<const byte_t *>(key);
+    size_t c_idx = this->find(hv, k, len);
+    if (c_idx != EMPTY) {
+      Counter &c = this->counter_[c_idx];
+      c.count_ += weight;
+      this->sift_down(c.heap_);
+      return;
+    }
+
+    if (this->size_ < this->capacity_) {
+      c_idx = this->size_++;
+      Counter &c = this->counter_[c_idx];
+      c.count_ = weight;
+      c.error_ = 0;
+      c.hash_ = hv;
+      c.len_ = len;
+      ::memcpy(c.key_, k, len);
+      this->heap_[c_idx] = c_idx;
+      this->insert_index(c_idx);
+      this->sift_up(c_idx);
+    } else {
+      // take over the smallest counter
+      c_idx = this->heap_[0];
+      this->remove_index(c_idx);
+      Counter &c = this->counter_[c_idx];
+      c.error_ = c.count_;
+      c.count_ += weight;
+      c.hash_ = hv;
+      c.len_ = len;
+      ::memcpy(c.key_, k, len);
+      this->insert_index(c_idx);
+      this->sift_down(0);
+    }
+  }
+
+  static bool cmp_item(const SpaceSaving::Item &a, const SpaceSaving::Item &b) {
+    return (a.count_ != b.count_) ? (a.count_ > b.count_) : (a.key_ < b.key_);
+  }
+
+  void SpaceSaving::top(std::vector<Item> *items, size_t k) const {
+    items->resize(this->size_);
+    for (size_t i = 0; i < this->size_; i++) {
+      const Counter &c = this->counter_[i];
+      Item &it = (*items)[i];
+      it.key_.assign(reinterpret_cast<const char *>(c.key_), c.len_);
+      it.count_ = c.count_;
+      it.error_ = c.error_;
+    }
+    std::sort(items->begin(), items->end(), cmp_item);
+    if (k > 0 && items->size() > k) {
+      items->resize(k);
+    }
+  }
+
+  uint64_t SpaceSaving::min_count() const {
+    return (this->size_ < this->capacity_) ?
+      0 : this->counter_[this->heap_[0]].count_;
+  }
+
+  bool SpaceSaving::merge(const SpaceSaving &ss) {
+    if (this->capacity_ != ss.capacity_) {
+      return false;
+    }
+
+    // A key missing in one summary may have been counted there up to its
+    // min count, which goes to both count and error (Agarwal et al.).
+    const uint64_t m1 = this->min_count(), m2 = ss.min_count();
+    std::vector<Counter> all;
+    all.reserve(this->size_ + ss.size_);
+    for (size_t i = 0; i < this->size_; i++) {
+      Counter c = this->counter_[i];
+      size_t o = ss.find(c.hash_, c.key_, c.len_);
+      if (o != EMPTY) {
+        c.count_ += ss.counter_[o].count_;
+        c.error_ += ss.counter_[o].error_;
+      } else {
+        c.count_ += m2;
+        c.error_ += m2;
+      }
+      all.push_back(c);
+    }
+    for (size_t i = 0; i < ss.size_; i++) {
+      const Counter &o = ss.counter_[i];
+      if (this->find(o.hash_, o.key_, o.len_) == EMPTY) {
+        all.push_back(o);
+        all.back().count_ += m1;
+        all.back().error_ += m1;
+      }
+    }
+
+    // keep the largest capacity_ counters
+    std::vector<std::pair<uint64_t, size_t> > order(all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+      order[i] = std::make_pair(all[i].count_, i);
+    }
+    std::sort(order.rbegin(), order.rend());
+    if (order.size() > this->capacity_) {
+      order.resize(this->capacity_);
+    }
+
+    this->clear();
+    for (size_t i = 0; i < order.size(); i++) {
+      const uint32_t c_idx = this->size_++;
+      this->counter_[c_idx] = all[order[i].second];
+      this->heap_[c_idx] = c_idx;
+      this->insert_index(c_idx);
+      this->sift_up(c_idx);
+    }
+    return true;
+  }
+
+  void SpaceSaving::clear() {
+    this->size_ = 0;
+    std::fill(this->index_.begin(), this->index_.end(), EMPTY);
+  }
+
+
+  // -------------------------------------------------------
+  // HitterSketch
+  HitterSketch::HitterSketch(size_t k, size_t width, size_t depth) :
+    ss_(k), cm_(width, depth), start_sec_(0) {
+  }
+  HitterSketch::~HitterSketch() {
+  }
+
+  uint64_t HitterSketch::hash(const void *key, size_t len) {
+    // MurmurHash64A, the key is truncated as SpaceSaving does
+    len = std::min(len, SpaceSaving::KEY_MAX);
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const byte_t *p = static_cast<const byte_t *>(key);
+    uint64_t h = 0x5bd1e995ULL ^ (len * m);
+
+    for (; len >= 8; len -= 8, p += 8) {
+      uint64_t k;
+      ::memcpy(&k, p, sizeof(k));
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+    switch (len) {
+    case 7: h ^= static_cast<uint64_t>(p[6]) << 48;
+    case 6: h ^= static_cast<uint64_t>(p[5]) << 40;
+    case 5: h ^= static_cast<uint64_t>(p[4]) << 32;
+    case 4: h ^= static_cast<uint64_t>(p[3]) << 24;
+    case 3: h ^= static_cast<uint64_t>(p[2]) << 16;
+    case 2: h ^= static_cast<uint64_t>(p[1]) << 8;
+    case 1: h ^= static_cast<uint64_t>(p[0]);
+      h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+  }
+
+  void HitterSketch::top(std::vector<SpaceSaving::Item> *items,
+                         size_t k) const {
+    this->ss_.top(items, k);
+  }
+
+  uint64_t HitterSketch::estimate(const void *key, size_t len) const {
+    return this->cm_.estimate(HitterSketch::hash(key, len));
+  }
+
+  bool HitterSketch::merge(const HitterSketch &hs) {
+    if (this->ss_.capacity() != hs.ss_.capacity() ||
+        this->cm_.width() != hs.cm_.width() ||
+        this->cm_.depth() != hs.cm_.depth()) {
+      return false;
+    }
+    this->ss_.merge(hs.ss_);
+    this->cm_.merge(hs.cm_);
+    if (this->start_sec_ == 0 ||
+        (hs.start_sec_ > 0 && hs.start_sec_ < this->start_sec_)) {
+      this->start_sec_ = hs.start_sec_;
+    }
+    return true;
+  }
+
+  void HitterSketch::clear() {
+    this->ss_.clear();
+    this->cm_.clear();
+    this->start_sec_ = 0;
+  }
+
+
+  // -------------------------------------------------------
+  // HeavyHitter
+  HeavyHitter::HeavyHitter(NetDec *nd, const std::string &key, size_t k,
+                           size_t width, size_t depth) :
+    key_(VALUE_NULL), tuple_(key == KEY_5TUPLE), text_(false),
+    weight_(WEIGHT_PACKET),
+    window_(0), rotate_count_(0), fmt_(NULL) {
+    this->cur_ = new HitterSketch(k, width, depth);
+    this->last_ = new HitterSketch(k, width, depth);
+
+    if (!this->tuple_) {
+      this->key_ = nd->lookup_value_id(key);
+      if (this->key_ == VALUE_NULL) {
+        this->errmsg_ = "no such value: " + key;
+      } else {
+        this->fmt_ = nd->new_value(this->key_);
+        this->text_ = (this->fmt_ && this->fmt_->contextual());
+      }
+    }
+  }
+  HeavyHitter::~HeavyHitter() {
+    delete this->cur_;
+    delete this->last_;
+    delete this->fmt_;
+  }
+
+  void HeavyHitter::rotate() {
+    std::swap(this->cur_, this->last_);
+    this->cur_->clear();
+    this->rotate_count_++;
+  }
+
+  void HeavyHitter::recv(ev_id eid, const Property &p) {
+    if (this->window_ > 0) {
+      const uint64_t sec = static_cast<uint64_t>(p.tv_sec());
+      const uint64_t base = sec - sec % this->window_;
+      if (this->cur_->start_sec() < base) {
+        if (this->cur_->start_sec() > 0) {
+          const bool gap = (this->cur_->start_sec() + this->window_ < base);
+          this->rotate();
+          if (gap) {
+            // no packet in the window just before, it is the last one
+            this->last_->clear();
+            this->last_->set_start_sec(base - this->window_);
+          }
+        }
+        this->cur_->set_start_sec(base);
+      }
+    }
+
+    const uint64_t w = (this->weight_ == WEIGHT_BYTES) ? p.len() : 1;
+    size_t len;
+    if (this->tuple_) {
+      const void *label = p.ssn_label(&len);
+      if (len > 0) {
+        this->cur_->add(label, len, w);
+      }
+      return;
+    }
+
+    const size_t n = p.value_size(this->key_);
+    for (size_t i = 0; i < n; i++) {
+      const Value &v = p.value(this->key_, i);
+      if (this->text_) {
+        // raw bytes of a compressed name are a pointer into the message
+        if (v.text(&(this->buf_))) {
+          this->cur_->add(this->buf_.data(), this->buf_.size(), w);
+        }
+      } else {
+        const byte_t *ptr = v.ptr(&len);
+        if (ptr) {
+          this->cur_->add(ptr, len, w);
+        }
+      }
+    }
+  }
+
+  std::string HeavyHitter::repr(const std::string &key) const {
+    if (this->text_) {
+      return key;  // text already
+    }
+    byte_t *ptr = reinterpret_cast<byte_t *>(const_cast<char *>(key.data()));
+    if (this->fmt_) {
+      this->fmt_->set(ptr, key.size());
+      return this->fmt_->repr();
+    }
+
+    // session label: left and right address, ports, protocol
+    const size_t words = key.size() / 4;
+    const size_t addr_len = (words > 2) ? (words - 2) / 2 * 4 : 0;
+    if ((addr_len != 4 && addr_len != 16) || key.size() % 4 != 0) {
+      Value v;
+      v.set(ptr, key.size());
+      return v.hex();
+    }
+
+    uint32_t port, proto;
+    ::memcpy(&port, ptr + addr_len * 2, sizeof(port));
+    ::memcpy(&proto, ptr + addr_len * 2 + 4, sizeof(proto));
+    const int af = (addr_len == 4) ? AF_INET : AF_INET6;
+    char la[INET6_ADDRSTRLEN], ra[INET6_ADDRSTRLEN];
+    ::inet_ntop(af, ptr, la, sizeof(la));
+    ::inet_ntop(af, ptr + addr_len, ra, sizeof(ra));
+
+    std::stringstream ss;
+    ss << la << ":" << ntohs(static_cast<uint16_t>(port >> 16)) << " <-> "
+       << ra << ":" << ntohs(static_cast<uint16_t>(port & 0xffff))
+       << " proto " << proto;
+    return ss.str();
+  }
+}  // namespace swarm
@@ -0,0 +1,202 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_HEAVY_HITTER_H__
+#define SRC_UTILS_HEAVY_HITTER_H__
+
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class CountMin:
+  // Count-Min sketch of depth rows by width counters. estimate() never
+  // goes under the real count and goes over it by at most 2N/width with
+  // probability 1 - 2^-depth, N is the total count. Rows are indexed by
+  // double hashing of one 64 bit key hash. Sketches of the same size can
+  // be merged.
+  //
+  class CountMin {
+  private:
+    size_t width_;
+    size_t depth_;
+    std::vector<uint64_t> count_;
+    uint64_t total_;
+
+  public:
+    CountMin(size_t width, size_t depth);
+    ~CountMin();
+    void add(uint64_t hv, uint64_t weight);
+    uint64_t estimate(uint64_t hv) const;
+    bool merge(const CountMin &cm);
+    void clear();
+
+    size_t width() const { return this->width_; }
+    size_t depth() const { return this->depth_; }
+    uint64_t total() const { return this->total_; }
+  };
+
+  // ----------------------------------------------------------------
+  // class SpaceSaving:
+  // Space-Saving top-K summary of capacity counters. A new key takes over
+  // the counter with the smallest count (and keeps it as error), so any key
+  // counted more than N/capacity is in the summary and count - error is
+  // the guaranteed count. Counters are a min heap indexed by an open
+  // addressing table, all allocated in the constructor. A key longer than
+  // KEY_MAX is counted under its first KEY_MAX bytes.
+  //
+  class SpaceSaving {
+  public:
+    static const size_t KEY_MAX = 256;  // DNS name fits
+    struct Item {
+      std::string key_;
+      uint64_t count_;
+      uint64_t error_;
+    };
+
+  private:
+    struct Counter {
+      uint64_t hash_;
+      uint64_t count_;
+      uint64_t error_;
+      size_t heap_;   // position in heap_
+      size_t len_;
+      byte_t key_[KEY_MAX];
+    };
+    static const uint32_t EMPTY = 0xffffffff;
+
+    size_t capacity_;
+    size_t size_;
+    std::vector<Counter> counter_;
+    std::vector<uint32_t> heap_;   // counter index, min count at top
+    std::vector<uint32_t> index_;  // hash table of counter index
+    size_t mask_;
+
+    size_t find(uint64_t hv, const byte_t *key, size_t len) const;
+    void insert_index(uint32_t c_idx);
+    void remove_index(uint32_t c_idx);
+    void sift_up(size_t pos);
+    void sift_down(size_t pos);
+
+  public:
+    explicit SpaceSaving(size_t capacity);
+    ~SpaceSaving();
+    void add(uint64_t hv, const void *key, size_t len, uint64_t weight);
+    // items of largest count first, up to k (all if 0)
+    void top(std::vector<Item> *items, size_t k = 0) const;
+    bool merge(const SpaceSaving &ss);
+    void clear();
+
+    size_t capacity() const { return this->capacity_; }
+    size_t size() const { return this->size_; }
+    uint64_t min_count() const;
+  };
+
+  // ----------------------------------------------------------------
+  // class HitterSketch:
+  // Space-Saving for top-K and Count-Min for point queries over the same
+  // key stream; a key is hashed once for both. Mergeable when built with
+  // the same sizes, e.g. windows or sensors into one.
+  //
+  class HitterSketch {
+  private:
+    SpaceSaving ss_;
+    CountMin cm_;
+    uint64_t start_sec_;
+
+  public:
+    HitterSketch(size_t k, size_t width, size_t depth);
+    ~HitterSketch();
+    static uint64_t hash(const void *key, size_t len);
+    inline void add(const void *key, size_t len, uint64_t weight) {
+      uint64_t hv = HitterSketch::hash(key, len);
+      this->ss_.add(hv, key, len, weight);
+      this->cm_.add(hv, weight);
+    }
+    void top(std::vector<SpaceSaving::Item> *items, size_t k = 0) const;
+    uint64_t estimate(const void *key, size_t len) const;
+    bool merge(const HitterSketch &hs);
+    void clear();
+
+    uint64_t total() const { return this->cm_.total(); }
+    uint64_t start_sec() const { return this->start_sec_; }
+    void set_start_sec(uint64_t sec) { this->start_sec_ = sec; }
+  };
+
+  // ----------------------------------------------------------------
+  // class HeavyHitter:
+  // Handler keeping a HitterSketch over a value of the packet, e.g.
+  // "ipv4.src" on "ipv4.packet" or "dns.qd_name" on "dns.packet", or the
+  // 5 tuple of Property::ssn_label() by KEY_5TUPLE. Every value of the
+  // name in a packet is counted. A contextual value (e.g. compressed DNS
+  // name) is keyed by its text, other ones by raw bytes. With a window,
+  // the sketch is rotated by packet time: last() is the latest whole
+  // window (empty after a silent one) and current() is being filled.
+  // Memory is fixed by k, width and depth.
+  //
+  class HeavyHitter : public Handler {
+  public:
+    static const char *KEY_5TUPLE;
+    enum Weight {
+      WEIGHT_PACKET = 0,
+      WEIGHT_BYTES,
+    };
+
+  private:
+    val_id key_;
+    bool tuple_;
+    bool text_;        // key by Value::text()
+    std::string buf_;  // text of a value
+    Weight weight_;
+    time_t window_;
+    HitterSketch *cur_;
+    HitterSketch *last_;
+    uint64_t rotate_count_;
+    Value *fmt_;
+    std::string errmsg_;
+
+  public:
+    HeavyHitter(NetDec *nd, const std::string &key, size_t k = 100,
+                size_t width = 2048, size_t depth = 4);
+    ~HeavyHitter();
+    bool ready() const { return this->errmsg_.empty(); }
+    void set_weight(Weight w) { this->weight_ = w; }
+    void set_window(time_t sec) { this->window_ = sec; }  // 0: no rotation
+    void recv(ev_id eid, const Property &p);
+    void rotate();
+
+    const HitterSketch &current() const { return *this->cur_; }
+    const HitterSketch &last() const { return *this->last_; }
+    uint64_t rotate_count() const { return this->rotate_count_; }
+    // printable form of an Item key, by the value or the 5 tuple
+    std::string repr(const std::string &key) const;
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_HEAVY_HITTER_H__
@@ -0,0 +1,626 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sstream>
+
+#include "./ipfix.h"
+#include "../checkpoint.h"
+#include "../property.h"
+#include "../debug.h"
+
+namespace swarm {
+  // Information element IDs and lengths of exported templates. NetFlow v9
+  // uses the same IDs for the common fields, but flow timestamps are
+  // FIRST_SWITCHED(22)/LAST_SWITCHED(21) relative to system uptime.
+  static const uint16_t IPFIX_V4_FIELDS[] = {
+    8, 4,  12, 4,  7, 2,  11, 2,  4, 1,  1, 8,  2, 8,  152, 8,  153, 8,
+  };
+  static const uint16_t IPFIX_V6_FIELDS[] = {
+    27, 16,  28, 16,  7, 2,  11, 2,  4, 1,  1, 8,  2, 8,  152, 8,  153, 8,
+  };
+  static const uint16_t NFV9_V4_FIELDS[] = {
+    8, 4,  12, 4,  7, 2,  11, 2,  4, 1,  1, 8,  2, 8,  22, 4,  21, 4,
+  };
+  static const uint16_t NFV9_V6_FIELDS[] = {
+    27, 16,  28, 16,  7, 2,  11, 2,  4, 1,  1, 8,  2, 8,  22, 4,  21, 4,
+  };
+  static const size_t FIELD_COUNT = 9;
+
+  static const size_t IPFIX_HDR_LEN = 16;
+  static const size_t NFV9_HDR_LEN  = 20;
+  static const size_t SET_HDR_LEN   = 4;
+
+  // Checkpoint record of FlowRecord, VERSION must be raised when the
+  // layout changes.
+  struct IpfixFlowCheckpoint {
+    static const uint32_t VERSION = 1;
+    uint64_t hash_;
+    uint64_t octets_, packets_;
+    uint64_t first_ms_, last_ms_;
+    int64_t last_sec_;
+    byte_t key_[48];
+    byte_t src_[16], dst_[16];
+    uint16_t src_port_, dst_port_;
+    uint8_t key_len_, addr_len_, proto_;
+    uint8_t reserved_[1];
+  };
+
+  // -------------------------------------------------------
+  // IpfixExporter::FlowRecord
+  IpfixExporter::FlowRecord::FlowRecord() :
+    hash_(0), key_len_(0), addr_len_(0), src_port_(0), dst_port_(0),
+    proto_(0), octets_(0), packets_(0), first_ms_(0), last_ms_(0),
+    last_sec_(0), next_free_(NULL) {
+  }
+  IpfixExporter::FlowRecord::~FlowRecord() {
+  }
+  bool IpfixExporter::FlowRecord::match(const void *key, size_t len) {
+    return (this->key_len_ == len && 0 == ::memcmp(this->key_, key, len));
+  }
+
+  // -------------------------------------------------------
+  // IpfixExporter
+  IpfixExporter::IpfixExporter(Format fmt, size_t max_flows) :
+    fmt_(fmt), fd_(-1), free_list_(NULL), pool_size_(max_flows),
+    active_flows_(0), idle_timeout_(15), active_timeout_(60), last_sec_(0),
+    msg_(DEFAULT_MSG_LEN), msg_len_(0), set_ptr_(0), set_id_(0),
+    msg_records_(0), msg_data_records_(0), seq_(0), domain_id_(0),
+    tmpl_interval_(20), msg_since_tmpl_(0), need_tmpl_(true),
+    boot_ms_(0), export_ms_(0),
+    exported_records_(0), exported_msgs_(0), lost_packets_(0) {
+    assert(fmt == IPFIX || fmt == NETFLOW_V9);
+    if (this->pool_size_ == 0) {
+      this->pool_size_ = 1;
+    }
+
+    // All flow records are allocated here and recycled through free_list_.
+    this->pool_ = new FlowRecord[this->pool_size_];
+    for (size_t i = 0; i < this->pool_size_; i++) {
+      this->release_flow(&(this->pool_[i]));
+    }
+    this->flow_table_ = new LRUHash(TIMESLOT, this->pool_size_);
+  }
+  IpfixExporter::~IpfixExporter() {
+    this->close();
+    delete this->flow_table_;
+    delete [] this->pool_;
+  }
+
+  bool IpfixExporter::open_udp(const std::string &host, int port) {
+    this->close();
+
+    struct addrinfo hints, *res;
+    ::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    std::stringstream ss;
+    ss << port;
+    int rc = ::getaddrinfo(host.c_str(), ss.str().c_str(), &hints, &res);
+    if (rc != 0) {
+      this->errmsg_ = "getaddrinfo error: ";
+      this->errmsg_ += ::gai_strerror(rc);
+      return false;
+    }
+
+    int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0 || ::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+      this->errmsg_ = "can't connect collector: ";
+      this->errmsg_ += ::strerror(errno);
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      ::freeaddrinfo(res);
+      return false;
+    }
+
+    ::freeaddrinfo(res);
+    this->fd_ = fd;
+    this->need_tmpl_ = true;
+    return true;
+  }
+
+  bool IpfixExporter::open_file(const std::string &path) {
+    this->close();
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      this->errmsg_ = "can't open file: ";
+      this->errmsg_ += ::strerror(errno);
+      return false;
+    }
+
+    this->fd_ = fd;
+    this->need_tmpl_ = true;
+    return true;
+  }
+
+  void IpfixExporter::close() {
+    if (this->fd_ >= 0) {
+      // active flows are exported to the current destination before closing
+      this->flush();
+      ::close(this->fd_);
+      this->fd_ = -1;
+    }
+  }
+
+  void IpfixExporter::set_timeout(time_t idle, time_t active) {
+    // idle timeout is bounded by timeslot size of the flow table
+    if (idle <= 0) {
+      idle = 1;
+    } else if (idle >= static_cast<time_t>(TIMESLOT)) {
+      idle = TIMESLOT - 1;
+    }
+    this->idle_timeout_ = idle;
+    this->active_timeout_ = active;
+  }
+
+  bool IpfixExporter::set_message_size(size_t len) {
+    if (len < 256 || len > 0xffff) {
+      this->errmsg_ = "message size must be between 256 and 65535";
+      return false;
+    }
+
+    this->send_message();
+    this->msg_.resize(len);
+    return true;
+  }
+
+  void IpfixExporter::recv(ev_id eid, const Property &p) {
+    size_t addr_len;
+    p.src_addr(&addr_len);
+    if (addr_len != 4 && addr_len != 16) {
+      return;
+    }
+
+    uint64_t now_ms = p.ts_ns() / 1000000;
+    if (this->boot_ms_ == 0) {
+      this->boot_ms_ = now_ms;
+    }
+    this->export_ms_ = now_ms;
+
+    this->timeout_flows(p.tv_sec());
+
+    FlowRecord *rec = this->fetch_flow(p, now_ms);
+    if (!rec) {
+      return;
+    }
+
+    rec->octets_  += p.len();
+    rec->packets_ += 1;
+    rec->last_ms_  = now_ms;
+    rec->last_sec_ = p.tv_sec();
+
+    if (this->active_timeout_ > 0 &&
+        rec->first_ms_ + this->active_timeout_ * 1000 <= now_ms) {
+      // long-lived flow: export the current counters and restart metering
+      this->export_flow(rec);
+      rec->octets_ = rec->packets_ = 0;
+      rec->first_ms_ = now_ms;
+    }
+  }
+
+  void IpfixExporter::flush() {
+    this->flow_table_->prog(TIMESLOT);
+    FlowRecord *rec;
+    while (NULL != (rec = dynamic_cast<FlowRecord*>(this->flow_table_->pop()))) {
+      this->export_flow(rec);
+      this->release_flow(rec);
+    }
+    this->send_message();
+  }
+
+  bool IpfixExporter::checkpoint(CheckpointWriter *w,
+                                 const std::string &name) const {
+    if (!w->begin(name, IpfixFlowCheckpoint::VERSION,
+                  sizeof(IpfixFlowCheckpoint))) {
+      return false;
+    }
+
+    // snapshot, the live cache is not changed
+    std::vector<LRUHash::Node*> nodes;
+    this->flow_table_->nodes(&nodes);
+    IpfixFlowCheckpoint ent;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      const FlowRecord *rec = dynamic_cast<const FlowRecord*>(nodes[i]);
+      if (rec == NULL || rec->packets_ == 0 ||
+          rec->key_len_ > sizeof(ent.key_)) {
+        continue;
+      }
+      ::memset(&ent, 0, sizeof(ent));
+      ent.hash_     = rec->hash_;
+      ent.octets_   = rec->octets_;
+      ent.packets_  = rec->packets_;
+      ent.first_ms_ = rec->first_ms_;
+      ent.last_ms_  = rec->last_ms_;
+      ent.last_sec_ = static_cast<int64_t>(rec->last_sec_);
+      ::memcpy(ent.key_, rec->key_, rec->key_len_);
+      ::memcpy(ent.src_, rec->src_, rec->addr_len_);
+      ::memcpy(ent.dst_, rec->dst_, rec->addr_len_);
+      ent.src_port_ = rec->src_port_;
+      ent.dst_port_ = rec->dst_port_;
+      ent.key_len_  = static_cast<uint8_t>(rec->key_len_);
+      ent.addr_len_ = static_cast<uint8_t>(rec->addr_len_);
+      ent.proto_    = rec->proto_;
+      if (!w->append(&ent)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void IpfixExporter::clear() {
+    this->flow_table_->prog(TIMESLOT);
+    FlowRecord *rec;
+    while (NULL != (rec = dynamic_cast<FlowRecord*>(this->flow_table_->pop()))) {
+      this->release_flow(rec);
+    }
+  }
+
+  bool IpfixExporter::restore(const CheckpointReader &r,
+                              const std::string &name) {
+    size_t count;
+    const IpfixFlowCheckpoint *ent = static_cast<const IpfixFlowCheckpoint *>
+      (r.section(name, IpfixFlowCheckpoint::VERSION,
+                 sizeof(IpfixFlowCheckpoint), &count));
+
+    for (size_t i = 0; ent != NULL && i < count; i++) {
+      const IpfixFlowCheckpoint &e = ent[i];
+      if (e.key_len_ > FlowRecord::KEY_MAX ||
+          (e.addr_len_ != 4 && e.addr_len_ != 16) ||
+          this->flow_table_->get(e.hash_, e.key_, e.key_len_)) {
+        continue;
+      }
+
+      FlowRecord *rec = this->free_list_;
+      if (rec == NULL) {
+        this->errmsg_ = "flow cache is full";
+        return false;
+      }
+      this->free_list_ = rec->next_free_;
+      rec->next_free_ = NULL;
+
+      rec->hash_ = e.hash_;
+      ::memcpy(rec->key_, e.key_, e.key_len_);
+      rec->key_len_  = e.key_len_;
+      ::memcpy(rec->src_, e.src_, e.addr_len_);
+      ::memcpy(rec->dst_, e.dst_, e.addr_len_);
+      rec->addr_len_ = e.addr_len_;
+      rec->src_port_ = e.src_port_;
+      rec->dst_port_ = e.dst_port_;
+      rec->proto_    = e.proto_;
+      rec->octets_   = e.octets_;
+      rec->packets_  = e.packets_;
+      rec->first_ms_ = e.first_ms_;
+      rec->last_ms_  = e.last_ms_;
+      rec->last_sec_ = static_cast<time_t>(e.last_sec_);
+
+      // sysUpTime of NetFlow v9 must not go before restored flows
+      if (this->boot_ms_ == 0 || this->boot_ms_ > rec->first_ms_) {
+        this->boot_ms_ = rec->first_ms_;
+      }
+      this->flow_table_->put(this->idle_timeout_, rec);
+      this->active_flows_++;
+    }
+    return true;
+  }
+
+  IpfixExporter::FlowRecord *IpfixExporter::fetch_flow(const Property &p,
+                                                       uint64_t now_ms) {
+    // Flow key is the bidirectional session label plus direction, then
+    // records of both directions are metered separately.
+    size_t label_len;
+    const void *label = p.ssn_label(&label_len);
+    uint32_t dir = static_cast<uint32_t>(p.dir());
+    const size_t key_len = label_len + sizeof(dir);
+    if (key_len > FlowRecord::KEY_MAX) {
+      return NULL;
+    }
+
+    byte_t key[FlowRecord::KEY_MAX];
+    ::memcpy(key, label, label_len);
+    ::memcpy(key + label_len, &dir, sizeof(dir));
+    uint64_t hv = p.hash_value() + dir;
+
+    FlowRecord *rec = dynamic_cast<FlowRecord*>
+      (this->flow_table_->get(hv, key, key_len));
+    if (rec) {
+      return rec;
+    }
+
+    if (NULL == (rec = this->free_list_)) {
+      this->lost_packets_++;
+      return NULL;
+    }
+    this->free_list_ = rec->next_free_;
+    rec->next_free_ = NULL;
+
+    rec->hash_ = hv;
+    ::memcpy(rec->key_, key, key_len);
+    rec->key_len_ = key_len;
+
+    size_t addr_len;
+    void *src = p.src_addr(&addr_len);
+    void *dst = p.dst_addr(NULL);
+    ::memcpy(rec->src_, src, addr_len);
+    ::memcpy(rec->dst_, dst, addr_len);
+    rec->addr_len_ = addr_len;
+    rec->src_port_ = static_cast<uint16_t>(p.src_port());
+    rec->dst_port_ = static_cast<uint16_t>(p.dst_port());
+    rec->proto_    = p.ip_proto();
+    rec->octets_   = rec->packets_ = 0;
+    rec->first_ms_ = rec->last_ms_ = now_ms;
+
+    this->flow_table_->put(this->idle_timeout_, rec);
+    this->active_flows_++;
+    return rec;
+  }
+
+  void IpfixExporter::timeout_flows(time_t now_sec) {
+    if (this->last_sec_ >= now_sec) {
+      return;
+    }
+
+    if (this->last_sec_ > 0) {
+      time_t delta = now_sec - this->last_sec_;
+      if (delta > static_cast<time_t>(TIMESLOT)) {
+        delta = TIMESLOT;
+      }
+      this->flow_table_->prog(delta);
+    }
+    this->last_sec_ = now_sec;
+
+    FlowRecord *rec;
+    while (NULL != (rec = dynamic_cast<FlowRecord*>(this->flow_table_->pop()))) {
+      if (rec->last_sec_ + this->idle_timeout_ <= now_sec) {
+        this->export_flow(rec);
+        this->release_flow(rec);
+      } else {
+        this->flow_table_->put(rec->last_sec_ + this->idle_timeout_ - now_sec,
+                               rec);
+      }
+    }
+  }
+
+  void IpfixExporter::release_flow(FlowRecord *rec) {
+    if (rec->key_len_ > 0) {
+      assert(this->active_flows_ > 0);
+      this->active_flows_--;
+      rec->key_len_ = 0;
+    }
+    rec->next_free_ = this->free_list_;
+    this->free_list_ = rec;
+  }
+
+  void IpfixExporter::export_flow(FlowRecord *rec) {
+    if (rec->packets_ == 0) {
+      return;
+    }
+
+    const uint16_t tmpl = (rec->addr_len_ == 4) ? TMPL_IPV4 : TMPL_IPV6;
+    const size_t rec_len = this->record_len(tmpl);
+    const size_t pad = 3;  // room for NetFlow v9 set padding
+
+    if (this->msg_len_ == 0) {
+      this->begin_message();
+    }
+
+    if (this->set_id_ != tmpl) {
+      this->close_set();
+      if (this->msg_len_ + SET_HDR_LEN + rec_len + pad > this->msg_.size()) {
+        this->send_message();
+        this->begin_message();
+      }
+      this->open_set(tmpl);
+    } else if (this->msg_len_ + rec_len + pad > this->msg_.size()) {
+      this->send_message();
+      this->begin_message();
+      this->open_set(tmpl);
+    }
+
+    this->put_bytes(rec->src_, rec->addr_len_);
+    this->put_bytes(rec->dst_, rec->addr_len_);
+    this->put16(rec->src_port_);
+    this->put16(rec->dst_port_);
+    this->put8(rec->proto_);
+    this->put64(rec->octets_);
+    this->put64(rec->packets_);
+    if (this->fmt_ == IPFIX) {
+      this->put64(rec->first_ms_);
+      this->put64(rec->last_ms_);
+    } else {
+      this->put32(static_cast<uint32_t>(rec->first_ms_ - this->boot_ms_));
+      this->put32(static_cast<uint32_t>(rec->last_ms_ - this->boot_ms_));
+    }
+
+    this->msg_records_++;
+    this->msg_data_records_++;
+    this->exported_records_++;
+  }
+
+  const uint16_t *IpfixExporter::fields(uint16_t tmpl_id,
+                                        size_t *count) const {
+    *count = FIELD_COUNT;
+    if (this->fmt_ == IPFIX) {
+      return (tmpl_id == TMPL_IPV4) ? IPFIX_V4_FIELDS : IPFIX_V6_FIELDS;
+    } else {
+      return (tmpl_id == TMPL_IPV4) ? NFV9_V4_FIELDS : NFV9_V6_FIELDS;
+    }
+  }
+
+  size_t IpfixExporter::record_len(uint16_t tmpl_id) const {
+    size_t count, len = 0;
+    const uint16_t *f = this->fields(tmpl_id, &count);
+    for (size_t i = 0; i < count; i++) {
+      len += f[i * 2 + 1];
+    }
+    return len;
+  }
+
+  void IpfixExporter::begin_message() {
+    this->msg_len_ = (this->fmt_ == IPFIX) ? IPFIX_HDR_LEN : NFV9_HDR_LEN;
+    this->set_ptr_ = 0;
+    this->set_id_ = 0;
+    this->msg_records_ = 0;
+    this->msg_data_records_ = 0;
+
+    if (this->need_tmpl_ ||
+        (this->tmpl_interval_ > 0 &&
+         this->msg_since_tmpl_ >= this->tmpl_interval_)) {
+      this->put_templates();
+      this->need_tmpl_ = false;
+      this->msg_since_tmpl_ = 0;
+    }
+    this->msg_since_tmpl_++;
+  }
+
+  void IpfixExporter::put_templates() {
+    // Template Set ID is 2 in IPFIX and FlowSet ID 0 in NetFlow v9
+    this->open_set(this->fmt_ == IPFIX ? 2 : 0);
+    const uint16_t tmpl_ids[] = { TMPL_IPV4, TMPL_IPV6 };
+    for (size_t t = 0; t < 2; t++) {
+      size_t count;
+      const uint16_t *f = this->fields(tmpl_ids[t], &count);
+      this->put16(tmpl_ids[t]);
+      this->put16(static_cast<uint16_t>(count));
+      for (size_t i = 0; i < count * 2; i++) {
+        this->put16(f[i]);
+      }
+      this->msg_records_++;
+    }
+    this->close_set();
+  }
+
+  void IpfixExporter::open_set(uint16_t set_id) {
+    assert(this->set_ptr_ == 0);
+    this->set_ptr_ = this->msg_len_;
+    this->set_id_ = set_id;
+    this->put16(set_id);
+    this->put16(0);  // length, filled by close_set()
+  }
+
+  void IpfixExporter::close_set() {
+    if (this->set_ptr_ == 0) {
+      return;
+    }
+
+    if (this->fmt_ == NETFLOW_V9) {
+      // FlowSets are padded to 32 bit boundary
+      while ((this->msg_len_ - this->set_ptr_) % 4 != 0) {
+        this->put8(0);
+      }
+    }
+
+    this->set16(this->set_ptr_ + 2,
+                static_cast<uint16_t>(this->msg_len_ - this->set_ptr_));
+    this->set_ptr_ = 0;
+    this->set_id_ = 0;
+  }
+
+  void IpfixExporter::send_message() {
+    if (this->msg_len_ == 0) {
+      return;
+    }
+
+    this->close_set();
+    if (this->msg_data_records_ == 0) {
+      // do not send a message carrying only templates
+      this->need_tmpl_ = true;
+      this->msg_len_ = 0;
+      return;
+    }
+
+    const uint32_t export_sec = static_cast<uint32_t>(this->export_ms_ / 1000);
+    if (this->fmt_ == IPFIX) {
+      this->set16(0, 10);
+      this->set16(2, static_cast<uint16_t>(this->msg_len_));
+      this->set32(4, export_sec);
+      this->set32(8, this->seq_);
+      this->set32(12, this->domain_id_);
+      // IPFIX sequence number counts data records
+      this->seq_ += static_cast<uint32_t>(this->msg_data_records_);
+    } else {
+      this->set16(0, 9);
+      this->set16(2, static_cast<uint16_t>(this->msg_records_));
+      this->set32(4, static_cast<uint32_t>(this->export_ms_ - this->boot_ms_));
+      this->set32(8, export_sec);
+      this->set32(12, this->seq_);
+      this->set32(16, this->domain_id_);
+      // NetFlow v9 sequence number counts export packets
+      this->seq_ += 1;
+    }
+
+    if (this->fd_ >= 0) {
+      ssize_t rc = ::write(this->fd_, &(this->msg_[0]), this->msg_len_);
+      if (rc < 0) {
+        this->errmsg_ = "write error: ";
+        this->errmsg_ += ::strerror(errno);
+      }
+    }
+
+    this->exported_msgs_++;
+    this->msg_len_ = 0;
+  }
+
+  void IpfixExporter::put8(uint8_t v) {
+    assert(this->msg_len_ + 1 <= this->msg_.size());
+    this->msg_[this->msg_len_++] = v;
+  }
+  void IpfixExporter::put16(uint16_t v) {
+    this->put8(static_cast<uint8_t>(v >> 8));
+    this->put8(static_cast<uint8_t>(v));
+  }
+  void IpfixExporter::put32(uint32_t v) {
+    this->put16(static_cast<uint16_t>(v >> 16));
+    this->put16(static_cast<uint16_t>(v));
+  }
+  void IpfixExporter::put64(uint64_t v) {
+    this->put32(static_cast<uint32_t>(v >> 32));
+    this->put32(static_cast<uint32_t>(v));
+  }
+  void IpfixExporter::put_bytes(const void *ptr, size_t len) {
+    assert(this->msg_len_ + len <= this->msg_.size());
+    ::memcpy(&(this->msg_[this->msg_len_]), ptr, len);
+    this->msg_len_ += len;
+  }
+  void IpfixExporter::set16(size_t ptr, uint16_t v) {
+    this->msg_[ptr]     = static_cast<uint8_t>(v >> 8);
+    this->msg_[ptr + 1] = static_cast<uint8_t>(v);
+  }
+  void IpfixExporter::set32(size_t ptr, uint32_t v) {
+    this->set16(ptr, static_cast<uint16_t>(v >> 16));
+    this->set16(ptr + 2, static_cast<uint16_t>(v));
+  }
+}  // namespace swarm
@@ -0,0 +1,169 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_IPFIX_H__
+#define SRC_UTILS_IPFIX_H__
+
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+#include "./lru-hash.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class IpfixExporter:
+  // Handler that meters unidirectional flows keyed by Property::ssn_label()
+  // and exports expired flows as IPFIX (RFC 7011) or NetFlow v9 (RFC 3954)
+  // messages. Register it for "ipv4.packet" and/or "ipv6.packet". Flow
+  // records come from a pool allocated in the constructor and messages are
+  // built in one fixed buffer, so nothing is allocated per record.
+  //
+  class IpfixExporter : public Handler {
+  public:
+    enum Format {
+      IPFIX = 10,
+      NETFLOW_V9 = 9,
+    };
+
+  private:
+    class FlowRecord : public LRUHash::Node {
+    public:
+      static const size_t KEY_MAX = 48;
+      uint64_t hash_;
+      byte_t key_[KEY_MAX];
+      size_t key_len_;
+
+      byte_t src_[16], dst_[16];
+      size_t addr_len_;
+      uint16_t src_port_, dst_port_;
+      uint8_t proto_;
+      uint64_t octets_, packets_;
+      uint64_t first_ms_, last_ms_;
+      time_t last_sec_;
+      FlowRecord *next_free_;
+
+      FlowRecord();
+      ~FlowRecord();
+      uint64_t hash() { return this->hash_; }
+      bool match(const void *key, size_t len);
+    };
+
+    static const uint16_t TMPL_IPV4 = 256;
+    static const uint16_t TMPL_IPV6 = 257;
+    static const size_t DEFAULT_MSG_LEN = 1400;
+
+    Format fmt_;
+    int fd_;
+    std::string errmsg_;
+
+    // Flow cache
+    FlowRecord *pool_;
+    FlowRecord *free_list_;
+    size_t pool_size_;
+    LRUHash *flow_table_;
+    size_t active_flows_;
+    time_t idle_timeout_;
+    time_t active_timeout_;
+    time_t last_sec_;
+
+    // Message buffer
+    std::vector<byte_t> msg_;
+    size_t msg_len_;
+    size_t set_ptr_;        // offset of the open set header, 0 if none
+    uint16_t set_id_;
+    size_t msg_records_;    // records (data and template) in the message
+    size_t msg_data_records_;
+    uint32_t seq_;
+    uint32_t domain_id_;
+    size_t tmpl_interval_;
+    size_t msg_since_tmpl_;
+    bool need_tmpl_;
+    uint64_t boot_ms_;
+    uint64_t export_ms_;
+
+    // Stat
+    uint64_t exported_records_;
+    uint64_t exported_msgs_;
+    uint64_t lost_packets_;
+
+    FlowRecord *fetch_flow(const Property &p, uint64_t now_ms);
+    void timeout_flows(time_t now_sec);
+    void export_flow(FlowRecord *rec);
+    void release_flow(FlowRecord *rec);
+
+    void begin_message();
+    void open_set(uint16_t set_id);
+    void close_set();
+    void put_templates();
+    void send_message();
+    const uint16_t *fields(uint16_t tmpl_id, size_t *count) const;
+    size_t record_len(uint16_t tmpl_id) const;
+
+    inline void put8(uint8_t v);
+    inline void put16(uint16_t v);
+    inline void put32(uint32_t v);
+    inline void put64(uint64_t v);
+    inline void put_bytes(const void *ptr, size_t len);
+    inline void set16(size_t ptr, uint16_t v);
+    inline void set32(size_t ptr, uint32_t v);
+
+    static const size_t TIMESLOT = 3600;
+
+  public:
+    IpfixExporter(Format fmt = IPFIX, size_t max_flows = 0x10000);
+    ~IpfixExporter();
+
+    bool open_udp(const std::string &host, int port);
+    bool open_file(const std::string &path);
+    void close();  // export all active flows, then close the destination
+
+    void set_timeout(time_t idle, time_t active);
+    void set_domain_id(uint32_t id) { this->domain_id_ = id; }
+    void set_template_interval(size_t msgs) { this->tmpl_interval_ = msgs; }
+    bool set_message_size(size_t len);
+
+    void recv(ev_id eid, const Property &p);
+    void flush();  // export all active flows and the pending message
+
+    // Active flows are saved to section of name (see checkpoint.h) and
+    // stay in the cache. A process stopping after the checkpoint calls
+    // clear() before close() so that the next one restoring the flows
+    // exports them, not both.
+    bool checkpoint(CheckpointWriter *w,
+                    const std::string &name = "ipfix") const;
+    bool restore(const CheckpointReader &r, const std::string &name = "ipfix");
+    void clear();  // release all active flows without exporting
+
+    size_t flow_count() const { return this->active_flows_; }
+    uint64_t exported_records() const { return this->exported_records_; }
+    uint64_t exported_msgs() const { return this->exported_msgs_; }
+    uint64_t lost_packets() const { return this->lost_packets_; }
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_IPFIX_H__
@@ -0,0 +1,138 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include "./load-shed.h"
+#include "../netdec.h"
+#include "../netcap.h"
+
+namespace swarm {
+  LoadShedder::LoadShedder(NetDec *nd, NetCap *nc) :
+    nd_(nd), nc_(nc), last_recv_(0), last_drop_(0), primed_(false),
+    high_(0.001), low_(0), calm_need_(5), calm_(0), shed_events_(0),
+    restore_events_(0), pressure_(0) {
+    static const char *defaults[] = {
+      "tcp_ssn", "dns", "mdns", "llmnr", "netbios_ns",
+    };
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+      this->add_candidate(defaults[i]);
+    }
+  }
+  LoadShedder::~LoadShedder() {
+    while (!this->shed_.empty()) {
+      this->restore_one();
+    }
+  }
+
+  bool LoadShedder::add_candidate(const std::string &dec_name) {
+    dec_id d_id = this->nd_->lookup_dec_id(dec_name);
+    if (d_id == DEC_NULL) {
+      return false;
+    }
+    if (std::find(this->candidate_.begin(), this->candidate_.end(), d_id) ==
+        this->candidate_.end()) {
+      this->candidate_.push_back(d_id);
+    }
+    return true;
+  }
+  void LoadShedder::clear_candidate() {
+    this->candidate_.clear();
+  }
+  void LoadShedder::set_threshold(double high, double low, int calm) {
+    this->high_ = high;
+    this->low_ = low;
+    this->calm_need_ = (calm > 0) ? calm : 1;
+  }
+
+  void LoadShedder::shed_one() {
+    dec_id target = DEC_NULL;
+    double cost = -1;
+    for (size_t i = 0; i < this->candidate_.size(); i++) {
+      dec_id d_id = this->candidate_[i];
+      if (this->nd_->is_shed(d_id)) {
+        continue;
+      }
+      double c = this->nd_->decoder_cost(d_id);
+      if (c > cost) {
+        cost = c;
+        target = d_id;
+      }
+    }
+
+    if (target != DEC_NULL) {
+      this->nd_->set_shed(target, true);
+      this->shed_.push_back(target);
+      this->shed_events_++;
+    }
+  }
+  void LoadShedder::restore_one() {
+    if (!this->shed_.empty()) {
+      this->nd_->set_shed(this->shed_.back(), false);
+      this->shed_.pop_back();
+      this->restore_events_++;
+    }
+  }
+
+  void LoadShedder::update(uint64_t recv, uint64_t drop, double occupancy) {
+    if (!this->primed_) {
+      this->last_recv_ = recv;
+      this->last_drop_ = drop;
+      this->primed_ = true;
+      if (occupancy < this->high_) {
+        return;
+      }
+    }
+
+    // pcap counters are 32 bit and may wrap, treat decrease as reset
+    uint64_t d_recv = (recv >= this->last_recv_) ? recv - this->last_recv_ : 0;
+    uint64_t d_drop = (drop >= this->last_drop_) ? drop - this->last_drop_ : 0;
+    this->last_recv_ = recv;
+    this->last_drop_ = drop;
+
+    double ratio = (d_recv + d_drop > 0) ?
+      static_cast<double>(d_drop) / static_cast<double>(d_recv + d_drop) : 0;
+    this->pressure_ = std::max(ratio, occupancy);
+
+    if (this->pressure_ > this->high_) {
+      this->calm_ = 0;
+      this->shed_one();
+    } else if (this->pressure_ <= this->low_) {
+      if (++(this->calm_) >= this->calm_need_) {
+        this->calm_ = 0;
+        this->restore_one();
+      }
+    } else {
+      this->calm_ = 0;
+    }
+  }
+
+  void LoadShedder::exec(const struct timespec &ts) {
+    uint64_t recv, drop;
+    if (this->nc_ && this->nc_->stats(&recv, &drop)) {
+      this->update(recv, drop);
+    }
+  }
+}  // namespace swarm
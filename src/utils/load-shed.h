@@ -0,0 +1,82 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_LOAD_SHED_H__
+#define SRC_UTILS_LOAD_SHED_H__
+
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../timer.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class LoadShedder:
+  // Overload controller. Each period it compares capture side drop
+  // ratio (or ring occupancy given by update()) with thresholds, and
+  // sheds one more candidate decoder while the pressure is high, the
+  // most expensive one by NetDec::decoder_cost() first. The cost is
+  // measured only while the caller enables NetDec::set_profile(true);
+  // without it, candidates are shed in the order they were added. After
+  // `calm` quiet periods the last shed decoder is restored. Run it as a
+  // wall clock task: NetCap::set_periodic_task(shedder, 1.0).
+  //
+  class LoadShedder : public Task {
+  private:
+    NetDec *nd_;
+    NetCap *nc_;
+    std::vector<dec_id> candidate_;
+    std::vector<dec_id> shed_;  // stack, last one is restored first
+    uint64_t last_recv_, last_drop_;
+    bool primed_;
+    double high_, low_;
+    int calm_need_, calm_;
+    uint64_t shed_events_, restore_events_;
+    double pressure_;
+
+    void shed_one();
+    void restore_one();
+
+  public:
+    explicit LoadShedder(NetDec *nd, NetCap *nc = NULL);
+    ~LoadShedder();
+    // default candidates are tcp_ssn and name service decoders
+    bool add_candidate(const std::string &dec_name);
+    void clear_candidate();
+    void set_threshold(double high, double low, int calm);
+
+    // recv/drop are cumulative counters, occupancy is 0..1 of a ring
+    void update(uint64_t recv, uint64_t drop, double occupancy = 0);
+    void exec(const struct timespec &ts);
+
+    size_t level() const { return this->shed_.size(); }
+    double pressure() const { return this->pressure_; }
+    uint64_t shed_events() const { return this->shed_events_; }
+    uint64_t restore_events() const { return this->restore_events_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_LOAD_SHED_H__
@@ -24,24 +24,51 @@ o * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <new>
 #include "./lru-hash.h"
+#include "./mem-pool.h"
 #include "./debug.h"
 
 namespace swarm {
-  LRUHash::LRUHash(size_t timeslot_size, size_t bucket_size) : 
-    timeslot_(timeslot_size), bucket_(bucket_size), curr_tick_(0) {
-    if (this->bucket_.size() == 0) {
-      this->bucket_.resize(LRUHash::DEFAULT_BUCKET_SIZE);
+  LRUHash::LRUHash(size_t timeslot_size, size_t bucket_size,
+                   MemPool *pool) :
+    timeslot_(timeslot_size), bucket_(NULL), bucket_size_(bucket_size),
+    pool_(pool), curr_tick_(0) {
+    if (this->bucket_size_ == 0) {
+      this->bucket_size_ = LRUHash::DEFAULT_BUCKET_SIZE;
+    }
+
+    if (this->pool_) {
+      void *mem = this->pool_->alloc(sizeof(Bucket) * this->bucket_size_);
+      if (mem) {
+        this->bucket_ = static_cast<Bucket *>(mem);
+        for (size_t i = 0; i < this->bucket_size_; i++) {
+          new (&this->bucket_[i]) Bucket();
+        }
+      } else {
+        this->pool_ = NULL;  // fall back to heap
+      }
+    }
+    if (this->bucket_ == NULL) {
+      this->bucket_ = new Bucket[this->bucket_size_];
     }
   }
   LRUHash::~LRUHash() {
+    if (this->pool_) {
+      for (size_t i = 0; i < this->bucket_size_; i++) {
+        this->bucket_[i].~Bucket();
+      }
+      this->pool_->free(this->bucket_);
+    } else {
+      delete [] this->bucket_;
+    }
   }
   bool LRUHash::put(size_t tick, LRUHash::Node *node) {
     if (tick >= this->timeslot_.size()) {
       return false;
     }
 
-    size_t ptr = node->hash() % this->bucket_.size();
+    size_t ptr = node->hash() % this->bucket_size_;
     this->bucket_[ptr].attach(node);
 
     size_t tp = (tick + this->curr_tick_) % this->timeslot_.size();
@@ -50,7 +77,7 @@ namespace swarm {
     return true;
   }
   LRUHash::Node *LRUHash::get(uint64_t hv, const void *key, size_t len) {
-    size_t ptr = hv % this->bucket_.size();
+    size_t ptr = hv % this->bucket_size_;
     return this->bucket_[ptr].search(hv, key, len);
   }
   void LRUHash::prog(size_t tick) {
@@ -69,6 +96,15 @@ namespace swarm {
   LRUHash::Node *LRUHash::pop() {
     return this->exp_node_.pop_link();
   }
+  void LRUHash::remove(LRUHash::Node *node) {
+    node->detach();
+    node->unlink();
+  }
+  void LRUHash::nodes(std::vector<Node*> *out) {
+    for (size_t i = 0; i < this->bucket_size_; i++) {
+      this->bucket_[i].collect(out);
+    }
+  }
 
   // class LRUHash::Timeslot
   LRUHash::TimeSlot::TimeSlot() {
@@ -99,9 +135,13 @@ namespace swarm {
                                          size_t len) {
     return this->root_.search(hv, key, len);
   }
+  void LRUHash::Bucket::collect(std::vector<Node*> *out) {
+    this->root_.collect(out);
+  }
 
   // class LRUHash::Node
-  LRUHash::Node::Node() : next_(NULL), prev_(NULL), link_(NULL), update_(0) {
+  LRUHash::Node::Node() : next_(NULL), prev_(NULL), link_(NULL),
+                           link_prev_(NULL), update_(0) {
   }
   LRUHash::Node::~Node() {  
   }
@@ -131,19 +171,36 @@ namespace swarm {
   void LRUHash::Node::push_link(Node * node) {
     Node * next = this->link_;
     node->link_ = next;
+    node->link_prev_ = this;
+    if (next) {
+      next->link_prev_ = node;
+    }
     this->link_ = node;
   }
   LRUHash::Node* LRUHash::Node::pop_link() {
     Node *node = this->link_;
     if (node) {
-      Node *next = node->link_;
-      this->link_ = next;
+      node->unlink();
     }
     return node;
   }  
+  void LRUHash::Node::unlink() {
+    Node *next = this->link_;
+    Node *prev = this->link_prev_;
+    if (prev) {
+      prev->link_ = next;
+      if (next) {
+        next->link_prev_ = prev;
+      }
+    }
+    this->link_ = this->link_prev_ = NULL;
+  }
   LRUHash::Node* LRUHash::Node::pop_all() {
     Node * all = this->link_;
     this->link_ = NULL;
+    if (all) {
+      all->link_prev_ = NULL;
+    }
     return all;  
   }
 
@@ -156,5 +213,10 @@ namespace swarm {
     }
     return NULL;  
   }
+  void LRUHash::Node::collect(std::vector<Node*> *out) {
+    for (Node *node = this->next_; node != NULL; node = node->next_) {
+      out->push_back(node);
+    }
+  }
 
 }  // namespace swarm
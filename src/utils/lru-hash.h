@@ -33,6 +33,8 @@
 #include <string>
 
 namespace swarm {
+  class MemPool;
+
   class LRUHash {
     class Bucket;
     static const size_t DEFAULT_BUCKET_SIZE = 1031;
@@ -41,7 +43,7 @@ namespace swarm {
     class Node {
     private:
       Node *next_, *prev_;  // double linked list for Bucket
-      Node *link_;          // single linked list for TimeSlot
+      Node *link_, *link_prev_;  // double linked list for TimeSlot
       int update_;
       
     public:
@@ -54,7 +56,9 @@ namespace swarm {
       Node *pop_all();
       void push_link(Node * prev);
       Node *pop_link();
+      void unlink();
       Node *search(uint64_t hv, const void *key, size_t len);
+      void collect(std::vector<Node*> *out);
     };
 
   private:    
@@ -70,6 +74,7 @@ namespace swarm {
     ~Bucket();
     void attach(Node *node);
     Node* search(uint64_t hv, const void *key, size_t len);
+    void collect(std::vector<Node*> *out);
   };
 
   class TimeSlot {
@@ -83,17 +88,25 @@ namespace swarm {
   };
 
   std::vector<TimeSlot> timeslot_;
-  std::vector<Bucket> bucket_;
+  Bucket *bucket_;
+  size_t bucket_size_;
+  MemPool *pool_;  // bucket_ is from pool_ if not NULL
   size_t curr_tick_;
   NodeRoot exp_node_;
 
   public:
-  LRUHash(size_t timeslot_size, size_t bucket_size=DEFAULT_BUCKET_SIZE);
+  // buckets of a large table can be put on huge pages by MemPool
+  LRUHash(size_t timeslot_size, size_t bucket_size=DEFAULT_BUCKET_SIZE,
+          MemPool *pool=NULL);
   ~LRUHash();
   bool put(size_t tick, Node *node);
   Node *get(uint64_t hv, const void *key, size_t len);
   void prog(size_t tick=1);  // progress tick
   Node *pop();  // pop expired node
+  // take a node out of the table before expiry, the caller owns it again
+  void remove(Node *node);
+  // append all nodes not expired yet, e.g. to save them
+  void nodes(std::vector<Node*> *out);
   };
 }  // namespace swarm
 
@@ -0,0 +1,294 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fstream>
+
+#include "./mem-pool.h"
+
+// Not in old libc headers, from linux/mman.h and linux/mempolicy.h
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+namespace swarm {
+  const int MemPool::NODE_ANY;
+  std::map<std::string, MemPool *> MemPool::pool_map_;
+  pthread_mutex_t MemPool::map_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  MemPool::PageSize MemPool::default_page_ = MemPool::PAGE_2M;
+  int MemPool::default_node_ = MemPool::NODE_ANY;
+
+  // ----------------------------------------------------------------
+  // MemPool
+  MemPool::MemPool(const std::string &name, PageSize page, int node) :
+    name_(name), page_(page), node_(node) {
+    this->stat_.region_ = 0;
+    this->stat_.reserved_ = 0;
+    this->stat_.used_ = 0;
+    this->stat_.huge_ = 0;
+    this->stat_.thp_ = 0;
+    this->stat_.fallback_ = 0;
+    this->stat_.bind_fail_ = 0;
+    this->stat_.tlb_entry_ = 0;
+    ::pthread_mutex_init(&this->mutex_, NULL);
+  }
+  MemPool::~MemPool() {
+    ::pthread_mutex_destroy(&this->mutex_);
+  }
+
+  MemPool *MemPool::get(const std::string &name) {
+    ::pthread_mutex_lock(&MemPool::map_mutex_);
+    MemPool *pool;
+    auto it = MemPool::pool_map_.find(name);
+    if (it != MemPool::pool_map_.end()) {
+      pool = it->second;
+    } else {
+      pool = new MemPool(name, MemPool::default_page_, MemPool::default_node_);
+      MemPool::pool_map_.insert(std::make_pair(name, pool));
+    }
+    ::pthread_mutex_unlock(&MemPool::map_mutex_);
+    return pool;
+  }
+  void MemPool::set_default(PageSize page, int node) {
+    ::pthread_mutex_lock(&MemPool::map_mutex_);
+    MemPool::default_page_ = page;
+    MemPool::default_node_ = node;
+    ::pthread_mutex_unlock(&MemPool::map_mutex_);
+  }
+  void MemPool::stats(std::vector<Stat> *st) {
+    std::vector<MemPool *> pools;
+    ::pthread_mutex_lock(&MemPool::map_mutex_);
+    for (auto it = MemPool::pool_map_.begin();
+         it != MemPool::pool_map_.end(); it++) {
+      pools.push_back(it->second);
+    }
+    ::pthread_mutex_unlock(&MemPool::map_mutex_);
+
+    st->clear();
+    for (size_t i = 0; i < pools.size(); i++) {
+      st->push_back(pools[i]->stat());
+    }
+  }
+
+  int MemPool::cpu_node() {
+#ifdef SYS_getcpu
+    unsigned cpu, node;
+    if (0 == ::syscall(SYS_getcpu, &cpu, &node, NULL)) {
+      return static_cast<int>(node);
+    }
+#endif
+    return MemPool::NODE_ANY;
+  }
+  int MemPool::dev_node(const std::string &dev) {
+    // -1 in sysfs if the platform has no NUMA information
+    std::ifstream ifs(("/sys/class/net/" + dev + "/device/numa_node").c_str());
+    int node = MemPool::NODE_ANY;
+    if (!(ifs >> node) || node < 0) {
+      return MemPool::NODE_ANY;
+    }
+    return node;
+  }
+  size_t MemPool::page_len(PageSize page) {
+    switch (page) {
+    case PAGE_2M: return 2UL * 1024 * 1024;
+    case PAGE_1G: return 1024UL * 1024 * 1024;
+    default:      return 4096;
+    }
+  }
+
+  void MemPool::configure(PageSize page, int node) {
+    ::pthread_mutex_lock(&this->mutex_);
+    this->page_ = page;
+    this->node_ = node;
+    ::pthread_mutex_unlock(&this->mutex_);
+  }
+
+  void *MemPool::map(size_t len, size_t page_len) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    if (page_len > 4096) {
+      // log2 of page size tells the huge page pool to the kernel
+      flags |= MAP_HUGETLB | (__builtin_ctzl(page_len) << MAP_HUGE_SHIFT);
+    }
+#else
+    if (page_len > 4096) {
+      return NULL;
+    }
+#endif
+    void *ptr = ::mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return (ptr == MAP_FAILED) ? NULL : ptr;
+  }
+  bool MemPool::bind(void *ptr, size_t len) {
+#ifdef SYS_mbind
+    unsigned long mask[4] = {0, 0, 0, 0};
+    const size_t bits = sizeof(mask[0]) * 8;
+    if (this->node_ < 0 ||
+        static_cast<size_t>(this->node_) >= bits * 4) {
+      return false;
+    }
+    mask[this->node_ / bits] = 1UL << (this->node_ % bits);
+    // preferred, not strict: a full node must not fail page faults
+    return (0 == ::syscall(SYS_mbind, ptr, len, MPOL_PREFERRED, mask,
+                           bits * 4, 0));
+#else
+    return false;
+#endif
+  }
+
+  void *MemPool::alloc(size_t size) {
+    ::pthread_mutex_lock(&this->mutex_);
+    const size_t huge_len = MemPool::page_len(this->page_);
+    Region r;
+    r.used_ = size;
+    r.thp_ = false;
+    void *ptr = NULL;
+
+    // region smaller than a huge page would waste the rest of it
+    if (this->page_ != PAGE_4K && size >= huge_len) {
+      r.page_len_ = huge_len;
+      r.len_ = (size + huge_len - 1) & ~(huge_len - 1);
+      ptr = this->map(r.len_, huge_len);
+      if (ptr == NULL) {
+        this->stat_.fallback_++;
+      }
+    }
+    if (ptr == NULL) {
+      r.page_len_ = 4096;
+      r.len_ = (size + 4095) & ~static_cast<size_t>(4095);
+      ptr = this->map(r.len_, 4096);
+#ifdef MADV_HUGEPAGE
+      if (ptr && this->page_ != PAGE_4K &&
+          r.len_ >= MemPool::page_len(PAGE_2M)) {
+        r.thp_ = (0 == ::madvise(ptr, r.len_, MADV_HUGEPAGE));
+      }
+#endif
+    }
+    if (ptr == NULL) {
+      ::pthread_mutex_unlock(&this->mutex_);
+      return NULL;
+    }
+
+    if (this->node_ != NODE_ANY && !this->bind(ptr, r.len_)) {
+      this->stat_.bind_fail_++;
+    }
+
+    this->region_.insert(std::make_pair(ptr, r));
+    this->stat_.region_++;
+    this->stat_.reserved_ += r.len_;
+    this->stat_.used_ += r.used_;
+    this->stat_.tlb_entry_ += r.len_ / r.page_len_;
+    if (r.page_len_ > 4096) {
+      this->stat_.huge_ += r.len_;
+    }
+    if (r.thp_) {
+      this->stat_.thp_ += r.len_;
+    }
+    ::pthread_mutex_unlock(&this->mutex_);
+    return ptr;
+  }
+  void MemPool::free(void *ptr) {
+    if (ptr == NULL) {
+      return;
+    }
+
+    ::pthread_mutex_lock(&this->mutex_);
+    auto it = this->region_.find(ptr);
+    if (it != this->region_.end()) {
+      const Region &r = it->second;
+      ::munmap(ptr, r.len_);
+      this->stat_.region_--;
+      this->stat_.reserved_ -= r.len_;
+      this->stat_.used_ -= r.used_;
+      this->stat_.tlb_entry_ -= r.len_ / r.page_len_;
+      if (r.page_len_ > 4096) {
+        this->stat_.huge_ -= r.len_;
+      }
+      if (r.thp_) {
+        this->stat_.thp_ -= r.len_;
+      }
+      this->region_.erase(it);
+    }
+    ::pthread_mutex_unlock(&this->mutex_);
+  }
+  MemPool::Stat MemPool::stat() {
+    ::pthread_mutex_lock(&this->mutex_);
+    Stat st = this->stat_;
+    st.name_ = this->name_;
+    st.page_ = this->page_;
+    st.node_ = this->node_;
+    ::pthread_mutex_unlock(&this->mutex_);
+    return st;
+  }
+
+  // ----------------------------------------------------------------
+  // MemSlab
+  MemSlab::MemSlab(MemPool *pool, size_t obj_size) :
+    pool_(pool), free_(NULL), ptr_(NULL), end_(NULL), count_(0) {
+    // room for the free list link and 16 byte alignment
+    const size_t min_size = sizeof(void *);
+    this->obj_size_ = ((obj_size < min_size ? min_size : obj_size) + 15) &
+      ~static_cast<size_t>(15);
+  }
+  MemSlab::~MemSlab() {
+    for (size_t i = 0; i < this->chunk_.size(); i++) {
+      this->pool_->free(this->chunk_[i]);
+    }
+  }
+  void *MemSlab::get() {
+    void *obj;
+    if (this->free_) {
+      obj = this->free_;
+      this->free_ = *static_cast<void **>(obj);
+    } else {
+      if (this->ptr_ + this->obj_size_ > this->end_) {
+        void *chunk = this->pool_->alloc(CHUNK_LEN_);
+        if (chunk == NULL) {
+          return NULL;
+        }
+        this->chunk_.push_back(chunk);
+        this->ptr_ = static_cast<uint8_t *>(chunk);
+        this->end_ = this->ptr_ + CHUNK_LEN_;
+      }
+      obj = this->ptr_;
+      this->ptr_ += this->obj_size_;
+    }
+    this->count_++;
+    return obj;
+  }
+  void MemSlab::put(void *obj) {
+    *static_cast<void **>(obj) = this->free_;
+    this->free_ = obj;
+    this->count_--;
+  }
+}  // namespace swarm
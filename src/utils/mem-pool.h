@@ -0,0 +1,146 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_MEM_POOL_H__
+#define SRC_UTILS_MEM_POOL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class MemPool:
+  // Named provider of large memory regions for capture rings, session
+  // tables and object slabs. A region of at least one huge page is
+  // mapped on huge pages of the pool (reserved by vm.nr_hugepages or
+  // /sys/kernel/mm/hugepages); if none is free, transparent huge pages
+  // are advised on normal pages instead. A pool with a NUMA node binds
+  // its regions to the node by mbind(2) before first touch, use
+  // cpu_node() or dev_node() to find the node of a thread or NIC.
+  //
+  // Pools are created by get() and live until exit, so that stats() can
+  // report all of them. alloc() and free() are thread safe.
+  //
+  class MemPool {
+  public:
+    enum PageSize {
+      PAGE_4K = 0,
+      PAGE_2M,
+      PAGE_1G,
+    };
+    static const int NODE_ANY = -1;
+
+    struct Stat {
+      std::string name_;
+      PageSize page_;         // requested page size
+      int node_;
+      uint64_t region_;       // number of live regions
+      uint64_t reserved_;     // mapped bytes
+      uint64_t used_;         // requested bytes
+      uint64_t huge_;         // bytes on huge pages of page_
+      uint64_t thp_;          // bytes advised to transparent huge pages
+      uint64_t fallback_;     // regions that could not get huge pages
+      uint64_t bind_fail_;    // regions that could not be bound to node_
+      uint64_t tlb_entry_;    // pages to map reserved_, THP as 4 KB
+    };
+
+  private:
+    struct Region {
+      size_t len_;
+      size_t used_;
+      size_t page_len_;  // page size actually mapped
+      bool thp_;
+    };
+
+    std::string name_;
+    PageSize page_;
+    int node_;
+    std::map<void *, Region> region_;
+    Stat stat_;
+    pthread_mutex_t mutex_;
+
+    static std::map<std::string, MemPool *> pool_map_;
+    static pthread_mutex_t map_mutex_;
+    static PageSize default_page_;
+    static int default_node_;
+
+    MemPool(const std::string &name, PageSize page, int node);
+    ~MemPool();
+    void *map(size_t len, size_t page_len);
+    bool bind(void *ptr, size_t len);
+
+  public:
+    // pool of the name, created with the default page size and node
+    static MemPool *get(const std::string &name);
+    // for pools created after this call. PAGE_2M and NODE_ANY at first
+    static void set_default(PageSize page, int node);
+    static void stats(std::vector<Stat> *st);
+    // NUMA node of the calling thread and of a network device,
+    // NODE_ANY if unknown
+    static int cpu_node();
+    static int dev_node(const std::string &dev);
+    static size_t page_len(PageSize page);
+
+    // for regions allocated later
+    void configure(PageSize page, int node);
+    // page aligned and zero filled region, NULL if out of memory
+    void *alloc(size_t size);
+    void free(void *ptr);
+    Stat stat();
+    const std::string &name() const { return this->name_; }
+  };
+
+  // ----------------------------------------------------------------
+  // class MemSlab:
+  // Fixed size objects carved from huge page sized chunks of a MemPool,
+  // so that objects of one table share few TLB entries instead of being
+  // spread over the heap. Chunks are returned to the pool only by the
+  // destructor. Not thread safe.
+  //
+  class MemSlab {
+  private:
+    static const size_t CHUNK_LEN_ = 2 * 1024 * 1024;
+    MemPool *pool_;
+    size_t obj_size_;
+    void *free_;  // free list linked through objects
+    uint8_t *ptr_;
+    uint8_t *end_;
+    std::vector<void *> chunk_;
+    size_t count_;
+
+  public:
+    MemSlab(MemPool *pool, size_t obj_size);
+    ~MemSlab();
+    void *get();  // NULL if the pool is out of memory
+    void put(void *obj);
+    size_t count() const { return this->count_; }  // objects in use
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_MEM_POOL_H__
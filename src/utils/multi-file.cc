@@ -0,0 +1,190 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./multi-file.h"
+#include "../netcap.h"
+#include "../netdec.h"
+
+namespace swarm {
+  MultiFile::MultiFile(FileReducer *reducer, size_t worker_count) :
+    reducer_(reducer), worker_count_(worker_count > 0 ? worker_count : 1),
+    next_(0), pkt_count_(0) {
+    pthread_mutex_init(&(this->mutex_), NULL);
+    pthread_cond_init(&(this->cond_), NULL);
+  }
+  MultiFile::~MultiFile() {
+    for (size_t i = 0; i < this->chain_.size(); i++) {
+      delete this->chain_[i];
+    }
+    pthread_cond_destroy(&(this->cond_));
+    pthread_mutex_destroy(&(this->mutex_));
+  }
+
+  void MultiFile::add_file(const std::string &path,
+                           const std::string &carry_key) {
+    if (!carry_key.empty()) {
+      for (size_t i = 0; i < this->chain_.size(); i++) {
+        if (this->chain_[i]->key_ == carry_key) {
+          this->chain_[i]->path_.push_back(path);
+          return;
+        }
+      }
+    }
+
+    Chain *ch = new Chain();
+    ch->path_.push_back(path);
+    ch->key_ = carry_key;
+    ch->task_ = NULL;
+    ch->nd_ = NULL;
+    ch->done_ = false;
+    ch->ok_ = false;
+    ch->pkt_count_ = 0;
+    this->chain_.push_back(ch);
+  }
+
+  void MultiFile::process(Chain *ch) {
+    ch->nd_ = new NetDec();
+    ch->task_ = this->reducer_->create();
+    if (!ch->task_->setup(ch->nd_)) {
+      ch->errmsg_ = "setup failed: " + ch->path_[0];
+      return;
+    }
+
+    uint32_t linktype = 0;
+    for (size_t i = 0; i < ch->path_.size(); i++) {
+      const std::string &path = ch->path_[i];
+      PcapReader reader(path);
+      if (!reader.ready()) {
+        ch->errmsg_ = path + ": " + reader.errmsg();
+        return;
+      }
+
+      if (i == 0) {
+        linktype = reader.linktype();
+        const char *dec = PcapReader::linktype2dec(linktype);
+        if (dec == NULL) {
+          ch->errmsg_ = path + ": unsupported link type";
+          return;
+        }
+        if (!ch->nd_->set_default_decoder(dec)) {
+          ch->errmsg_ = path + ": " + ch->nd_->errmsg();
+          return;
+        }
+      } else if (reader.linktype() != linktype) {
+        // one NetDec has only one default decoder
+        ch->errmsg_ = path + ": link type differs in a carry chain";
+        return;
+      }
+
+      PcapReader::Record rec;
+      int rc;
+      while ((rc = reader.next(&rec)) > 0) {
+        ch->nd_->input(rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+        ch->pkt_count_++;
+      }
+      if (rc < 0) {
+        ch->errmsg_ = path + ": " + reader.errmsg();
+        return;
+      }
+
+      ch->task_->finish(ch->nd_, path);
+    }
+
+    ch->ok_ = true;
+  }
+
+  void *MultiFile::worker(void *obj) {
+    MultiFile *mf = static_cast<MultiFile*>(obj);
+
+    while (true) {
+      pthread_mutex_lock(&(mf->mutex_));
+      if (mf->next_ >= mf->chain_.size()) {
+        pthread_mutex_unlock(&(mf->mutex_));
+        break;
+      }
+      Chain *ch = mf->chain_[mf->next_++];
+      pthread_mutex_unlock(&(mf->mutex_));
+
+      mf->process(ch);
+
+      pthread_mutex_lock(&(mf->mutex_));
+      ch->done_ = true;
+      pthread_cond_broadcast(&(mf->cond_));
+      pthread_mutex_unlock(&(mf->mutex_));
+    }
+
+    return NULL;
+  }
+
+  bool MultiFile::run() {
+    size_t n = this->worker_count_;
+    if (n > this->chain_.size()) {
+      n = this->chain_.size();
+    }
+
+    this->next_ = 0;
+    std::vector<pthread_t> th(n);
+    for (size_t i = 0; i < n; i++) {
+      if (0 != pthread_create(&th[i], NULL, MultiFile::worker, this)) {
+        // remaining chains are taken by created workers (or below)
+        th.resize(i);
+        break;
+      }
+    }
+    if (th.empty()) {
+      MultiFile::worker(this);
+    }
+
+    // reduce in the order files were added while workers continue
+    bool rc = true;
+    for (size_t i = 0; i < this->chain_.size(); i++) {
+      Chain *ch = this->chain_[i];
+      pthread_mutex_lock(&(this->mutex_));
+      while (!ch->done_) {
+        pthread_cond_wait(&(this->cond_), &(this->mutex_));
+      }
+      pthread_mutex_unlock(&(this->mutex_));
+
+      this->pkt_count_ += ch->pkt_count_;
+      if (ch->ok_) {
+        this->reducer_->reduce(ch->task_);
+      } else if (rc) {
+        this->errmsg_ = ch->errmsg_;
+        rc = false;
+      }
+      delete ch->nd_;
+      delete ch->task_;
+      delete ch;
+    }
+    this->chain_.clear();
+
+    for (size_t i = 0; i < th.size(); i++) {
+      pthread_join(th[i], NULL);
+    }
+
+    return rc;
+  }
+}  // namespace swarm
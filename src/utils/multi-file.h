@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_MULTI_FILE_H__
+#define SRC_UTILS_MULTI_FILE_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "../common.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class FileTask:
+  // Per worker state of MultiFile. setup() is called with a fresh NetDec
+  // before the first file of a chain to install handlers; finish() is
+  // called after each file. Results are kept in the task until the
+  // reducer collects them.
+  //
+  class FileTask {
+  public:
+    virtual ~FileTask() {}
+    virtual bool setup(NetDec *nd) = 0;
+    virtual void finish(NetDec *nd, const std::string &path) {}
+  };
+
+  // ----------------------------------------------------------------
+  // class FileReducer:
+  // create() is called on worker threads, reduce() only on the thread
+  // calling MultiFile::run(), once per chain in the order files were
+  // added. The task is deleted by MultiFile after reduce().
+  //
+  class FileReducer {
+  public:
+    virtual ~FileReducer() {}
+    virtual FileTask *create() = 0;
+    virtual void reduce(FileTask *task) = 0;
+  };
+
+  // ----------------------------------------------------------------
+  // class MultiFile:
+  // Decodes many pcap/pcapng files in parallel on a worker pool, each
+  // with its own NetDec, and merges results with a FileReducer.
+  // Files added with the same non-empty carry key (e.g. interface name)
+  // form a chain: they are decoded in order on one NetDec so that flow
+  // state such as TCP sessions carries across file boundaries.
+  //
+  class MultiFile {
+  private:
+    struct Chain {
+      std::vector<std::string> path_;
+      std::string key_;
+      FileTask *task_;
+      NetDec *nd_;
+      bool done_;
+      bool ok_;
+      std::string errmsg_;
+      uint64_t pkt_count_;
+    };
+
+    FileReducer *reducer_;
+    size_t worker_count_;
+    std::vector<Chain*> chain_;
+    size_t next_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+    uint64_t pkt_count_;
+    std::string errmsg_;
+
+    static void *worker(void *obj);
+    void process(Chain *ch);
+
+  public:
+    MultiFile(FileReducer *reducer, size_t worker_count);
+    ~MultiFile();
+    void add_file(const std::string &path, const std::string &carry_key = "");
+    size_t chain_count() const { return this->chain_.size(); }
+    // blocks until all files are decoded and reduced. false if any file
+    // failed; results of other chains are still reduced
+    bool run();
+    uint64_t pkt_count() const { return this->pkt_count_; }
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_MULTI_FILE_H__
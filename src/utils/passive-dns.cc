@@ -0,0 +1,404 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "./passive-dns.h"
+#include "../property.h"
+#include "../value.h"
+#include "../debug.h"
+
+namespace swarm {
+  const uint32_t PassiveDns::NAME_NONE;
+
+  // DNS names are case insensitive (RFC 4343)
+  static inline void to_lower(std::string *s) {
+    for (size_t i = 0; i < s->size(); i++) {
+      char &c = (*s)[i];
+      if ('A' <= c && c <= 'Z') {
+        c += 'a' - 'A';
+      }
+    }
+  }
+
+  PassiveDns::PassiveDns(NetDec *nd, size_t mem_budget,
+                         const std::string &base_name) :
+    addr_mask_(0), addr_cnt_(0), addr_max_(0), sweep_ptr_(0),
+    name_mask_(0), name_bytes_(0), name_budget_(0), now_(0),
+    max_ttl_(86400), inserted_(0), expired_(0), evicted_(0), dropped_(0) {
+    const std::string &bn = base_name;
+    this->P_NAME_ = nd->lookup_value_id(bn + ".an_name");
+    this->P_TYPE_ = nd->lookup_value_id(bn + ".an_type");
+    this->P_DATA_ = nd->lookup_value_id(bn + ".an_data");
+    this->P_TTL_  = nd->lookup_value_id(bn + ".an_ttl");
+
+    // Half of the budget goes to fixed size tables (address slot, two name
+    // index slots and a name entry per address), the rest to name strings.
+    const size_t slot_cost = sizeof(AddrEntry) + 2 * sizeof(uint32_t) +
+      sizeof(NameEntry);
+    size_t cap = 64;
+    while (cap * 2 * slot_cost <= mem_budget / 2) {
+      cap *= 2;
+    }
+
+    this->addr_tbl_.resize(cap);
+    for (size_t i = 0; i < cap; i++) {
+      this->addr_tbl_[i].len_ = 0;
+    }
+    this->addr_mask_ = cap - 1;
+    this->addr_max_ = cap * 3 / 4;
+
+    this->name_tbl_.resize(cap * 2, NAME_NONE);
+    this->name_mask_ = cap * 2 - 1;
+    this->names_.reserve(this->addr_max_ + 1);
+
+    const size_t fixed = cap * slot_cost;
+    this->name_budget_ = (mem_budget > fixed * 2) ?
+      mem_budget - fixed : fixed;
+  }
+  PassiveDns::~PassiveDns() {
+    for (size_t i = 0; i < this->names_.size(); i++) {
+      ::free(this->names_[i].str_);
+    }
+  }
+
+  uint32_t PassiveDns::addr_hash(const void *addr, size_t len) {
+    const byte_t *p = static_cast<const byte_t*>(addr);
+    uint32_t h = static_cast<uint32_t>(len);
+    for (size_t i = 0; i + 4 <= len; i += 4) {
+      uint32_t w;
+      ::memcpy(&w, p + i, sizeof(w));
+      h = (h ^ w) * 0x9E3779B1U;
+      h ^= h >> 15;
+    }
+    return h;
+  }
+
+  uint32_t PassiveDns::name_hash(const char *name, size_t len) {
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; i++) {
+      h = (h ^ static_cast<byte_t>(name[i])) * 16777619U;
+    }
+    return h;
+  }
+
+  size_t PassiveDns::find_addr(const void *addr, size_t len) const {
+    // returns the slot holding addr or the empty slot to insert it
+    size_t i = PassiveDns::addr_hash(addr, len) & this->addr_mask_;
+    for (;; i = (i + 1) & this->addr_mask_) {
+      const AddrEntry &e = this->addr_tbl_[i];
+      if (e.len_ == 0 || (e.len_ == len && 0 == ::memcmp(e.addr_, addr, len))) {
+        return i;
+      }
+    }
+  }
+
+  void PassiveDns::remove_addr(size_t i) {
+    AddrEntry *tbl = &(this->addr_tbl_[0]);
+    assert(tbl[i].len_ != 0);
+    this->release(tbl[i].name_);
+
+    // backward shift deletion, no tombstones
+    for (size_t j = i;;) {
+      j = (j + 1) & this->addr_mask_;
+      if (tbl[j].len_ == 0) {
+        break;
+      }
+      size_t k = PassiveDns::addr_hash(tbl[j].addr_, tbl[j].len_) &
+        this->addr_mask_;
+      bool stay = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+      if (!stay) {
+        tbl[i] = tbl[j];
+        i = j;
+      }
+    }
+    tbl[i].len_ = 0;
+    this->addr_cnt_--;
+  }
+
+  bool PassiveDns::reclaim(bool force) {
+    // Without force, look at a few slots and drop expired entries. With
+    // force, remove one entry: an expired one within a short window if
+    // any, otherwise the first entry under the cursor.
+    const size_t window = force ? 64 : SWEEP_STEP;
+    const size_t tbl_size = this->addr_tbl_.size();
+    size_t victim = tbl_size;
+
+    for (size_t n = 0; n < window; n++) {
+      size_t i = this->sweep_ptr_;
+      this->sweep_ptr_ = (this->sweep_ptr_ + 1) & this->addr_mask_;
+      const AddrEntry &e = this->addr_tbl_[i];
+      if (e.len_ == 0) {
+        continue;
+      }
+      if (e.expire_ <= this->now_) {
+        this->remove_addr(i);
+        this->expired_++;
+        if (force) {
+          return true;
+        }
+      } else if (victim == tbl_size) {
+        victim = i;
+      }
+    }
+
+    if (!force) {
+      return true;
+    }
+
+    if (victim == tbl_size) {
+      if (this->addr_cnt_ == 0) {
+        return false;
+      }
+      // nothing in the window, continue to the next entry
+      while (this->addr_tbl_[this->sweep_ptr_].len_ == 0) {
+        this->sweep_ptr_ = (this->sweep_ptr_ + 1) & this->addr_mask_;
+      }
+      victim = this->sweep_ptr_;
+    }
+    this->remove_addr(victim);
+    this->evicted_++;
+    return true;
+  }
+
+  uint32_t PassiveDns::intern(const char *name, size_t len) {
+    // make room first, reclaim() may reorder the name index
+    while (this->name_bytes_ + len + 1 > this->name_budget_) {
+      if (!this->reclaim(true)) {
+        return NAME_NONE;
+      }
+    }
+
+    const uint32_t h = PassiveDns::name_hash(name, len);
+    size_t i = h & this->name_mask_;
+    for (; this->name_tbl_[i] != NAME_NONE; i = (i + 1) & this->name_mask_) {
+      NameEntry &e = this->names_[this->name_tbl_[i]];
+      if (e.hash_ == h && e.len_ == len && 0 == ::memcmp(e.str_, name, len)) {
+        e.ref_++;
+        return this->name_tbl_[i];
+      }
+    }
+
+    uint32_t id;
+    if (this->free_names_.empty()) {
+      id = static_cast<uint32_t>(this->names_.size());
+      NameEntry e = {NULL, 0, 0, 0};
+      this->names_.push_back(e);
+    } else {
+      id = this->free_names_.back();
+      this->free_names_.pop_back();
+    }
+
+    NameEntry &e = this->names_[id];
+    e.str_ = static_cast<char*>(::malloc(len + 1));
+    ::memcpy(e.str_, name, len);
+    e.str_[len] = '\0';
+    e.len_ = static_cast<uint32_t>(len);
+    e.ref_ = 1;
+    e.hash_ = h;
+    this->name_tbl_[i] = id;
+    this->name_bytes_ += len + 1;
+    return id;
+  }
+
+  void PassiveDns::release(uint32_t name_id) {
+    NameEntry &e = this->names_[name_id];
+    assert(e.ref_ > 0);
+    if (--e.ref_ > 0) {
+      return;
+    }
+
+    uint32_t *tbl = &(this->name_tbl_[0]);
+    size_t i = e.hash_ & this->name_mask_;
+    while (tbl[i] != name_id) {
+      assert(tbl[i] != NAME_NONE);
+      i = (i + 1) & this->name_mask_;
+    }
+    for (size_t j = i;;) {
+      j = (j + 1) & this->name_mask_;
+      if (tbl[j] == NAME_NONE) {
+        break;
+      }
+      size_t k = this->names_[tbl[j]].hash_ & this->name_mask_;
+      bool stay = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+      if (!stay) {
+        tbl[i] = tbl[j];
+        i = j;
+      }
+    }
+    tbl[i] = NAME_NONE;
+
+    this->name_bytes_ -= e.len_ + 1;
+    ::free(e.str_);
+    e.str_ = NULL;
+    this->free_names_.push_back(name_id);
+  }
+
+  bool PassiveDns::insert(const void *addr, size_t addr_len, const char *name,
+                          size_t name_len, time_t expire) {
+    if (addr_len != 4 && addr_len != 16) {
+      return false;
+    }
+
+    // amortized expiry
+    this->reclaim(false);
+
+    size_t i = this->find_addr(addr, addr_len);
+    AddrEntry *e = &(this->addr_tbl_[i]);
+    if (e->len_ != 0) {
+      const NameEntry &n = this->names_[e->name_];
+      if (n.len_ == name_len && 0 == ::memcmp(n.str_, name, name_len)) {
+        e->expire_ = expire;
+        return true;
+      }
+    }
+
+    uint32_t name_id = this->intern(name, name_len);
+    if (name_id == NAME_NONE) {
+      this->dropped_++;
+      return false;
+    }
+
+    // intern() may have evicted entries, then look up again
+    i = this->find_addr(addr, addr_len);
+    if (this->addr_tbl_[i].len_ != 0) {
+      this->release(this->addr_tbl_[i].name_);
+    } else {
+      while (this->addr_cnt_ >= this->addr_max_) {
+        this->reclaim(true);
+      }
+      i = this->find_addr(addr, addr_len);
+      this->addr_cnt_++;
+    }
+
+    e = &(this->addr_tbl_[i]);
+    ::memcpy(e->addr_, addr, addr_len);
+    e->len_ = static_cast<uint8_t>(addr_len);
+    e->name_ = name_id;
+    e->expire_ = expire;
+    this->inserted_++;
+    return true;
+  }
+
+  const char *PassiveDns::lookup(const void *addr, size_t addr_len,
+                                 time_t now, size_t *name_len) const {
+    if (addr_len != 4 && addr_len != 16) {
+      return NULL;
+    }
+
+    const AddrEntry &e = this->addr_tbl_[this->find_addr(addr, addr_len)];
+    if (e.len_ == 0 || e.expire_ <= (now > 0 ? now : this->now_)) {
+      return NULL;
+    }
+
+    const NameEntry &n = this->names_[e.name_];
+    if (name_len) {
+      *name_len = n.len_;
+    }
+    return n.str_;
+  }
+
+  void PassiveDns::recv(ev_id eid, const Property &p) {
+    if (this->P_DATA_ == VALUE_NULL || this->P_TTL_ == VALUE_NULL) {
+      return;
+    }
+
+    this->now_ = p.tv_sec();
+    const size_t n = p.value_size(this->P_DATA_);
+
+    // CNAME records of the message, to map addresses to the queried name
+    size_t cn_cnt = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (p.value(this->P_TYPE_, i).ntoh<uint16_t>() != 5) {
+        continue;
+      }
+      if (this->cn_owner_.size() <= cn_cnt) {
+        this->cn_owner_.resize(cn_cnt + 1);
+        this->cn_target_.resize(cn_cnt + 1);
+      }
+      if (p.value(this->P_NAME_, i).text(&(this->cn_owner_[cn_cnt])) &&
+          p.value(this->P_DATA_, i).text(&(this->cn_target_[cn_cnt]))) {
+        to_lower(&(this->cn_owner_[cn_cnt]));
+        to_lower(&(this->cn_target_[cn_cnt]));
+        cn_cnt++;
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      const uint16_t type = p.value(this->P_TYPE_, i).ntoh<uint16_t>();
+      if (type != 1 && type != 28) {  // A, AAAA
+        continue;
+      }
+
+      size_t len;
+      const byte_t *addr = p.value(this->P_DATA_, i).ptr(&len);
+      if (addr == NULL || len != (type == 1 ? 4U : 16U)) {
+        continue;
+      }
+
+      time_t ttl = p.value(this->P_TTL_, i).uint32();
+      if (ttl == 0) {
+        continue;
+      }
+      if (ttl > this->max_ttl_) {
+        ttl = this->max_ttl_;
+      }
+
+      if (!p.value(this->P_NAME_, i).text(&(this->owner_))) {
+        continue;
+      }
+      to_lower(&(this->owner_));
+      for (size_t c = 0; c < CHAIN_MAX; c++) {
+        size_t j = 0;
+        while (j < cn_cnt && this->cn_target_[j] != this->owner_) {
+          j++;
+        }
+        if (j == cn_cnt) {
+          break;
+        }
+        this->owner_ = this->cn_owner_[j];
+      }
+
+      this->insert(addr, len, this->owner_.data(), this->owner_.size(),
+                   this->now_ + ttl);
+    }
+  }
+
+  size_t PassiveDns::name_count() const {
+    return this->names_.size() - this->free_names_.size();
+  }
+
+  size_t PassiveDns::mem_usage() const {
+    return this->addr_tbl_.size() * sizeof(AddrEntry) +
+      this->name_tbl_.size() * sizeof(uint32_t) +
+      this->names_.capacity() * sizeof(NameEntry) +
+      this->free_names_.capacity() * sizeof(uint32_t) +
+      this->name_bytes_;
+  }
+}  // namespace swarm
@@ -0,0 +1,136 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_PASSIVE_DNS_H__
+#define SRC_UTILS_PASSIVE_DNS_H__
+
+#include <time.h>
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class PassiveDns:
+  // Address to name store built from observed DNS answers. Register it
+  // for "dns.an" (or "mdns.an", "llmnr.an" with the matching base name).
+  // A and AAAA answers are indexed by address, CNAME chains in the same
+  // message are followed back to the queried name; names from messages
+  // are matched and stored in lower case. Entries expire by the
+  // record TTL on packet time. Names are interned and reference counted,
+  // the address index is an open addressing table sized from the memory
+  // budget. A sweep cursor walks the table on every insert to drop expired
+  // entries and, when the budget is exhausted, evicts entries under the
+  // cursor (expired ones first). Lookups are O(1) and do not allocate.
+  //
+  class PassiveDns : public Handler {
+  private:
+    struct AddrEntry {
+      time_t expire_;
+      uint32_t name_;
+      uint8_t len_;       // 0: empty, 4: IPv4, 16: IPv6
+      byte_t addr_[16];
+    };
+
+    struct NameEntry {
+      char *str_;
+      uint32_t len_;
+      uint32_t ref_;
+      uint32_t hash_;
+    };
+
+    static const uint32_t NAME_NONE = 0xFFFFFFFF;
+    static const size_t CHAIN_MAX = 8;
+    static const size_t SWEEP_STEP = 2;
+
+    val_id P_NAME_, P_TYPE_, P_DATA_, P_TTL_;
+
+    std::vector<AddrEntry> addr_tbl_;
+    size_t addr_mask_;
+    size_t addr_cnt_;
+    size_t addr_max_;
+    size_t sweep_ptr_;
+
+    std::vector<NameEntry> names_;
+    std::vector<uint32_t> free_names_;
+    std::vector<uint32_t> name_tbl_;
+    size_t name_mask_;
+    size_t name_bytes_;
+    size_t name_budget_;
+
+    time_t now_;
+    time_t max_ttl_;
+
+    // Stat
+    uint64_t inserted_;
+    uint64_t expired_;
+    uint64_t evicted_;
+    uint64_t dropped_;
+
+    // per message scratch buffers, kept to avoid allocation
+    std::vector<std::string> cn_owner_, cn_target_;
+    std::string owner_;
+
+    static uint32_t addr_hash(const void *addr, size_t len);
+    static uint32_t name_hash(const char *name, size_t len);
+    size_t find_addr(const void *addr, size_t len) const;
+    void remove_addr(size_t idx);
+    bool reclaim(bool force);
+
+    uint32_t intern(const char *name, size_t len);
+    void release(uint32_t name_id);
+
+  public:
+    static const size_t DEFAULT_BUDGET = 32 * 1024 * 1024;
+
+    explicit PassiveDns(NetDec *nd, size_t mem_budget = DEFAULT_BUDGET,
+                        const std::string &base_name = "dns");
+    ~PassiveDns();
+
+    void recv(ev_id eid, const Property &p);
+
+    bool insert(const void *addr, size_t addr_len, const char *name,
+                size_t name_len, time_t expire);
+    // Returns NUL terminated name valid until the next insert, or NULL.
+    // now = 0 means time of the last DNS packet.
+    const char *lookup(const void *addr, size_t addr_len, time_t now = 0,
+                       size_t *name_len = NULL) const;
+
+    void set_max_ttl(time_t ttl) { this->max_ttl_ = ttl; }
+
+    size_t size() const { return this->addr_cnt_; }
+    size_t capacity() const { return this->addr_max_; }
+    size_t name_count() const;
+    size_t mem_usage() const;
+    uint64_t inserted() const { return this->inserted_; }
+    uint64_t expired() const { return this->expired_; }
+    uint64_t evicted() const { return this->evicted_; }
+    uint64_t dropped() const { return this->dropped_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_PASSIVE_DNS_H__
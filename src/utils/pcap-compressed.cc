@@ -0,0 +1,475 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pcap.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include "./pcap-compressed.h"
+#include "./mem-pool.h"
+#include "../netdec.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class Inflater:
+  // Stream decompressor. read() returns decompressed bytes, 0 at the end
+  // of stream and -1 on error.
+  //
+  class Inflater {
+  public:
+    virtual ~Inflater() {}
+    virtual bool ready() const = 0;
+    virtual ssize_t read(uint8_t *buf, size_t len) = 0;
+  };
+
+#ifdef HAVE_ZLIB
+  class GzipInflater : public Inflater {
+  private:
+    gzFile gz_;
+  public:
+    explicit GzipInflater(const std::string &path) {
+      this->gz_ = gzopen(path.c_str(), "rb");
+      if (this->gz_) {
+        gzbuffer(this->gz_, 256 * 1024);
+      }
+    }
+    ~GzipInflater() {
+      if (this->gz_) {
+        gzclose(this->gz_);
+      }
+    }
+    bool ready() const { return (this->gz_ != NULL); }
+    ssize_t read(uint8_t *buf, size_t len) {
+      // gzread() takes unsigned int length
+      if (len > 0x40000000) {
+        len = 0x40000000;
+      }
+      int rc = gzread(this->gz_, buf, static_cast<unsigned>(len));
+      return (rc < 0) ? -1 : rc;
+    }
+  };
+#endif
+
+#ifdef HAVE_ZSTD
+  class ZstdInflater : public Inflater {
+  private:
+    FILE *fp_;
+    ZSTD_DStream *ds_;
+    std::vector<uint8_t> in_buf_;
+    ZSTD_inBuffer in_;
+  public:
+    explicit ZstdInflater(const std::string &path) :
+      fp_(fopen(path.c_str(), "rb")), ds_(ZSTD_createDStream()),
+      in_buf_(ZSTD_DStreamInSize()) {
+      this->in_.src = &(this->in_buf_[0]);
+      this->in_.size = 0;
+      this->in_.pos = 0;
+      if (this->ds_) {
+        ZSTD_initDStream(this->ds_);
+      }
+    }
+    ~ZstdInflater() {
+      if (this->fp_) {
+        fclose(this->fp_);
+      }
+      if (this->ds_) {
+        ZSTD_freeDStream(this->ds_);
+      }
+    }
+    bool ready() const { return (this->fp_ != NULL && this->ds_ != NULL); }
+    ssize_t read(uint8_t *buf, size_t len) {
+      ZSTD_outBuffer out = {buf, len, 0};
+      while (out.pos < out.size) {
+        if (this->in_.pos == this->in_.size) {
+          this->in_.size = fread(&(this->in_buf_[0]), 1, this->in_buf_.size(),
+                                 this->fp_);
+          this->in_.pos = 0;
+          if (this->in_.size == 0) {
+            break;
+          }
+        }
+        size_t rc = ZSTD_decompressStream(this->ds_, &out, &(this->in_));
+        if (ZSTD_isError(rc)) {
+          return -1;
+        }
+      }
+      return out.pos;
+    }
+  };
+#endif
+
+#ifdef HAVE_LZ4
+  class Lz4Inflater : public Inflater {
+  private:
+    FILE *fp_;
+    LZ4F_dctx *dctx_;
+    std::vector<uint8_t> in_buf_;
+    size_t in_pos_, in_len_;
+  public:
+    explicit Lz4Inflater(const std::string &path) :
+      fp_(fopen(path.c_str(), "rb")), dctx_(NULL), in_buf_(256 * 1024),
+      in_pos_(0), in_len_(0) {
+      if (LZ4F_isError(LZ4F_createDecompressionContext(&(this->dctx_),
+                                                       LZ4F_VERSION))) {
+        this->dctx_ = NULL;
+      }
+    }
+    ~Lz4Inflater() {
+      if (this->fp_) {
+        fclose(this->fp_);
+      }
+      if (this->dctx_) {
+        LZ4F_freeDecompressionContext(this->dctx_);
+      }
+    }
+    bool ready() const { return (this->fp_ != NULL && this->dctx_ != NULL); }
+    ssize_t read(uint8_t *buf, size_t len) {
+      size_t pos = 0;
+      while (pos < len) {
+        if (this->in_pos_ == this->in_len_) {
+          this->in_len_ = fread(&(this->in_buf_[0]), 1, this->in_buf_.size(),
+                                this->fp_);
+          this->in_pos_ = 0;
+          if (this->in_len_ == 0) {
+            break;
+          }
+        }
+        size_t dst_len = len - pos;
+        size_t src_len = this->in_len_ - this->in_pos_;
+        size_t rc = LZ4F_decompress(this->dctx_, buf + pos, &dst_len,
+                                    &(this->in_buf_[this->in_pos_]), &src_len,
+                                    NULL);
+        if (LZ4F_isError(rc)) {
+          return -1;
+        }
+        pos += dst_len;
+        this->in_pos_ += src_len;
+      }
+      return pos;
+    }
+  };
+#endif
+
+
+  // ----------------------------------------------------------------
+  // class CapPcapCompressed
+  //
+  CapPcapCompressed::CapPcapCompressed(const std::string &filepath,
+                                       size_t buf_size, size_t buf_count) :
+    path_(filepath), inf_(NULL), buf_size_(buf_size), stop_(false),
+    inf_error_(false), swap_(false), frac_mul_(1000) {
+    pthread_mutex_init(&(this->mutex_), NULL);
+    pthread_cond_init(&(this->cond_), NULL);
+    this->set_status(FAIL);
+
+    Codec codec = CapPcapCompressed::detect(filepath);
+    if (codec == CODEC_NONE) {
+      this->set_errmsg("Unknown compression format");
+      return;
+    }
+    if (!CapPcapCompressed::has_codec(codec)) {
+      this->set_errmsg("The codec is not supported in this build");
+      return;
+    }
+
+    switch (codec) {
+#ifdef HAVE_ZLIB
+    case CODEC_GZIP: this->inf_ = new GzipInflater(filepath); break;
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD: this->inf_ = new ZstdInflater(filepath); break;
+#endif
+#ifdef HAVE_LZ4
+    case CODEC_LZ4:  this->inf_ = new Lz4Inflater(filepath);  break;
+#endif
+    default: break;
+    }
+    if (this->inf_ == NULL || !this->inf_->ready()) {
+      this->set_errmsg("can't open file");
+      return;
+    }
+
+    // the ring needs 2 buffers at least: the capture thread holds one
+    // while it copies the tail of record to the next one
+    if (buf_count < 2) {
+      buf_count = 2;
+    }
+    if (this->buf_size_ == 0) {
+      this->buf_size_ = 4096;
+    }
+    this->ring_.resize(buf_count);
+    for (size_t i = 0; i < this->ring_.size(); i++) {
+      Buf &b = this->ring_[i];
+      b.mem_ = static_cast<uint8_t*>
+        (MemPool::get("ring")->alloc(HEADROOM_ + this->buf_size_));
+      b.len_ = 0;
+      b.full_ = false;
+      b.eof_ = false;
+      if (b.mem_ == NULL) {
+        this->set_errmsg("can't allocate buffer");
+        return;
+      }
+    }
+
+    this->set_status(READY);
+  }
+  CapPcapCompressed::~CapPcapCompressed() {
+    for (size_t i = 0; i < this->ring_.size(); i++) {
+      MemPool::get("ring")->free(this->ring_[i].mem_);
+    }
+    delete this->inf_;
+    pthread_cond_destroy(&(this->cond_));
+    pthread_mutex_destroy(&(this->mutex_));
+  }
+
+  CapPcapCompressed::Codec
+  CapPcapCompressed::detect(const std::string &filepath) {
+    uint8_t m[4];
+    FILE *fp = fopen(filepath.c_str(), "rb");
+    if (fp == NULL) {
+      return CODEC_NONE;
+    }
+    size_t len = fread(m, 1, sizeof(m), fp);
+    fclose(fp);
+
+    if (len >= 2 && m[0] == 0x1F && m[1] == 0x8B) {
+      return CODEC_GZIP;
+    } else if (len == 4 && m[0] == 0x28 && m[1] == 0xB5 && m[2] == 0x2F &&
+               m[3] == 0xFD) {
+      return CODEC_ZSTD;
+    } else if (len == 4 && m[0] == 0x04 && m[1] == 0x22 && m[2] == 0x4D &&
+               m[3] == 0x18) {
+      return CODEC_LZ4;
+    }
+    return CODEC_NONE;
+  }
+
+  bool CapPcapCompressed::has_codec(Codec codec) {
+    switch (codec) {
+#ifdef HAVE_ZLIB
+    case CODEC_GZIP: return true;
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD: return true;
+#endif
+#ifdef HAVE_LZ4
+    case CODEC_LZ4:  return true;
+#endif
+    default: return false;
+    }
+  }
+
+  uint32_t CapPcapCompressed::rd32(const uint8_t *p) const {
+    uint32_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return this->swap_ ? __builtin_bswap32(v) : v;
+  }
+
+  void *CapPcapCompressed::inflate_thread(void *obj) {
+    static_cast<CapPcapCompressed*>(obj)->inflate();
+    return NULL;
+  }
+
+  void CapPcapCompressed::inflate() {
+    for (size_t i = 0; ; i++) {
+      Buf &b = this->ring_[i % this->ring_.size()];
+      pthread_mutex_lock(&(this->mutex_));
+      while (b.full_ && !this->stop_) {
+        pthread_cond_wait(&(this->cond_), &(this->mutex_));
+      }
+      bool stop = this->stop_;
+      pthread_mutex_unlock(&(this->mutex_));
+      if (stop) {
+        break;
+      }
+
+      // fill the data area of buffer as much as possible
+      uint8_t *data = b.mem_ + HEADROOM_;
+      size_t len = 0;
+      ssize_t rc = 1;
+      while (len < this->buf_size_ &&
+             (rc = this->inf_->read(data + len, this->buf_size_ - len)) > 0) {
+        len += rc;
+      }
+
+      pthread_mutex_lock(&(this->mutex_));
+      b.len_ = len;
+      b.eof_ = (rc <= 0);
+      b.full_ = true;
+      if (rc < 0) {
+        this->inf_error_ = true;
+      }
+      pthread_cond_broadcast(&(this->cond_));
+      pthread_mutex_unlock(&(this->mutex_));
+
+      if (b.eof_) {
+        break;
+      }
+    }
+  }
+
+  CapPcapCompressed::Buf *CapPcapCompressed::acquire(size_t idx) {
+    Buf *b = &(this->ring_[idx % this->ring_.size()]);
+    pthread_mutex_lock(&(this->mutex_));
+    while (!b->full_) {
+      pthread_cond_wait(&(this->cond_), &(this->mutex_));
+    }
+    pthread_mutex_unlock(&(this->mutex_));
+    return b;
+  }
+
+  void CapPcapCompressed::release(size_t idx) {
+    pthread_mutex_lock(&(this->mutex_));
+    this->ring_[idx % this->ring_.size()].full_ = false;
+    pthread_cond_broadcast(&(this->cond_));
+    pthread_mutex_unlock(&(this->mutex_));
+  }
+
+  bool CapPcapCompressed::parse_file_hdr(const uint8_t *p) {
+    uint32_t magic;
+    ::memcpy(&magic, p, sizeof(magic));
+    switch (magic) {
+    case 0xA1B2C3D4: this->frac_mul_ = 1000; break;
+    case 0xD4C3B2A1: this->swap_ = true; this->frac_mul_ = 1000; break;
+    case 0xA1B23C4D: this->frac_mul_ = 1;    break;
+    case 0x4D3CB2A1: this->swap_ = true; this->frac_mul_ = 1;    break;
+    default:
+      this->set_errmsg("Invalid pcap magic number");
+      return false;
+    }
+
+    const char *dec = PcapReader::linktype2dec(this->rd32(p + 20));
+    if (dec == NULL) {
+      this->set_errmsg ("Only DLT_EN10MB and DLT_RAW are "
+                        "supported in this version");
+      return false;
+    }
+    if (this->netdec() && !this->netdec()->set_default_decoder(dec)) {
+      this->set_errmsg(this->netdec()->errmsg());
+      return false;
+    }
+    return true;
+  }
+
+  bool CapPcapCompressed::decode() {
+    static const size_t FILE_HDR_LEN = 24, PKT_HDR_LEN = 16;
+    size_t idx = 0;
+    Buf *b = this->acquire(idx);
+    const uint8_t *p = b->mem_ + HEADROOM_;
+    const uint8_t *end = p + b->len_;
+    bool hdr_done = false;
+
+    while (true) {
+      size_t avail = end - p;
+      size_t need = hdr_done ? PKT_HDR_LEN : FILE_HDR_LEN;
+      if (hdr_done && avail >= need) {
+        uint32_t caplen = this->rd32(p + 8);
+        if (caplen > MAX_CAPLEN_) {
+          this->set_errmsg("Invalid packet data");
+          return false;
+        }
+        need += caplen;
+      }
+
+      if (avail >= need) {
+        if (!hdr_done) {
+          if (!this->parse_file_hdr(p)) {
+            return false;
+          }
+          hdr_done = true;
+        } else if (this->netdec()) {
+          uint64_t ts_ns = static_cast<uint64_t>(this->rd32(p)) * 1000000000 +
+            static_cast<uint64_t>(this->rd32(p + 4)) * this->frac_mul_;
+          uint32_t caplen = need - PKT_HDR_LEN;
+          uint32_t len = this->rd32(p + 12);
+          this->netdec()->input(p + PKT_HDR_LEN, len, ts_ns,
+                                (caplen < len) ? caplen : len);
+        }
+        p += need;
+        continue;
+      }
+
+      if (b->eof_) {
+        if (this->inf_error_) {
+          this->set_errmsg("decompression error");
+          return false;
+        } else if (avail > 0 || !hdr_done) {
+          this->set_errmsg("Truncated pcap file");
+          return false;
+        }
+        return true;
+      }
+
+      // move the incomplete record in front of the next buffer
+      Buf *nb = this->acquire(idx + 1);
+      uint8_t *np = nb->mem_ + HEADROOM_ - avail;
+      ::memcpy(np, p, avail);
+      this->release(idx);
+      idx++;
+      b = nb;
+      p = np;
+      end = nb->mem_ + HEADROOM_ + nb->len_;
+    }
+  }
+
+  bool CapPcapCompressed::setup() {
+    this->stop_ = false;
+    if (0 != pthread_create(&(this->th_), NULL,
+                            CapPcapCompressed::inflate_thread, this)) {
+      this->set_errmsg("can't create decompression thread");
+      this->set_status(FAIL);
+      return false;
+    }
+
+    bool rc = this->decode();
+
+    pthread_mutex_lock(&(this->mutex_));
+    this->stop_ = true;
+    pthread_cond_broadcast(&(this->cond_));
+    pthread_mutex_unlock(&(this->mutex_));
+    pthread_join(this->th_, NULL);
+
+    this->set_status(rc ? STOP : FAIL);
+    return rc;
+  }
+
+  bool CapPcapCompressed::teardown() {
+    return true;
+  }
+
+  void CapPcapCompressed::handler(int revents) {
+  }
+}  // namespace swarm
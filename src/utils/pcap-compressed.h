@@ -0,0 +1,106 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_PCAP_COMPRESSED_H__
+#define SRC_UTILS_PCAP_COMPRESSED_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "../netcap.h"
+
+namespace swarm {
+  class Inflater;
+
+  // ----------------------------------------------------------------
+  // class CapPcapCompressed:
+  // Reads a gzip, zstd or lz4 (frame format) compressed pcap file. The
+  // format is detected by magic number. A dedicated thread decompresses
+  // into a ring of large buffers and the capture thread parses pcap
+  // records in place and passes them to NetDec without copy. Only the
+  // tail of a record crossing a buffer boundary is copied into the head
+  // room in front of the next buffer. pcapng is not supported here.
+  // Codecs are available if the library was found at build time.
+  //
+  class CapPcapCompressed : public NetCap {
+  public:
+    enum Codec {
+      CODEC_NONE = 0,
+      CODEC_GZIP,
+      CODEC_ZSTD,
+      CODEC_LZ4,
+    };
+
+  private:
+    struct Buf {
+      uint8_t *mem_;  // head room + data
+      size_t len_;
+      bool full_;
+      bool eof_;
+    };
+
+    // a tail of incomplete record is at most header + max caplen
+    static const size_t MAX_CAPLEN_ = 262144;
+    static const size_t HEADROOM_ = MAX_CAPLEN_ + 16;
+
+    std::string path_;
+    Inflater *inf_;
+    std::vector<Buf> ring_;
+    size_t buf_size_;
+    pthread_t th_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+    bool stop_;
+    bool inf_error_;
+
+    bool swap_;
+    uint64_t frac_mul_;
+
+    inline uint32_t rd32(const uint8_t *p) const;
+    static void *inflate_thread(void *obj);
+    void inflate();
+    Buf *acquire(size_t idx);
+    void release(size_t idx);
+    bool parse_file_hdr(const uint8_t *p);
+    bool decode();
+
+    bool setup();
+    bool teardown();
+    void handler(int revents);
+
+  public:
+    explicit CapPcapCompressed(const std::string &filepath,
+                               size_t buf_size = 4 * 1024 * 1024,
+                               size_t buf_count = 4);
+    ~CapPcapCompressed();
+    // detect codec by magic number, CODEC_NONE if unknown
+    static Codec detect(const std::string &filepath);
+    // true if the codec is supported in this build
+    static bool has_codec(Codec codec);
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_PCAP_COMPRESSED_H__
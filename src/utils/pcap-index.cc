@@ -0,0 +1,463 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pcap.h>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+#include "./pcap-index.h"
+#include "../flowhash.h"
+#include "../netdec.h"
+#include "../property.h"
+
+namespace swarm {
+  // index file header, arrays of Block, Flow and posting follow it
+  struct swidx_hdr {
+    char magic[8];
+    uint64_t file_size;
+    uint64_t interval_ns;
+    uint64_t block_bytes;
+    uint64_t block_count;
+    uint64_t flow_count;
+    uint64_t posting_count;
+    uint32_t linktype;
+    uint32_t reserved;
+    char flow_hash[16];  // FlowHash::name(), NUL terminated
+  };
+  static const char SWIDX_MAGIC[8] = {'S', 'W', 'I', 'D', 'X', 0, 0, 2};
+
+  // Property::hash_value() of a record, decoded by a private NetDec with
+  // the flow hash of the index, as handlers of the file see it
+  class IndexHasher : public Handler {
+  private:
+    NetDec nd_;
+    FlowHash *fh_;
+    uint64_t hash_;
+
+  public:
+    IndexHasher() : fh_(NULL), hash_(0) {}
+    ~IndexHasher() {
+      delete this->fh_;
+    }
+    bool setup(uint32_t linktype, const std::string &flow_hash,
+               std::string *errmsg) {
+      const char *dec = PcapReader::linktype2dec(linktype);
+      if (dec == NULL) {
+        *errmsg = "unsupported link type";
+        return false;
+      }
+      this->fh_ = FlowHash::New(flow_hash);
+      if (this->fh_ == NULL) {
+        *errmsg = "unknown flow hash: " + flow_hash;
+        return false;
+      }
+      if (!this->nd_.set_default_decoder(dec) ||
+          !this->nd_.set_flow_hash(this->fh_) ||
+          this->nd_.set_handler(std::string(dec) + ".packet", this) ==
+          HDLR_NULL) {
+        *errmsg = this->nd_.errmsg();
+        return false;
+      }
+      return true;
+    }
+    uint64_t hash(const PcapReader::Record &rec) {
+      this->hash_ = 0;
+      this->nd_.input(rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+      return this->hash_;
+    }
+    void recv(ev_id eid, const Property &p) {
+      this->hash_ = p.hash_value();
+    }
+  };
+
+  // -------------------------------------------------------------------
+  // class PcapIndex
+  //
+  PcapIndex::PcapIndex(uint64_t interval_ns, uint64_t block_bytes) :
+    interval_ns_(interval_ns > 0 ? interval_ns : 1),
+    block_bytes_(block_bytes > 0 ? block_bytes : 1),
+    file_size_(0), linktype_(0), flow_hash_("default") {
+  }
+  PcapIndex::~PcapIndex() {
+  }
+
+  bool PcapIndex::set_flow_hash(const std::string &name) {
+    FlowHash *fh = FlowHash::New(name);
+    if (fh == NULL) {
+      this->errmsg_ = "unknown flow hash: " + name;
+      return false;
+    }
+    this->flow_hash_ = fh->name();
+    delete fh;
+    return true;
+  }
+
+  std::string PcapIndex::default_path(const std::string &pcap_path) {
+    return pcap_path + ".swidx";
+  }
+
+  bool PcapIndex::build(const std::string &pcap_path) {
+    PcapReader reader(pcap_path);
+    if (!reader.ready() || !reader.seek(reader.offset())) {
+      this->errmsg_ = reader.errmsg();
+      return false;
+    }
+
+    this->block_.clear();
+    this->flow_.clear();
+    this->posting_.clear();
+    this->file_size_ = reader.length();
+    this->linktype_ = reader.linktype();
+    IndexHasher hasher;
+    if (!hasher.setup(this->linktype_, this->flow_hash_, &this->errmsg_)) {
+      return false;
+    }
+
+    // posting lists are appended in block order, so a block is added only
+    // if it differs from the last one
+    std::unordered_map<uint64_t, std::vector<uint32_t> > flow_map;
+    PcapReader::Record rec;
+    uint64_t block_ts = 0;
+    size_t off = reader.offset();
+    int rc;
+
+    while ((rc = reader.next(&rec)) > 0) {
+      if (this->block_.empty() ||
+          rec.ts_ns_ >= block_ts + this->interval_ns_ ||
+          rec.ts_ns_ < block_ts ||
+          off - this->block_.back().offset_ >= this->block_bytes_) {
+        Block b = {off, rec.ts_ns_, rec.ts_ns_};
+        this->block_.push_back(b);
+        block_ts = rec.ts_ns_;
+      }
+
+      Block &b = this->block_.back();
+      b.ts_min_ = std::min(b.ts_min_, rec.ts_ns_);
+      b.ts_max_ = std::max(b.ts_max_, rec.ts_ns_);
+
+      uint32_t bi = this->block_.size() - 1;
+      uint64_t hv = hasher.hash(rec);
+      std::vector<uint32_t> &pl = flow_map[hv];
+      if (pl.empty() || pl.back() != bi) {
+        pl.push_back(bi);
+      }
+      off = reader.offset();
+    }
+
+    if (rc < 0) {
+      this->errmsg_ = reader.errmsg();
+      return false;
+    }
+
+    this->flow_.reserve(flow_map.size());
+    for (auto it = flow_map.begin(); it != flow_map.end(); it++) {
+      Flow f = {it->first, 0, it->second.size()};
+      this->flow_.push_back(f);
+    }
+    std::sort(this->flow_.begin(), this->flow_.end());
+    for (size_t i = 0; i < this->flow_.size(); i++) {
+      const std::vector<uint32_t> &pl = flow_map[this->flow_[i].hash_];
+      this->flow_[i].begin_ = this->posting_.size();
+      this->posting_.insert(this->posting_.end(), pl.begin(), pl.end());
+    }
+
+    return true;
+  }
+
+  bool PcapIndex::save(const std::string &idx_path) const {
+    FILE *fp = fopen(idx_path.c_str(), "wb");
+    if (fp == NULL) {
+      const_cast<PcapIndex*>(this)->errmsg_ = "can't open index file";
+      return false;
+    }
+
+    struct swidx_hdr hdr;
+    ::memset(&hdr, 0, sizeof(hdr));
+    ::memcpy(hdr.magic, SWIDX_MAGIC, sizeof(hdr.magic));
+    hdr.file_size = this->file_size_;
+    hdr.interval_ns = this->interval_ns_;
+    hdr.block_bytes = this->block_bytes_;
+    hdr.block_count = this->block_.size();
+    hdr.flow_count = this->flow_.size();
+    hdr.posting_count = this->posting_.size();
+    hdr.linktype = this->linktype_;
+    ::strncpy(hdr.flow_hash, this->flow_hash_.c_str(),
+              sizeof(hdr.flow_hash) - 1);
+
+    bool rc =
+      (fwrite(&hdr, sizeof(hdr), 1, fp) == 1) &&
+      (fwrite(this->block_.data(), sizeof(Block), this->block_.size(), fp) ==
+       this->block_.size()) &&
+      (fwrite(this->flow_.data(), sizeof(Flow), this->flow_.size(), fp) ==
+       this->flow_.size()) &&
+      (fwrite(this->posting_.data(), sizeof(uint32_t), this->posting_.size(),
+              fp) == this->posting_.size());
+    rc = (fclose(fp) == 0) && rc;
+
+    if (!rc) {
+      const_cast<PcapIndex*>(this)->errmsg_ = "can't write index file";
+    }
+    return rc;
+  }
+
+  bool PcapIndex::load(const std::string &idx_path) {
+    FILE *fp = fopen(idx_path.c_str(), "rb");
+    if (fp == NULL) {
+      this->errmsg_ = "can't open index file";
+      return false;
+    }
+
+    // counts in the header must agree with the file length before
+    // allocating anything
+    long length = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    uint64_t body = (length > 0) ? static_cast<uint64_t>(length) : 0;
+    struct swidx_hdr hdr;
+    bool rc = (length >= static_cast<long>(sizeof(hdr)) &&
+               fseek(fp, 0, SEEK_SET) == 0 &&
+               fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+               ::memcmp(hdr.magic, SWIDX_MAGIC, sizeof(hdr.magic)) == 0);
+    if (rc) {
+      body -= sizeof(hdr);
+      rc = (hdr.block_count <= body / sizeof(Block) &&
+            hdr.flow_count <= body / sizeof(Flow) &&
+            hdr.posting_count <= body / sizeof(uint32_t) &&
+            hdr.block_count * sizeof(Block) + hdr.flow_count * sizeof(Flow) +
+            hdr.posting_count * sizeof(uint32_t) == body);
+    }
+    if (rc) {
+      this->file_size_ = hdr.file_size;
+      this->interval_ns_ = hdr.interval_ns;
+      this->block_bytes_ = hdr.block_bytes;
+      this->linktype_ = hdr.linktype;
+      hdr.flow_hash[sizeof(hdr.flow_hash) - 1] = '\0';
+      this->flow_hash_ = hdr.flow_hash;
+      this->block_.resize(hdr.block_count);
+      this->flow_.resize(hdr.flow_count);
+      this->posting_.resize(hdr.posting_count);
+      rc =
+        (fread(this->block_.data(), sizeof(Block), this->block_.size(), fp) ==
+         this->block_.size()) &&
+        (fread(this->flow_.data(), sizeof(Flow), this->flow_.size(), fp) ==
+         this->flow_.size()) &&
+        (fread(this->posting_.data(), sizeof(uint32_t), this->posting_.size(),
+               fp) == this->posting_.size());
+    }
+    fclose(fp);
+
+    if (!rc) {
+      this->errmsg_ = "Invalid index file";
+    } else {
+      rc = this->verify();
+    }
+    if (!rc) {
+      this->block_.clear();
+      this->flow_.clear();
+      this->posting_.clear();
+    }
+    return rc;
+  }
+
+  bool PcapIndex::verify() {
+    for (size_t i = 0; i < this->block_.size(); i++) {
+      if (this->block_[i].offset_ > this->file_size_ ||
+          (i > 0 && this->block_[i].offset_ < this->block_[i - 1].offset_)) {
+        this->errmsg_ = "Invalid index file: block offset out of range";
+        return false;
+      }
+    }
+    for (size_t i = 0; i < this->flow_.size(); i++) {
+      const Flow &f = this->flow_[i];
+      if (f.begin_ > this->posting_.size() ||
+          f.count_ > this->posting_.size() - f.begin_) {
+        this->errmsg_ = "Invalid index file: posting list out of range";
+        return false;
+      }
+      if (i > 0 && f.hash_ < this->flow_[i - 1].hash_) {
+        // find_flow() does binary search
+        this->errmsg_ = "Invalid index file: flows are not sorted";
+        return false;
+      }
+    }
+    for (size_t i = 0; i < this->posting_.size(); i++) {
+      if (this->posting_[i] >= this->block_.size()) {
+        this->errmsg_ = "Invalid index file: block id out of range";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint64_t PcapIndex::block_end(size_t i) const {
+    return (i + 1 < this->block_.size()) ?
+      this->block_[i + 1].offset_ : this->file_size_;
+  }
+
+  void PcapIndex::find_time(uint64_t begin_ns, uint64_t end_ns,
+                            std::vector<uint32_t> *blocks) const {
+    for (size_t i = 0; i < this->block_.size(); i++) {
+      if (this->block_[i].ts_max_ >= begin_ns &&
+          this->block_[i].ts_min_ <= end_ns) {
+        blocks->push_back(i);
+      }
+    }
+  }
+
+  bool PcapIndex::find_flow(uint64_t hash,
+                            std::vector<uint32_t> *blocks) const {
+    Flow key = {hash, 0, 0};
+    auto it = std::lower_bound(this->flow_.begin(), this->flow_.end(), key);
+    if (it == this->flow_.end() || it->hash_ != hash) {
+      return false;
+    }
+    blocks->insert(blocks->end(), this->posting_.begin() + it->begin_,
+                   this->posting_.begin() + it->begin_ + it->count_);
+    return true;
+  }
+
+
+  // -------------------------------------------------------------------
+  // class CapPcapIndexed
+  //
+  CapPcapIndexed::CapPcapIndexed(const std::string &filepath,
+                                 const PcapIndex *idx) :
+    reader_(filepath), idx_(idx), begin_ns_(0), end_ns_(UINT64_MAX),
+    use_flow_(false), flow_hash_(0), read_count_(0) {
+    this->set_status(FAIL);
+    if (!this->reader_.ready()) {
+      this->set_errmsg(this->reader_.errmsg());
+    } else if (this->reader_.length() != idx->file_size() ||
+               this->reader_.linktype() != idx->linktype()) {
+      this->set_errmsg("The index does not match the file");
+    } else {
+      this->set_status(READY);
+    }
+  }
+  CapPcapIndexed::~CapPcapIndexed() {
+  }
+
+  void CapPcapIndexed::set_time_range(uint64_t begin_ns, uint64_t end_ns) {
+    this->begin_ns_ = begin_ns;
+    this->end_ns_ = end_ns;
+  }
+  void CapPcapIndexed::set_flow(uint64_t hash) {
+    this->use_flow_ = true;
+    this->flow_hash_ = hash;
+  }
+
+  bool CapPcapIndexed::setup() {
+    const char *dec = PcapReader::linktype2dec(this->reader_.linktype());
+    if (dec == NULL) {
+      this->set_errmsg ("Only DLT_EN10MB and DLT_RAW are "
+                        "supported in this version");
+      this->set_status (NetCap::FAIL);
+      return false;
+    }
+
+    if (this->netdec() && !this->netdec()->set_default_decoder(dec)) {
+      this->set_errmsg(this->netdec()->errmsg());
+      this->set_status(FAIL);
+      return false;
+    }
+
+    // a flow hash taken from a handler is comparable only if NetDec uses
+    // the hash the index was built with
+    IndexHasher hasher;
+    if (this->use_flow_) {
+      const FlowHash *fh = this->netdec() ? this->netdec()->flow_hash() : NULL;
+      const std::string name = fh ? fh->name() : "default";
+      std::string err;
+      if (name != this->idx_->flow_hash()) {
+        err = "flow hash of NetDec (" + name + ") differs from the index (" +
+          this->idx_->flow_hash() + ")";
+      } else {
+        hasher.setup(this->reader_.linktype(), name, &err);
+      }
+      if (!err.empty()) {
+        this->set_errmsg(err);
+        this->set_status(FAIL);
+        return false;
+      }
+    }
+
+    // blocks in both of time range and flow posting list
+    std::vector<uint32_t> blocks;
+    this->idx_->find_time(this->begin_ns_, this->end_ns_, &blocks);
+    if (this->use_flow_) {
+      std::vector<uint32_t> fb;
+      this->idx_->find_flow(this->flow_hash_, &fb);
+      std::vector<uint32_t> tmp;
+      std::set_intersection(blocks.begin(), blocks.end(), fb.begin(),
+                            fb.end(), std::back_inserter(tmp));
+      blocks.swap(tmp);
+    }
+
+    PcapReader::Record rec;
+    bool rc = true;
+    for (size_t i = 0; rc && i < blocks.size(); i++) {
+      uint64_t end = this->idx_->block_end(blocks[i]);
+      if (!this->reader_.seek(this->idx_->block(blocks[i]).offset_)) {
+        this->set_errmsg(this->reader_.errmsg());
+        rc = false;
+        break;
+      }
+
+      while (this->reader_.offset() < end) {
+        int r = this->reader_.next(&rec);
+        if (r <= 0) {
+          if (r < 0) {
+            this->set_errmsg(this->reader_.errmsg());
+            rc = false;
+          }
+          break;
+        }
+        this->read_count_++;
+
+        if (rec.ts_ns_ < this->begin_ns_ || rec.ts_ns_ > this->end_ns_ ||
+            (this->use_flow_ && hasher.hash(rec) != this->flow_hash_)) {
+          continue;
+        }
+        if (this->netdec()) {
+          this->netdec()->input(rec.data_, rec.len_, rec.ts_ns_,
+                                rec.caplen_);
+        }
+      }
+    }
+
+    this->set_status(STOP);
+    return rc;
+  }
+
+  bool CapPcapIndexed::teardown() {
+    return true;
+  }
+
+  void CapPcapIndexed::handler(int revents) {
+  }
+}  // namespace swarm
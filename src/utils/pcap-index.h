@@ -0,0 +1,135 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_PCAP_INDEX_H__
+#define SRC_UTILS_PCAP_INDEX_H__
+
+#include <string>
+#include <vector>
+#include "../netcap.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // class PcapIndex:
+  // Sidecar index of a classic pcap file built in one pass. The file is
+  // cut into blocks at every `interval` of packet time or `block_bytes`
+  // of data. Each block keeps its file offset and min/max timestamp, and
+  // every flow hash (Property::hash_value() of the decoded packet, i.e.
+  // of the inner 5 tuple of a tunnel) has a posting list of blocks where
+  // the flow appears. The hash function is "default" unless
+  // set_flow_hash() selects another one (see FlowHash::New()), and is
+  // saved in the index.
+  //
+  class PcapIndex {
+  public:
+    struct Block {
+      uint64_t offset_;
+      uint64_t ts_min_;
+      uint64_t ts_max_;
+    };
+
+  private:
+    struct Flow {
+      uint64_t hash_;
+      uint64_t begin_;  // index of posting_
+      uint64_t count_;
+      bool operator<(const Flow &f) const { return this->hash_ < f.hash_; }
+    };
+
+    uint64_t interval_ns_;
+    uint64_t block_bytes_;
+    uint64_t file_size_;
+    uint32_t linktype_;
+    std::string flow_hash_;
+    std::vector<Block> block_;
+    std::vector<Flow> flow_;
+    std::vector<uint32_t> posting_;
+    std::string errmsg_;
+
+    // check ranges of loaded blocks, flows and postings
+    bool verify();
+
+  public:
+    explicit PcapIndex(uint64_t interval_ns = 1000000000ULL,
+                       uint64_t block_bytes = 4 * 1024 * 1024);
+    ~PcapIndex();
+    // hash function for build(), by FlowHash::name()
+    bool set_flow_hash(const std::string &name);
+    bool build(const std::string &pcap_path);
+    bool save(const std::string &idx_path) const;
+    bool load(const std::string &idx_path);
+    // index file name used by swarm-index, "<pcap_path>.swidx"
+    static std::string default_path(const std::string &pcap_path);
+
+    size_t block_size() const { return this->block_.size(); }
+    const Block &block(size_t i) const { return this->block_[i]; }
+    // end offset of i-th block
+    uint64_t block_end(size_t i) const;
+    size_t flow_size() const { return this->flow_.size(); }
+    uint64_t file_size() const { return this->file_size_; }
+    uint32_t linktype() const { return this->linktype_; }
+    const std::string &flow_hash() const { return this->flow_hash_; }
+
+    // append blocks overlapping [begin, end] of packet time
+    void find_time(uint64_t begin_ns, uint64_t end_ns,
+                   std::vector<uint32_t> *blocks) const;
+    // append blocks including the flow, false if the flow is not indexed
+    bool find_flow(uint64_t hash, std::vector<uint32_t> *blocks) const;
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+
+  // ----------------------------------------------------------------
+  // class CapPcapIndexed:
+  // CapPcapMmap with seek. Only blocks of PcapIndex matching the time
+  // range and/or flow hash are read, and packets in them are filtered
+  // by the same condition before NetDec::input(). A packet of the blocks
+  // is decoded once more to get its flow hash, and the NetDec must use
+  // the flow hash of the index (NetDec::set_flow_hash()).
+  //
+  class CapPcapIndexed : public NetCap {
+  private:
+    PcapReader reader_;
+    const PcapIndex *idx_;
+    uint64_t begin_ns_, end_ns_;
+    bool use_flow_;
+    uint64_t flow_hash_;
+    uint64_t read_count_;
+
+    bool setup();
+    bool teardown();
+    void handler(int revents);
+
+  public:
+    CapPcapIndexed(const std::string &filepath, const PcapIndex *idx);
+    ~CapPcapIndexed();
+    void set_time_range(uint64_t begin_ns, uint64_t end_ns);
+    void set_flow(uint64_t hash);
+    // number of records read from file, including filtered out ones
+    uint64_t read_count() const { return this->read_count_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_PCAP_INDEX_H__
@@ -0,0 +1,659 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <pcap.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+#include <sstream>
+
+#include "./pcap-writer.h"
+#include "./mem-pool.h"
+#include "../bpf.h"
+#include "../netdec.h"
+#include "../property.h"
+
+namespace swarm {
+  // ----------------------------------------------------------------
+  // PcapWriter::Uring
+  // Minimal io_uring for IORING_OP_WRITE by raw system calls, liburing
+  // is not required.
+  //
+#ifdef HAVE_IO_URING
+  struct PcapWriter::Uring {
+    int fd_;
+    unsigned entries_;
+    unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    struct io_uring_sqe *sqes_;
+    struct io_uring_cqe *cqes_;
+    void *sq_ptr_, *cq_ptr_;
+    size_t sq_len_, cq_len_, sqe_len_;
+
+    Uring() : fd_(-1), sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED),
+              sq_len_(0), cq_len_(0), sqe_len_(0) {
+      this->sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    ~Uring() {
+      if (this->sqes_ != MAP_FAILED) {
+        ::munmap(this->sqes_, this->sqe_len_);
+      }
+      if (this->cq_ptr_ != MAP_FAILED && this->cq_ptr_ != this->sq_ptr_) {
+        ::munmap(this->cq_ptr_, this->cq_len_);
+      }
+      if (this->sq_ptr_ != MAP_FAILED) {
+        ::munmap(this->sq_ptr_, this->sq_len_);
+      }
+      if (this->fd_ >= 0) {
+        ::close(this->fd_);
+      }
+    }
+
+    bool setup(unsigned entries) {
+      struct io_uring_params p;
+      ::memset(&p, 0, sizeof(p));
+      this->fd_ = ::syscall(__NR_io_uring_setup, entries, &p);
+      if (this->fd_ < 0) {
+        return false;
+      }
+      this->entries_ = p.sq_entries;
+
+      this->sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      this->cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      bool single = (p.features & IORING_FEAT_SINGLE_MMAP);
+      if (single) {
+        this->sq_len_ = this->cq_len_ =
+          (this->sq_len_ > this->cq_len_) ? this->sq_len_ : this->cq_len_;
+      }
+
+      this->sq_ptr_ = ::mmap(NULL, this->sq_len_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, this->fd_,
+                             IORING_OFF_SQ_RING);
+      if (this->sq_ptr_ == MAP_FAILED) {
+        return false;
+      }
+      this->cq_ptr_ = single ? this->sq_ptr_ :
+        ::mmap(NULL, this->cq_len_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, this->fd_, IORING_OFF_CQ_RING);
+      if (this->cq_ptr_ == MAP_FAILED) {
+        return false;
+      }
+      this->sqe_len_ = p.sq_entries * sizeof(struct io_uring_sqe);
+      this->sqes_ = static_cast<struct io_uring_sqe*>(
+          ::mmap(NULL, this->sqe_len_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, this->fd_, IORING_OFF_SQES));
+      if (this->sqes_ == MAP_FAILED) {
+        return false;
+      }
+
+      uint8_t *sq = static_cast<uint8_t*>(this->sq_ptr_);
+      uint8_t *cq = static_cast<uint8_t*>(this->cq_ptr_);
+      this->sq_head_  = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+      this->sq_tail_  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      this->sq_mask_  = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      this->sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+      this->cq_head_  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      this->cq_tail_  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      this->cq_mask_  = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      this->cqes_ =
+        reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+      return true;
+    }
+
+    bool submit(int fd, const void *buf, unsigned len, uint64_t offset,
+                uint64_t user_data) {
+      unsigned tail = *(this->sq_tail_);
+      unsigned head = __atomic_load_n(this->sq_head_, __ATOMIC_ACQUIRE);
+      if (tail - head >= this->entries_) {
+        return false;
+      }
+
+      unsigned idx = tail & *(this->sq_mask_);
+      struct io_uring_sqe *sqe = &(this->sqes_[idx]);
+      ::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(buf);
+      sqe->len = len;
+      sqe->off = offset;
+      sqe->user_data = user_data;
+      this->sq_array_[idx] = idx;
+      __atomic_store_n(this->sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+      return (::syscall(__NR_io_uring_enter, this->fd_, 1, 0, 0, NULL, 0)
+              == 1);
+    }
+
+    // pop one completion, wait for it if wait is true
+    bool pop(bool wait, uint64_t *user_data, int32_t *res) {
+      while (true) {
+        unsigned head = *(this->cq_head_);
+        unsigned tail = __atomic_load_n(this->cq_tail_, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+          struct io_uring_cqe *cqe = &(this->cqes_[head & *(this->cq_mask_)]);
+          *user_data = cqe->user_data;
+          *res = cqe->res;
+          __atomic_store_n(this->cq_head_, head + 1, __ATOMIC_RELEASE);
+          return true;
+        }
+        if (!wait) {
+          return false;
+        }
+        if (::syscall(__NR_io_uring_enter, this->fd_, 0, 1,
+                      IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+          return false;
+        }
+      }
+    }
+  };
+#else
+  struct PcapWriter::Uring {
+  };
+#endif
+
+
+  // ----------------------------------------------------------------
+  // PcapWriter
+  //
+  PcapWriter::PcapWriter(NetDec *nd, const std::string &path, Format format,
+                         size_t buf_size, size_t buf_count) :
+    nd_(nd), path_(path), format_(format), cur_buf_(-1), linktype_(-1),
+    block_(false), rotate_size_(0), rotate_interval_(0), file_bytes_(0),
+    file_ts_(0), file_pkts_(0), filter_(NULL), last_pkt_(0),
+    pkt_count_(0), drop_count_(0), error_count_(0),
+    uring_(NULL), use_uring_(true), thread_run_(false), stop_(false) {
+    pthread_mutex_init(&(this->mutex_), NULL);
+    pthread_cond_init(&(this->cond_), NULL);
+
+    // a buffer must hold the largest record, and page aligned
+    const size_t page = 4096;
+    this->buf_size_ = (buf_size < MIN_BUF_SIZE_) ? MIN_BUF_SIZE_ : buf_size;
+    this->buf_size_ = (this->buf_size_ + page - 1) & ~(page - 1);
+    if (buf_count < 2) {
+      buf_count = 2;
+    }
+
+    this->buf_.resize(buf_count);
+    for (size_t i = 0; i < this->buf_.size(); i++) {
+      Buf &b = this->buf_[i];
+      void *mem = MemPool::get("ring")->alloc(this->buf_size_);
+      b.mem_ = static_cast<uint8_t*>(mem);
+      b.len_ = 0;
+      b.file_ = 0;
+      b.offset_ = 0;
+      b.busy_ = (mem == NULL);  // never used if allocation failed
+    }
+  }
+  PcapWriter::~PcapWriter() {
+    this->close();
+
+    if (this->thread_run_) {
+      pthread_mutex_lock(&(this->mutex_));
+      this->stop_ = true;
+      pthread_cond_broadcast(&(this->cond_));
+      pthread_mutex_unlock(&(this->mutex_));
+      pthread_join(this->th_, NULL);
+    }
+    delete this->uring_;
+    delete this->filter_;
+
+    for (size_t i = 0; i < this->buf_.size(); i++) {
+      MemPool::get("ring")->free(this->buf_[i].mem_);
+    }
+    pthread_cond_destroy(&(this->cond_));
+    pthread_mutex_destroy(&(this->mutex_));
+  }
+
+  void PcapWriter::set_rotation(uint64_t max_bytes, uint64_t interval_ns) {
+    this->rotate_size_ = max_bytes;
+    this->rotate_interval_ = interval_ns;
+  }
+
+  void PcapWriter::add_flow(uint64_t hash) {
+    this->flow_.insert(hash);
+  }
+
+  bool PcapWriter::set_filter(const std::string &expr) {
+    delete this->filter_;
+    this->filter_ = NULL;
+    this->filter_expr_ = expr;
+    return true;
+  }
+
+  bool PcapWriter::set_filter(const struct bpf_insn *insns, size_t len) {
+    delete this->filter_;
+    this->filter_ = new BpfFilter();
+    this->filter_expr_.clear();
+    if (!this->filter_->load(insns, len)) {
+      this->errmsg_ = this->filter_->errmsg();
+      delete this->filter_;
+      this->filter_ = NULL;
+      return false;
+    }
+    return true;
+  }
+
+  std::string PcapWriter::file_path(size_t i) const {
+    if (i == 0) {
+      return this->path_;
+    }
+    std::stringstream ss;
+    ss << this->path_ << i;
+    return ss.str();
+  }
+
+  bool PcapWriter::start_backend() {
+#ifdef HAVE_IO_URING
+    if (this->use_uring_) {
+      this->uring_ = new Uring();
+      if (!this->uring_->setup(this->buf_.size())) {
+        delete this->uring_;
+        this->uring_ = NULL;
+      }
+    }
+#endif
+    if (this->uring_ == NULL) {
+      if (0 != pthread_create(&(this->th_), NULL, PcapWriter::write_thread,
+                              this)) {
+        this->errmsg_ = "can't create writer thread";
+        return false;
+      }
+      this->thread_run_ = true;
+    }
+    return true;
+  }
+
+  bool PcapWriter::open_file(uint64_t ts_ns) {
+    std::string path = this->file_path(this->file_.size());
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      this->errmsg_ = "can't open file: " + path;
+      return false;
+    }
+
+    OutFile f = {fd, 0, 0, false};
+    pthread_mutex_lock(&(this->mutex_));
+    this->file_.push_back(f);
+    pthread_mutex_unlock(&(this->mutex_));
+    this->file_bytes_ = 0;
+    this->file_ts_ = ts_ns;
+    this->file_pkts_ = 0;
+
+    uint8_t *p;
+    if (this->format_ == FMT_PCAPNG) {
+      // section header and one interface with nano second resolution
+      const uint32_t shb[7] = {0x0A0D0D0A, 28, 0x1A2B3C4D, 0x00000001,
+                               0xFFFFFFFF, 0xFFFFFFFF, 28};
+      const uint32_t idb[8] = {0x00000001, 32,
+                               static_cast<uint32_t>(this->linktype_),
+                               SNAPLEN_, 0x00010009, 0x00000009, 0, 32};
+      if ((p = this->reserve(sizeof(shb) + sizeof(idb), true)) == NULL) {
+        return false;
+      }
+      ::memcpy(p, shb, sizeof(shb));
+      ::memcpy(p + sizeof(shb), idb, sizeof(idb));
+    } else {
+      const uint32_t hdr[6] = {0xA1B23C4D, 0x00040002, 0, 0, SNAPLEN_,
+                               static_cast<uint32_t>(this->linktype_)};
+      if ((p = this->reserve(sizeof(hdr), true)) == NULL) {
+        return false;
+      }
+      ::memcpy(p, hdr, sizeof(hdr));
+    }
+    return true;
+  }
+
+  void PcapWriter::open_first(uint64_t ts_ns) {
+    if (this->linktype_ < 0) {
+      this->linktype_ = this->nd_->linktype();
+    }
+
+    bool rc = true;
+    if (this->linktype_ < 0) {
+      this->errmsg_ = "unknown link type";
+      rc = false;
+    }
+    if (rc && !this->filter_expr_.empty()) {
+      this->filter_ = new BpfFilter();
+      if (!this->filter_->compile(this->filter_expr_, this->linktype_)) {
+        this->errmsg_ = this->filter_->errmsg();
+        rc = false;
+      }
+    }
+    rc = rc && this->start_backend() && this->open_file(ts_ns);
+
+    if (!rc) {
+      // keep a closed entry, following packets are dropped
+      this->error_count_++;
+      OutFile f = {-1, 0, 0, true};
+      pthread_mutex_lock(&(this->mutex_));
+      this->file_.push_back(f);
+      pthread_mutex_unlock(&(this->mutex_));
+    }
+  }
+
+  void PcapWriter::retire_file() {
+    this->submit();
+    if (this->file_.empty()) {
+      return;
+    }
+
+    pthread_mutex_lock(&(this->mutex_));
+    OutFile &f = this->file_.back();
+    if (!f.retired_) {
+      f.retired_ = true;
+      if (f.inflight_ == 0 && f.fd_ >= 0) {
+        ::close(f.fd_);
+        f.fd_ = -1;
+      }
+    }
+    pthread_mutex_unlock(&(this->mutex_));
+  }
+
+  uint8_t *PcapWriter::reserve(size_t len, bool block) {
+    if (len > this->buf_size_) {
+      return NULL;
+    }
+    if (this->cur_buf_ < 0 ||
+        this->buf_size_ - this->buf_[this->cur_buf_].len_ < len) {
+      this->submit();
+      if (!this->acquire(block)) {
+        return NULL;
+      }
+    }
+
+    Buf &b = this->buf_[this->cur_buf_];
+    uint8_t *p = b.mem_ + b.len_;
+    b.len_ += len;
+    this->file_bytes_ += len;
+    return p;
+  }
+
+  bool PcapWriter::acquire(bool block) {
+    bool reaped = false;
+    while (true) {
+      pthread_mutex_lock(&(this->mutex_));
+      for (size_t i = 0; i < this->buf_.size(); i++) {
+        Buf &b = this->buf_[i];
+        if (!b.busy_) {
+          b.busy_ = true;
+          b.len_ = 0;
+          b.file_ = this->file_.size() - 1;
+          this->cur_buf_ = i;
+          pthread_mutex_unlock(&(this->mutex_));
+          return true;
+        }
+      }
+
+      if (this->uring_ == NULL && block) {
+        pthread_cond_wait(&(this->cond_), &(this->mutex_));
+        pthread_mutex_unlock(&(this->mutex_));
+        continue;
+      }
+      pthread_mutex_unlock(&(this->mutex_));
+
+      if (this->uring_ == NULL || (!block && reaped)) {
+        return false;
+      }
+      this->reap(block);
+      reaped = true;
+    }
+  }
+
+  void PcapWriter::submit() {
+    if (this->cur_buf_ < 0) {
+      return;
+    }
+    size_t idx = this->cur_buf_;
+    Buf &b = this->buf_[idx];
+    this->cur_buf_ = -1;
+
+    pthread_mutex_lock(&(this->mutex_));
+    if (b.len_ == 0) {
+      b.busy_ = false;
+      pthread_mutex_unlock(&(this->mutex_));
+      return;
+    }
+    OutFile &f = this->file_[b.file_];
+    b.offset_ = f.size_;
+    f.size_ += b.len_;
+    f.inflight_++;
+    int fd = f.fd_;
+
+    if (this->uring_ == NULL) {
+      this->queue_.push_back(idx);
+      pthread_cond_broadcast(&(this->cond_));
+      pthread_mutex_unlock(&(this->mutex_));
+      return;
+    }
+    pthread_mutex_unlock(&(this->mutex_));
+
+#ifdef HAVE_IO_URING
+    if (!this->uring_->submit(fd, b.mem_, b.len_, b.offset_, idx)) {
+      // complete() writes it synchronously
+      this->complete(idx, -1);
+    }
+#endif
+  }
+
+  void PcapWriter::complete(size_t idx, ssize_t res) {
+    pthread_mutex_lock(&(this->mutex_));
+    Buf &b = this->buf_[idx];
+    int fd = this->file_[b.file_].fd_;
+    pthread_mutex_unlock(&(this->mutex_));
+
+    // short or failed asynchronous write, finish it here
+    size_t done = (res > 0) ? res : 0;
+    bool ok = true;
+    while (done < b.len_) {
+      ssize_t rc = ::pwrite(fd, b.mem_ + done, b.len_ - done,
+                            b.offset_ + done);
+      if (rc <= 0) {
+        ok = false;
+        break;
+      }
+      done += rc;
+    }
+
+    pthread_mutex_lock(&(this->mutex_));
+    OutFile &f = this->file_[b.file_];
+    if (!ok) {
+      this->error_count_++;
+      this->errmsg_ = "write error";
+    }
+    b.busy_ = false;
+    f.inflight_--;
+    if (f.retired_ && f.inflight_ == 0 && f.fd_ >= 0) {
+      ::close(f.fd_);
+      f.fd_ = -1;
+    }
+    pthread_cond_broadcast(&(this->cond_));
+    pthread_mutex_unlock(&(this->mutex_));
+  }
+
+  void PcapWriter::reap(bool wait) {
+#ifdef HAVE_IO_URING
+    uint64_t idx;
+    int32_t res;
+    // wait for one at most, then take all completed ones
+    bool w = wait;
+    while (this->uring_->pop(w, &idx, &res)) {
+      this->complete(idx, res);
+      w = false;
+    }
+#endif
+  }
+
+  void *PcapWriter::write_thread(void *obj) {
+    static_cast<PcapWriter*>(obj)->write_loop();
+    return NULL;
+  }
+
+  void PcapWriter::write_loop() {
+    pthread_mutex_lock(&(this->mutex_));
+    while (true) {
+      while (this->queue_.empty() && !this->stop_) {
+        pthread_cond_wait(&(this->cond_), &(this->mutex_));
+      }
+      if (this->queue_.empty()) {
+        break;
+      }
+
+      size_t idx = this->queue_.front();
+      this->queue_.pop_front();
+      const Buf &b = this->buf_[idx];
+      int fd = this->file_[b.file_].fd_;
+      pthread_mutex_unlock(&(this->mutex_));
+
+      ssize_t rc = ::pwrite(fd, b.mem_, b.len_, b.offset_);
+      this->complete(idx, rc);
+      pthread_mutex_lock(&(this->mutex_));
+    }
+    pthread_mutex_unlock(&(this->mutex_));
+  }
+
+  bool PcapWriter::idle_locked() const {
+    for (size_t i = 0; i < this->buf_.size(); i++) {
+      if (this->buf_[i].busy_ && this->buf_[i].mem_ != NULL) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool PcapWriter::idle() {
+    pthread_mutex_lock(&(this->mutex_));
+    bool rc = this->idle_locked();
+    pthread_mutex_unlock(&(this->mutex_));
+    return rc;
+  }
+
+  void PcapWriter::recv(ev_id eid, const Property &p) {
+    // a capture may pass every packet in the same buffer (e.g. libpcap
+    // offline), so tell packets apart by their sequence number
+    uint64_t seq = this->nd_->recv_pkt();
+    if (seq == this->last_pkt_) {
+      return;  // same packet, the event fired again
+    }
+    this->last_pkt_ = seq;
+
+    const byte_t *data = p.raw_data();
+    uint64_t ts = p.ts_ns();
+
+    if (!this->flow_.empty() &&
+        this->flow_.find(p.hash_value()) == this->flow_.end()) {
+      return;
+    }
+
+    if (this->file_.empty()) {
+      this->open_first(ts);
+    }
+    if (this->file_.back().retired_) {
+      this->drop_count_++;  // closed or failed to open
+      return;
+    }
+
+    if (this->filter_ &&
+        !this->filter_->match(data, p.len(), p.cap_len())) {
+      return;
+    }
+
+    size_t caplen = p.cap_len();
+    if (caplen > SNAPLEN_) {
+      caplen = SNAPLEN_;
+    }
+    size_t rec_len = (this->format_ == FMT_PCAPNG) ?
+      32 + ((caplen + 3) & ~3) : 16 + caplen;
+
+    if (this->file_pkts_ > 0 &&
+        ((this->rotate_size_ > 0 &&
+          this->file_bytes_ + rec_len > this->rotate_size_) ||
+         (this->rotate_interval_ > 0 &&
+          ts >= this->file_ts_ + this->rotate_interval_))) {
+      this->retire_file();
+      if (!this->open_file(ts)) {
+        this->error_count_++;
+        this->drop_count_++;
+        return;
+      }
+    }
+
+    uint8_t *w = this->reserve(rec_len, this->block_);
+    if (w == NULL) {
+      this->drop_count_++;
+      return;
+    }
+
+    uint32_t len = p.len();
+    if (this->format_ == FMT_PCAPNG) {
+      uint32_t hdr[7] = {0x00000006, static_cast<uint32_t>(rec_len), 0,
+                         static_cast<uint32_t>(ts >> 32),
+                         static_cast<uint32_t>(ts & 0xFFFFFFFF),
+                         static_cast<uint32_t>(caplen), len};
+      ::memcpy(w, hdr, sizeof(hdr));
+      ::memcpy(w + sizeof(hdr), data, caplen);
+      ::memset(w + sizeof(hdr) + caplen, 0, rec_len - 32 - caplen);
+      uint32_t tail = rec_len;
+      ::memcpy(w + rec_len - 4, &tail, sizeof(tail));
+    } else {
+      uint32_t hdr[4] = {static_cast<uint32_t>(ts / 1000000000),
+                         static_cast<uint32_t>(ts % 1000000000),
+                         static_cast<uint32_t>(caplen), len};
+      ::memcpy(w, hdr, sizeof(hdr));
+      ::memcpy(w + sizeof(hdr), data, caplen);
+    }
+
+    this->file_pkts_++;
+    this->pkt_count_++;
+  }
+
+  bool PcapWriter::flush() {
+    this->submit();
+    if (this->uring_) {
+      while (!this->idle()) {
+        this->reap(true);
+      }
+    } else {
+      pthread_mutex_lock(&(this->mutex_));
+      while (!this->idle_locked()) {
+        pthread_cond_wait(&(this->cond_), &(this->mutex_));
+      }
+      pthread_mutex_unlock(&(this->mutex_));
+    }
+    return (this->error_count_ == 0);
+  }
+
+  bool PcapWriter::close() {
+    this->retire_file();
+    return this->flush();
+  }
+}  // namespace swarm
@@ -0,0 +1,164 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_PCAP_WRITER_H__
+#define SRC_UTILS_PCAP_WRITER_H__
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "../common.h"
+#include "../netdec.h"
+
+namespace swarm {
+  class BpfFilter;
+
+  // ----------------------------------------------------------------
+  // class PcapWriter:
+  // Handler that writes packets of the event back to pcap (nano second)
+  // or pcapng files. Records are packed into large page aligned buffers
+  // and a full buffer is written asynchronously by io_uring, or by a
+  // writer thread if io_uring is not available, so recv() never waits
+  // for disk. If all buffers are in flight the packet is dropped and
+  // counted, unless set_block(true).
+  //
+  // Files are rotated by size and/or packet time; rotated files are
+  // named like tcpdump -C: path, path1, path2 ... Packets can be
+  // selected by flow hash (Property::hash_value()) and BPF. A packet
+  // is written once even if the event fires several times for it.
+  //
+  class PcapWriter : public Handler {
+  public:
+    enum Format {
+      FMT_PCAP,
+      FMT_PCAPNG,
+    };
+
+  private:
+    struct Buf {
+      uint8_t *mem_;
+      size_t len_;
+      size_t file_;     // index of file_
+      uint64_t offset_;  // file offset to write
+      bool busy_;
+    };
+    struct OutFile {
+      int fd_;
+      uint64_t size_;
+      uint32_t inflight_;
+      bool retired_;
+    };
+    struct Uring;
+
+    NetDec *nd_;
+    std::string path_;
+    Format format_;
+    size_t buf_size_;
+    std::vector<Buf> buf_;
+    std::vector<OutFile> file_;
+    int cur_buf_;       // -1 if no buffer
+    int linktype_;
+    bool block_;
+
+    uint64_t rotate_size_;
+    uint64_t rotate_interval_;
+    uint64_t file_bytes_;  // bytes appended to current file
+    uint64_t file_ts_;     // packet time when current file is opened
+    uint64_t file_pkts_;
+
+    std::unordered_set<uint64_t> flow_;
+    BpfFilter *filter_;
+    std::string filter_expr_;
+    uint64_t last_pkt_;    // NetDec::recv_pkt() of the last written packet
+
+    uint64_t pkt_count_;
+    uint64_t drop_count_;
+    uint64_t error_count_;
+    std::string errmsg_;
+
+    // async write backend
+    Uring *uring_;
+    bool use_uring_;
+    bool thread_run_;
+    pthread_t th_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+    std::deque<size_t> queue_;
+    bool stop_;
+
+    static const size_t MIN_BUF_SIZE_ = 512 * 1024;
+    static const uint32_t SNAPLEN_ = 262144;
+
+    void open_first(uint64_t ts_ns);
+    bool open_file(uint64_t ts_ns);
+    void retire_file();
+    uint8_t *reserve(size_t len, bool block);
+    bool acquire(bool block);
+    bool idle_locked() const;
+    bool idle();
+    void submit();
+    void complete(size_t idx, ssize_t res);
+    void reap(bool wait);
+    static void *write_thread(void *obj);
+    void write_loop();
+    bool start_backend();
+
+  public:
+    explicit PcapWriter(NetDec *nd, const std::string &path,
+                        Format format = FMT_PCAP,
+                        size_t buf_size = 1024 * 1024, size_t buf_count = 16);
+    ~PcapWriter();
+    // rotate when the file exceeds max_bytes or after interval_ns of
+    // packet time. 0 disables each condition
+    void set_rotation(uint64_t max_bytes, uint64_t interval_ns);
+    void add_flow(uint64_t hash);
+    // BPF expression is compiled at the first packet for the link type
+    bool set_filter(const std::string &expr);
+    bool set_filter(const struct bpf_insn *insns, size_t len);
+    // wait for a free buffer instead of dropping
+    void set_block(bool block) { this->block_ = block; }
+    // false: use writer thread even if io_uring is available. Must be
+    // called before the first packet
+    void set_io_uring(bool enable) { this->use_uring_ = enable; }
+    bool io_uring() const { return (this->uring_ != NULL); }
+
+    void recv(ev_id eid, const Property &p);
+    // write out buffered records and wait for completion
+    bool flush();
+    bool close();
+
+    size_t file_count() const { return this->file_.size(); }
+    std::string file_path(size_t i) const;
+    uint64_t pkt_count() const { return this->pkt_count_; }
+    uint64_t drop_count() const { return this->drop_count_; }
+    uint64_t error_count() const { return this->error_count_; }
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_PCAP_WRITER_H__
@@ -0,0 +1,237 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./stat-shm.h"
+#include "../swarm.h"
+
+namespace swarm {
+  static const char STAT_MAGIC[8] = {'S', 'W', 'S', 'T', 'A', 'T', 0, 1};
+
+  static uint64_t wall_ns() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  static void copy_name(char *dst, const std::string &src) {
+    size_t len = src.length();
+    if (len >= StatSegment::NAME_LEN) {
+      len = StatSegment::NAME_LEN - 1;
+    }
+    ::memcpy(dst, src.c_str(), len);
+    dst[len] = '\0';
+  }
+
+  // ----------------------------------------------------------------
+  // StatPublisher
+  StatPublisher::StatPublisher(const std::string &name, NetDec *nd,
+                               NetCap *nc) :
+    path_("/swarm-" + name), nd_(nd), nc_(nc), fd_(-1), seg_(NULL) {
+    this->fd_ = ::shm_open(this->path_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (this->fd_ < 0) {
+      this->errmsg_ = "shm_open error: " + this->path_ + ", " +
+        strerror(errno);
+      return;
+    }
+    if (0 != ::ftruncate(this->fd_, sizeof(StatSegment))) {
+      this->errmsg_ = std::string("ftruncate error: ") + strerror(errno);
+      return;
+    }
+    void *ptr = ::mmap(NULL, sizeof(StatSegment), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, this->fd_, 0);
+    if (ptr == MAP_FAILED) {
+      this->errmsg_ = std::string("mmap error: ") + strerror(errno);
+      return;
+    }
+
+    this->seg_ = static_cast<StatSegment *>(ptr);
+    ::memset(this->seg_, 0, sizeof(StatSegment));
+    this->seg_->version_ = STAT_VERSION;
+    this->seg_->size_ = sizeof(StatSegment);
+    this->seg_->pid_ = ::getpid();
+    this->seg_->start_ns_ = wall_ns();
+    this->seg_->update_ns_ = this->seg_->start_ns_;
+    // magic last, a reader can attach while it is being created
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ::memcpy(this->seg_->magic_, STAT_MAGIC, sizeof(STAT_MAGIC));
+  }
+  StatPublisher::~StatPublisher() {
+    if (this->seg_) {
+      ::munmap(this->seg_, sizeof(StatSegment));
+    }
+    if (this->fd_ >= 0) {
+      ::close(this->fd_);
+      ::shm_unlink(this->path_.c_str());
+    }
+  }
+
+  void StatPublisher::exec(const struct timespec &tv) {
+    this->update();
+  }
+
+  void StatPublisher::update() {
+    StatSegment *s = this->seg_;
+    if (s == NULL) {
+      return;
+    }
+    NetDec *nd = this->nd_;
+
+    // sequence lock: odd seq_ while writing
+    uint64_t seq = s->seq_;
+    __atomic_store_n(&s->seq_, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->update_ns_ = wall_ns();
+    s->recv_pkt_ = nd->recv_pkt();
+    s->recv_len_ = nd->recv_len();
+    s->cap_len_ = nd->cap_len();
+    s->last_ts_ns_ = nd->last_ts_ns();
+    s->filter_reject_ = nd->filter_reject();
+    s->sample_drop_ = nd->sample_drop();
+    s->shed_count_ = nd->shed_count();
+    s->chksum_fail_ = nd->checksum_fail();
+    s->swap_count_ = nd->swap_count();
+
+    uint64_t recv = 0, drop = 0;
+    s->cap_valid_ = (this->nc_ && this->nc_->stats(&recv, &drop)) ? 1 : 0;
+    s->cap_recv_ = recv;
+    s->cap_drop_ = drop;
+
+    size_t n = 0;
+    for (size_t i = 0; i < nd->dec_size() && n < StatSegment::DEC_MAX; i++) {
+      const dec_id d_id = static_cast<dec_id>(i);
+      const std::string name = nd->lookup_dec_name(d_id);
+      if (name.empty()) {
+        continue;  // unloaded
+      }
+      StatSegment::Dec &d = s->dec_[n++];
+      copy_name(d.name_, name);
+      d.count_ = nd->decoder_count(d_id);
+      d.cost_ns_ = static_cast<uint64_t>(nd->decoder_cost(d_id));
+      d.session_ = nd->session_count(d_id);
+      d.shed_ = nd->is_shed(d_id) ? 1 : 0;
+    }
+    s->dec_size_ = n;
+
+    std::vector<NetDec::HandlerStat> hs;
+    nd->handler_stat(&hs);
+    n = 0;
+    for (size_t i = 0; i < hs.size() && n < StatSegment::HDLR_MAX; i++) {
+      StatSegment::Hdlr &h = s->hdlr_[n++];
+      copy_name(h.ev_, hs[i].ev_);
+      h.id_ = hs[i].id_;
+      h.calls_ = hs[i].calls_;
+      h.cost_ns_ = static_cast<uint64_t>(hs[i].cost_ns_);
+    }
+    s->hdlr_size_ = n;
+
+    __atomic_store_n(&s->seq_, seq + 2, __ATOMIC_RELEASE);
+  }
+
+  // ----------------------------------------------------------------
+  // StatReader
+  StatReader::StatReader() : fd_(-1), seg_(NULL) {
+  }
+  StatReader::~StatReader() {
+    this->close();
+  }
+
+  bool StatReader::open(const std::string &name) {
+    this->close();
+    const std::string path = "/swarm-" + name;
+    this->fd_ = ::shm_open(path.c_str(), O_RDONLY, 0);
+    if (this->fd_ < 0) {
+      this->errmsg_ = "shm_open error: " + path + ", " + strerror(errno);
+      return false;
+    }
+
+    struct stat st;
+    if (0 != ::fstat(this->fd_, &st) ||
+        static_cast<size_t>(st.st_size) < sizeof(StatSegment)) {
+      this->errmsg_ = "segment size mismatch: " + path;
+      this->close();
+      return false;
+    }
+    void *ptr = ::mmap(NULL, sizeof(StatSegment), PROT_READ, MAP_SHARED,
+                       this->fd_, 0);
+    if (ptr == MAP_FAILED) {
+      this->errmsg_ = std::string("mmap error: ") + strerror(errno);
+      this->close();
+      return false;
+    }
+
+    this->seg_ = static_cast<const StatSegment *>(ptr);
+    if (0 != ::memcmp(this->seg_->magic_, STAT_MAGIC, sizeof(STAT_MAGIC)) ||
+        this->seg_->version_ != STAT_VERSION ||
+        this->seg_->size_ != sizeof(StatSegment)) {
+      this->errmsg_ = "not a swarm stat segment of version " +
+        std::to_string(STAT_VERSION) + ": " + path;
+      this->close();
+      return false;
+    }
+    return true;
+  }
+
+  void StatReader::close() {
+    if (this->seg_) {
+      ::munmap(const_cast<StatSegment *>(this->seg_), sizeof(StatSegment));
+      this->seg_ = NULL;
+    }
+    if (this->fd_ >= 0) {
+      ::close(this->fd_);
+      this->fd_ = -1;
+    }
+  }
+
+  bool StatReader::read(StatSegment *out) const {
+    if (this->seg_ == NULL) {
+      return false;
+    }
+
+    // an update takes a few micro seconds, so retry for a while
+    for (int i = 0; i < 10000; i++) {
+      uint64_t s1 = __atomic_load_n(&this->seg_->seq_, __ATOMIC_ACQUIRE);
+      if (s1 & 1) {
+        continue;
+      }
+      ::memcpy(out, this->seg_, sizeof(StatSegment));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      uint64_t s2 = __atomic_load_n(&this->seg_->seq_, __ATOMIC_RELAXED);
+      if (s1 == s2) {
+        return true;
+      }
+    }
+    return false;
+  }
+}  // namespace swarm
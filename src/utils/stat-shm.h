@@ -0,0 +1,143 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_UTILS_STAT_SHM_H__
+#define SRC_UTILS_STAT_SHM_H__
+
+#include <stdint.h>
+#include <string>
+#include "../common.h"
+#include "../timer.h"
+
+namespace swarm {
+  class NetDec;
+  class NetCap;
+
+  // ----------------------------------------------------------------
+  // Live statistics in a POSIX shared memory segment ("/swarm-NAME").
+  // StatPublisher is a Task of the capture thread; each exec() copies
+  // counters of NetDec, NetCap and decoders into the segment under a
+  // sequence lock, so the packet path has no system call or lock for it
+  // and readers never block the writer. StatReader attaches read-only,
+  // see apps/swarm-top.cc.
+  //
+  // The layout is fixed size. STAT_VERSION is raised when it changes and
+  // a reader rejects a segment of another version.
+  //
+  const uint32_t STAT_VERSION = 1;
+
+  struct StatSegment {
+    static const size_t DEC_MAX = 128;
+    static const size_t HDLR_MAX = 64;
+    static const size_t NAME_LEN = 48;
+
+    struct Dec {
+      char name_[NAME_LEN];
+      uint64_t count_;     // calls of the decoder
+      uint64_t cost_ns_;   // nsec per call, if profiled
+      uint64_t session_;   // entries of session table
+      uint8_t shed_;
+      uint8_t reserved_[7];
+    };
+    struct Hdlr {
+      char ev_[NAME_LEN];  // event name or glob pattern
+      uint64_t id_;
+      uint64_t calls_;
+      uint64_t cost_ns_;   // nsec per call, if profiled
+    };
+
+    char magic_[8];
+    uint32_t version_;
+    uint32_t size_;        // sizeof(StatSegment)
+    uint64_t seq_;         // odd while writing
+    uint64_t pid_;
+    uint64_t start_ns_;    // wall clock, nano second
+    uint64_t update_ns_;
+
+    // NetDec
+    uint64_t recv_pkt_;
+    uint64_t recv_len_;
+    uint64_t cap_len_;
+    uint64_t last_ts_ns_;  // packet time
+    uint64_t filter_reject_;
+    uint64_t sample_drop_;
+    uint64_t shed_count_;
+    uint64_t chksum_fail_;
+    uint64_t swap_count_;
+
+    // NetCap, cap_valid_ is 0 if the backend can not drop
+    uint64_t cap_recv_;
+    uint64_t cap_drop_;
+    uint32_t cap_valid_;
+
+    uint32_t dec_size_;
+    uint32_t hdlr_size_;
+    uint32_t reserved_;
+    Dec dec_[DEC_MAX];
+    Hdlr hdlr_[HDLR_MAX];
+  };
+
+  class StatPublisher : public Task {
+  private:
+    std::string path_;
+    NetDec *nd_;
+    NetCap *nc_;
+    int fd_;
+    StatSegment *seg_;
+    std::string errmsg_;
+
+  public:
+    // name of the segment is "/swarm-" + name. Call
+    // NetCap::set_periodic_task () or NetDec::set_repeat_timer () with
+    // this to update it. NetDec::set_profile () enables costs.
+    StatPublisher(const std::string &name, NetDec *nd, NetCap *nc = NULL);
+    ~StatPublisher();  // unlinks the segment
+    bool ready() const { return (this->seg_ != NULL); }
+    const std::string &errmsg() const { return this->errmsg_; }
+    void update();
+    void exec(const struct timespec &tv);
+  };
+
+  class StatReader {
+  private:
+    int fd_;
+    const StatSegment *seg_;
+    std::string errmsg_;
+
+  public:
+    StatReader();
+    ~StatReader();
+    bool open(const std::string &name);
+    void close();
+    // consistent copy of the segment, false if the writer does not
+    // finish an update in time. Data stays after the writer exits, see
+    // pid_ for liveness.
+    bool read(StatSegment *out) const;
+    const std::string &errmsg() const { return this->errmsg_; }
+  };
+}  // namespace swarm
+
+#endif  // SRC_UTILS_STAT_SHM_H__
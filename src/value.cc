@@ -99,6 +99,14 @@ namespace swarm {
     this->len_ = len;
   }
 
+  void Value::restore (byte_t *ptr, size_t len, const std::string *text) {
+    if (ptr) {
+      this->set (ptr, len);
+    } else {
+      this->init ();
+    }
+  }
+
   byte_t *Value::ptr (size_t *len) const {
     if (len) {
       *len = this->len_;
@@ -109,6 +117,14 @@ namespace swarm {
   std::string Value::repr() const {
     return this->str();
   }
+  bool Value::text(std::string *s) const {
+    if (this->ptr_) {
+      s->assign(reinterpret_cast<char *> (this->ptr_), this->len_);
+      return true;
+    } else {
+      return false;
+    }
+  }
   std::string Value::str() const {
     if (this->ptr_) {
       std::string v(reinterpret_cast<char *> (this->ptr_), this->len_);
@@ -223,6 +239,11 @@ namespace swarm {
   std::string ValueMAC::repr() const {
     return this->mac();
   }
+  std::string ValueIPAddr::repr() const {
+    size_t len;
+    this->ptr(&len);
+    return (len == 16) ? this->ip6() : this->ip4();
+  }
   std::string ValueNum::repr () const {
     std::stringstream ss;
     ss << this->uint64();
@@ -50,13 +50,16 @@ namespace swarm {
     static const std::string null_;
 
     Value ();
-    ~Value ();
+    virtual ~Value ();
     void init ();
     void set (byte_t *ptr, size_t len);
     void copy (byte_t *ptr, size_t len);
     byte_t *ptr (size_t *len=NULL) const;
     
     virtual std::string repr() const;
+    // Text form written into caller's buffer (keeps its capacity, so bulk
+    // exporters avoid a new string per value). Returns false if null.
+    virtual bool text(std::string *s) const;
     std::string str() const;
     std::string hex() const;
     std::string ip4() const;
@@ -98,6 +101,14 @@ namespace swarm {
     uint64_t uint64() const;
 
     virtual bool is_null() const { return (this->ptr_ == NULL); }
+
+    // Used by DecodeLog. A value whose text form needs the rest of the
+    // packet (e.g. DNS name compression) is contextual; its text is
+    // saved with the bytes and given back to restore(). NULL text means
+    // text() failed. ptr is valid while the packet is processed.
+    virtual bool contextual() const { return false; }
+    virtual void restore(byte_t *ptr, size_t len, const std::string *text);
+
     bool operator==(const Value &v) const {
       return (this->len_ == v.len_ && 
               0 == ::memcmp(this->ptr_, v.ptr_, this->len_));
@@ -185,6 +196,7 @@ namespace swarm {
   DEF_REPR_CLASS (ValueIPv6, FacIPv6);
   DEF_REPR_CLASS (ValueMAC,  FacMAC);
   DEF_REPR_CLASS (ValueNum,  FacNum);
+  DEF_REPR_CLASS (ValueIPAddr, FacIPAddr);  // IPv4 or IPv6 by length
 
 
 }  // namespace swarm
@@ -0,0 +1,131 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <pcap.h>
+#include <string>
+#include "../src/swarm.h"
+#include "../src/bpf.h"
+
+namespace {
+  class Counter : public swarm::Handler {
+  public:
+    int c_;
+    Counter () : c_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &prop) { this->c_++; }
+  };
+
+  // "ip and udp and port 53" for Ethernet, same as tcpdump -d output
+  const struct bpf_insn UDP53[] = {
+    { 0x28, 0,  0, 0x0000000c },  // ldh [12]
+    { 0x15, 0, 10, 0x00000800 },  // jeq #0x800
+    { 0x30, 0,  0, 0x00000017 },  // ldb [23]
+    { 0x15, 0,  8, 0x00000011 },  // jeq #17
+    { 0x28, 0,  0, 0x00000014 },  // ldh [20]
+    { 0x45, 6,  0, 0x00001fff },  // jset #0x1fff
+    { 0xb1, 0,  0, 0x0000000e },  // ldxb 4*([14]&0xf)
+    { 0x48, 0,  0, 0x0000000e },  // ldh [x + 14]
+    { 0x15, 2,  0, 0x00000035 },  // jeq #53
+    { 0x48, 0,  0, 0x00000010 },  // ldh [x + 16]
+    { 0x15, 0,  1, 0x00000035 },  // jeq #53
+    { 0x06, 0,  0, 0x0000ffff },  // ret #65535
+    { 0x06, 0,  0, 0x00000000 },  // ret #0
+  };
+}
+
+TEST (BpfFilter, program) {
+  swarm::BpfFilter f;
+  swarm::byte_t pkt[64] = {0};
+
+  // ld len; add #1; tax; txa; ret a
+  const struct bpf_insn len_prog[] = {
+    { 0x80, 0, 0, 0 }, { 0x04, 0, 0, 1 }, { 0x07, 0, 0, 0 },
+    { 0x87, 0, 0, 0 }, { 0x16, 0, 0, 0 },
+  };
+  ASSERT_TRUE (f.load (len_prog, 5));
+  EXPECT_EQ (101U, f.run (pkt, 100, sizeof(pkt)));
+
+  // st M[3]; ld #0; ld M[3]; ret a
+  const struct bpf_insn mem_prog[] = {
+    { 0x00, 0, 0, 7 }, { 0x02, 0, 0, 3 }, { 0x00, 0, 0, 0 },
+    { 0x60, 0, 0, 3 }, { 0x16, 0, 0, 0 },
+  };
+  ASSERT_TRUE (f.load (mem_prog, 5));
+  EXPECT_EQ (7U, f.run (pkt, sizeof(pkt), sizeof(pkt)));
+
+  // out of captured data rejects
+  const struct bpf_insn oob_prog[] = {
+    { 0x20, 0, 0, 62 }, { 0x06, 0, 0, 1 },
+  };
+  ASSERT_TRUE (f.load (oob_prog, 2));
+  EXPECT_EQ (0U, f.run (pkt, sizeof(pkt), sizeof(pkt)));
+  EXPECT_EQ (1U, f.run (pkt, sizeof(pkt) + 2, sizeof(pkt) + 2));
+}
+
+TEST (BpfFilter, validate) {
+  swarm::BpfFilter f;
+  const struct bpf_insn no_ret[] = { { 0x00, 0, 0, 1 } };
+  const struct bpf_insn bad_jmp[] = { { 0x15, 2, 0, 1 }, { 0x06, 0, 0, 1 } };
+  const struct bpf_insn bad_ja[] = { { 0x05, 0, 0, 1 }, { 0x06, 0, 0, 1 } };
+  const struct bpf_insn bad_div[] = { { 0x34, 0, 0, 0 }, { 0x06, 0, 0, 1 } };
+  const struct bpf_insn bad_mem[] = { { 0x02, 0, 0, 16 }, { 0x06, 0, 0, 1 } };
+
+  EXPECT_FALSE (f.load (no_ret, 1));
+  EXPECT_FALSE (f.load (bad_jmp, 2));
+  EXPECT_FALSE (f.load (bad_ja, 2));
+  EXPECT_FALSE (f.load (bad_div, 2));
+  EXPECT_FALSE (f.load (bad_mem, 2));
+  EXPECT_FALSE (f.load (NULL, 0));
+  EXPECT_FALSE (f.compile ("this is not a filter", DLT_EN10MB));
+  EXPECT_NE ("", f.errmsg ());
+  EXPECT_EQ (0U, f.size ());
+}
+
+TEST (BpfFilter, netdec) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  Counter *eth = new Counter (), *dns = new Counter ();
+  nd->set_handler ("ether.packet", eth);
+  nd->set_handler ("dns.packet", dns);
+  ASSERT_TRUE (nd->set_filter (UDP53, sizeof(UDP53) / sizeof(UDP53[0])));
+
+  swarm::CapPcapMmap *cap = new swarm::CapPcapMmap ("./data/SkypeIRC.cap");
+  cap->bind_netdec (nd);
+  ASSERT_TRUE (cap->start ());
+  delete cap;
+
+  // rejected packets are not decoded at all
+  EXPECT_EQ (2263U, nd->recv_pkt ());
+  EXPECT_EQ (2263U, nd->filter_accept () + nd->filter_reject ());
+  EXPECT_EQ (707U, nd->filter_accept ());
+  EXPECT_EQ (707, eth->c_);
+  EXPECT_EQ (707, dns->c_);
+
+  EXPECT_FALSE (nd->set_filter ("this is not a filter"));
+  EXPECT_EQ (707U, nd->filter_accept ());
+  EXPECT_TRUE (nd->set_filter (""));
+  EXPECT_EQ (0U, nd->filter_accept ());
+  delete nd;
+}
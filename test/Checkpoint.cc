@@ -0,0 +1,208 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include <string>
+
+#include "./gtest.h"
+#include "../src/swarm.h"
+#include "../src/utils/ipfix.h"
+
+namespace checkpoint_test {
+  // count TCP packets given segment data by tcp_ssn
+  class SegCounter : public swarm::Handler {
+  public:
+    int count_;
+    SegCounter() : count_(0) {}
+    void recv(swarm::ev_id eid, const swarm::Property &p) {
+      if (!p.value("tcp_ssn.segment").is_null()) {
+        this->count_++;
+      }
+    }
+  };
+
+  std::string tmp_path(const char *name) {
+    std::stringstream ss;
+    ss << "/tmp/swarm-test-" << ::getpid() << "-" << name;
+    return ss.str();
+  }
+
+  // feed packets [begin, end) of SkypeIRC.cap
+  void feed(swarm::NetDec *nd, size_t begin, size_t end) {
+    swarm::PcapReader pcap("./data/SkypeIRC.cap");
+    ASSERT_TRUE(pcap.ready());
+    swarm::PcapReader::Record rec;
+    for (size_t i = 0; i < end && pcap.next(&rec) > 0; i++) {
+      if (i >= begin) {
+        nd->input(rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+      }
+    }
+  }
+
+  struct TestRec {
+    uint64_t a_;
+    uint32_t b_, c_;
+  };
+
+  TEST(Checkpoint, file) {
+    const std::string path = tmp_path("file");
+    swarm::CheckpointWriter w;
+    ASSERT_TRUE(w.open(path)) << w.errmsg();
+    EXPECT_FALSE(w.begin("odd", 1, 12));  // not multiple of 8
+    ASSERT_TRUE(w.begin("test", 2, sizeof(TestRec)));
+    for (uint32_t i = 0; i < 100; i++) {
+      TestRec r = {i, i * 2, i * 3};
+      ASSERT_TRUE(w.append(&r));
+    }
+    ASSERT_TRUE(w.begin("empty", 1, sizeof(TestRec)));
+    ASSERT_TRUE(w.close()) << w.errmsg();
+    EXPECT_EQ(0, ::access(path.c_str(), F_OK));
+    EXPECT_NE(0, ::access((path + ".tmp").c_str(), F_OK));
+
+    swarm::CheckpointReader r;
+    ASSERT_TRUE(r.open(path)) << r.errmsg();
+    EXPECT_LT(0U, r.saved_ns());
+    size_t count;
+    const TestRec *rec = static_cast<const TestRec *>
+      (r.section("test", 2, sizeof(TestRec), &count));
+    ASSERT_TRUE(rec != NULL);
+    ASSERT_EQ(100U, count);
+    EXPECT_EQ(99U, rec[99].a_);
+    EXPECT_EQ(198U, rec[99].b_);
+    EXPECT_EQ(297U, rec[99].c_);
+
+    EXPECT_TRUE(NULL != r.section("empty", 1, sizeof(TestRec), &count));
+    EXPECT_EQ(0U, count);
+    // another layout and unknown section
+    EXPECT_TRUE(NULL == r.section("test", 1, sizeof(TestRec), &count));
+    EXPECT_TRUE(NULL == r.section("test", 2, 8, &count));
+    EXPECT_TRUE(NULL == r.section("none", 1, sizeof(TestRec), &count));
+    EXPECT_EQ(0U, count);
+    r.close();
+
+    // not a checkpoint
+    EXPECT_FALSE(r.open("./data/SkypeIRC.cap"));
+    EXPECT_FALSE(r.open(tmp_path("not-exist")));
+    ::unlink(path.c_str());
+  }
+
+  TEST(Checkpoint, tcp_ssn) {
+    const size_t split = 1000, total = 2263;
+    const std::string path = tmp_path("tcp_ssn");
+
+    // without restart
+    swarm::NetDec *nd = new swarm::NetDec();
+    SegCounter *full = new SegCounter();
+    feed(nd, 0, split);
+    nd->set_handler("tcp.packet", full);
+    feed(nd, split, total);
+    EXPECT_LT(0, full->count_);
+    delete nd;
+
+    // stop at split and save
+    nd = new swarm::NetDec();
+    feed(nd, 0, split);
+    swarm::dec_id ssn_id = nd->lookup_dec_id("tcp_ssn");
+    size_t ssn_count = nd->session_count(ssn_id);
+    EXPECT_LT(0U, ssn_count);
+    ASSERT_TRUE(nd->save_checkpoint(path)) << nd->errmsg();
+    delete nd;
+
+    // restart without checkpoint loses segments of mid-stream sessions
+    nd = new swarm::NetDec();
+    SegCounter *lost = new SegCounter();
+    nd->set_handler("tcp.packet", lost);
+    feed(nd, split, total);
+    EXPECT_GT(full->count_, lost->count_);
+    delete nd;
+
+    // restart with checkpoint
+    nd = new swarm::NetDec();
+    ASSERT_TRUE(nd->load_checkpoint(path)) << nd->errmsg();
+    EXPECT_EQ(ssn_count, nd->session_count(ssn_id));
+    SegCounter *resumed = new SegCounter();
+    nd->set_handler("tcp.packet", resumed);
+    feed(nd, split, total);
+    EXPECT_EQ(full->count_, resumed->count_);
+    delete nd;
+
+    // tables are keyed by another hash
+    nd = new swarm::NetDec();
+    swarm::FlowHashCrc32c crc;
+    ASSERT_TRUE(nd->set_flow_hash(&crc));
+    EXPECT_FALSE(nd->load_checkpoint(path));
+    EXPECT_EQ(0U, nd->session_count(ssn_id));
+    delete nd;
+
+    delete full;
+    delete lost;
+    delete resumed;
+    ::unlink(path.c_str());
+  }
+
+  TEST(Checkpoint, ipfix) {
+    const std::string path = tmp_path("ipfix");
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::IpfixExporter *ex = new swarm::IpfixExporter();
+    nd->set_handler("ipv4.packet", ex);
+    feed(nd, 0, 1000);
+    size_t flows = ex->flow_count();
+    uint64_t exported = ex->exported_records();  // by idle timeout
+    EXPECT_LT(0U, flows);
+
+    swarm::CheckpointWriter w;
+    ASSERT_TRUE(w.open(path));
+    ASSERT_TRUE(nd->save_checkpoint(&w)) << nd->errmsg();
+    ASSERT_TRUE(ex->checkpoint(&w)) << w.errmsg();
+    ASSERT_TRUE(w.close());
+    // a checkpoint does not touch the live cache
+    EXPECT_EQ(flows, ex->flow_count());
+    // stopping: saved flows are left to the next process, not exported
+    ex->clear();
+    EXPECT_EQ(0U, ex->flow_count());
+    ex->flush();
+    EXPECT_EQ(exported, ex->exported_records());
+    delete nd;
+    delete ex;
+
+    nd = new swarm::NetDec();
+    ex = new swarm::IpfixExporter();
+    swarm::CheckpointReader r;
+    ASSERT_TRUE(r.open(path));
+    ASSERT_TRUE(nd->load_checkpoint(r)) << nd->errmsg();
+    ASSERT_TRUE(ex->restore(r)) << ex->errmsg();
+    EXPECT_EQ(flows, ex->flow_count());
+    // restored twice, flows are not duplicated
+    ASSERT_TRUE(ex->restore(r));
+    EXPECT_EQ(flows, ex->flow_count());
+    delete nd;
+    delete ex;
+    ::unlink(path.c_str());
+  }
+}  // namespace checkpoint_test
@@ -0,0 +1,203 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include "../src/swarm.h"
+
+namespace {
+  // straightforward RFC 1071 sum of big endian 16 bit words
+  uint32_t ref_sum (const swarm::byte_t *p, size_t len, uint32_t sum = 0) {
+    for (size_t i = 0; i + 1 < len; i += 2) {
+      sum += (p[i] << 8) | p[i + 1];
+    }
+    if (len & 1) {
+      sum += p[len - 1] << 8;
+    }
+    return sum;
+  }
+  uint16_t ref_chksum (uint32_t sum) {
+    while (sum >> 16) {
+      sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons (static_cast<uint16_t> (~sum));
+  }
+
+  class ChksumHandler : public swarm::Handler {
+  public:
+    std::string key_;
+    size_t ok_, bad_, none_;
+    explicit ChksumHandler (const std::string &key) :
+      key_(key), ok_(0), bad_(0), none_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &p) {
+      const swarm::Value &v = p.value (this->key_);
+      if (v.is_null ()) {
+        this->none_++;
+      } else if (v.uint32 () == 1) {
+        this->ok_++;
+      } else {
+        this->bad_++;
+      }
+    }
+  };
+
+  class Counter : public swarm::Handler {
+  public:
+    size_t count_;
+    Counter () : count_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &p) {
+      this->count_++;
+    }
+  };
+
+  // ether + IPv6 + UDP (port 53) with payload, checksum filled
+  std::vector<swarm::byte_t> ipv6_udp (size_t pl_len) {
+    std::vector<swarm::byte_t> pkt (14 + 40 + 8 + pl_len, 0);
+    swarm::byte_t *eth = &pkt[0], *ip6 = eth + 14, *udp = ip6 + 40;
+    eth[12] = 0x86;
+    eth[13] = 0xdd;
+    ip6[0] = 0x60;
+    ip6[4] = static_cast<swarm::byte_t> ((8 + pl_len) >> 8);
+    ip6[5] = static_cast<swarm::byte_t> (8 + pl_len);
+    ip6[6] = 17;
+    ip6[7] = 64;
+    for (size_t i = 0; i < 32; i++) {
+      ip6[8 + i] = static_cast<swarm::byte_t> (i * 7 + 1);
+    }
+    udp[0] = 0x30;
+    udp[1] = 0x39;
+    udp[3] = 53;
+    udp[4] = ip6[4];
+    udp[5] = ip6[5];
+    for (size_t i = 0; i < pl_len; i++) {
+      udp[8 + i] = static_cast<swarm::byte_t> (i * 13);
+    }
+
+    uint32_t sum = ref_sum (ip6 + 8, 32);
+    sum += 17 + 8 + pl_len;
+    sum = ref_sum (udp, 8 + pl_len, sum);
+    uint16_t c = ref_chksum (sum);
+    ::memcpy (udp + 6, &c, sizeof (c));
+    return pkt;
+  }
+}
+
+TEST (Checksum, rfc1071) {
+  // example of RFC 1071 section 3
+  const swarm::byte_t d[] = {0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7};
+  uint16_t c = ~swarm::Checksum::fold (swarm::Checksum::add (d, sizeof (d)));
+  EXPECT_EQ (0x220d, ntohs (c));
+  EXPECT_EQ (ref_chksum (ref_sum (d, sizeof (d))), c);
+}
+
+TEST (Checksum, vector_vs_scalar) {
+  std::vector<swarm::byte_t> buf (2048 + 8);
+  srand (1);
+  for (size_t i = 0; i < buf.size (); i++) {
+    buf[i] = static_cast<swarm::byte_t> (rand ());
+  }
+
+  // every length around vector widths and unaligned heads
+  for (size_t off = 0; off < 4; off++) {
+    for (size_t len = 0; len <= 2048; len += (len < 130 ? 1 : 61)) {
+      const swarm::byte_t *p = &buf[off];
+      uint64_t v = swarm::Checksum::add (p, len, 7);
+      uint64_t s = swarm::Checksum::add_scalar (p, len, 7);
+      EXPECT_EQ (swarm::Checksum::fold (s), swarm::Checksum::fold (v))
+        << swarm::Checksum::impl () << " off=" << off << " len=" << len;
+      uint16_t c = ~swarm::Checksum::fold (v - 7);
+      ASSERT_EQ (ref_chksum (ref_sum (p, len)), c) << len;
+    }
+  }
+}
+
+TEST (Checksum, SkypeIRC) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  nd->set_checksum (true);
+  ChksumHandler ip ("ipv4.chksum_ok"), udp ("udp.chksum_ok"),
+    tcp ("tcp.chksum_ok");
+  nd->set_handler ("ipv4.packet", &ip);
+  nd->set_handler ("udp.packet", &udp);
+  nd->set_handler ("tcp.packet", &tcp);
+  Counter dns;
+  nd->set_handler ("dns.packet", &dns);
+
+  swarm::CapPcapMmap *cap = new swarm::CapPcapMmap ("./data/SkypeIRC.cap");
+  cap->bind_netdec (nd);
+  ASSERT_TRUE (cap->start ());
+  delete cap;
+
+  EXPECT_EQ (2247U, ip.ok_ + ip.bad_);
+  EXPECT_EQ (0U, ip.none_);
+  EXPECT_EQ (0U, udp.none_);
+  EXPECT_EQ (0U, tcp.none_);
+  EXPECT_EQ (ip.ok_ + udp.ok_ + tcp.ok_, nd->checksum_pass ());
+  EXPECT_EQ (ip.bad_ + udp.bad_ + tcp.bad_, nd->checksum_fail ());
+  // all of failed ones are sent by the capturing host (192.168.1.2)
+  // with checksum offload; the numbers are checked by Wireshark
+  EXPECT_EQ (2247U, ip.ok_);
+  EXPECT_EQ (555U, udp.ok_);
+  EXPECT_EQ (517U, udp.bad_);
+  EXPECT_EQ (989U, tcp.ok_);
+  EXPECT_EQ (161U, tcp.bad_);
+  EXPECT_EQ (353U, dns.count_);  // queries of the host are dropped
+  delete nd;
+}
+
+TEST (Checksum, ipv6_udp) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  ChksumHandler udp ("udp.chksum_ok");
+  nd->set_handler ("udp.packet", &udp);
+  Counter dns;
+  nd->set_handler ("dns.packet", &dns);
+
+  // not verified unless enabled
+  std::vector<swarm::byte_t> pkt = ipv6_udp (33);
+  ASSERT_TRUE (nd->input (&pkt[0], pkt.size (), 1000, pkt.size ()));
+  EXPECT_EQ (1U, udp.none_);
+
+  nd->set_checksum (true);
+  ASSERT_TRUE (nd->input (&pkt[0], pkt.size (), 2000, pkt.size ()));
+  EXPECT_EQ (1U, udp.ok_);
+  size_t dns_count = dns.count_;
+
+  // broken payload is not passed to DNS decoder
+  pkt[pkt.size () - 1] ^= 0x5a;
+  ASSERT_TRUE (nd->input (&pkt[0], pkt.size (), 3000, pkt.size ()));
+  EXPECT_EQ (1U, udp.bad_);
+  EXPECT_EQ (dns_count, dns.count_);
+  EXPECT_EQ (1U, nd->checksum_fail ());
+
+  // truncated capture can not be verified
+  pkt = ipv6_udp (64);
+  ASSERT_TRUE (nd->input (&pkt[0], pkt.size (), 4000, pkt.size () - 10));
+  EXPECT_EQ (2U, udp.none_);
+  delete nd;
+}
@@ -0,0 +1,205 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "./gtest.h"
+#include "../src/swarm.h"
+#include "../src/utils/columnar.h"
+
+namespace columnar_test {
+  class EvCounter : public swarm::Handler {
+  public:
+    int count_;
+    EvCounter() : count_(0) {}
+    void recv(swarm::ev_id eid, const swarm::Property &p) { this->count_++; }
+  };
+
+  // values of the exported columns by event, to check the record batch
+  class RowRecorder : public swarm::Handler {
+  public:
+    std::vector<uint64_t> usec_;
+    std::vector<std::string> src_;  // empty if null
+    std::vector<int> dst_port_;     // -1 if null
+    void recv(swarm::ev_id eid, const swarm::Property &p) {
+      size_t len;
+      const swarm::byte_t *src = p.value("ipv4.src").ptr(&len);
+      const swarm::Value &port = p.value("udp.dst_port");
+      this->usec_.push_back(p.ts_ns() / 1000);
+      this->src_.push_back(src ? std::string(reinterpret_cast<const char*>
+                                             (src), len) : "");
+      this->dst_port_.push_back(port.is_null() ?
+                                -1 : port.ntoh<uint16_t>());
+    }
+  };
+
+  static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+  }
+  static uint64_t get64(const uint8_t *p) {
+    return get32(p) | (static_cast<uint64_t>(get32(p + 4)) << 32);
+  }
+
+  // field of a flatbuffer table, NULL if absent
+  static const uint8_t *fb_field(const uint8_t *tbl, int id) {
+    const uint8_t *vt = tbl - static_cast<int32_t>(get32(tbl));
+    const size_t vt_len = vt[0] | (vt[1] << 8);
+    if (4 + id * 2U >= vt_len) {
+      return NULL;
+    }
+    const uint16_t off = vt[4 + id * 2] | (vt[5 + id * 2] << 8);
+    return off ? tbl + off : NULL;
+  }
+
+  // check rows of the first record batch against rec. Buffers of column c
+  // are validity (2c) and data (2c + 1), columns are timestamp, ipv4.src
+  // and udp.dst_port
+  static void check_batch(const uint8_t *rb, const uint8_t *body,
+                          const RowRecorder &rec) {
+    const uint64_t rows = get64(fb_field(rb, 0));
+    ASSERT_LT(0U, rows);
+    ASSERT_GE(rec.usec_.size(), rows);
+    const uint8_t *bf = fb_field(rb, 2);
+    const uint8_t *bufs = bf + get32(bf) + 4;  // {offset, length}
+    const uint8_t *ts = body + get64(bufs + 16 * 1);
+    const uint8_t *src_valid = body + get64(bufs + 16 * 2);
+    const uint64_t src_valid_len = get64(bufs + 16 * 2 + 8);
+    const uint8_t *src = body + get64(bufs + 16 * 3);
+    const uint8_t *port_valid = body + get64(bufs + 16 * 4);
+    const uint64_t port_valid_len = get64(bufs + 16 * 4 + 8);
+    const uint8_t *port = body + get64(bufs + 16 * 5);
+
+    for (size_t r = 0; r < rows; r++) {
+      EXPECT_EQ(rec.usec_[r], get64(ts + r * 8)) << r;
+      bool valid = (src_valid_len == 0 || (src_valid[r / 8] >> (r % 8)) & 1);
+      EXPECT_EQ(!rec.src_[r].empty(), valid) << r;
+      if (valid) {
+        EXPECT_EQ(rec.src_[r],
+                  std::string(reinterpret_cast<const char*>(src + r * 4),
+                              4)) << r;
+      }
+      valid = (port_valid_len == 0 || (port_valid[r / 8] >> (r % 8)) & 1);
+      EXPECT_EQ(rec.dst_port_[r] >= 0, valid) << r;
+      if (valid) {
+        EXPECT_EQ(rec.dst_port_[r], port[r * 2] | (port[r * 2 + 1] << 8))
+          << r;
+      }
+    }
+  }
+
+  TEST(ColumnarExporter, arrow_file) {
+    char fname[] = "/tmp/swarm_columnar_XXXXXX";
+    int tmp_fd = ::mkstemp(fname);
+    ASSERT_LE(0, tmp_fd);
+    ::close(tmp_fd);
+
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::ColumnarExporter *ce = new swarm::ColumnarExporter(nd, 100);
+    EvCounter *dns = new EvCounter();
+    RowRecorder *rec = new RowRecorder();
+
+    EXPECT_FALSE(ce->add_column("no.such.value"));
+    EXPECT_FALSE(ce->add_column("ipv4.src:float"));
+    ASSERT_TRUE(ce->add_column("ipv4.src:ipv4"));
+    ASSERT_TRUE(ce->add_column("udp.dst_port:u16"));
+    ASSERT_TRUE(ce->add_column("dns.qd_name"));
+    ASSERT_TRUE(ce->add_column("dns.an_data", swarm::ColumnarExporter::STRING));
+    EXPECT_EQ(5U, ce->column_size());  // including timestamp
+
+    ASSERT_TRUE(ce->open(fname));
+    nd->set_handler("dns.packet", ce);
+    nd->set_handler("dns.packet", dns);
+    nd->set_handler("dns.packet", rec);
+
+    swarm::CapPcapFile *cap = new swarm::CapPcapFile("./data/SkypeIRC.cap");
+    cap->bind_netdec(nd);
+    ASSERT_TRUE(cap->start());
+    EXPECT_EQ(static_cast<uint64_t>(dns->count_), ce->rows());
+    ASSERT_TRUE(ce->close());
+    EXPECT_EQ(static_cast<uint64_t>((dns->count_ + 99) / 100), ce->batches());
+
+    FILE *fp = ::fopen(fname, "rb");
+    ASSERT_TRUE(fp != NULL);
+    std::vector<uint8_t> data;
+    uint8_t chunk[0x1000];
+    size_t rlen;
+    while (0 < (rlen = ::fread(chunk, 1, sizeof(chunk), fp))) {
+      data.insert(data.end(), chunk, chunk + rlen);
+    }
+    ::fclose(fp);
+    ::unlink(fname);
+
+    // "ARROW1" at both ends, footer length before the trailing magic
+    ASSERT_LT(16U, data.size());
+    EXPECT_EQ(0, ::memcmp(&data[0], "ARROW1\0\0", 8));
+    EXPECT_EQ(0, ::memcmp(&data[data.size() - 6], "ARROW1", 6));
+    uint32_t footer_len = get32(&data[data.size() - 10]);
+    EXPECT_GT(data.size(), footer_len + 10);
+    EXPECT_EQ(0U, footer_len % 8);
+
+    // walk encapsulated messages until end-of-stream marker
+    size_t ptr = 8, msgs = 0, checked = 0;
+    while (ptr + 8 <= data.size()) {
+      ASSERT_EQ(0xFFFFFFFF, get32(&data[ptr]));
+      uint32_t meta_len = get32(&data[ptr + 4]);
+      if (meta_len == 0) {
+        break;
+      }
+      EXPECT_EQ(0U, meta_len % 8);
+      // bodyLength is the last field of Message and 8 byte aligned; take
+      // it from the flatbuffer vtable
+      const uint8_t *fb = &data[ptr + 8];
+      const uint8_t *tbl = fb + get32(fb);
+      const uint8_t *vt = tbl - static_cast<int32_t>(get32(tbl));
+      uint16_t body_off = vt[10] | (vt[11] << 8);
+      ASSERT_NE(0, body_off);
+      uint64_t body_len = get32(tbl + body_off);
+      EXPECT_EQ(0U, body_len % 8);
+
+      // decoded values of the first record batch
+      const uint8_t *hdr_type = fb_field(tbl, 1);
+      if (hdr_type && *hdr_type == 3 && checked++ == 0) {
+        const uint8_t *hdr = fb_field(tbl, 2);
+        check_batch(hdr + get32(hdr), fb + meta_len, *rec);
+      }
+      ptr += 8 + meta_len + body_len;
+      msgs++;
+    }
+    // schema, 2 string dictionaries and deltas, record batches
+    EXPECT_LE(1 + 2 + ce->batches(), msgs);
+    EXPECT_EQ(ce->batches(), checked);
+    EXPECT_EQ(data.size() - 10 - footer_len - 8, ptr);
+
+    delete ce;
+    delete cap;
+    delete rec;
+  }
+}  // namespace columnar_test
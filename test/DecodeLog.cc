@@ -0,0 +1,164 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "../src/swarm.h"
+#include "../src/utils/decode-log.h"
+
+namespace {
+  // summary of handler callbacks to compare live decode with replay
+  class Summary : public swarm::Handler {
+  private:
+    swarm::NetDec *nd_;
+
+  public:
+    std::vector<std::string> log_;
+    std::vector<std::string> data_;
+    explicit Summary (swarm::NetDec *nd) : nd_(nd) {}
+    void recv (swarm::ev_id eid, const swarm::Property &p) {
+      std::string s = this->nd_->lookup_event_name (eid);
+      char buf[64];
+      snprintf (buf, sizeof (buf), " %llu %zu %llu ",
+                static_cast<unsigned long long> (p.ts_ns ()), p.len (),
+                static_cast<unsigned long long> (p.hash_value ()));
+      s += buf + p.src_addr () + ">" + p.dst_addr ();
+      const char *keys[] = {"dns.qd_name", "dns.an_name", "dns.an_data",
+                            "dns.an_type", "dns.tx_id"};
+      for (size_t k = 0; k < sizeof (keys) / sizeof (keys[0]); k++) {
+        for (size_t i = 0; i < p.value_size (keys[k]); i++) {
+          s += " " + p.value (keys[k], i).repr ();
+        }
+      }
+      this->log_.push_back (s);
+      if (p.raw_data ()) {
+        this->data_.push_back (
+            std::string (reinterpret_cast<const char*> (p.raw_data ()),
+                         p.cap_len ()));
+      }
+    }
+  };
+
+  void subscribe (swarm::NetDec *nd, Summary *sum) {
+    nd->set_handler ("ipv4.packet", sum);
+    nd->set_handler ("dns.packet", sum);
+    nd->set_handler ("dns.an", sum);
+  }
+
+  std::string tmp_path () {
+    char fname[] = "/tmp/swarm_declog_XXXXXX";
+    ::close (::mkstemp (fname));
+    return fname;
+  }
+
+  void golden (bool with_data) {
+    const std::string path = tmp_path ();
+
+    swarm::NetDec *nd = new swarm::NetDec ();
+    Summary live (nd);
+    subscribe (nd, &live);
+    swarm::DecodeLogWriter *w = new swarm::DecodeLogWriter (nd);
+    ASSERT_TRUE (w->open (path, with_data));
+    swarm::CapPcapMmap *cap = new swarm::CapPcapMmap ("./data/SkypeIRC.cap");
+    cap->bind_netdec (nd);
+    ASSERT_TRUE (cap->start ());
+    ASSERT_TRUE (w->close ());
+    EXPECT_EQ (2263U, w->pkt_count ());
+    delete cap;
+    delete w;
+    delete nd;
+
+    nd = new swarm::NetDec ();
+    Summary rep (nd);
+    subscribe (nd, &rep);
+    swarm::DecodeLogReplayer *r = new swarm::DecodeLogReplayer (nd);
+    ASSERT_TRUE (r->open (path)) << r->errmsg ();
+    ASSERT_TRUE (r->run ()) << r->errmsg ();
+    EXPECT_EQ (2263U, r->pkt_count ());
+    delete r;
+
+    EXPECT_EQ (2263U, nd->recv_pkt ());
+    ASSERT_EQ (live.log_.size (), rep.log_.size ());
+    for (size_t i = 0; i < live.log_.size (); i++) {
+      EXPECT_EQ (live.log_[i], rep.log_[i]);
+    }
+    if (with_data) {
+      EXPECT_TRUE (live.data_ == rep.data_);
+    } else {
+      EXPECT_EQ (0U, rep.data_.size ());
+    }
+    delete nd;
+    ::unlink (path.c_str ());
+  }
+}
+
+TEST (DecodeLog, golden) {
+  golden (false);
+}
+
+TEST (DecodeLog, with_data) {
+  golden (true);
+}
+
+TEST (DecodeLog, broken) {
+  const std::string path = tmp_path ();
+  FILE *fp = fopen (path.c_str (), "wb");
+  fputs ("not a log", fp);
+  fclose (fp);
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::DecodeLogReplayer *r = new swarm::DecodeLogReplayer (nd);
+  EXPECT_FALSE (r->open (path));
+  EXPECT_FALSE (r->run ());
+  delete r;
+  delete nd;
+  ::unlink (path.c_str ());
+}
+
+TEST (DecodeLog, broken_id) {
+  // a value definition with a huge id must fail, not grow the id map
+  const std::string path = tmp_path ();
+  const char log[] = {'S', 'W', 'D', 'L', 'O', 'G', 0, 1, 0,
+                      2,  // TAG_VALUE
+                      '\xff', '\xff', '\xff', '\xff', '\xff', '\xff',
+                      '\xff', '\x7f',  // id 2^56 - 1
+                      1, 'x'};
+  FILE *fp = fopen (path.c_str (), "wb");
+  fwrite (log, 1, sizeof (log), fp);
+  fclose (fp);
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::DecodeLogReplayer *r = new swarm::DecodeLogReplayer (nd);
+  ASSERT_TRUE (r->open (path)) << r->errmsg ();
+  EXPECT_FALSE (r->run ());
+  EXPECT_EQ ("broken decode log", r->errmsg ());
+  delete r;
+  delete nd;
+  ::unlink (path.c_str ());
+}
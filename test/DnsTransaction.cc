@@ -0,0 +1,205 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "./gtest.h"
+#include "../src/swarm.h"
+#include "../src/utils/dns-latency.h"
+
+namespace dns_tx_test {
+  class TxCounter : public swarm::Handler {
+  public:
+    swarm::ev_id ev_tx_;
+    int tx_, timeout_;
+    std::vector<std::string> timeout_name_;
+    std::string first_name_;
+    uint32_t first_latency_;
+
+    explicit TxCounter(swarm::NetDec *nd) : tx_(0), timeout_(0) {
+      this->ev_tx_ = nd->lookup_event_id("dns.transaction");
+    }
+    void recv(swarm::ev_id eid, const swarm::Property &p) {
+      if (eid == this->ev_tx_) {
+        if (this->tx_ == 0) {
+          this->first_name_ = p.value("dns_tx.name").str();
+          this->first_latency_ = p.value("dns_tx.latency").uint32();
+        }
+        this->tx_++;
+      } else {
+        this->timeout_++;
+        for (size_t i = 0; i < p.value_size("dns_tx.timeout_name"); i++) {
+          this->timeout_name_.push_back(p.value("dns_tx.timeout_name", i).str());
+        }
+      }
+    }
+  };
+
+  // Ethernet + IPv4 + UDP + DNS header with one question
+  static size_t build_dns(uint8_t *buf, uint16_t tx_id, bool resp,
+                          const char *label) {
+    static const uint8_t hdr[] = {
+      0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x00, 0x01, 0x02, 0x03, 0x04, 0x06,
+      0x08, 0x00,
+      0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+      10, 0, 0, 1,  10, 0, 0, 53,
+      0x30, 0x39, 0x00, 0x35, 0x00, 0x00, 0x00, 0x00,
+    };
+    size_t len = sizeof(hdr);
+    ::memcpy(buf, hdr, len);
+    if (resp) {
+      // swap address and port
+      ::memcpy(buf + 26, hdr + 30, 4);
+      ::memcpy(buf + 30, hdr + 26, 4);
+      ::memcpy(buf + 34, hdr + 36, 2);
+      ::memcpy(buf + 36, hdr + 34, 2);
+    }
+
+    const uint16_t dns[6] = {htons(tx_id), htons(resp ? 0x8183 : 0x0100),
+                             htons(1), 0, 0, 0};
+    ::memcpy(buf + len, dns, sizeof(dns));
+    len += sizeof(dns);
+    size_t l_len = ::strlen(label);
+    ::memcpy(buf + len, label, l_len + 1);
+    len += l_len + 1;
+    const uint16_t q[2] = {htons(1), htons(1)};
+    ::memcpy(buf + len, q, sizeof(q));
+    len += sizeof(q);
+
+    uint16_t ip_len = htons(static_cast<uint16_t>(len - 14));
+    uint16_t udp_len = htons(static_cast<uint16_t>(len - 34));
+    ::memcpy(buf + 16, &ip_len, 2);
+    ::memcpy(buf + 38, &udp_len, 2);
+    return len;
+  }
+
+  TEST(DnsTransaction, timeout) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    TxCounter *cnt = new TxCounter(nd);
+    swarm::DnsLatency *lat = new swarm::DnsLatency(nd);
+    nd->set_handler("dns.transaction", cnt);
+    nd->set_handler("dns.timeout", cnt);
+    nd->set_handler("dns.transaction", lat);
+    nd->set_handler("dns.timeout", lat);
+
+    uint8_t buf[256];
+    size_t len;
+    struct timeval tv = {1000, 0};
+
+    // query 1 answered after 2500 usec, query 2 never answered
+    len = build_dns(buf, 1, false, "\x01" "a" "\x07" "example");
+    ASSERT_TRUE(nd->input(buf, len, tv, len));
+    len = build_dns(buf, 2, false, "\x01" "b" "\x07" "example");
+    ASSERT_TRUE(nd->input(buf, len, tv, len));
+    tv.tv_usec = 2500;
+    len = build_dns(buf, 1, true, "\x01" "a" "\x07" "example");
+    ASSERT_TRUE(nd->input(buf, len, tv, len));
+
+    EXPECT_EQ(1, cnt->tx_);
+    EXPECT_EQ("a.example.", cnt->first_name_);
+    EXPECT_EQ(2500U, cnt->first_latency_);
+    EXPECT_EQ(0, cnt->timeout_);
+    // answered query 1 is gone from the table, query 2 is left
+    EXPECT_EQ(1U, nd->session_count(nd->lookup_dec_id("dns_tx")));
+
+    // a late response of query 1 must not match again
+    tv.tv_sec = 1001;
+    len = build_dns(buf, 1, true, "\x01" "a" "\x07" "example");
+    ASSERT_TRUE(nd->input(buf, len, tv, len));
+    EXPECT_EQ(1, cnt->tx_);
+
+    tv.tv_sec = 1010;
+    len = build_dns(buf, 3, false, "\x01" "c" "\x07" "example");
+    ASSERT_TRUE(nd->input(buf, len, tv, len));
+    EXPECT_EQ(1, cnt->timeout_);
+    ASSERT_EQ(1U, cnt->timeout_name_.size());
+    EXPECT_EQ("b.example.", cnt->timeout_name_[0]);
+
+    uint8_t server[4] = {10, 0, 0, 53};
+    const swarm::DnsLatency::Server *srv = lat->server(server, sizeof(server));
+    ASSERT_TRUE(srv != NULL);
+    EXPECT_EQ(1U, srv->hist_.count());
+    EXPECT_EQ(1U, srv->timeout_);
+    EXPECT_EQ(1U, srv->rcode_[3]);  // NXDOMAIN
+
+    delete cnt;
+    delete lat;
+    delete nd;
+  }
+
+  TEST(DnsTransaction, SkypeIRC) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    TxCounter *cnt = new TxCounter(nd);
+    swarm::DnsLatency *lat = new swarm::DnsLatency(nd);
+    nd->set_handler("dns.transaction", cnt);
+    nd->set_handler("dns.transaction", lat);
+
+    swarm::CapPcapFile *cap = new swarm::CapPcapFile("./data/SkypeIRC.cap");
+    cap->bind_netdec(nd);
+    ASSERT_TRUE(cap->start());
+
+    EXPECT_EQ(353, cnt->tx_);
+    EXPECT_EQ("2.1.168.192.in-addr.arpa.", cnt->first_name_);
+    EXPECT_EQ(34292U, cnt->first_latency_);
+
+    ASSERT_EQ(1U, lat->servers().size());
+    const swarm::LatencyHistogram &h = lat->servers().begin()->second.hist_;
+    EXPECT_EQ(353U, h.count());
+    EXPECT_LE(h.min(), h.quantile(0.5));
+    EXPECT_LE(h.quantile(0.5), h.quantile(0.99));
+    EXPECT_LE(h.quantile(0.99), h.max());
+
+    delete cap;
+    delete cnt;
+    delete lat;
+  }
+
+  TEST(LatencyHistogram, quantile) {
+    swarm::LatencyHistogram h;
+    EXPECT_EQ(0U, h.quantile(0.5));
+    for (uint32_t v = 1; v <= 100000; v++) {
+      h.add(v);
+    }
+    EXPECT_EQ(100000U, h.count());
+    EXPECT_EQ(1U, h.min());
+    EXPECT_EQ(100000U, h.max());
+    EXPECT_DOUBLE_EQ(50000.5, h.mean());
+
+    const double q[] = {0.01, 0.5, 0.9, 0.99};
+    for (size_t i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+      double real = q[i] * 100000;
+      EXPECT_LE(real * 0.875, h.quantile(q[i]));
+      EXPECT_GE(real * 1.125, h.quantile(q[i]));
+    }
+    EXPECT_EQ(100000U, h.quantile(1.0));
+
+    h.reset();
+    EXPECT_EQ(0U, h.count());
+  }
+}  // namespace dns_tx_test
@@ -0,0 +1,184 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <arpa/inet.h>
+#include <set>
+#include <string>
+#include "../src/swarm.h"
+
+namespace {
+  struct Tuple {
+    uint8_t addr_[2][16];
+    uint16_t port_[2];
+    size_t addr_len_;
+  };
+
+  Tuple tuple4 (const char *src, uint16_t sport, const char *dst,
+                uint16_t dport) {
+    Tuple t;
+    t.addr_len_ = 4;
+    inet_pton (AF_INET, src, t.addr_[0]);
+    inet_pton (AF_INET, dst, t.addr_[1]);
+    t.port_[0] = htons (sport);
+    t.port_[1] = htons (dport);
+    return t;
+  }
+  Tuple tuple6 (const char *src, uint16_t sport, const char *dst,
+                uint16_t dport) {
+    Tuple t;
+    t.addr_len_ = 16;
+    inet_pton (AF_INET6, src, t.addr_[0]);
+    inet_pton (AF_INET6, dst, t.addr_[1]);
+    t.port_[0] = htons (sport);
+    t.port_[1] = htons (dport);
+    return t;
+  }
+  uint64_t hash (const swarm::FlowHash &fh, const Tuple &t, bool port,
+                 bool rev = false) {
+    const int s = rev ? 1 : 0, d = rev ? 0 : 1;
+    return fh.hash (t.addr_[s], t.addr_[d], t.addr_len_,
+                    &(t.port_[s]), &(t.port_[d]), port ? 2 : 0,
+                    port ? 6 : 0);
+  }
+
+  class HashChecker : public swarm::Handler {
+  public:
+    const swarm::FlowHash *fh_;
+    size_t count_, mismatch_;
+    std::set<uint64_t> flow_;
+    explicit HashChecker (const swarm::FlowHash *fh) :
+      fh_(fh), count_(0), mismatch_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &p) {
+      size_t addr_len, port_len;
+      const void *sa = p.src_addr (&addr_len);
+      const void *da = p.dst_addr (&addr_len);
+      const void *sp = p.src_port (&port_len);
+      const void *dp = p.dst_port (&port_len);
+      uint64_t h = this->fh_->hash (sa, da, addr_len, sp, dp, port_len,
+                                    p.ip_proto ());
+      if (h != p.hash_value () ||
+          h != this->fh_->hash (da, sa, addr_len, dp, sp, port_len,
+                                p.ip_proto ())) {
+        this->mismatch_++;
+      }
+      this->flow_.insert (h);
+      this->count_++;
+    }
+  };
+
+  size_t count_flows (swarm::FlowHash *fh, const std::string &ev) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    swarm::FlowHashDefault def;
+    HashChecker chk (fh ? fh : &def);
+    if (fh) {
+      EXPECT_TRUE (nd->set_flow_hash (fh));
+    }
+    nd->set_handler (ev, &chk);
+
+    swarm::CapPcapMmap *cap = new swarm::CapPcapMmap ("./data/SkypeIRC.cap");
+    cap->bind_netdec (nd);
+    EXPECT_TRUE (cap->start ());
+    delete cap;
+    delete nd;
+
+    EXPECT_LT (0U, chk.count_);
+    EXPECT_EQ (0U, chk.mismatch_);
+    return chk.flow_.size ();
+  }
+}
+
+TEST (FlowHash, toeplitz_ms_vector) {
+  // verification suite of Microsoft RSS document
+  swarm::FlowHashToeplitz fh (swarm::FlowHashToeplitz::MS_KEY_);
+  EXPECT_FALSE (fh.symmetric ());
+
+  Tuple t = tuple4 ("66.9.149.187", 2794, "161.142.100.80", 1766);
+  EXPECT_EQ (0x323e8fc2U, hash (fh, t, false));
+  EXPECT_EQ (0x51ccc178U, hash (fh, t, true));
+  t = tuple4 ("199.92.111.2", 14230, "65.69.140.83", 4739);
+  EXPECT_EQ (0xd718262aU, hash (fh, t, false));
+  EXPECT_EQ (0xc626b0eaU, hash (fh, t, true));
+  t = tuple6 ("3ffe:2501:200:1fff::7", 2794, "3ffe:2501:200:3::1", 1766);
+  EXPECT_EQ (0x2cc18cd5U, hash (fh, t, false));
+  EXPECT_EQ (0x40207d3dU, hash (fh, t, true));
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  EXPECT_FALSE (nd->set_flow_hash (&fh));
+  EXPECT_TRUE (NULL == nd->flow_hash ());
+  delete nd;
+}
+
+TEST (FlowHash, symmetric) {
+  swarm::FlowHashToeplitz tp;
+  swarm::FlowHashCrc32c crc;
+  swarm::FlowHashDefault def;
+  EXPECT_TRUE (tp.symmetric ());
+
+  const swarm::FlowHash *fh[] = {&tp, &crc, &def};
+  Tuple t[] = {
+    tuple4 ("192.168.1.2", 1234, "10.0.0.1", 80),
+    tuple4 ("10.0.0.1", 53, "10.0.0.1", 5353),
+    tuple6 ("2001:db8::1", 443, "2001:db8::2:1", 50000),
+  };
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      EXPECT_EQ (hash (*fh[i], t[j], true), hash (*fh[i], t[j], true, true))
+        << fh[i]->name () << " " << j;
+      EXPECT_NE (hash (*fh[i], t[j], true), hash (*fh[i], t[(j + 1) % 3], true))
+        << fh[i]->name () << " " << j;
+    }
+  }
+}
+
+TEST (FlowHash, crc32c) {
+  EXPECT_EQ (0xe3069283, swarm::FlowHashCrc32c::crc32c ("123456789", 9));
+  EXPECT_EQ (0U, swarm::FlowHashCrc32c::crc32c ("", 0));
+}
+
+TEST (FlowHash, New) {
+  const char *name[] = {"default", "toeplitz", "crc32c"};
+  for (size_t i = 0; i < 3; i++) {
+    swarm::FlowHash *fh = swarm::FlowHash::New (name[i]);
+    ASSERT_TRUE (fh != NULL);
+    EXPECT_EQ (std::string (name[i]), fh->name ());
+    delete fh;
+  }
+  EXPECT_TRUE (NULL == swarm::FlowHash::New ("md5"));
+}
+
+TEST (FlowHash, netdec) {
+  // same number of flows as by the default hash, i.e. no collision
+  swarm::FlowHashToeplitz tp;
+  swarm::FlowHashCrc32c crc;
+  const char *ev[] = {"tcp.packet", "udp.packet"};
+  for (size_t i = 0; i < 2; i++) {
+    size_t flows = count_flows (NULL, ev[i]);
+    EXPECT_LT (0U, flows);
+    EXPECT_EQ (flows, count_flows (&tp, ev[i])) << ev[i];
+    EXPECT_EQ (flows, count_flows (&crc, ev[i])) << ev[i];
+  }
+}
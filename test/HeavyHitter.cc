@@ -0,0 +1,273 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "./gtest.h"
+#include "../src/swarm.h"
+#include "../src/utils/heavy-hitter.h"
+
+namespace heavy_hitter_test {
+  typedef std::map<std::string, uint64_t> CountMap;
+
+  std::string key_of(uint32_t n) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key-%u", n);
+    return buf;
+  }
+
+  // skewed stream: key-0 takes 10%, key-1 .. key-9 take 30% and the
+  // rest is spread over `keys` light keys
+  void gen_stream(std::vector<std::string> *stream, CountMap *truth,
+                  size_t keys, size_t n, unsigned int seed) {
+    for (size_t i = 0; i < n; i++) {
+      uint32_t r = rand_r(&seed) % 100, k;
+      if (r < 10) {
+        k = 0;
+      } else if (r < 40) {
+        k = 1 + rand_r(&seed) % 9;
+      } else {
+        k = 10 + rand_r(&seed) % keys;
+      }
+      stream->push_back(key_of(k));
+      (*truth)[stream->back()]++;
+    }
+  }
+
+  void check_bounds(const swarm::HitterSketch &hs, const CountMap &truth,
+                    uint64_t total, size_t k) {
+    std::vector<swarm::SpaceSaving::Item> items;
+    hs.top(&items);
+    std::set<std::string> seen;
+    for (size_t i = 0; i < items.size(); i++) {
+      const swarm::SpaceSaving::Item &it = items[i];
+      EXPECT_TRUE(seen.insert(it.key_).second) << it.key_;
+      uint64_t real = truth.find(it.key_)->second;
+      EXPECT_LE(real, it.count_) << it.key_;
+      EXPECT_GE(real, it.count_ - it.error_) << it.key_;
+    }
+    // every key over N/k is in the summary, CM never under counts
+    for (CountMap::const_iterator it = truth.begin(); it != truth.end(); it++) {
+      if (it->second > total / k) {
+        EXPECT_EQ(1U, seen.count(it->first)) << it->first;
+      }
+      EXPECT_LE(it->second, hs.estimate(it->first.data(), it->first.size()));
+    }
+  }
+
+  TEST(HeavyHitter, exact) {
+    swarm::HitterSketch hs(16, 256, 4);
+    for (uint32_t i = 0; i < 10; i++) {
+      std::string key = key_of(i);
+      hs.add(key.data(), key.size(), i + 1);
+    }
+    std::vector<swarm::SpaceSaving::Item> items;
+    hs.top(&items, 3);
+    ASSERT_EQ(3U, items.size());
+    EXPECT_EQ("key-9", items[0].key_);
+    EXPECT_EQ(10U, items[0].count_);
+    EXPECT_EQ(0U, items[0].error_);
+    EXPECT_EQ("key-7", items[2].key_);
+    EXPECT_EQ(55U, hs.total());
+    EXPECT_LE(10U, hs.estimate("key-9", 5));
+  }
+
+  TEST(HeavyHitter, skewed) {
+    const size_t k = 50;
+    swarm::HitterSketch hs(k, 1024, 4);
+    std::vector<std::string> stream;
+    CountMap truth;
+    gen_stream(&stream, &truth, 5000, 100000, 1);
+    ASSERT_LT(k * 10, truth.size());
+    for (size_t i = 0; i < stream.size(); i++) {
+      hs.add(stream[i].data(), stream[i].size(), 1);
+    }
+    check_bounds(hs, truth, stream.size(), k);
+
+    std::vector<swarm::SpaceSaving::Item> items;
+    hs.top(&items, 1);
+    EXPECT_EQ("key-0", items[0].key_);
+  }
+
+  TEST(HeavyHitter, merge) {
+    const size_t k = 50;
+    swarm::HitterSketch a(k, 1024, 4), b(k, 1024, 4), all(k, 1024, 4);
+    std::vector<std::string> stream;
+    CountMap truth;
+    gen_stream(&stream, &truth, 5000, 100000, 2);
+    for (size_t i = 0; i < stream.size(); i++) {
+      swarm::HitterSketch &hs = (i % 3 == 0) ? a : b;
+      hs.add(stream[i].data(), stream[i].size(), 1);
+      all.add(stream[i].data(), stream[i].size(), 1);
+    }
+    ASSERT_TRUE(a.merge(b));
+    EXPECT_EQ(stream.size(), a.total());
+    check_bounds(a, truth, stream.size(), k);
+    // Count-Min is linear
+    for (CountMap::iterator it = truth.begin(); it != truth.end(); it++) {
+      EXPECT_EQ(all.estimate(it->first.data(), it->first.size()),
+                a.estimate(it->first.data(), it->first.size()));
+    }
+
+    swarm::HitterSketch other(k, 512, 4);
+    EXPECT_FALSE(a.merge(other));
+  }
+
+  // exact counts by text of values
+  class ValueCounter : public swarm::Handler {
+  public:
+    std::string key_;
+    CountMap count_;
+    void recv(swarm::ev_id eid, const swarm::Property &p) {
+      std::string t;
+      for (size_t i = 0; i < p.value_size(this->key_); i++) {
+        ASSERT_TRUE(p.value(this->key_, i).text(&t));
+        this->count_[t]++;
+      }
+    }
+  };
+
+  void check_exact(const swarm::HeavyHitter &hh, const ValueCounter &vc) {
+    std::vector<swarm::SpaceSaving::Item> items;
+    hh.current().top(&items);
+    ASSERT_LT(0U, items.size());
+    ASSERT_GE(1000U, vc.count_.size());
+    EXPECT_EQ(vc.count_.size(), items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+      CountMap::const_iterator it = vc.count_.find(items[i].key_);
+      ASSERT_TRUE(it != vc.count_.end()) << items[i].key_;
+      EXPECT_EQ(it->second, items[i].count_);
+      EXPECT_EQ(0U, items[i].error_);
+    }
+  }
+
+  TEST(HeavyHitter, handler) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::HeavyHitter *none = new swarm::HeavyHitter(nd, "no.such.value");
+    EXPECT_FALSE(none->ready());
+    delete none;
+
+    swarm::HeavyHitter *src = new swarm::HeavyHitter(nd, "ipv4.src", 10);
+    swarm::HeavyHitter *qname =
+      new swarm::HeavyHitter(nd, "dns.qd_name", 1000);
+    swarm::HeavyHitter *aname =
+      new swarm::HeavyHitter(nd, "dns.an_name", 1000);
+    swarm::HeavyHitter *tuple =
+      new swarm::HeavyHitter(nd, swarm::HeavyHitter::KEY_5TUPLE, 10);
+    swarm::HeavyHitter *win = new swarm::HeavyHitter(nd, "ipv4.src", 10);
+    ASSERT_TRUE(src->ready());
+    ASSERT_TRUE(qname->ready());
+    ASSERT_TRUE(tuple->ready());
+    win->set_window(60);
+    ValueCounter *vc = new ValueCounter();
+    vc->key_ = "dns.qd_name";
+    ValueCounter *va = new ValueCounter();
+    va->key_ = "dns.an_name";
+
+    nd->set_handler("ipv4.packet", src);
+    nd->set_handler("ipv4.packet", tuple);
+    nd->set_handler("ipv4.packet", win);
+    nd->set_handler("dns.packet", qname);
+    nd->set_handler("dns.packet", vc);
+    nd->set_handler("dns.packet", aname);
+    nd->set_handler("dns.packet", va);
+
+    swarm::PcapReader pcap("./data/SkypeIRC.cap");
+    ASSERT_TRUE(pcap.ready());
+    swarm::PcapReader::Record rec;
+    while (pcap.next(&rec) > 0) {
+      nd->input(rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+    }
+
+    std::vector<swarm::SpaceSaving::Item> items;
+    EXPECT_EQ(2247U, src->current().total());
+    src->current().top(&items, 1);
+    ASSERT_EQ(1U, items.size());
+    EXPECT_EQ(4U, items[0].key_.size());
+    EXPECT_NE(std::string::npos, src->repr(items[0].key_).find('.'));
+
+    // exact with less names than k
+    check_exact(*qname, *vc);
+    qname->current().top(&items, 1);
+    EXPECT_EQ("ui.skype.com.", qname->repr(items[0].key_));
+
+    // answer names are mostly compressed pointers into the message, they
+    // are counted by name, not by raw bytes
+    check_exact(*aname, *va);
+    aname->current().top(&items, 1);
+    EXPECT_LT(1U, items[0].count_);
+    EXPECT_EQ('.', *(aname->repr(items[0].key_).rbegin()));
+
+    tuple->current().top(&items, 1);
+    ASSERT_EQ(1U, items.size());
+    EXPECT_NE(std::string::npos, tuple->repr(items[0].key_).find(" <-> "));
+
+    // rotated by packet time, the last window is kept
+    EXPECT_LT(0U, win->rotate_count());
+    EXPECT_LT(0U, win->last().total());
+    EXPECT_GT(2247U, win->current().total());
+    EXPECT_EQ(win->current().start_sec() - 60, win->last().start_sec());
+
+    delete nd;
+    delete src;
+    delete qname;
+    delete aname;
+    delete va;
+    delete tuple;
+    delete win;
+    delete vc;
+  }
+
+  TEST(HeavyHitter, window_gap) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::HeavyHitter *win = new swarm::HeavyHitter(nd, "ipv4.src", 10);
+    win->set_window(10);
+    nd->set_handler("ipv4.packet", win);
+
+    swarm::PcapReader pcap("./data/SkypeIRC.cap");
+    swarm::PcapReader::Record rec;
+    ASSERT_TRUE(pcap.ready());
+    ASSERT_LT(0, pcap.next(&rec));
+
+    // 2 packets in [1000, 1010), 1 in [1010, 1020), none in [1020, 1030)
+    const uint64_t ts[] = {1000, 1005, 1012, 1035};
+    for (size_t i = 0; i < sizeof(ts) / sizeof(ts[0]); i++) {
+      nd->input(rec.data_, rec.len_, ts[i] * 1000000000ULL, rec.caplen_);
+    }
+    EXPECT_EQ(1030U, win->current().start_sec());
+    EXPECT_EQ(1U, win->current().total());
+    // the window before is empty, not [1010, 1020)
+    EXPECT_EQ(1020U, win->last().start_sec());
+    EXPECT_EQ(0U, win->last().total());
+
+    delete nd;
+    delete win;
+  }
+}  // namespace heavy_hitter_test
@@ -0,0 +1,206 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "./gtest.h"
+#include "../src/swarm.h"
+#include "../src/utils/ipfix.h"
+
+namespace ipfix_test {
+  static uint16_t get16(const uint8_t *p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+  }
+  static uint64_t get64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+      v = (v << 8) | p[i];
+    }
+    return v;
+  }
+
+  class PktCounter : public swarm::Handler {
+  public:
+    int count_;
+    PktCounter() : count_(0) {}
+    void recv(swarm::ev_id eid, const swarm::Property &p) { this->count_++; }
+  };
+
+  // Walk sets of one message and sum up packetDeltaCount of data records.
+  // Returns number of data records in the message.
+  static size_t parse_msg(const uint8_t *msg, size_t len, size_t hdr_len,
+                          uint64_t *pkt_sum) {
+    size_t records = 0;
+    for (size_t ptr = hdr_len; ptr + 4 <= len; ) {
+      uint16_t set_id  = get16(msg + ptr);
+      uint16_t set_len = get16(msg + ptr + 2);
+      EXPECT_LE(ptr + set_len, len);
+      if (set_id == 256) {
+        // IPv4 record: addr(4+4) port(2+2) proto(1) octets(8) packets(8)
+        size_t rec_len = (hdr_len == 16) ? 45 : 37;
+        for (size_t r = ptr + 4; r + rec_len <= ptr + set_len; r += rec_len) {
+          *pkt_sum += get64(msg + r + 21);
+          records++;
+        }
+      }
+      ptr += set_len;
+    }
+    return records;
+  }
+
+  TEST(IpfixExporter, udp) {
+    int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_LE(0, sock);
+    int rcvbuf = 4 * 1024 * 1024;
+    ::setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    ASSERT_EQ(0, ::bind(sock, reinterpret_cast<struct sockaddr*>(&addr),
+                        sizeof(addr)));
+    socklen_t addr_len = sizeof(addr);
+    ::getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::IpfixExporter *exp = new swarm::IpfixExporter();
+    PktCounter *ipv4 = new PktCounter();
+    ASSERT_TRUE(exp->open_udp("127.0.0.1", ntohs(addr.sin_port)));
+    nd->set_handler("ipv4.packet", exp);
+    nd->set_handler("ipv4.packet", ipv4);
+
+    swarm::CapPcapFile *cap = new swarm::CapPcapFile("./data/SkypeIRC.cap");
+    cap->bind_netdec(nd);
+    ASSERT_TRUE(cap->start());
+    exp->flush();
+    EXPECT_EQ(0U, exp->flow_count());
+    EXPECT_EQ(0U, exp->lost_packets());
+    EXPECT_LT(0U, exp->exported_msgs());
+
+    ::fcntl(sock, F_SETFL, O_NONBLOCK);
+    uint8_t buf[0x10000];
+    ssize_t len;
+    uint64_t msgs = 0, records = 0, pkt_sum = 0;
+    while (0 < (len = ::recv(sock, buf, sizeof(buf), 0))) {
+      EXPECT_EQ(10, get16(buf));
+      EXPECT_EQ(len, get16(buf + 2));
+      EXPECT_GE(1400, len);
+      // sequence number is count of data records sent before the message
+      EXPECT_EQ(records, ntohl(*reinterpret_cast<uint32_t*>(buf + 8)));
+      records += parse_msg(buf, len, 16, &pkt_sum);
+      msgs++;
+    }
+
+    EXPECT_EQ(exp->exported_msgs(), msgs);
+    EXPECT_EQ(exp->exported_records(), records);
+    EXPECT_EQ(static_cast<uint64_t>(ipv4->count_), pkt_sum);
+    EXPECT_EQ(2247, ipv4->count_);
+
+    ::close(sock);
+    delete exp;
+    delete cap;
+  }
+
+  TEST(IpfixExporter, netflow_v9_file) {
+    char fname[] = "/tmp/swarm_ipfix_XXXXXX";
+    int tmp_fd = ::mkstemp(fname);
+    ASSERT_LE(0, tmp_fd);
+    ::close(tmp_fd);
+
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::IpfixExporter *exp =
+      new swarm::IpfixExporter(swarm::IpfixExporter::NETFLOW_V9, 16);
+    ASSERT_TRUE(exp->open_file(fname));
+    ASSERT_TRUE(exp->set_message_size(512));
+    nd->set_handler("ipv4.packet", exp);
+
+    swarm::CapPcapFile *cap = new swarm::CapPcapFile("./data/SkypeIRC.cap");
+    cap->bind_netdec(nd);
+    ASSERT_TRUE(cap->start());
+    exp->close();
+
+    FILE *fp = ::fopen(fname, "rb");
+    ASSERT_TRUE(fp != NULL);
+    std::vector<uint8_t> data;
+    uint8_t chunk[0x1000];
+    size_t exported = 0, msgs = 0;
+    uint64_t pkt_sum = 0;
+
+    // NetFlow v9 has no message length, then walk FlowSets by count field
+    size_t rlen;
+    while (0 < (rlen = ::fread(chunk, 1, sizeof(chunk), fp))) {
+      data.insert(data.end(), chunk, chunk + rlen);
+    }
+    ::fclose(fp);
+    const uint8_t *buf = &data[0];
+    const size_t flen = data.size();
+    ::unlink(fname);
+
+    size_t ptr = 0;
+    while (ptr + 20 <= flen) {
+      ASSERT_EQ(9, get16(buf + ptr));
+      size_t count = get16(buf + ptr + 2);
+      size_t end = ptr + 20;
+      size_t rec = 0;
+      while (rec < count && end + 4 <= flen) {
+        uint16_t set_id = get16(buf + end);
+        uint16_t set_len = get16(buf + end + 2);
+        ASSERT_EQ(0, set_len % 4);
+        if (set_id == 0) {
+          rec += 2;  // IPv4 and IPv6 templates
+        } else if (set_id == 256) {
+          rec += (set_len - 4) / 37;
+        }
+        end += set_len;
+      }
+      EXPECT_EQ(count, rec);
+      EXPECT_GE(512U, end - ptr);
+      exported += parse_msg(buf + ptr, end - ptr, 20, &pkt_sum);
+      ptr = end;
+      msgs++;
+    }
+
+    EXPECT_EQ(flen, ptr);
+    EXPECT_EQ(exp->exported_msgs(), msgs);
+    EXPECT_EQ(exp->exported_records(), exported);
+    // packets of flows that did not fit into the 16 entry pool are counted
+    EXPECT_EQ(2247U, pkt_sum + exp->lost_packets());
+
+    delete exp;
+    delete cap;
+  }
+}  // namespace ipfix_test
@@ -151,3 +151,25 @@ TEST(LRUHash, error_handle) {
   EXPECT_EQ(NULL,  lru->pop());
 }
 
+TEST(LRUHash, remove) {
+  swarm::LRUHash *lru = new swarm::LRUHash(10);
+  TestNode *n1 = new TestNode(100, "100");
+  TestNode *n2 = new TestNode(200, "200");
+  TestNode *n3 = new TestNode(300, "300");
+
+  ASSERT_TRUE(lru->put(1, n1));
+  ASSERT_TRUE(lru->put(1, n2));
+  ASSERT_TRUE(lru->put(1, n3));
+
+  // removed node is neither found nor expired
+  lru->remove(n2);
+  EXPECT_EQ(NULL, lru->get(n2->hash(), n2->key(), n2->len()));
+  EXPECT_EQ(n1, lru->get(n1->hash(), n1->key(), n1->len()));
+  EXPECT_EQ(n3, lru->get(n3->hash(), n3->key(), n3->len()));
+
+  lru->prog(2);
+  EXPECT_EQ(n1, lru->pop());
+  EXPECT_EQ(n3, lru->pop());
+  EXPECT_EQ(NULL, lru->pop());
+  delete n2;
+}
@@ -0,0 +1,177 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <string>
+#include "../src/swarm.h"
+#include "../src/utils/load-shed.h"
+
+namespace {
+  class ShedCounter : public swarm::Handler {
+  public:
+    swarm::dec_id dec_;
+    int count_, shed_;
+    explicit ShedCounter (swarm::dec_id dec) : dec_(dec), count_(0), shed_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->count_++;
+      if (prop.shed (this->dec_)) {
+        this->shed_++;
+      }
+    }
+  };
+
+  class SegCounter : public ShedCounter {
+  public:
+    explicit SegCounter (swarm::dec_id dec) : ShedCounter (dec) {}
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      if (!prop.value ("tcp_ssn.segment").is_null ()) {
+        this->count_++;
+      }
+    }
+  };
+
+  void replay (swarm::NetDec *nd) {
+    swarm::CapPcapMmap *cap = new swarm::CapPcapMmap ("./data/SkypeIRC.cap");
+    cap->bind_netdec (nd);
+    ASSERT_TRUE (cap->start ());
+    delete cap;
+  }
+}
+
+TEST (LoadShed, decoder) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id dns = nd->lookup_dec_id ("dns");
+  swarm::dec_id ssn = nd->lookup_dec_id ("tcp_ssn");
+  ShedCounter *pkt = new ShedCounter (dns);
+  ShedCounter *an = new ShedCounter (dns);
+  ShedCounter *tx = new ShedCounter (dns);
+  SegCounter *seg = new SegCounter (ssn);
+  nd->set_handler ("dns.packet", pkt);
+  nd->set_handler ("dns.an", an);
+  nd->set_handler ("dns.transaction", tx);
+  nd->set_handler ("tcp.packet", seg);
+
+  EXPECT_FALSE (nd->set_shed (swarm::DEC_NULL, true));
+  ASSERT_TRUE (nd->set_shed (dns, true));
+  ASSERT_TRUE (nd->set_shed (ssn, true));
+  EXPECT_TRUE (nd->is_shed (dns));
+  EXPECT_EQ (2U, nd->shed_count ());
+  replay (nd);
+
+  // header of DNS is still decoded, records and tcp sessions are not
+  EXPECT_EQ (707, pkt->count_);
+  EXPECT_EQ (707, pkt->shed_);
+  EXPECT_EQ (0, an->count_);
+  EXPECT_EQ (0, tx->count_);
+  EXPECT_EQ (0, seg->count_);
+
+  ASSERT_TRUE (nd->set_shed (dns, false));
+  ASSERT_TRUE (nd->set_shed (ssn, false));
+  EXPECT_EQ (0U, nd->shed_count ());
+  replay (nd);
+  EXPECT_EQ (707 * 2, pkt->count_);
+  EXPECT_EQ (707, pkt->shed_);
+  EXPECT_LT (0, an->count_);
+  EXPECT_EQ (0, an->shed_);
+  EXPECT_LT (0, tx->count_);
+  EXPECT_LT (0, seg->count_);
+  delete nd;
+}
+
+TEST (LoadShed, controller) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  nd->set_profile (true);
+  swarm::LoadShedder *ls = new swarm::LoadShedder (nd);
+  EXPECT_FALSE (ls->add_candidate ("no_such_decoder"));
+  ls->clear_candidate ();
+  ASSERT_TRUE (ls->add_candidate ("dns"));
+  ASSERT_TRUE (ls->add_candidate ("tcp_ssn"));
+  ls->set_threshold (0.01, 0.0, 3);
+
+  replay (nd);
+  swarm::dec_id dns = nd->lookup_dec_id ("dns");
+  swarm::dec_id ssn = nd->lookup_dec_id ("tcp_ssn");
+  EXPECT_LT (0, nd->decoder_cost (nd->lookup_dec_id ("ether")));
+  swarm::dec_id first = (nd->decoder_cost (dns) >= nd->decoder_cost (ssn)) ?
+    dns : ssn;
+  swarm::dec_id second = (first == dns) ? ssn : dns;
+
+  ls->update (1000, 0);
+  EXPECT_EQ (0U, ls->level ());
+  ls->update (2000, 100);   // 9% drop
+  EXPECT_EQ (1U, ls->level ());
+  EXPECT_TRUE (nd->is_shed (first));
+  EXPECT_FALSE (nd->is_shed (second));
+  ls->update (3000, 105);   // under high threshold, above low: keep
+  EXPECT_EQ (1U, ls->level ());
+  ls->update (4000, 200);
+  EXPECT_EQ (2U, ls->level ());
+  ls->update (5000, 300);   // nothing more to shed
+  EXPECT_EQ (2U, ls->level ());
+  EXPECT_EQ (2U, nd->shed_count ());
+
+  // restored in reverse order after 3 calm periods each
+  ls->update (6000, 300);
+  ls->update (7000, 300);
+  EXPECT_EQ (2U, ls->level ());
+  ls->update (8000, 300);
+  EXPECT_EQ (1U, ls->level ());
+  EXPECT_TRUE (nd->is_shed (first));
+  EXPECT_FALSE (nd->is_shed (second));
+  ls->update (9000, 300);
+  ls->update (10000, 300);
+  ls->update (11000, 300);
+  EXPECT_EQ (0U, ls->level ());
+  EXPECT_EQ (2U, ls->shed_events ());
+  EXPECT_EQ (2U, ls->restore_events ());
+
+  // ring occupancy works as pressure too
+  ls->update (12000, 300, 0.9);
+  EXPECT_EQ (1U, ls->level ());
+  delete ls;
+  EXPECT_EQ (0U, nd->shed_count ());
+  delete nd;
+}
+
+TEST (LoadShed, without_profile) {
+  // no cost is measured, candidates are shed in the order added
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::LoadShedder *ls = new swarm::LoadShedder (nd);
+  ls->clear_candidate ();
+  ASSERT_TRUE (ls->add_candidate ("tcp_ssn"));
+  ASSERT_TRUE (ls->add_candidate ("dns"));
+  ls->set_threshold (0.01, 0.0, 3);
+
+  replay (nd);
+  swarm::dec_id ssn = nd->lookup_dec_id ("tcp_ssn");
+  EXPECT_EQ (0, nd->decoder_cost (ssn));
+  ls->update (1000, 0);
+  ls->update (2000, 100);
+  EXPECT_TRUE (nd->is_shed (ssn));
+  EXPECT_FALSE (nd->is_shed (nd->lookup_dec_id ("dns")));
+  delete ls;
+  delete nd;
+}
@@ -0,0 +1,168 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <set>
+#include "./gtest.h"
+#include "../src/utils/mem-pool.h"
+#include "../src/utils/lru-hash.h"
+
+namespace {
+  class PoolNode : public swarm::LRUHash::Node {
+  private:
+    uint64_t hv_;
+
+  public:
+    explicit PoolNode(uint64_t hv) : hv_(hv) {}
+    uint64_t hash() { return this->hv_; }
+    bool match(const void *key, size_t len) {
+      return (len == sizeof(this->hv_) && memcmp(&this->hv_, key, len) == 0);
+    }
+  };
+}
+
+TEST(MemPool, region) {
+  swarm::MemPool *pool = swarm::MemPool::get("test-4k");
+  EXPECT_EQ(pool, swarm::MemPool::get("test-4k"));
+  pool->configure(swarm::MemPool::PAGE_4K, swarm::MemPool::NODE_ANY);
+
+  uint8_t *p = static_cast<uint8_t *>(pool->alloc(10000));
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(p) % 4096);
+  EXPECT_EQ(0, p[0]);
+  EXPECT_EQ(0, p[9999]);
+  memset(p, 0xff, 10000);
+
+  swarm::MemPool::Stat st = pool->stat();
+  EXPECT_EQ("test-4k", st.name_);
+  EXPECT_EQ(1U, st.region_);
+  EXPECT_EQ(10000U, st.used_);
+  EXPECT_EQ(12288U, st.reserved_);
+  EXPECT_EQ(3U, st.tlb_entry_);
+  EXPECT_EQ(0U, st.huge_);
+
+  pool->free(p);
+  pool->free(NULL);
+  st = pool->stat();
+  EXPECT_EQ(0U, st.region_);
+  EXPECT_EQ(0U, st.used_);
+  EXPECT_EQ(0U, st.reserved_);
+  EXPECT_EQ(0U, st.tlb_entry_);
+}
+
+TEST(MemPool, huge_page) {
+  // huge pages are used if reserved, 4 KB pages and THP otherwise
+  swarm::MemPool *pool = swarm::MemPool::get("test-2m");
+  pool->configure(swarm::MemPool::PAGE_2M, swarm::MemPool::cpu_node());
+  const size_t len = 3 * 1024 * 1024;
+  uint8_t *p = static_cast<uint8_t *>(pool->alloc(len));
+  ASSERT_TRUE(p != NULL);
+  memset(p, 1, len);
+
+  swarm::MemPool::Stat st = pool->stat();
+  EXPECT_EQ(len, st.used_);
+  if (st.fallback_ == 0) {
+    EXPECT_EQ(4U * 1024 * 1024, st.reserved_);
+    EXPECT_EQ(st.reserved_, st.huge_);
+    EXPECT_EQ(2U, st.tlb_entry_);
+  } else {
+    EXPECT_EQ(len, st.reserved_);
+    EXPECT_EQ(0U, st.huge_);
+    EXPECT_EQ(len / 4096, st.tlb_entry_);
+  }
+
+  // small one does not waste a huge page
+  void *q = pool->alloc(100);
+  ASSERT_TRUE(q != NULL);
+  EXPECT_EQ(st.reserved_ + 4096, pool->stat().reserved_);
+
+  // nor does one between half and a full huge page
+  void *r = pool->alloc(1536 * 1024);
+  ASSERT_TRUE(r != NULL);
+  EXPECT_EQ(st.reserved_ + 4096 + 1536 * 1024, pool->stat().reserved_);
+  EXPECT_EQ(st.huge_, pool->stat().huge_);
+
+  pool->free(p);
+  pool->free(q);
+  pool->free(r);
+  EXPECT_EQ(0U, pool->stat().reserved_);
+
+  std::vector<swarm::MemPool::Stat> stats;
+  swarm::MemPool::stats(&stats);
+  bool found = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    found |= (stats[i].name_ == "test-2m");
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(MemPool, node) {
+  EXPECT_EQ(swarm::MemPool::NODE_ANY, swarm::MemPool::dev_node("no-such-dev"));
+  EXPECT_LE(swarm::MemPool::NODE_ANY, swarm::MemPool::cpu_node());
+}
+
+TEST(MemPool, slab) {
+  swarm::MemPool *pool = swarm::MemPool::get("test-slab");
+  swarm::MemSlab *slab = new swarm::MemSlab(pool, 40);
+
+  // objects are aligned and not overlapped, and put one is reused
+  std::set<uintptr_t> addr;
+  std::vector<void *> obj;
+  for (size_t i = 0; i < 100000; i++) {
+    void *p = slab->get();
+    ASSERT_TRUE(p != NULL);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(p) % 16);
+    memset(p, 0xaa, 40);
+    addr.insert(reinterpret_cast<uintptr_t>(p));
+    obj.push_back(p);
+  }
+  EXPECT_EQ(100000U, addr.size());
+  EXPECT_EQ(100000U, slab->count());
+  EXPECT_EQ(3U, pool->stat().region_);  // 48 byte x 100000 in 2 MB chunks
+
+  slab->put(obj[10]);
+  EXPECT_EQ(obj[10], slab->get());
+
+  delete slab;
+  EXPECT_EQ(0U, pool->stat().region_);
+}
+
+TEST(MemPool, lru_hash) {
+  swarm::MemPool *pool = swarm::MemPool::get("test-lru");
+  swarm::LRUHash *lru = new swarm::LRUHash(10, 0xffff, pool);
+  EXPECT_EQ(1U, pool->stat().region_);
+
+  PoolNode *node = new PoolNode(100);
+  uint64_t key = 100;
+  ASSERT_TRUE(lru->put(1, node));
+  EXPECT_EQ(node, lru->get(100, &key, sizeof(key)));
+  lru->prog(2);
+  EXPECT_EQ(node, lru->pop());
+
+  delete node;
+  delete lru;
+  EXPECT_EQ(0U, pool->stat().region_);
+}
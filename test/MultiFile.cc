@@ -0,0 +1,167 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include "../src/swarm.h"
+#include "../src/utils/multi-file.h"
+
+namespace {
+  class PktCounter : public swarm::Handler {
+  public:
+    int ipv4_, seg_;
+    PktCounter () : ipv4_(0), seg_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->ipv4_++;
+      if (!prop.value ("tcp_ssn.segment").is_null ()) {
+        this->seg_++;
+      }
+    }
+  };
+
+  class CountTask : public swarm::FileTask {
+  public:
+    PktCounter counter_;
+    int files_;
+    CountTask () : files_(0) {}
+    bool setup (swarm::NetDec *nd) {
+      return (nd->set_handler ("ipv4.packet", &this->counter_) !=
+              swarm::HDLR_NULL);
+    }
+    void finish (swarm::NetDec *nd, const std::string &path) {
+      this->files_++;
+    }
+  };
+
+  class CountReducer : public swarm::FileReducer {
+  public:
+    int ipv4_, seg_, files_, reduced_;
+    CountReducer () : ipv4_(0), seg_(0), files_(0), reduced_(0) {}
+    swarm::FileTask *create () { return new CountTask (); }
+    void reduce (swarm::FileTask *task) {
+      CountTask *t = dynamic_cast<CountTask*> (task);
+      this->ipv4_ += t->counter_.ipv4_;
+      this->seg_ += t->counter_.seg_;
+      this->files_ += t->files_;
+      this->reduced_++;
+    }
+  };
+
+  void put32 (FILE *fp, uint32_t v) {
+    fwrite (&v, sizeof (v), 1, fp);
+  }
+
+  // split SkypeIRC.cap into two pcap files at the n-th packet
+  void split (const std::string &p1, const std::string &p2, size_t n) {
+    swarm::PcapReader reader ("./data/SkypeIRC.cap");
+    ASSERT_TRUE (reader.ready ());
+    FILE *fp[2] = {fopen (p1.c_str (), "wb"), fopen (p2.c_str (), "wb")};
+    for (int i = 0; i < 2; i++) {
+      ASSERT_TRUE (fp[i] != NULL);
+      put32 (fp[i], 0xA1B2C3D4);
+      put32 (fp[i], 0x00040002);
+      put32 (fp[i], 0);
+      put32 (fp[i], 0);
+      put32 (fp[i], 0xffff);
+      put32 (fp[i], reader.linktype ());
+    }
+
+    swarm::PcapReader::Record rec;
+    for (size_t c = 0; reader.next (&rec) > 0; c++) {
+      FILE *f = fp[c < n ? 0 : 1];
+      put32 (f, rec.ts_ns_ / 1000000000);
+      put32 (f, (rec.ts_ns_ % 1000000000) / 1000);
+      put32 (f, rec.caplen_);
+      put32 (f, rec.len_);
+      fwrite (rec.data_, 1, rec.caplen_, f);
+    }
+    fclose (fp[0]);
+    fclose (fp[1]);
+  }
+}
+
+TEST (MultiFile, parallel) {
+  CountReducer red;
+  swarm::MultiFile mf (&red, 3);
+  for (int i = 0; i < 4; i++) {
+    mf.add_file ("./data/SkypeIRC.cap");
+  }
+  EXPECT_EQ (4U, mf.chain_count ());
+  ASSERT_TRUE (mf.run ());
+  EXPECT_EQ (4, red.reduced_);
+  EXPECT_EQ (4, red.files_);
+  EXPECT_EQ (4 * 2247, red.ipv4_);
+  EXPECT_EQ (4U * 2263, mf.pkt_count ());
+
+  // broken file is reported, others are still reduced
+  CountReducer red2;
+  swarm::MultiFile mf2 (&red2, 2);
+  mf2.add_file ("./data/SkypeIRC.cap");
+  mf2.add_file ("./data/not_exist.cap");
+  EXPECT_FALSE (mf2.run ());
+  EXPECT_FALSE (mf2.errmsg ().empty ());
+  EXPECT_EQ (1, red2.reduced_);
+  EXPECT_EQ (2247, red2.ipv4_);
+}
+
+TEST (MultiFile, carry) {
+  char t1[] = "/tmp/swarm-mf1-XXXXXX", t2[] = "/tmp/swarm-mf2-XXXXXX";
+  close (mkstemp (t1));
+  close (mkstemp (t2));
+  split (t1, t2, 1000);
+
+  CountReducer whole;
+  swarm::MultiFile mf0 (&whole, 1);
+  mf0.add_file ("./data/SkypeIRC.cap");
+  ASSERT_TRUE (mf0.run ());
+
+  // separated: TCP sessions are cut at the file boundary
+  CountReducer sep;
+  swarm::MultiFile mf1 (&sep, 2);
+  mf1.add_file (t1);
+  mf1.add_file (t2);
+  ASSERT_TRUE (mf1.run ());
+  EXPECT_EQ (2, sep.reduced_);
+  EXPECT_EQ (2247, sep.ipv4_);
+
+  // carried: same result as the single file
+  CountReducer carry;
+  swarm::MultiFile mf2 (&carry, 2);
+  mf2.add_file (t1, "eth0");
+  mf2.add_file (t2, "eth0");
+  EXPECT_EQ (1U, mf2.chain_count ());
+  ASSERT_TRUE (mf2.run ());
+  EXPECT_EQ (1, carry.reduced_);
+  EXPECT_EQ (2, carry.files_);
+  EXPECT_EQ (2247, carry.ipv4_);
+  EXPECT_EQ (whole.seg_, carry.seg_);
+  EXPECT_GT (whole.seg_, sep.seg_);
+
+  unlink (t1);
+  unlink (t2);
+}
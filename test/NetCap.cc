@@ -26,9 +26,62 @@
 
 
 #include "./gtest.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 #include "../src/swarm.h"
 
+namespace {
+  class PktRecorder : public swarm::Handler {
+  public:
+    std::vector<uint64_t> ts_;
+    std::vector<std::string> data_;
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->ts_.push_back(prop.ts_ns());
+      // rewind to the head of the packet from current decode position
+      swarm::Property &p = const_cast<swarm::Property &>(prop);
+      const swarm::byte_t *head = p.refer(0) - (p.cap_len() - p.remain());
+      this->data_.push_back(std::string(reinterpret_cast<const char*>(head),
+                                        p.cap_len()));
+    }
+  };
+
+  bool record(swarm::NetCap *cap, PktRecorder *rec) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    nd->set_handler("ether.packet", rec);
+    cap->bind_netdec(nd);
+    bool rc = (cap->status() == swarm::NetCap::READY && cap->start());
+    delete cap;
+    delete nd;
+    return rc;
+  }
+
+  void put32(std::string *s, uint32_t v) {
+    s->append(reinterpret_cast<char*>(&v), sizeof(v));
+  }
+  void put16(std::string *s, uint16_t v) {
+    s->append(reinterpret_cast<char*>(&v), sizeof(v));
+  }
+  void pad4(std::string *s) {
+    while (s->size() % 4 != 0) {
+      s->push_back('\0');
+    }
+  }
+  std::string write_tmp(const std::string &buf) {
+    char fname[] = "/tmp/swarm_netcap_XXXXXX";
+    int tmp_fd = ::mkstemp(fname);
+    if (tmp_fd < 0 ||
+        ::write(tmp_fd, buf.data(), buf.size()) !=
+        static_cast<ssize_t>(buf.size())) {
+      return "";
+    }
+    ::close(tmp_fd);
+    return fname;
+  }
+}
+
 TEST(CapPcapMmap, Basic) {
   class Counter  : public swarm::Handler {
   protected:
@@ -54,3 +107,191 @@ TEST(CapPcapMmap, Basic) {
   EXPECT_EQ(2247, ip4_count->count());
   delete cap;
 }
+
+TEST(CapPcapMmap, SkypeIRC) {
+  PktRecorder mmap_rec, file_rec;
+  std::string sample_file = "./data/SkypeIRC.cap";
+  ASSERT_TRUE(record(new swarm::CapPcapMmap(sample_file), &mmap_rec));
+  ASSERT_TRUE(record(new swarm::CapPcapFile(sample_file), &file_rec));
+
+  EXPECT_EQ(2263U, mmap_rec.ts_.size());
+  ASSERT_EQ(file_rec.ts_.size(), mmap_rec.ts_.size());
+  EXPECT_TRUE(file_rec.ts_ == mmap_rec.ts_);
+  EXPECT_TRUE(file_rec.data_ == mmap_rec.data_);
+  // micro second precision file
+  EXPECT_EQ(0U, mmap_rec.ts_[0] % 1000);
+}
+
+TEST(CapPcapMmap, nanosec) {
+  PktRecorder orig;
+  ASSERT_TRUE(record(new swarm::CapPcapMmap("./data/SkypeIRC.cap"), &orig));
+  ASSERT_LT(100U, orig.ts_.size());
+
+  // nano second pcap (magic 0xA1B23C4D) and pcapng with if_tsresol = 9.
+  // sub-micro second digits must survive through the whole path
+  std::string pcap, ng;
+  put32(&pcap, 0xA1B23C4D);
+  put16(&pcap, 2);
+  put16(&pcap, 4);
+  put32(&pcap, 0);
+  put32(&pcap, 0);
+  put32(&pcap, 0xffff);
+  put32(&pcap, 1);
+
+  put32(&ng, 0x0A0D0D0A);  // SHB
+  put32(&ng, 28);
+  put32(&ng, 0x1A2B3C4D);
+  put16(&ng, 1);
+  put16(&ng, 0);
+  put32(&ng, 0xffffffff);
+  put32(&ng, 0xffffffff);
+  put32(&ng, 28);
+  put32(&ng, 1);  // IDB with if_tsresol
+  put32(&ng, 32);
+  put16(&ng, 1);
+  put16(&ng, 0);
+  put32(&ng, 0xffff);
+  put16(&ng, 9);
+  put16(&ng, 1);
+  ng.push_back(9);
+  pad4(&ng);
+  put32(&ng, 0);
+  put32(&ng, 32);
+
+  std::vector<uint64_t> ts_list;
+  for (size_t i = 0; i < 100; i++) {
+    uint64_t ts = orig.ts_[i] + (i * 7) % 1000;
+    const std::string &d = orig.data_[i];
+    ts_list.push_back(ts);
+
+    put32(&pcap, static_cast<uint32_t>(ts / 1000000000));
+    put32(&pcap, static_cast<uint32_t>(ts % 1000000000));
+    put32(&pcap, d.size());
+    put32(&pcap, d.size());
+    pcap.append(d);
+
+    size_t blen = 32 + ((d.size() + 3) & ~3);
+    put32(&ng, 6);  // EPB
+    put32(&ng, blen);
+    put32(&ng, 0);
+    put32(&ng, static_cast<uint32_t>(ts >> 32));
+    put32(&ng, static_cast<uint32_t>(ts));
+    put32(&ng, d.size());
+    put32(&ng, d.size());
+    ng.append(d);
+    pad4(&ng);
+    put32(&ng, blen);
+  }
+
+  std::string pcap_file = write_tmp(pcap);
+  std::string ng_file = write_tmp(ng);
+  ASSERT_NE("", pcap_file);
+  ASSERT_NE("", ng_file);
+
+  PktRecorder pcap_rec, ng_rec, lib_rec;
+  EXPECT_TRUE(record(new swarm::CapPcapMmap(pcap_file), &pcap_rec));
+  EXPECT_TRUE(record(new swarm::CapPcapMmap(ng_file), &ng_rec));
+  EXPECT_TRUE(record(new swarm::CapPcapFile(pcap_file), &lib_rec));
+  EXPECT_TRUE(ts_list == pcap_rec.ts_);
+  EXPECT_TRUE(ts_list == ng_rec.ts_);
+  EXPECT_TRUE(ts_list == lib_rec.ts_);
+  ASSERT_EQ(100U, ng_rec.data_.size());
+  for (size_t i = 0; i < 100; i++) {
+    EXPECT_EQ(orig.data_[i], ng_rec.data_[i]);
+  }
+
+  ::unlink(pcap_file.c_str());
+  ::unlink(ng_file.c_str());
+}
+
+TEST(NetDec, input_nanosec) {
+  class TsCheck : public swarm::Handler {
+  public:
+    uint64_t ts_ns_;
+    time_t sec_, usec_;
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->ts_ns_ = prop.ts_ns();
+      this->sec_ = prop.tv_sec();
+      this->usec_ = prop.tv_usec();
+    }
+  };
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  TsCheck *chk = new TsCheck();
+  nd->set_handler("ether.packet", chk);
+  swarm::byte_t pkt[64] = {0};
+
+  nd->input(pkt, sizeof(pkt), 1234567890123456789ULL);
+  EXPECT_EQ(1234567890123456789ULL, chk->ts_ns_);
+  EXPECT_EQ(1234567890, chk->sec_);
+  EXPECT_EQ(123456, chk->usec_);
+
+  struct timeval tv = {1234567891, 5};
+  nd->input(pkt, sizeof(pkt), tv);
+  EXPECT_EQ(1234567891000005000ULL, chk->ts_ns_);
+  EXPECT_EQ(1234567890123456789ULL, nd->init_ts_ns());
+  EXPECT_EQ(1234567891000005000ULL, nd->last_ts_ns());
+
+  struct timespec ts;
+  nd->last_ts(&ts);
+  EXPECT_EQ(1234567891, ts.tv_sec);
+  EXPECT_EQ(5000, ts.tv_nsec);
+  delete nd;
+}
+
+TEST(CapMergedFiles, interleave) {
+  PktRecorder src;
+  ASSERT_TRUE(record(new swarm::CapPcapMmap("./data/SkypeIRC.cap"), &src));
+
+  // SkypeIRC.cap has a packet out of time order, sort it first
+  std::vector<std::pair<uint64_t, size_t> > order;
+  for (size_t n = 0; n < src.ts_.size(); n++) {
+    order.push_back(std::make_pair(src.ts_[n], n));
+  }
+  std::stable_sort(order.begin(), order.end());
+  PktRecorder orig;
+  for (size_t n = 0; n < order.size(); n++) {
+    orig.ts_.push_back(src.ts_[order[n].second]);
+    orig.data_.push_back(src.data_[order[n].second]);
+  }
+
+  // deal packets to 3 taps round robin, every file keeps time order
+  std::string tap[3];
+  for (int i = 0; i < 3; i++) {
+    put32(&tap[i], 0xA1B23C4D);
+    put32(&tap[i], 0x00040002);
+    put32(&tap[i], 0);
+    put32(&tap[i], 0);
+    put32(&tap[i], 0xffff);
+    put32(&tap[i], 1);
+  }
+  for (size_t n = 0; n < orig.ts_.size(); n++) {
+    std::string *s = &tap[n % 3];
+    put32(s, orig.ts_[n] / 1000000000);
+    put32(s, orig.ts_[n] % 1000000000);
+    put32(s, orig.data_[n].size());
+    put32(s, orig.data_[n].size());
+    s->append(orig.data_[n]);
+  }
+
+  std::vector<std::string> files;
+  for (int i = 0; i < 3; i++) {
+    files.push_back(write_tmp(tap[i]));
+    ASSERT_FALSE(files.back().empty());
+  }
+
+  PktRecorder merged;
+  ASSERT_TRUE(record(new swarm::CapMergedFiles(files), &merged));
+  ASSERT_EQ(orig.ts_.size(), merged.ts_.size());
+  EXPECT_TRUE(orig.ts_ == merged.ts_);
+  EXPECT_TRUE(orig.data_ == merged.data_);
+
+  files.push_back("./data/not_exist.cap");
+  swarm::CapMergedFiles *bad = new swarm::CapMergedFiles(files);
+  EXPECT_EQ(swarm::NetCap::FAIL, bad->status());
+  delete bad;
+
+  for (int i = 0; i < 3; i++) {
+    ::unlink(files[i].c_str());
+  }
+}
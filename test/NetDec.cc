@@ -336,3 +336,169 @@ TEST (NetDec, external_decoder_unload) {
 
   EXPECT_EQ (0, th->count ());
 }
+
+TEST (NetDec, glob_handler) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  struct pcap_pkthdr *pkthdr;
+  const u_char *pkt_data;
+  pcap_t *pd = get_skypeirc_pcap ();
+
+  TestHandler *eth_h = new TestHandler ();
+  TestHandler *pkt_h = new TestHandler ();
+  TestHandler *icmp_h = new TestHandler ();
+  TestHandler *none_h = new TestHandler ();
+  EXPECT_NE (swarm::HDLR_NULL, nd->set_handler ("ether.*", eth_h));
+  EXPECT_NE (swarm::HDLR_NULL, nd->set_handler ("*.packet", pkt_h));
+  swarm::hdlr_id none_id = nd->set_handler ("ipv?.*", none_h);
+  EXPECT_NE (swarm::HDLR_NULL, none_id);
+  EXPECT_EQ (none_h, nd->unset_handler (none_id));
+
+  // the pattern is expanded again for decoders loaded after registration
+  EXPECT_NE (swarm::HDLR_NULL, nd->set_handler ("icmp.*", icmp_h));
+  swarm::dec_id d_id = nd->load_decoder ("my-icmp", new IcmpDecoder (nd));
+  ASSERT_TRUE (d_id != swarm::DEC_NULL);
+  ASSERT_TRUE (nd->bind_decoder (d_id, "ipv4"));
+
+  while (0 < pcap_next_ex (pd, &pkthdr, &pkt_data)) {
+    nd->input (pkt_data, pkthdr->len, pkthdr->ts, pkthdr->caplen);
+  }
+
+  EXPECT_EQ (2263, eth_h->count ());
+  EXPECT_EQ (23, icmp_h->count ());
+  EXPECT_EQ (0, none_h->count ());
+  // ether, ipv4, dns and icmp packet events at least
+  EXPECT_LE (2263 + 2247 + 707 + 23, pkt_h->count ());
+}
+
+class PortDecoder : public swarm::Decoder {
+private:
+  swarm::ev_id EV_PKT_;
+
+public:
+  explicit PortDecoder (swarm::NetDec * nd) : swarm::Decoder (nd) {
+    this->EV_PKT_ = nd->assign_event ("my-port.packet", "Port Test Packet");
+  }
+  void setup (swarm::NetDec * nd) {
+  };
+
+  // name service like header: 12 byte and one question
+  bool accept (const swarm::Property &p) {
+    size_t len;
+    const swarm::byte_t *data = p.peek (&len);
+    return (len >= 12 && data[4] == 0 && data[5] == 1);
+  }
+
+  bool decode (swarm::Property *p) {
+    p->push_event (this->EV_PKT_);
+    return true;
+  }
+};
+
+void read_skypeirc (swarm::NetDec *nd) {
+  struct pcap_pkthdr *pkthdr;
+  const u_char *pkt_data;
+  pcap_t *pd = get_skypeirc_pcap ();
+  while (0 < pcap_next_ex (pd, &pkthdr, &pkt_data)) {
+    nd->input (pkt_data, pkthdr->len, pkthdr->ts, pkthdr->caplen);
+  }
+  pcap_close (pd);
+}
+
+TEST (NetDec, bind_port) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id dns_id = nd->lookup_dec_id ("dns");
+  EXPECT_EQ (dns_id, nd->lookup_port ("udp", 53));
+  EXPECT_EQ (swarm::DEC_NULL, nd->lookup_port ("udp", 54));
+  EXPECT_EQ (swarm::DEC_NULL, nd->lookup_port ("tcp", 53));
+
+  swarm::dec_id d_id = nd->load_decoder ("my-port", new PortDecoder (nd));
+  ASSERT_TRUE (d_id != swarm::DEC_NULL);
+  // a port has only one decoder
+  EXPECT_FALSE (nd->bind_port (d_id, "udp", 53));
+  EXPECT_FALSE (nd->unbind_port (d_id, "udp", 53));
+  EXPECT_FALSE (nd->bind_port (d_id, "no-such-decoder", 53));
+  ASSERT_TRUE (nd->unbind_port (dns_id, "udp", 53));
+  ASSERT_TRUE (nd->bind_port (d_id, "udp", 53));
+  EXPECT_EQ (d_id, nd->lookup_port ("udp", 53));
+
+  TestHandler *dns_h = new TestHandler ();
+  TestHandler *my_h = new TestHandler ();
+  nd->set_handler ("dns.packet", dns_h);
+  nd->set_handler ("my-port.packet", my_h);
+  read_skypeirc (nd);
+
+  EXPECT_EQ (0, dns_h->count ());
+  EXPECT_EQ (707, my_h->count ());
+
+  // port binding is removed with the decoder
+  ASSERT_TRUE (nd->unload_decoder (d_id));
+  EXPECT_EQ (swarm::DEC_NULL, nd->lookup_port ("udp", 53));
+}
+
+class SegHandler : public swarm::Handler {
+public:
+  int count_;
+  SegHandler () : count_(0) {}
+  void recv (swarm::ev_id eid, const swarm::Property &p) {
+    if (!p.value ("tcp_ssn.segment").is_null ()) {
+      this->count_++;
+    }
+  }
+};
+
+TEST (NetDec, bind_port_tcp) {
+  swarm::NetDec *nd0 = new swarm::NetDec ();
+  SegHandler *seg0 = new SegHandler ();
+  nd0->set_handler ("tcp.packet", seg0);
+  read_skypeirc (nd0);
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id d_id = nd->load_decoder ("my-port", new PortDecoder (nd));
+  ASSERT_TRUE (d_id != swarm::DEC_NULL);
+  ASSERT_TRUE (nd->bind_port (d_id, "tcp", 6667));  // IRC
+
+  TestHandler *my_h = new TestHandler ();
+  SegHandler *seg = new SegHandler ();
+  nd->set_handler ("my-port.packet", my_h);
+  nd->set_handler ("tcp.packet", seg);
+  read_skypeirc (nd);
+
+  EXPECT_LT (0, my_h->count ());
+  // tcp_ssn still reassembles segments of the bound port
+  EXPECT_LT (0, seg0->count_);
+  EXPECT_EQ (seg0->count_, seg->count_);
+  delete nd0;
+  delete nd;
+}
+
+TEST (NetDec, bind_signature) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id dns_id = nd->lookup_dec_id ("dns");
+  swarm::dec_id d_id = nd->load_decoder ("my-port", new PortDecoder (nd));
+  ASSERT_TRUE (d_id != swarm::DEC_NULL);
+  ASSERT_TRUE (nd->bind_signature (d_id, "udp"));
+  EXPECT_FALSE (nd->bind_signature (d_id, "udp"));
+
+  // bound port is prior to signature
+  TestHandler *dns_h = new TestHandler ();
+  TestHandler *my_h = new TestHandler ();
+  nd->set_handler ("dns.packet", dns_h);
+  nd->set_handler ("my-port.packet", my_h);
+  read_skypeirc (nd);
+  EXPECT_EQ (707, dns_h->count ());
+  int sig_only = my_h->count ();
+
+  // DNS queries and responses have one question, so all DNS packets
+  // match the signature after DNS port is released
+  swarm::NetDec *nd2 = new swarm::NetDec ();
+  d_id = nd2->load_decoder ("my-port", new PortDecoder (nd2));
+  ASSERT_TRUE (nd2->bind_signature (d_id, "udp"));
+  ASSERT_TRUE (nd2->unbind_port (dns_id, "udp", 53));
+  TestHandler *my2_h = new TestHandler ();
+  nd2->set_handler ("my-port.packet", my2_h);
+  read_skypeirc (nd2);
+  EXPECT_EQ (sig_only + 707, my2_h->count ());
+
+  ASSERT_TRUE (nd2->unbind_signature (d_id, "udp"));
+  EXPECT_FALSE (nd2->unbind_signature (d_id, "udp"));
+}
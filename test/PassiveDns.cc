@@ -0,0 +1,161 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "./gtest.h"
+#include "../src/swarm.h"
+#include "../src/utils/passive-dns.h"
+
+namespace passive_dns_test {
+  TEST(PassiveDns, basic) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::PassiveDns *pd = new swarm::PassiveDns(nd);
+    uint8_t a1[4] = {10, 0, 0, 1}, a2[4] = {10, 0, 0, 2};
+    uint8_t a6[16] = {0x20, 0x01, 0x0d, 0xb8};
+    const std::string n1 = "www.example.com.", n2 = "mail.example.com.";
+    size_t len;
+
+    EXPECT_TRUE(NULL == pd->lookup(a1, sizeof(a1), 100));
+    EXPECT_FALSE(pd->insert(a1, 5, n1.data(), n1.size(), 200));
+    EXPECT_TRUE(pd->insert(a1, sizeof(a1), n1.data(), n1.size(), 200));
+    EXPECT_TRUE(pd->insert(a2, sizeof(a2), n1.data(), n1.size(), 300));
+    EXPECT_TRUE(pd->insert(a6, sizeof(a6), n2.data(), n2.size(), 300));
+    EXPECT_EQ(3U, pd->size());
+    EXPECT_EQ(2U, pd->name_count());  // n1 is interned once
+
+    const char *name = pd->lookup(a1, sizeof(a1), 100, &len);
+    ASSERT_TRUE(name != NULL);
+    EXPECT_EQ(n1, std::string(name, len));
+    EXPECT_EQ(n2, pd->lookup(a6, sizeof(a6), 100));
+    EXPECT_TRUE(NULL == pd->lookup(a6, 4, 100));
+
+    // expired on lookup time
+    EXPECT_TRUE(NULL == pd->lookup(a1, sizeof(a1), 200));
+    EXPECT_TRUE(NULL != pd->lookup(a2, sizeof(a2), 200));
+
+    // newer answer replaces the name
+    EXPECT_TRUE(pd->insert(a2, sizeof(a2), n2.data(), n2.size(), 400));
+    EXPECT_EQ(n2, pd->lookup(a2, sizeof(a2), 300));
+    EXPECT_EQ(3U, pd->size());
+
+    delete pd;
+    delete nd;
+  }
+
+  TEST(PassiveDns, budget) {
+    const size_t budget = 16 * 1024;
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::PassiveDns *pd = new swarm::PassiveDns(nd, budget);
+    char name[64];
+    const size_t n = pd->capacity() * 4;
+
+    for (size_t i = 0; i < n; i++) {
+      uint32_t addr = htonl(0x0A000000 + i);
+      int len = snprintf(name, sizeof(name), "host-%zu.example.com.", i);
+      ASSERT_TRUE(pd->insert(&addr, sizeof(addr), name, len, 1000));
+      EXPECT_EQ(name, std::string(pd->lookup(&addr, sizeof(addr), 1)));
+      ASSERT_GE(pd->capacity(), pd->size());
+      ASSERT_GE(budget, pd->mem_usage());
+    }
+    EXPECT_EQ(n, pd->inserted());
+    EXPECT_EQ(n - pd->size(), pd->evicted());
+    EXPECT_EQ(pd->size(), pd->name_count());
+
+    delete pd;
+    delete nd;
+  }
+
+  TEST(PassiveDns, cname_case) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::PassiveDns *pd = new swarm::PassiveDns(nd);
+    nd->set_handler("dns.an", pd);
+
+    // response from 10.0.0.53:53 to 10.0.0.1:12345 for www.example.com,
+    // the CNAME target differs in case from the owner of the A record
+    const uint8_t pkt[] = {
+      0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x00, 0x01, 0x02, 0x03, 0x04, 0x06,
+      0x08, 0x00,
+      0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+      10, 0, 0, 53,  10, 0, 0, 1,
+      0x00, 0x35, 0x30, 0x39, 0x00, 0x00, 0x00, 0x00,
+      // id 1, response, 1 question and 2 answers
+      0x00, 0x01, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+      3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm',
+      0, 0x00, 0x01, 0x00, 0x01,
+      // WWW.Example.com CNAME cdn.example.net, ttl 3600
+      3, 'W', 'W', 'W', 7, 'E', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm',
+      0, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 17,
+      3, 'c', 'd', 'n', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'n', 'e', 't',
+      0,
+      // CDN.example.NET A 192.0.2.1, ttl 3600
+      3, 'C', 'D', 'N', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'N', 'E', 'T',
+      0, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 4,
+      192, 0, 2, 1,
+    };
+    uint8_t buf[sizeof(pkt)];
+    ::memcpy(buf, pkt, sizeof(pkt));
+    const uint16_t ip_len = htons(sizeof(pkt) - 14);
+    const uint16_t udp_len = htons(sizeof(pkt) - 34);
+    ::memcpy(buf + 16, &ip_len, 2);
+    ::memcpy(buf + 38, &udp_len, 2);
+    struct timeval tv = {1000, 0};
+    ASSERT_TRUE(nd->input(buf, sizeof(buf), tv, sizeof(buf)));
+
+    const uint8_t addr[4] = {192, 0, 2, 1};
+    const char *name = pd->lookup(addr, sizeof(addr));
+    ASSERT_TRUE(name != NULL);
+    EXPECT_EQ(std::string("www.example.com."), name);
+
+    delete pd;
+    delete nd;
+  }
+
+  TEST(PassiveDns, SkypeIRC) {
+    swarm::NetDec *nd = new swarm::NetDec();
+    swarm::PassiveDns *pd = new swarm::PassiveDns(nd);
+    nd->set_handler("dns.an", pd);
+
+    swarm::CapPcapFile *cap = new swarm::CapPcapFile("./data/SkypeIRC.cap");
+    cap->bind_netdec(nd);
+    ASSERT_TRUE(cap->start());
+
+    // answers in the capture are A (163) and PTR only, ttl is 10000 sec
+    EXPECT_LT(150U, pd->size());
+    uint32_t addr;
+    ASSERT_EQ(1, inet_pton(AF_INET, "212.204.214.114", &addr));
+    const char *name = pd->lookup(&addr, sizeof(addr));
+    ASSERT_TRUE(name != NULL);
+    EXPECT_EQ(std::string("sterling.freenode.net."), name);
+    EXPECT_TRUE(NULL == pd->lookup(&addr, sizeof(addr), 1156534267 + 10000));
+
+    delete cap;
+    delete pd;
+  }
+}  // namespace passive_dns_test
@@ -0,0 +1,168 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#include "../src/swarm.h"
+#include "../src/utils/pcap-compressed.h"
+
+namespace {
+  class PktRecorder : public swarm::Handler {
+  public:
+    std::vector<uint64_t> ts_;
+    std::vector<std::string> data_;
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->ts_.push_back (prop.ts_ns ());
+      swarm::Property &p = const_cast<swarm::Property &> (prop);
+      const swarm::byte_t *head = p.refer (0) - (p.cap_len () - p.remain ());
+      this->data_.push_back (std::string (reinterpret_cast<const char*> (head),
+                                          p.cap_len ()));
+    }
+  };
+
+  bool record (swarm::NetCap *cap, PktRecorder *rec) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    nd->set_handler ("ether.packet", rec);
+    cap->bind_netdec (nd);
+    bool rc = (cap->status () == swarm::NetCap::READY && cap->start ());
+    delete cap;
+    delete nd;
+    return rc;
+  }
+
+  std::string read_file (const std::string &path) {
+    std::string buf;
+    FILE *fp = fopen (path.c_str (), "rb");
+    char tmp[4096];
+    size_t len;
+    while (fp && (len = fread (tmp, 1, sizeof (tmp), fp)) > 0) {
+      buf.append (tmp, len);
+    }
+    if (fp) {
+      fclose (fp);
+    }
+    return buf;
+  }
+
+  std::string write_tmp (const std::string &buf) {
+    char fname[] = "/tmp/swarm_zcap_XXXXXX";
+    int fd = ::mkstemp (fname);
+    if (fd < 0 || ::write (fd, buf.data (), buf.size ()) !=
+        static_cast<ssize_t> (buf.size ())) {
+      return "";
+    }
+    ::close (fd);
+    return fname;
+  }
+
+  std::string compress (swarm::CapPcapCompressed::Codec codec,
+                        const std::string &src) {
+    std::string dst;
+    switch (codec) {
+#ifdef HAVE_ZLIB
+    case swarm::CapPcapCompressed::CODEC_GZIP: {
+      char fname[] = "/tmp/swarm_zcap_XXXXXX";
+      ::close (::mkstemp (fname));
+      gzFile gz = gzopen (fname, "wb");
+      gzwrite (gz, src.data (), src.size ());
+      gzclose (gz);
+      return fname;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case swarm::CapPcapCompressed::CODEC_ZSTD:
+      dst.resize (ZSTD_compressBound (src.size ()));
+      dst.resize (ZSTD_compress (&dst[0], dst.size (), src.data (),
+                                 src.size (), 3));
+      return write_tmp (dst);
+#endif
+#ifdef HAVE_LZ4
+    case swarm::CapPcapCompressed::CODEC_LZ4:
+      dst.resize (LZ4F_compressFrameBound (src.size (), NULL));
+      dst.resize (LZ4F_compressFrame (&dst[0], dst.size (), src.data (),
+                                      src.size (), NULL));
+      return write_tmp (dst);
+#endif
+    default:
+      return "";
+    }
+  }
+}
+
+TEST (CapPcapCompressed, codecs) {
+  PktRecorder orig;
+  ASSERT_TRUE (record (new swarm::CapPcapMmap ("./data/SkypeIRC.cap"),
+                       &orig));
+  std::string raw = read_file ("./data/SkypeIRC.cap");
+  ASSERT_FALSE (raw.empty ());
+
+  swarm::CapPcapCompressed::Codec codecs[] = {
+    swarm::CapPcapCompressed::CODEC_GZIP,
+    swarm::CapPcapCompressed::CODEC_ZSTD,
+    swarm::CapPcapCompressed::CODEC_LZ4,
+  };
+  for (size_t i = 0; i < sizeof (codecs) / sizeof (codecs[0]); i++) {
+    if (!swarm::CapPcapCompressed::has_codec (codecs[i])) {
+      continue;
+    }
+    std::string path = compress (codecs[i], raw);
+    ASSERT_FALSE (path.empty ());
+    EXPECT_EQ (codecs[i], swarm::CapPcapCompressed::detect (path));
+
+    // default ring and tiny buffers that split almost every record
+    PktRecorder big, small;
+    ASSERT_TRUE (record (new swarm::CapPcapCompressed (path), &big));
+    ASSERT_TRUE (record (new swarm::CapPcapCompressed (path, 100, 2),
+                         &small));
+    EXPECT_TRUE (orig.ts_ == big.ts_);
+    EXPECT_TRUE (orig.data_ == big.data_);
+    EXPECT_TRUE (orig.ts_ == small.ts_);
+    EXPECT_TRUE (orig.data_ == small.data_);
+    ::unlink (path.c_str ());
+  }
+}
+
+TEST (CapPcapCompressed, invalid) {
+  swarm::CapPcapCompressed *cap =
+    new swarm::CapPcapCompressed ("./data/SkypeIRC.cap");
+  EXPECT_EQ (swarm::NetCap::FAIL, cap->status ());
+  delete cap;
+  EXPECT_EQ (swarm::CapPcapCompressed::CODEC_NONE,
+             swarm::CapPcapCompressed::detect ("./data/not_exist.cap.gz"));
+}
@@ -0,0 +1,249 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "../src/swarm.h"
+#include "../src/utils/pcap-index.h"
+
+namespace {
+  class PktRecorder : public swarm::Handler {
+  public:
+    std::vector<uint64_t> ts_;
+    std::vector<uint64_t> hash_;
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->ts_.push_back (prop.ts_ns ());
+      this->hash_.push_back (prop.hash_value ());
+    }
+  };
+
+  bool record (swarm::NetCap *cap, PktRecorder *rec,
+               swarm::FlowHash *fh = NULL) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    nd->set_flow_hash (fh);
+    nd->set_handler ("ether.packet", rec);
+    cap->bind_netdec (nd);
+    bool rc = (cap->status () == swarm::NetCap::READY && cap->start ());
+    delete cap;
+    delete nd;
+    return rc;
+  }
+
+  const std::string sample_file = "./data/SkypeIRC.cap";
+
+  // copy an index file with overwriting `width` bytes of v at off (from
+  // the end if negative), and truncate the copy at len if not 0
+  bool corrupt (const std::string &src, const char *dst, off_t off,
+                uint64_t v, size_t width, off_t len = 0) {
+    FILE *in = fopen (src.c_str (), "rb");
+    FILE *out = fopen (dst, "wb");
+    std::vector<char> buf;
+    char c[4096];
+    size_t n;
+    while (in && (n = fread (c, 1, sizeof (c), in)) > 0) {
+      buf.insert (buf.end (), c, c + n);
+    }
+    if (in) {
+      fclose (in);
+    }
+    if (off < 0) {
+      off += buf.size ();
+    }
+    ::memcpy (&buf[off], &v, width);
+    if (len > 0) {
+      buf.resize (len);
+    }
+    bool rc = (out && fwrite (buf.data (), 1, buf.size (), out) == buf.size ());
+    if (out) {
+      fclose (out);
+    }
+    return rc;
+  }
+}
+
+TEST (PcapIndex, time_range) {
+  PktRecorder all;
+  ASSERT_TRUE (record (new swarm::CapPcapMmap (sample_file), &all));
+
+  swarm::PcapIndex idx (10ULL * 1000000000ULL);
+  ASSERT_TRUE (idx.build (sample_file));
+  EXPECT_LT (30U, idx.block_size ());
+
+  char fname[] = "/tmp/swarm_index_XXXXXX";
+  ::close (::mkstemp (fname));
+  ASSERT_TRUE (idx.save (fname));
+  swarm::PcapIndex loaded;
+  ASSERT_TRUE (loaded.load (fname));
+  ::unlink (fname);
+  EXPECT_EQ (idx.block_size (), loaded.block_size ());
+  EXPECT_EQ (idx.flow_size (), loaded.flow_size ());
+
+  // 30 seconds from 100 seconds after the first packet
+  uint64_t begin = all.ts_[0] + 100ULL * 1000000000ULL;
+  uint64_t end = begin + 30ULL * 1000000000ULL;
+  size_t expected = 0;
+  for (size_t i = 0; i < all.ts_.size (); i++) {
+    if (begin <= all.ts_[i] && all.ts_[i] <= end) {
+      expected++;
+    }
+  }
+  ASSERT_LT (0U, expected);
+
+  PktRecorder part;
+  swarm::CapPcapIndexed *cap = new swarm::CapPcapIndexed (sample_file,
+                                                          &loaded);
+  cap->set_time_range (begin, end);
+  swarm::NetDec *nd = new swarm::NetDec ();
+  nd->set_handler ("ether.packet", &part);
+  cap->bind_netdec (nd);
+  ASSERT_TRUE (cap->start ());
+  EXPECT_EQ (expected, part.ts_.size ());
+  EXPECT_GT (all.ts_.size () / 2, cap->read_count ());
+  delete cap;
+  delete nd;
+}
+
+TEST (PcapIndex, flow) {
+  PktRecorder all;
+  ASSERT_TRUE (record (new swarm::CapPcapMmap (sample_file), &all));
+
+  swarm::PcapIndex idx (10ULL * 1000000000ULL);
+  ASSERT_TRUE (idx.build (sample_file));
+
+  // the flow of the last packet
+  uint64_t hv = all.hash_.back ();
+  size_t expected = 0;
+  for (size_t i = 0; i < all.hash_.size (); i++) {
+    expected += (all.hash_[i] == hv) ? 1 : 0;
+  }
+
+  std::vector<uint32_t> blocks;
+  ASSERT_TRUE (idx.find_flow (hv, &blocks));
+  EXPECT_FALSE (idx.find_flow (hv + 1, &blocks));
+
+  PktRecorder part;
+  swarm::CapPcapIndexed *cap = new swarm::CapPcapIndexed (sample_file, &idx);
+  cap->set_flow (hv);
+  ASSERT_TRUE (record (cap, &part));
+  ASSERT_EQ (expected, part.hash_.size ());
+  for (size_t i = 0; i < part.hash_.size (); i++) {
+    EXPECT_EQ (hv, part.hash_[i]);
+  }
+
+  // index built for another file is rejected
+  swarm::PcapIndex other;
+  cap = new swarm::CapPcapIndexed (sample_file, &other);
+  EXPECT_EQ (swarm::NetCap::FAIL, cap->status ());
+  delete cap;
+}
+
+TEST (PcapIndex, flow_hash) {
+  // flows are indexed by hash_value() of the hash set to the index, and
+  // NetDec of a query must use the same hash
+  swarm::FlowHash *fh = swarm::FlowHash::New ("crc32c");
+  PktRecorder all;
+  ASSERT_TRUE (record (new swarm::CapPcapMmap (sample_file), &all, fh));
+
+  swarm::PcapIndex idx;
+  EXPECT_EQ ("default", idx.flow_hash ());
+  EXPECT_FALSE (idx.set_flow_hash ("no-such-hash"));
+  ASSERT_TRUE (idx.set_flow_hash ("crc32c"));
+  ASSERT_TRUE (idx.build (sample_file));
+  char fname[] = "/tmp/swarm_index_XXXXXX";
+  ::close (::mkstemp (fname));
+  ASSERT_TRUE (idx.save (fname));
+  swarm::PcapIndex loaded;
+  ASSERT_TRUE (loaded.load (fname));
+  ::unlink (fname);
+  EXPECT_EQ ("crc32c", loaded.flow_hash ());
+
+  uint64_t hv = all.hash_.back ();
+  size_t expected = 0;
+  for (size_t i = 0; i < all.hash_.size (); i++) {
+    expected += (all.hash_[i] == hv) ? 1 : 0;
+  }
+  PktRecorder part;
+  swarm::CapPcapIndexed *cap = new swarm::CapPcapIndexed (sample_file,
+                                                          &loaded);
+  cap->set_flow (hv);
+  ASSERT_TRUE (record (cap, &part, fh));
+  EXPECT_EQ (expected, part.hash_.size ());
+
+  PktRecorder other;
+  cap = new swarm::CapPcapIndexed (sample_file, &loaded);
+  cap->set_flow (hv);
+  EXPECT_FALSE (record (cap, &other));
+  EXPECT_EQ (0U, other.hash_.size ());
+  delete fh;
+}
+
+TEST (PcapIndex, broken) {
+  swarm::PcapIndex idx (10ULL * 1000000000ULL);
+  ASSERT_TRUE (idx.build (sample_file));
+  char fname[] = "/tmp/swarm_index_XXXXXX";
+  ::close (::mkstemp (fname));
+  ASSERT_TRUE (idx.save (fname));
+  std::string good = std::string (fname) + ".good";
+  ASSERT_EQ (0, ::rename (fname, good.c_str ()));
+
+  // header 80 bytes, then blocks and flows of 24 bytes, then postings
+  const off_t flow0 = 80 + 24 * idx.block_size ();
+  struct {
+    off_t off_;
+    uint64_t v_;
+    size_t width_;
+    off_t len_;
+  } cases[] = {
+    {flow0 + 8, 0xffffffffffffff00ULL, 8, 0},  // begin of posting list
+    {flow0 + 16, 0xffffffffULL, 8, 0},         // length of posting list
+    {-4, idx.block_size (), 4, 0},             // block id in posting
+    {80 + 24, 0, 8, 0},                        // block offset goes back
+    {flow0 + 24, 0, 8, 0},                     // flow hash not sorted
+    {32, 0x100000000000ULL, 8, 0},             // block count in header
+    {0, 'X', 1, 0},                            // magic
+    {0, 0, 0, flow0 + 4},                      // truncated
+  };
+
+  swarm::PcapIndex loaded;
+  ASSERT_TRUE (corrupt (good, fname, 0, 0, 0));
+  EXPECT_TRUE (loaded.load (fname)) << loaded.errmsg ();
+  for (size_t i = 0; i < sizeof (cases) / sizeof (cases[0]); i++) {
+    ASSERT_TRUE (corrupt (good, fname, cases[i].off_, cases[i].v_,
+                          cases[i].width_, cases[i].len_));
+    swarm::PcapIndex broken;
+    EXPECT_FALSE (broken.load (fname)) << i;
+    EXPECT_NE ("", broken.errmsg ()) << i;
+    EXPECT_EQ (0U, broken.block_size ()) << i;
+    EXPECT_EQ (0U, broken.flow_size ()) << i;
+  }
+  ::unlink (fname);
+  ::unlink (good.c_str ());
+}
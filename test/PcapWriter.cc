@@ -0,0 +1,234 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <pcap.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "../src/swarm.h"
+#include "../src/utils/pcap-writer.h"
+
+namespace {
+  class PktRecorder : public swarm::Handler {
+  public:
+    std::vector<uint64_t> ts_;
+    std::vector<uint64_t> hash_;
+    std::vector<std::string> data_;
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->ts_.push_back (prop.ts_ns ());
+      this->hash_.push_back (prop.hash_value ());
+      this->data_.push_back (
+          std::string (reinterpret_cast<const char*> (prop.raw_data ()),
+                       prop.cap_len ()));
+    }
+  };
+
+  bool record (const std::string &path, PktRecorder *rec) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    nd->set_handler ("ether.packet", rec);
+    swarm::CapPcapMmap *cap = new swarm::CapPcapMmap (path);
+    cap->bind_netdec (nd);
+    bool rc = (cap->status () == swarm::NetCap::READY && cap->start ());
+    delete cap;
+    delete nd;
+    return rc;
+  }
+
+  // decode SkypeIRC.cap and write packets of the event by the writer
+  void dump (swarm::NetDec *nd, swarm::PcapWriter *w,
+             const std::string &ev = "ether.packet") {
+    nd->set_handler (ev, w);
+    swarm::CapPcapMmap *cap = new swarm::CapPcapMmap ("./data/SkypeIRC.cap");
+    cap->bind_netdec (nd);
+    ASSERT_TRUE (cap->start ());
+    ASSERT_TRUE (w->close ());
+    delete cap;
+  }
+
+  std::string tmp_path () {
+    char fname[] = "/tmp/swarm_writer_XXXXXX";
+    ::close (::mkstemp (fname));
+    return fname;
+  }
+
+  void remove_files (const swarm::PcapWriter &w) {
+    for (size_t i = 0; i < w.file_count (); i++) {
+      ::unlink (w.file_path (i).c_str ());
+    }
+  }
+}
+
+TEST (PcapWriter, formats) {
+  PktRecorder orig;
+  ASSERT_TRUE (record ("./data/SkypeIRC.cap", &orig));
+
+  for (int i = 0; i < 4; i++) {
+    swarm::PcapWriter::Format fmt = (i & 1) ?
+      swarm::PcapWriter::FMT_PCAPNG : swarm::PcapWriter::FMT_PCAP;
+    swarm::NetDec *nd = new swarm::NetDec ();
+    std::string path = tmp_path ();
+    swarm::PcapWriter *w = new swarm::PcapWriter (nd, path, fmt, 0, 2);
+    w->set_io_uring (i < 2);
+    w->set_block (true);
+    dump (nd, w);
+    EXPECT_EQ (1U, w->file_count ());
+    EXPECT_EQ (orig.ts_.size (), w->pkt_count ());
+    EXPECT_EQ (0U, w->drop_count ());
+
+    PktRecorder out;
+    ASSERT_TRUE (record (path, &out));
+    EXPECT_TRUE (orig.ts_ == out.ts_);
+    EXPECT_TRUE (orig.data_ == out.data_);
+    remove_files (*w);
+    delete w;
+    delete nd;
+  }
+}
+
+TEST (PcapWriter, rotation) {
+  PktRecorder orig;
+  ASSERT_TRUE (record ("./data/SkypeIRC.cap", &orig));
+
+  // by size, packets are split into files without loss
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::PcapWriter *w = new swarm::PcapWriter (nd, tmp_path ());
+  w->set_block (true);
+  w->set_rotation (100 * 1000, 0);
+  dump (nd, w);
+  EXPECT_EQ (5U, w->file_count ());
+
+  PktRecorder out;
+  for (size_t i = 0; i < w->file_count (); i++) {
+    ASSERT_TRUE (record (w->file_path (i), &out));
+  }
+  EXPECT_TRUE (orig.data_ == out.data_);
+  remove_files (*w);
+  delete w;
+  delete nd;
+
+  // by packet time, 322 seconds into 60 seconds files
+  nd = new swarm::NetDec ();
+  w = new swarm::PcapWriter (nd, tmp_path ());
+  w->set_block (true);
+  w->set_rotation (0, 60ULL * 1000000000ULL);
+  dump (nd, w);
+  EXPECT_EQ (6U, w->file_count ());
+  size_t total = 0;
+  for (size_t i = 0; i < w->file_count (); i++) {
+    PktRecorder part;
+    ASSERT_TRUE (record (w->file_path (i), &part));
+    ASSERT_LT (0U, part.ts_.size ());
+    EXPECT_GT (60ULL * 1000000000ULL, part.ts_.back () - part.ts_.front ());
+    total += part.ts_.size ();
+  }
+  EXPECT_EQ (orig.ts_.size (), total);
+  remove_files (*w);
+  delete w;
+  delete nd;
+}
+
+TEST (PcapWriter, selection) {
+  PktRecorder orig;
+  ASSERT_TRUE (record ("./data/SkypeIRC.cap", &orig));
+
+  // by flow
+  uint64_t hv = orig.hash_.back ();
+  size_t expected = 0;
+  for (size_t i = 0; i < orig.hash_.size (); i++) {
+    expected += (orig.hash_[i] == hv) ? 1 : 0;
+  }
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::PcapWriter *w = new swarm::PcapWriter (nd, tmp_path ());
+  w->add_flow (hv);
+  dump (nd, w);
+  PktRecorder out;
+  ASSERT_TRUE (record (w->file_path (0), &out));
+  EXPECT_EQ (expected, out.hash_.size ());
+  remove_files (*w);
+  delete w;
+  delete nd;
+
+  // by BPF, "ip"
+  const struct bpf_insn ip_prog[] = {
+    { 0x28, 0, 0, 0x0000000c },  // ldh [12]
+    { 0x15, 0, 1, 0x00000800 },  // jeq #0x800
+    { 0x06, 0, 0, 0x0000ffff },  // ret #65535
+    { 0x06, 0, 0, 0x00000000 },  // ret #0
+  };
+  nd = new swarm::NetDec ();
+  w = new swarm::PcapWriter (nd, tmp_path ());
+  ASSERT_TRUE (w->set_filter (ip_prog, 4));
+  dump (nd, w);
+  EXPECT_EQ (2247U, w->pkt_count ());
+  remove_files (*w);
+  delete w;
+  delete nd;
+
+  // by event, written once per packet
+  nd = new swarm::NetDec ();
+  w = new swarm::PcapWriter (nd, tmp_path ());
+  dump (nd, w, "dns.packet");
+  EXPECT_EQ (707U, w->pkt_count ());
+  remove_files (*w);
+  delete w;
+  delete nd;
+}
+
+TEST (PcapWriter, reused_buffer) {
+  // libpcap offline passes every packet in the same buffer; two packets
+  // with the same time must both be written, and once each although the
+  // writer handles two events of them
+  PktRecorder orig;
+  ASSERT_TRUE (record ("./data/SkypeIRC.cap", &orig));
+  ASSERT_NE (orig.data_[0], orig.data_[1]);
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::PcapWriter *w = new swarm::PcapWriter (nd, tmp_path ());
+  w->set_block (true);
+  nd->set_handler ("ether.packet", w);
+  nd->set_handler ("ipv4.packet", w);
+  std::vector<swarm::byte_t> buf (0x10000);
+  for (size_t i = 0; i < 2; i++) {
+    const std::string &pkt = orig.data_[i];
+    ::memcpy (buf.data (), pkt.data (), pkt.size ());
+    nd->input (buf.data (), pkt.size (), orig.ts_[0], pkt.size ());
+  }
+  ASSERT_TRUE (w->close ());
+  EXPECT_EQ (2U, w->pkt_count ());
+  EXPECT_EQ (0U, w->drop_count ());
+
+  PktRecorder out;
+  ASSERT_TRUE (record (w->file_path (0), &out));
+  ASSERT_EQ (2U, out.data_.size ());
+  EXPECT_EQ (orig.data_[0], out.data_[0]);
+  EXPECT_EQ (orig.data_[1], out.data_[1]);
+  remove_files (*w);
+  delete w;
+  delete nd;
+}
@@ -0,0 +1,249 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <string>
+#include "../src/swarm.h"
+
+namespace {
+  class CountDecoder : public swarm::Decoder {
+  private:
+    swarm::ev_id EV_PKT_;
+    swarm::val_id P_VER_;
+    u_int8_t ver_;
+
+  public:
+    int count_;
+    CountDecoder (swarm::NetDec * nd, u_int8_t ver) :
+      swarm::Decoder (nd), ver_(ver), count_(0) {
+      this->EV_PKT_ = nd->assign_event ("my-count.packet", "Count Packet");
+      this->P_VER_ = nd->assign_value ("my-count.ver", "Decoder Version",
+                                       new swarm::FacNum ());
+    }
+    void setup (swarm::NetDec * nd) {
+    };
+    static swarm::Decoder * New (swarm::NetDec * nd) {
+      return new CountDecoder (nd, 1);
+    }
+    static swarm::Decoder * New2 (swarm::NetDec * nd) {
+      return new CountDecoder (nd, 2);
+    }
+
+    bool accept (const swarm::Property &p) {
+      return true;
+    }
+    void migrate (swarm::Decoder *old) {
+      CountDecoder *prev = dynamic_cast<CountDecoder *> (old);
+      if (prev) {
+        this->count_ = prev->count_;
+      }
+    }
+    bool decode (swarm::Property *p) {
+      this->count_++;
+      p->set (this->P_VER_, &(this->ver_), sizeof (this->ver_));
+      p->push_event (this->EV_PKT_);
+      return true;
+    }
+  };
+
+  class VerCounter : public swarm::Handler {
+  private:
+    std::string ver_;
+
+  public:
+    int count_[3];
+    swarm::NetDec *swap_nd_;  // swap at the first packet if set
+    explicit VerCounter (const std::string &ver = "my-count.ver") :
+      ver_(ver), swap_nd_(NULL) {
+      count_[0] = count_[1] = count_[2] = 0;
+    }
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->count_[prop.value (this->ver_).uint32 ()]++;
+      if (this->swap_nd_) {
+        EXPECT_TRUE (this->swap_nd_->swap_decoder ("my-count",
+                                                   CountDecoder::New2));
+        // old decoder and its value are alive until end of the packet
+        EXPECT_EQ (0U, this->swap_nd_->swap_count ());
+        EXPECT_EQ (1U, prop.value ("my-count.ver").uint32 ());
+        this->swap_nd_ = NULL;
+      }
+    }
+  };
+
+  class SegCounter : public swarm::Handler {
+  public:
+    int count_;
+    SegCounter () : count_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      if (!prop.value ("tcp_ssn.segment").is_null ()) {
+        this->count_++;
+      }
+    }
+  };
+
+  // read SkypeIRC and call swap() after n packets
+  template <typename F>
+  void read (swarm::NetDec *nd, size_t n, F swap) {
+    swarm::PcapReader reader ("./data/SkypeIRC.cap");
+    ASSERT_TRUE (reader.ready ());
+    swarm::PcapReader::Record rec;
+    for (size_t i = 0; reader.next (&rec) > 0; i++) {
+      if (i == n) {
+        swap (nd);
+      }
+      nd->input (rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+    }
+  }
+  void no_swap (swarm::NetDec *nd) {
+  }
+}
+
+TEST (Plugin, load_error) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  EXPECT_EQ (swarm::DEC_NULL, nd->load_plugin ("./no-such-plugin.so"));
+  EXPECT_NE ("", nd->errmsg ());
+  EXPECT_FALSE (nd->swap_plugin ("./no-such-plugin.so"));
+  EXPECT_FALSE (nd->swap_decoder ("no-such-decoder", CountDecoder::New));
+
+  // failed request from other thread is left in errmsg
+  nd->request_swap ("./no-such-plugin.so");
+  read (nd, 0, no_swap);
+  EXPECT_EQ (0U, nd->swap_count ());
+  EXPECT_NE ("", nd->errmsg ());
+  delete nd;
+}
+
+TEST (Plugin, swap_decoder) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id d_id = nd->load_decoder ("my-count", CountDecoder::New (nd));
+  ASSERT_NE (swarm::DEC_NULL, d_id);
+  ASSERT_TRUE (nd->bind_decoder (d_id, "ipv4"));
+  swarm::ev_id eid = nd->lookup_event_id ("my-count.packet");
+  swarm::val_id vid = nd->lookup_value_id ("my-count.ver");
+  size_t ev_size = nd->event_size ();
+  size_t val_size = nd->value_size ();
+
+  VerCounter *vc = new VerCounter ();
+  nd->set_handler ("my-count.packet", vc);
+  read (nd, 1000, [] (swarm::NetDec *nd) {
+      EXPECT_TRUE (nd->swap_decoder ("my-count", CountDecoder::New2));
+    });
+
+  // registrations are kept over the swap
+  EXPECT_EQ (1U, nd->swap_count ());
+  EXPECT_EQ (d_id, nd->lookup_dec_id ("my-count"));
+  EXPECT_EQ (eid, nd->lookup_event_id ("my-count.packet"));
+  EXPECT_EQ (vid, nd->lookup_value_id ("my-count.ver"));
+  EXPECT_EQ (ev_size, nd->event_size ());
+  EXPECT_EQ (val_size, nd->value_size ());
+
+  // binding and handler are kept, and no packet is lost
+  EXPECT_LT (0, vc->count_[1]);
+  EXPECT_LT (0, vc->count_[2]);
+  EXPECT_EQ (2247, vc->count_[1] + vc->count_[2]);
+  delete nd;
+}
+
+TEST (Plugin, swap_in_handler) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id d_id = nd->load_decoder ("my-count", CountDecoder::New (nd));
+  ASSERT_TRUE (nd->bind_decoder (d_id, "ipv4"));
+
+  VerCounter *vc = new VerCounter ();
+  vc->swap_nd_ = nd;
+  nd->set_handler ("my-count.packet", vc);
+  read (nd, 0, no_swap);
+
+  EXPECT_EQ (1U, nd->swap_count ());
+  EXPECT_EQ (1, vc->count_[1]);
+  EXPECT_EQ (2246, vc->count_[2]);
+  delete nd;
+}
+
+TEST (Plugin, swap_tcp_ssn) {
+  // TCP sessions migrate, so reassembly goes on as without swap
+  swarm::NetDec *nd1 = new swarm::NetDec ();
+  SegCounter *seg1 = new SegCounter ();
+  nd1->set_handler ("tcp.packet", seg1);
+  read (nd1, 0, no_swap);
+
+  swarm::NetDec *nd2 = new swarm::NetDec ();
+  SegCounter *seg2 = new SegCounter ();
+  nd2->set_handler ("tcp.packet", seg2);
+  read (nd2, 1000, [] (swarm::NetDec *nd) {
+      auto New = swarm::DecoderMap::lookup ("tcp_ssn");
+      ASSERT_TRUE (New != NULL);
+      EXPECT_TRUE (nd->swap_decoder ("tcp_ssn", New));
+    });
+
+  EXPECT_EQ (1U, nd2->swap_count ());
+  EXPECT_LT (0, seg1->count_);
+  EXPECT_EQ (seg1->count_, seg2->count_);
+  delete nd1;
+  delete nd2;
+}
+
+// plugin-count1.so and plugin-count2.so are built from test/plugin
+TEST (Plugin, load_plugin) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  swarm::dec_id d_id = nd->load_plugin (PLUGIN_PATH "1.so");
+  ASSERT_NE (swarm::DEC_NULL, d_id) << nd->errmsg ();
+  EXPECT_EQ (d_id, nd->lookup_dec_id ("plugin_count"));
+  ASSERT_TRUE (nd->bind_decoder (d_id, "ipv4"));
+  EXPECT_EQ (swarm::DEC_NULL, nd->load_plugin (PLUGIN_PATH "1.so"));
+  EXPECT_NE ("", nd->errmsg ());
+
+  VerCounter *vc = new VerCounter ("plugin_count.ver");
+  nd->set_handler ("plugin_count.packet", vc);
+  read (nd, 0, no_swap);
+  EXPECT_EQ (2247, vc->count_[1]);
+  EXPECT_EQ (0, vc->count_[2]);
+  delete nd;  // the decoder is deleted before the plugin is closed
+}
+
+TEST (Plugin, swap_plugin) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  // only a loaded decoder can be swapped
+  EXPECT_FALSE (nd->swap_plugin (PLUGIN_PATH "2.so"));
+  EXPECT_NE ("", nd->errmsg ());
+
+  swarm::dec_id d_id = nd->load_plugin (PLUGIN_PATH "1.so");
+  ASSERT_NE (swarm::DEC_NULL, d_id) << nd->errmsg ();
+  ASSERT_TRUE (nd->bind_decoder (d_id, "ipv4"));
+
+  VerCounter *vc = new VerCounter ("plugin_count.ver");
+  nd->set_handler ("plugin_count.packet", vc);
+  read (nd, 1000, [] (swarm::NetDec *nd) {
+      EXPECT_TRUE (nd->swap_plugin (PLUGIN_PATH "2.so")) << nd->errmsg ();
+    });
+
+  EXPECT_EQ (1U, nd->swap_count ());
+  EXPECT_EQ (d_id, nd->lookup_dec_id ("plugin_count"));
+  EXPECT_LT (0, vc->count_[1]);
+  EXPECT_LT (0, vc->count_[2]);
+  EXPECT_EQ (2247, vc->count_[1] + vc->count_[2]);
+  delete nd;
+}
@@ -0,0 +1,198 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <pcap.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../src/swarm.h"
+#include "../src/sampler.h"
+
+namespace {
+  class HashRecorder : public swarm::Handler {
+  public:
+    std::vector<uint64_t> hash_;
+    std::vector<uint32_t> rate_;
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->hash_.push_back (prop.hash_value ());
+      this->rate_.push_back (prop.sample_rate ());
+    }
+  };
+
+  struct Pkt {
+    std::string data_;
+    size_t len_;
+    struct timeval tv_;
+  };
+
+  void load_pcap (std::vector<Pkt> *pkts) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *pkthdr;
+    const u_char *pkt_data;
+    pcap_t *pd = pcap_open_offline ("./data/SkypeIRC.cap", errbuf);
+    ASSERT_TRUE (pd != NULL);
+    while (0 < pcap_next_ex (pd, &pkthdr, &pkt_data)) {
+      Pkt p;
+      p.data_.assign (reinterpret_cast<const char*>(pkt_data),
+                      pkthdr->caplen);
+      p.len_ = pkthdr->len;
+      p.tv_ = pkthdr->ts;
+      pkts->push_back (p);
+    }
+    pcap_close (pd);
+  }
+
+  void feed (swarm::NetDec *nd, const std::vector<Pkt> &pkts,
+             size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      nd->input (reinterpret_cast<const swarm::byte_t*>(pkts[i].data_.data ()),
+                 pkts[i].len_, pkts[i].tv_, pkts[i].data_.size ());
+    }
+  }
+}
+
+TEST (Sampler, raw_flow_hash) {
+  std::vector<Pkt> pkts;
+  load_pcap (&pkts);
+  ASSERT_EQ (2263U, pkts.size ());
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  HashRecorder *rec = new HashRecorder ();
+  nd->set_handler ("ether.packet", rec);
+  feed (nd, pkts, 0, pkts.size ());
+  ASSERT_EQ (pkts.size (), rec->hash_.size ());
+
+  // without any decoder, same value as Property::hash_value()
+  for (size_t i = 0; i < pkts.size (); i++) {
+    const swarm::byte_t *d =
+      reinterpret_cast<const swarm::byte_t*>(pkts[i].data_.data ());
+    EXPECT_EQ (rec->hash_[i],
+               swarm::Sampler::raw_flow_hash (d, pkts[i].data_.size (),
+                                              DLT_EN10MB)) << i;
+    EXPECT_EQ (1U, rec->rate_[i]);
+  }
+  delete nd;
+}
+
+TEST (Sampler, raw_flow_hash_fragment) {
+  // IPv4 UDP 10.0.0.1:4660 > 10.0.0.2:53, first fragment
+  swarm::byte_t pkt[28] = {
+    0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x20, 0x00, 0x40, 0x11, 0x00, 0x00,
+    10, 0, 0, 1,  10, 0, 0, 2,
+    0x12, 0x34, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00,
+  };
+  const uint64_t first = swarm::Sampler::raw_flow_hash (pkt, sizeof (pkt),
+                                                        DLT_RAW);
+  // same addresses and protocol without L4 header
+  const uint64_t no_port = swarm::Sampler::raw_flow_hash (pkt, 20, DLT_RAW);
+  EXPECT_NE (first, no_port);
+
+  // later fragments carry payload where ports would be, it is not used
+  pkt[6] = 0x00;
+  pkt[7] = 0xb9;
+  EXPECT_EQ (no_port, swarm::Sampler::raw_flow_hash (pkt, sizeof (pkt),
+                                                     DLT_RAW));
+  pkt[20] = 0xff;
+  pkt[23] = 0xff;
+  EXPECT_EQ (no_port, swarm::Sampler::raw_flow_hash (pkt, sizeof (pkt),
+                                                     DLT_RAW));
+}
+
+TEST (Sampler, packet) {
+  std::vector<Pkt> pkts;
+  load_pcap (&pkts);
+
+  swarm::NetDec *nd = new swarm::NetDec ();
+  HashRecorder *rec = new HashRecorder ();
+  nd->set_handler ("ether.packet", rec);
+  EXPECT_FALSE (nd->set_sampling (swarm::SAMPLE_PACKET, 0));
+  ASSERT_TRUE (nd->set_sampling (swarm::SAMPLE_PACKET, 10));
+  EXPECT_EQ (10U, nd->sample_rate ());
+
+  feed (nd, pkts, 0, 1000);
+  EXPECT_EQ (100U, rec->hash_.size ());
+  EXPECT_EQ (900U, nd->sample_drop ());
+
+  // change rate at runtime
+  ASSERT_TRUE (nd->set_sampling (swarm::SAMPLE_PACKET, 2));
+  feed (nd, pkts, 1000, 2000);
+  EXPECT_EQ (600U, rec->hash_.size ());
+  EXPECT_EQ (10U, rec->rate_[0]);
+  EXPECT_EQ (2U, rec->rate_.back ());
+
+  // and turn it off
+  ASSERT_TRUE (nd->set_sampling (swarm::SAMPLE_NONE, 0));
+  feed (nd, pkts, 2000, pkts.size ());
+  EXPECT_EQ (600 + pkts.size () - 2000, rec->hash_.size ());
+  EXPECT_EQ (1U, rec->rate_.back ());
+  EXPECT_EQ (pkts.size (), nd->recv_pkt ());
+  delete nd;
+}
+
+TEST (Sampler, flow) {
+  std::vector<Pkt> pkts;
+  load_pcap (&pkts);
+
+  // packets per flow without sampling
+  std::map<uint64_t, size_t> all;
+  for (size_t i = 0; i < pkts.size (); i++) {
+    const swarm::byte_t *d =
+      reinterpret_cast<const swarm::byte_t*>(pkts[i].data_.data ());
+    all[swarm::Sampler::raw_flow_hash (d, pkts[i].data_.size (),
+                                       DLT_EN10MB)]++;
+  }
+
+  std::map<uint64_t, size_t> kept[2];
+  const uint32_t rates[2] = {4, 16};
+  for (size_t r = 0; r < 2; r++) {
+    swarm::NetDec *nd = new swarm::NetDec ();
+    HashRecorder *rec = new HashRecorder ();
+    nd->set_handler ("ether.packet", rec);
+    ASSERT_TRUE (nd->set_sampling (swarm::SAMPLE_FLOW, rates[r]));
+    feed (nd, pkts, 0, pkts.size ());
+
+    EXPECT_EQ (pkts.size (), rec->hash_.size () + nd->sample_drop ());
+    for (size_t i = 0; i < rec->hash_.size (); i++) {
+      kept[r][rec->hash_[i]]++;
+      EXPECT_EQ (rates[r], rec->rate_[i]);
+    }
+    delete nd;
+  }
+
+  // whole flows are kept, and some flows are dropped
+  for (size_t r = 0; r < 2; r++) {
+    EXPECT_LT (0U, kept[r].size ());
+    EXPECT_GT (all.size (), kept[r].size ());
+    for (auto it = kept[r].begin (); it != kept[r].end (); it++) {
+      EXPECT_EQ (all[it->first], it->second);
+    }
+  }
+  // flows kept at 1-in-16 are kept at 1-in-4 as well
+  for (auto it = kept[1].begin (); it != kept[1].end (); it++) {
+    EXPECT_EQ (1U, kept[0].count (it->first));
+  }
+}
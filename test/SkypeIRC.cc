@@ -471,4 +471,38 @@ namespace SkypeIRC {
 
   }
 
+  TEST_F (SkypeIRCFix, repeat_timer) {
+    class Stat : public swarm::Task {
+    public:
+      swarm::NetDec *nd_;
+      std::vector<uint64_t> pkt_;
+      std::vector<time_t> sec_;
+      void exec (const struct timespec &ts) {
+        this->pkt_.push_back(this->nd_->recv_pkt ());
+        this->sec_.push_back(ts.tv_sec);
+      }
+    };
+
+    Stat stat;
+    stat.nd_ = nd;
+    EXPECT_NE (swarm::TASK_NULL, nd->set_repeat_timer (&stat, 10000));
+    EXPECT_EQ (swarm::TASK_NULL, nd->set_repeat_timer (&stat, 0));
+
+    for (auto it = test_data.begin (); it != test_data.end (); it++) {
+      PcapData * p = (*it);
+      nd->input (p->pkt_data (), p->len (), *(p->ts ()), p->caplen ());
+    }
+
+    // 322.7 sec of traffic, replayed at full speed
+    ASSERT_EQ (32U, stat.pkt_.size ());
+    time_t init_sec = static_cast<time_t>(nd->init_ts ());
+    for (size_t i = 0; i < stat.sec_.size (); i++) {
+      EXPECT_EQ (init_sec + 10 * static_cast<time_t>(i + 1), stat.sec_[i]);
+      if (i > 0) {
+        EXPECT_LE (stat.pkt_[i - 1], stat.pkt_[i]);
+      }
+    }
+    EXPECT_GT (nd->recv_pkt (), stat.pkt_.back ());
+  }
+
 }  // namespace SkypeIRC
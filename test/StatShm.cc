@@ -0,0 +1,126 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include "../src/swarm.h"
+#include "../src/utils/stat-shm.h"
+
+namespace {
+  class StatCounter : public swarm::Handler {
+  public:
+    uint64_t count_;
+    StatCounter () : count_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &prop) {
+      this->count_++;
+    }
+  };
+
+  std::string seg_name () {
+    std::stringstream ss;
+    ss << "test-" << ::getpid ();
+    return ss.str ();
+  }
+
+  const swarm::StatSegment::Dec *find_dec (const swarm::StatSegment &s,
+                                           const char *name) {
+    for (uint32_t i = 0; i < s.dec_size_; i++) {
+      if (0 == strcmp (s.dec_[i].name_, name)) {
+        return &s.dec_[i];
+      }
+    }
+    return NULL;
+  }
+}
+
+TEST (StatShm, publish) {
+  swarm::NetDec *nd = new swarm::NetDec ();
+  nd->set_profile (true);
+  StatCounter *dns = new StatCounter ();
+  StatCounter *glob = new StatCounter ();
+  swarm::hdlr_id dns_id = nd->set_handler ("dns.packet", dns);
+  nd->set_handler ("tcp.*", glob);
+
+  swarm::StatPublisher *sp = new swarm::StatPublisher (seg_name (), nd);
+  ASSERT_TRUE (sp->ready ()) << sp->errmsg ();
+  // updated by packet time while reading
+  ASSERT_NE (swarm::TASK_NULL, nd->set_repeat_timer (sp, 1000));
+
+  swarm::StatReader reader;
+  ASSERT_TRUE (reader.open (seg_name ())) << reader.errmsg ();
+  swarm::StatSegment *s = new swarm::StatSegment ();
+  ASSERT_TRUE (reader.read (s));
+  EXPECT_EQ (swarm::STAT_VERSION, s->version_);
+  EXPECT_EQ (static_cast<uint64_t>(::getpid ()), s->pid_);
+  EXPECT_EQ (0U, s->recv_pkt_);
+
+  swarm::PcapReader pcap ("./data/SkypeIRC.cap");
+  ASSERT_TRUE (pcap.ready ());
+  swarm::PcapReader::Record rec;
+  while (pcap.next (&rec) > 0) {
+    nd->input (rec.data_, rec.len_, rec.ts_ns_, rec.caplen_);
+  }
+  ASSERT_TRUE (reader.read (s));
+  EXPECT_LT (0U, s->recv_pkt_);  // by timer
+  EXPECT_GT (2263U, s->recv_pkt_);
+
+  sp->update ();
+  ASSERT_TRUE (reader.read (s));
+  EXPECT_EQ (2263U, s->recv_pkt_);
+  EXPECT_EQ (nd->recv_len (), s->recv_len_);
+  EXPECT_EQ (0U, s->cap_valid_);
+
+  const swarm::StatSegment::Dec *ether = find_dec (*s, "ether");
+  ASSERT_TRUE (ether != NULL);
+  EXPECT_EQ (2263U, ether->count_);
+  const swarm::StatSegment::Dec *dns_dec = find_dec (*s, "dns");
+  ASSERT_TRUE (dns_dec != NULL);
+  EXPECT_EQ (707U, dns_dec->count_);
+  const swarm::StatSegment::Dec *ssn = find_dec (*s, "tcp_ssn");
+  ASSERT_TRUE (ssn != NULL);
+  EXPECT_LT (0U, ssn->session_);
+
+  ASSERT_EQ (2U, s->hdlr_size_);
+  for (uint32_t i = 0; i < s->hdlr_size_; i++) {
+    const swarm::StatSegment::Hdlr &h = s->hdlr_[i];
+    if (h.id_ == static_cast<uint64_t>(dns_id)) {
+      EXPECT_STREQ ("dns.packet", h.ev_);
+      EXPECT_EQ (dns->count_, h.calls_);
+    } else {
+      EXPECT_STREQ ("tcp.*", h.ev_);
+      EXPECT_EQ (glob->count_, h.calls_);
+    }
+  }
+
+  // the segment is removed with the publisher
+  delete sp;
+  swarm::StatReader r2;
+  EXPECT_FALSE (r2.open (seg_name ()));
+  delete s;
+  delete nd;
+}
@@ -27,6 +27,7 @@
 #include <time.h>
 #include <pcap.h>
 #include <string.h>
+#include <vector>
 
 #include "./gtest.h"
 #include "../src/debug.h"
@@ -53,3 +54,103 @@ TEST(Timer, set) {
   EXPECT_FALSE(nc->unset_task(tid2));
 }
 
+namespace {
+  class Recorder : public swarm::Task {
+  public:
+    std::vector<uint64_t> fired_;  // msec
+    void exec (const struct timespec &ts) {
+      this->fired_.push_back(static_cast<uint64_t>(ts.tv_sec) * 1000 +
+                             ts.tv_nsec / 1000000);
+    }
+  };
+
+  const uint64_t MSEC = 1000000;
+}
+
+TEST (TimerWheel, onetime_and_repeat) {
+  swarm::TimerWheel tw;
+  Recorder once, rep;
+  const uint64_t base = 1000000;  // msec
+
+  tw.add (&once, 300, 0);
+  tw.ticktock (base * MSEC);
+  tw.add (&rep, 100, 100);
+  EXPECT_EQ (2U, tw.size ());
+
+  tw.ticktock ((base + 99) * MSEC);
+  EXPECT_EQ (0U, once.fired_.size ());
+  EXPECT_EQ (0U, rep.fired_.size ());
+
+  tw.ticktock ((base + 100) * MSEC);
+  ASSERT_EQ (1U, rep.fired_.size ());
+  EXPECT_EQ (base + 100, rep.fired_[0]);
+
+  // a gap longer than the interval, every period is reported
+  tw.ticktock ((base + 1050) * MSEC);
+  ASSERT_EQ (1U, once.fired_.size ());
+  EXPECT_EQ (base + 300, once.fired_[0]);
+  ASSERT_EQ (10U, rep.fired_.size ());
+  for (size_t i = 0; i < rep.fired_.size (); i++) {
+    EXPECT_EQ (base + 100 * (i + 1), rep.fired_[i]);
+  }
+  EXPECT_EQ (1U, tw.size ());
+
+  // time going backward is ignored
+  tw.ticktock (base * MSEC);
+  EXPECT_EQ (10U, rep.fired_.size ());
+}
+
+TEST (TimerWheel, long_delay) {
+  swarm::TimerWheel tw;
+  const uint64_t base = 123456789;
+  // over every level boundary including parking beyond the top level
+  const uint64_t delay[] = {1, 255, 256, 257, 65535, 65536, 70000,
+                            16777216, 20000000, 5000000000ULL};
+  const size_t n = sizeof(delay) / sizeof(delay[0]);
+  Recorder rec[n];
+
+  tw.ticktock (base * MSEC);
+  for (size_t i = 0; i < n; i++) {
+    tw.add (&rec[i], delay[i], 0);
+  }
+
+  // irregular packet times
+  uint64_t t = base;
+  while (tw.size () > 0) {
+    t += 977 + (t % 131) * 1000;
+    tw.ticktock (t * MSEC);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ (1U, rec[i].fired_.size ());
+    EXPECT_EQ (base + delay[i], rec[i].fired_[0]);
+  }
+}
+
+TEST (TimerWheel, unset_in_exec) {
+  class SelfCancel : public swarm::Task {
+  public:
+    swarm::TimerWheel *tw_;
+    swarm::task_id self_, other_;
+    int count_;
+    void exec (const struct timespec &ts) {
+      this->count_++;
+      this->tw_->remove (this->self_);
+      this->tw_->remove (this->other_);
+    }
+  };
+
+  swarm::TimerWheel tw;
+  Recorder other;
+  SelfCancel sc;
+  sc.tw_ = &tw;
+  sc.count_ = 0;
+  tw.ticktock (10 * MSEC);
+  sc.self_ = tw.add (&sc, 5, 5);
+  sc.other_ = tw.add (&other, 5, 5);
+  tw.ticktock (100 * MSEC);
+  EXPECT_EQ (1, sc.count_);
+  EXPECT_EQ (0U, other.fired_.size ());
+  EXPECT_EQ (0U, tw.size ());
+  EXPECT_FALSE (tw.remove (sc.self_));
+}
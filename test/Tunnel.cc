@@ -0,0 +1,316 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "./gtest.h"
+#include <arpa/inet.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../src/swarm.h"
+
+namespace {
+  typedef std::vector<swarm::byte_t> Bytes;
+
+  void put16 (Bytes *b, uint16_t v) {
+    b->push_back (v >> 8);
+    b->push_back (v & 0xff);
+  }
+  void put32 (Bytes *b, uint32_t v) {
+    put16 (b, v >> 16);
+    put16 (b, v & 0xffff);
+  }
+  void append (Bytes *b, const Bytes &t) {
+    b->insert (b->end (), t.begin (), t.end ());
+  }
+
+  Bytes ether (uint16_t type, const Bytes &pl) {
+    Bytes b (12, 0x02);
+    put16 (&b, type);
+    append (&b, pl);
+    return b;
+  }
+  Bytes ipv4 (const char *src, const char *dst, uint8_t proto,
+              const Bytes &pl) {
+    Bytes b;
+    put16 (&b, 0x4500);
+    put16 (&b, 20 + pl.size ());
+    put32 (&b, 0);
+    b.push_back (64);
+    b.push_back (proto);
+    put16 (&b, 0);
+    uint32_t a;
+    inet_pton (AF_INET, src, &a);
+    put32 (&b, ntohl (a));
+    inet_pton (AF_INET, dst, &a);
+    put32 (&b, ntohl (a));
+    append (&b, pl);
+    return b;
+  }
+  Bytes ipv6 (const char *src, const char *dst, uint8_t next,
+              const Bytes &pl) {
+    Bytes b;
+    put32 (&b, 0x60000000);
+    put16 (&b, pl.size ());
+    b.push_back (next);
+    b.push_back (64);
+    uint8_t a[16];
+    inet_pton (AF_INET6, src, a);
+    b.insert (b.end (), a, a + 16);
+    inet_pton (AF_INET6, dst, a);
+    b.insert (b.end (), a, a + 16);
+    append (&b, pl);
+    return b;
+  }
+  Bytes tcp (uint16_t sport, uint16_t dport) {
+    Bytes b;
+    put16 (&b, sport);
+    put16 (&b, dport);
+    put32 (&b, 1);
+    put32 (&b, 0);
+    put16 (&b, 0x5002);  // header length 20, SYN
+    put16 (&b, 8192);
+    put32 (&b, 0);
+    return b;
+  }
+  Bytes udp (uint16_t sport, uint16_t dport, const Bytes &pl) {
+    Bytes b;
+    put16 (&b, sport);
+    put16 (&b, dport);
+    put16 (&b, 8 + pl.size ());
+    put16 (&b, 0);
+    append (&b, pl);
+    return b;
+  }
+
+  // inner packets
+  Bytes inner4 () {
+    return ipv4 ("10.1.1.1", "10.2.2.2", 6, tcp (1234, 80));
+  }
+  Bytes inner6 () {
+    return ipv6 ("2001:db8::1", "2001:db8::2", 6, tcp (1234, 80));
+  }
+  const char *OUTER_SRC = "192.0.2.1";
+  const char *OUTER_DST = "192.0.2.2";
+
+  class TcpRecorder : public swarm::Handler {
+  public:
+    uint64_t hash_;
+    std::string src_;
+    size_t depth_;
+    size_t count_;
+    std::map<std::string, std::vector<std::string> > val_;
+    TcpRecorder () : hash_(0), depth_(0), count_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &p) {
+      const char *keys[] = {"ipv4.src", "ipv4.dst", "ether.src", "udp.src_port",
+                            "gre.key", "vxlan.vni", "gtpu.teid", "mpls.label"};
+      this->hash_ = p.hash_value ();
+      this->src_ = p.src_addr ();
+      this->depth_ = p.tunnel_depth ();
+      this->count_++;
+      this->val_.clear ();
+      for (size_t k = 0; k < sizeof (keys) / sizeof (keys[0]); k++) {
+        for (size_t i = 0; i < p.value_size (keys[k]); i++) {
+          this->val_[keys[k]].push_back (p.value (keys[k], i).repr ());
+        }
+      }
+    }
+  };
+
+  class TunnelTest : public ::testing::Test {
+  public:
+    swarm::NetDec *nd_;
+    TcpRecorder rec_;
+    uint64_t hash4_, hash6_;
+
+    virtual void SetUp () {
+      this->nd_ = new swarm::NetDec ();
+      this->nd_->set_handler ("tcp.packet", &(this->rec_));
+      this->input (ether (0x86dd, inner6 ()));
+      this->hash6_ = this->rec_.hash_;
+      this->input (ether (0x0800, inner4 ()));
+      this->hash4_ = this->rec_.hash_;
+      EXPECT_EQ ("10.1.1.1", this->rec_.src_);
+      EXPECT_EQ (0U, this->rec_.depth_);
+      EXPECT_NE (this->hash4_, this->hash6_);
+    }
+    virtual void TearDown () {
+      delete this->nd_;
+    }
+    // values of the packet by key
+    std::map<std::string, std::vector<std::string> > &input (const Bytes &pkt) {
+      this->rec_.count_ = 0;
+      EXPECT_TRUE (this->nd_->input (&pkt[0], pkt.size (), 1000000000,
+                                     pkt.size ()));
+      EXPECT_EQ (1U, this->rec_.count_);
+      return this->rec_.val_;
+    }
+  };
+}
+
+TEST_F (TunnelTest, ipip) {
+  std::map<std::string, std::vector<std::string> > &v =
+    this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 4, inner4 ())));
+  EXPECT_EQ (this->hash4_, this->rec_.hash_);
+  EXPECT_EQ ("10.1.1.1", this->rec_.src_);
+  EXPECT_EQ (1U, this->rec_.depth_);
+  ASSERT_EQ (2U, v["ipv4.src"].size ());
+  EXPECT_EQ (OUTER_SRC, v["ipv4.src"][0]);
+  EXPECT_EQ ("10.1.1.1", v["ipv4.src"][1]);
+
+  // 6in4
+  this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 41, inner6 ())));
+  EXPECT_EQ (this->hash6_, this->rec_.hash_);
+  EXPECT_EQ ("2001:db8::1", this->rec_.src_);
+
+  // IPv4 in IPv6
+  this->input (ether (0x86dd, ipv6 ("2001:db8:f::1", "2001:db8:f::2", 4,
+                                    inner4 ())));
+  EXPECT_EQ (this->hash4_, this->rec_.hash_);
+}
+
+TEST_F (TunnelTest, gre) {
+  Bytes gre;
+  put16 (&gre, 0x2000);  // K
+  put16 (&gre, 0x0800);
+  put32 (&gre, 42);
+  append (&gre, inner4 ());
+  std::map<std::string, std::vector<std::string> > &v =
+    this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 47, gre)));
+  EXPECT_EQ (this->hash4_, this->rec_.hash_);
+  EXPECT_EQ ("42", v["gre.key"][0]);
+  EXPECT_EQ (OUTER_DST, v["ipv4.dst"][0]);
+
+  // transparent ethernet bridging over IPv6
+  gre.clear ();
+  put16 (&gre, 0x0000);
+  put16 (&gre, 0x6558);
+  append (&gre, ether (0x86dd, inner6 ()));
+  this->input (ether (0x86dd, ipv6 ("2001:db8:f::1", "2001:db8:f::2", 47,
+                                    gre)));
+  EXPECT_EQ (this->hash6_, this->rec_.hash_);
+  EXPECT_EQ (1U, this->rec_.depth_);
+}
+
+TEST_F (TunnelTest, vxlan) {
+  Bytes vx;
+  put32 (&vx, 0x08000000);
+  put32 (&vx, 5000 << 8);
+  append (&vx, ether (0x0800, inner4 ()));
+  std::map<std::string, std::vector<std::string> > &v =
+    this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 17,
+                                      udp (49152, 4789, vx))));
+  EXPECT_EQ (this->hash4_, this->rec_.hash_);
+  EXPECT_EQ ("10.1.1.1", this->rec_.src_);
+  EXPECT_EQ ("5000", v["vxlan.vni"][0]);
+  EXPECT_EQ ("49152", v["udp.src_port"][0]);
+  EXPECT_EQ (2U, v["ether.src"].size ());
+}
+
+TEST_F (TunnelTest, gtpu) {
+  Bytes gtp;
+  gtp.push_back (0x30);  // version 1, PT
+  gtp.push_back (0xff);  // G-PDU
+  put16 (&gtp, inner4 ().size ());
+  put32 (&gtp, 0x1234);
+  append (&gtp, inner4 ());
+  std::map<std::string, std::vector<std::string> > &v =
+    this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 17,
+                                      udp (2152, 2152, gtp))));
+  EXPECT_EQ (this->hash4_, this->rec_.hash_);
+  EXPECT_EQ ("4660", v["gtpu.teid"][0]);
+
+  // with sequence number and an extension header (PDU session container)
+  gtp.clear ();
+  gtp.push_back (0x36);  // E, S
+  gtp.push_back (0xff);
+  put16 (&gtp, 4 + 4 + inner6 ().size ());
+  put32 (&gtp, 0x5678);
+  put16 (&gtp, 7);       // sequence
+  gtp.push_back (0);     // N-PDU
+  gtp.push_back (0x85);  // next extension
+  put32 (&gtp, 0x01000900);  // length 1, content, no more extension
+  append (&gtp, inner6 ());
+  this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 17,
+                                    udp (2152, 2152, gtp))));
+  EXPECT_EQ (this->hash6_, this->rec_.hash_);
+}
+
+TEST_F (TunnelTest, mpls) {
+  Bytes mpls;
+  put32 (&mpls, (100 << 12) | 0x40);   // label 100
+  put32 (&mpls, (200 << 12) | 0x140);  // label 200, bottom of stack
+  append (&mpls, inner4 ());
+  std::map<std::string, std::vector<std::string> > &v = this->input (ether (0x8847, mpls));
+  EXPECT_EQ (this->hash4_, this->rec_.hash_);
+  EXPECT_EQ (0U, this->rec_.depth_);
+  ASSERT_EQ (2U, v["mpls.label"].size ());
+  EXPECT_EQ ("100", v["mpls.label"][0]);
+  EXPECT_EQ ("200", v["mpls.label"][1]);
+}
+
+namespace {
+  class PktCounter : public swarm::Handler {
+  public:
+    size_t count_;
+    PktCounter () : count_(0) {}
+    void recv (swarm::ev_id eid, const swarm::Property &p) {
+      this->count_++;
+    }
+  };
+}
+
+TEST_F (TunnelTest, packet_event) {
+  PktCounter v4, v6, udp_pkt;
+  this->nd_->set_handler ("ipv4.packet", &v4);
+  this->nd_->set_handler ("ipv6.packet", &v6);
+  this->nd_->set_handler ("udp.packet", &udp_pkt);
+
+  // IP in IP: handlers of ipv4.packet run once, not per layer
+  this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 4, inner4 ())));
+  EXPECT_EQ (1U, v4.count_);
+  EXPECT_EQ (0U, v6.count_);
+
+  // 6in4
+  v4.count_ = 0;
+  this->input (ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 41, inner6 ())));
+  EXPECT_EQ (1U, v4.count_);
+  EXPECT_EQ (1U, v6.count_);
+
+  // VXLAN over UDP carrying UDP
+  Bytes vx;
+  put32 (&vx, 0x08000000);
+  put32 (&vx, 5000 << 8);
+  append (&vx, ether (0x0800, ipv4 ("10.1.1.1", "10.2.2.2", 17,
+                                    udp (1234, 53, Bytes ()))));
+  v4.count_ = 0;
+  this->rec_.count_ = 0;
+  Bytes pkt = ether (0x0800, ipv4 (OUTER_SRC, OUTER_DST, 17,
+                                   udp (49152, 4789, vx)));
+  EXPECT_TRUE (this->nd_->input (&pkt[0], pkt.size (), 1000000000,
+                                 pkt.size ()));
+  EXPECT_EQ (1U, v4.count_);
+  EXPECT_EQ (1U, udp_pkt.count_);
+}
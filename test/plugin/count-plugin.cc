@@ -0,0 +1,72 @@
+/*-
+ * Copyright (c) 2013 Masayoshi Mizutani <mizutani@sfc.wide.ad.jp>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Decoder plugin for test/Plugin.cc, built twice as plugin-count1.so and
+// plugin-count2.so. Decoder "plugin_count" sets PLUGIN_VER to
+// "plugin_count.ver" of each packet.
+
+#include "../../src/swarm.h"
+
+namespace {
+  class PluginCount : public swarm::Decoder {
+  private:
+    swarm::ev_id EV_PKT_;
+    swarm::val_id P_VER_;
+    u_int8_t ver_;
+    u_int32_t count_;
+
+  public:
+    explicit PluginCount (swarm::NetDec * nd) :
+      swarm::Decoder (nd), ver_(PLUGIN_VER), count_(0) {
+      this->EV_PKT_ = nd->assign_event ("plugin_count.packet",
+                                        "Plugin Count Packet");
+      this->P_VER_ = nd->assign_value ("plugin_count.ver", "Plugin Version",
+                                       new swarm::FacNum ());
+    }
+    void setup (swarm::NetDec * nd) {
+    }
+    static swarm::Decoder * New (swarm::NetDec * nd) {
+      return new PluginCount (nd);
+    }
+    bool accept (const swarm::Property &p) {
+      return true;
+    }
+    void migrate (swarm::Decoder *old) {
+      PluginCount *prev = dynamic_cast<PluginCount *> (old);
+      if (prev) {
+        this->count_ = prev->count_;
+      }
+    }
+    bool decode (swarm::Property *p) {
+      this->count_++;
+      p->set (this->P_VER_, &(this->ver_), sizeof (this->ver_));
+      p->push_event (this->EV_PKT_);
+      return true;
+    }
+  };
+}  // namespace
+
+SWARM_PLUGIN (plugin_count, PluginCount::New);